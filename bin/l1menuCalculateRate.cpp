@@ -4,6 +4,7 @@
 
 #include <TFile.h>
 #include "l1menu/ISample.h"
+#include "l1menu/FullSample.h"
 #include "l1menu/IMenuRate.h"
 #include "l1menu/TriggerMenu.h"
 #include "l1menu/tools/CommandLineParser.h"
@@ -13,7 +14,8 @@
 void printUsage( const std::string& executableName, std::ostream& output=std::cout )
 {
 	output << "Usage:" << "\n"
-			<< "\t" << executableName << " --totalrate <total rate in kHz> [--output <output filename>] [--format <CSV | OLD | XML>] <sample filename> <menu filename>" << "\n"
+			<< "\t" << executableName << " --totalrate <total rate in kHz> [--output <output filename>] [--format <CSV | OLD | XML>] [--threads <number>] <sample filename> <menu filename>" << "\n"
+			<< "\t" << "\t" << "--threads sets how many threads read the events if the sample is an ntuple, the default is one" << "\n"
 			<< "\n"
 			<< "\t" << executableName << " --help" << "\n"
 			<< "\t" << "\t" << "prints this help message" << "\n"
@@ -27,6 +29,7 @@ int main( int argc, char* argv[] )
 	std::string outputFilename;
 	l1menu::tools::FileFormat fileFormat=l1menu::tools::FileFormat::XMLFORMAT;
 	float totalTriggerRatekHz; // The rate if every single event passed
+	size_t numberOfThreads=0; // Zero leaves the FullSample default
 
 	l1menu::tools::CommandLineParser commandLineParser;
 	try
@@ -34,6 +37,7 @@ int main( int argc, char* argv[] )
 		commandLineParser.addOption( "output", l1menu::tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "totalrate", l1menu::tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "format", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "threads", l1menu::tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "help", l1menu::tools::CommandLineParser::NoArgument );
 		commandLineParser.parse( argc, argv );
 
@@ -53,6 +57,12 @@ int main( int argc, char* argv[] )
 			else if( formatString=="CSV" ) fileFormat=l1menu::tools::FileFormat::CSVFORMAT;
 			else throw std::runtime_error( "format must be one of 'XML', 'OLD', or 'CSV'" );
 		}
+		if( commandLineParser.optionHasBeenSet( "threads" ) )
+		{
+			int threadsArgument=l1menu::tools::convertStringToInt( commandLineParser.optionArguments("threads").back() );
+			if( threadsArgument<=0 ) throw std::runtime_error( "threads must be greater than zero" );
+			numberOfThreads=threadsArgument;
+		}
 
 		//
 		// Code to work out what to scale to
@@ -89,13 +99,20 @@ int main( int argc, char* argv[] )
 
 	try
 	{
-		std::cout << "Loading sample from the file " << sampleFilename << std::endl;
-		std::unique_ptr<l1menu::ISample> pSample=l1menu::tools::loadSample( sampleFilename );
-		pSample->setEventRate( totalTriggerRatekHz );
-
 		std::cout << "Loading menu from file " << menuFilename << std::endl;
 		std::unique_ptr<l1menu::TriggerMenu> pMenu=l1menu::tools::loadMenu( menuFilename );
 
+		// Only the triggers in the menu are needed, so don't bother loading anything else from the sample
+		std::cout << "Loading sample from the file " << sampleFilename << std::endl;
+		std::unique_ptr<l1menu::ISample> pSample=l1menu::tools::loadSample( sampleFilename, *pMenu, true );
+		pSample->setEventRate( totalTriggerRatekHz );
+		if( numberOfThreads!=0 )
+		{
+			l1menu::FullSample* pFullSample=dynamic_cast<l1menu::FullSample*>( pSample.get() );
+			if( pFullSample==nullptr ) std::cerr << "Warning: --threads only applies to ntuples, so it's being ignored" << std::endl;
+			else pFullSample->setNumberOfThreads( numberOfThreads );
+		}
+
 		std::cout << "Calculating rates..." << std::endl;
 
 		std::shared_ptr<const l1menu::IMenuRate> pRates=pSample->rate(*pMenu);
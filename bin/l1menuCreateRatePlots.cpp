@@ -3,20 +3,26 @@
 
 #include <TFile.h>
 #include "l1menu/ISample.h"
+#include "l1menu/ReducedSample.h"
+#include "l1menu/FullSample.h"
 #include "l1menu/MenuRatePlots.h"
 #include "l1menu/IMenuRate.h"
 #include "l1menu/TriggerMenu.h"
 #include "l1menu/tools/miscellaneous.h"
 #include "l1menu/tools/fileIO.h"
 #include "l1menu/tools/CommandLineParser.h"
+#include "l1menu/tools/stringManipulation.h"
 
 void printUsage( const std::string& executableName, std::ostream& output=std::cout )
 {
 	output << "Usage:" << "\n"
-			<< "\t" << executableName << " [--output <output filename>] [--original-binning] <sample filename> <menu filename>" << "\n"
+			<< "\t" << executableName << " [--output <output filename>] [--original-binning] [--collapse] [--threads <number>] <sample filename> <menu filename>" << "\n"
 			<< "\t" << "\t" << "Creates trigger rate plots using the menu and sample provided. The \"output\" option allows" << "\n"
 			<< "\t" << "\t" << "you to specify the filename for the output (default is \"rateHistograms.root\"). The" << "\n"
 			<< "\t" << "\t" << "\"original-binning\" option will use the binning that was used in the L1Menu2015.C macro." << "\n"
+			<< "\t" << "\t" << "\"collapse\" loads the whole sample into memory and merges identical events, which makes" << "\n"
+			<< "\t" << "\t" << "filling the plots much quicker for large ReducedSamples. \"threads\" sets how many threads" << "\n"
+			<< "\t" << "\t" << "read the events if the sample is an ntuple, the default is one." << "\n"
 			<< "\n"
 			<< "\t" << executableName << " --help" << "\n"
 			<< "\t" << "\t" << "prints this help message"
@@ -30,6 +36,8 @@ int main( int argc, char* argv[] )
 	std::string sampleFilename;
 	std::string menuFilename;
 	std::string outputFilename="rateHistograms.root"; // default value if not specified on the command line
+	bool collapseIdenticalEvents=false;
+	size_t numberOfThreads=0; // Zero leaves the FullSample default
 
 	l1menu::tools::CommandLineParser commandLineParser;
 	try
@@ -37,6 +45,8 @@ int main( int argc, char* argv[] )
 		commandLineParser.addOption( "help", l1menu::tools::CommandLineParser::NoArgument );
 		commandLineParser.addOption( "output", l1menu::tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "original-binning", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "collapse", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "threads", l1menu::tools::CommandLineParser::RequiredArgument );
 		commandLineParser.parse( argc, argv );
 
 		if( commandLineParser.optionHasBeenSet( "help" ) )
@@ -47,6 +57,13 @@ int main( int argc, char* argv[] )
 
 		if( commandLineParser.optionHasBeenSet( "output" ) ) outputFilename=commandLineParser.optionArguments("output").back();
 		if( commandLineParser.optionHasBeenSet( "original-binning" ) ) l1menu::tools::setBinningToL1Menu2015Values();
+		if( commandLineParser.optionHasBeenSet( "collapse" ) ) collapseIdenticalEvents=true;
+		if( commandLineParser.optionHasBeenSet( "threads" ) )
+		{
+			int threadsArgument=l1menu::tools::convertStringToInt( commandLineParser.optionArguments("threads").back() );
+			if( threadsArgument<=0 ) throw std::runtime_error( "threads must be greater than zero" );
+			numberOfThreads=threadsArgument;
+		}
 		if( commandLineParser.nonOptionArguments().size()<2 ) throw std::runtime_error( "Not enough command line arguments" );
 
 		const std::vector<std::string>& arguments=commandLineParser.nonOptionArguments();
@@ -72,13 +89,30 @@ int main( int argc, char* argv[] )
 		else throw std::logic_error( "The number of bunches has not been programmed for the bunch spacing selected" );
 
 
-		std::cout << "Loading sample from the file " << sampleFilename << std::endl;
-		std::unique_ptr<l1menu::ISample> pSample=l1menu::tools::loadSample( sampleFilename );
-		pSample->setEventRate( orbitsPerSecond*numberOfBunches*scaleToKiloHz );
-
 		std::cout << "Loading menu from file " << menuFilename << std::endl;
 		std::unique_ptr<l1menu::TriggerMenu> pMenu=l1menu::tools::loadMenu( menuFilename );
 
+		// Only the triggers in the menu are needed, so don't bother loading anything else from the sample
+		std::cout << "Loading sample from the file " << sampleFilename << std::endl;
+		std::unique_ptr<l1menu::ISample> pSample=l1menu::tools::loadSample( sampleFilename, *pMenu, !collapseIdenticalEvents );
+		pSample->setEventRate( orbitsPerSecond*numberOfBunches*scaleToKiloHz );
+		if( numberOfThreads!=0 )
+		{
+			l1menu::FullSample* pFullSample=dynamic_cast<l1menu::FullSample*>( pSample.get() );
+			if( pFullSample==nullptr ) std::cerr << "Warning: --threads only applies to ntuples, so it's being ignored" << std::endl;
+			else pFullSample->setNumberOfThreads( numberOfThreads );
+		}
+		if( collapseIdenticalEvents )
+		{
+			l1menu::ReducedSample* pReducedSample=dynamic_cast<l1menu::ReducedSample*>( pSample.get() );
+			if( pReducedSample==nullptr ) std::cerr << "Warning: --collapse only works for ReducedSamples, so it's being ignored" << std::endl;
+			else
+			{
+				pReducedSample->collapseIdenticalEvents();
+				std::cout << "Collapsed identical events into " << pReducedSample->numberOfEvents() << " rows" << std::endl;
+			}
+		}
+
 		l1menu::MenuRatePlots rateVersusThresholdPlots( *pMenu );
 
 		// Use a smart pointer with a custom deleter that will close the file properly.
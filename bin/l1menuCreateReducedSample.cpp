@@ -1,31 +1,176 @@
-#include "l1menu/FullSample.h"
 #include "l1menu/TriggerMenu.h"
 #include "l1menu/ReducedSample.h"
+#include "l1menu/tools/CommandLineParser.h"
+#include "l1menu/tools/fileIO.h"
+#include "l1menu/tools/stringManipulation.h"
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <stdexcept>
 
+/** @brief The output filename used if none is given on the command line, which depends on the format. */
+std::string defaultOutputFilename( l1menu::ReducedSample::FileFormat fileFormat )
+{
+	if( fileFormat==l1menu::ReducedSample::FileFormat::PROTOBUF ) return "reducedSample.proto";
+	else if( fileFormat==l1menu::ReducedSample::FileFormat::MEMORYMAPPED ) return "reducedSample.mmap";
+	else return "reducedSample.chunked";
+}
+
+void printUsage( const std::string& executableName, size_t defaultEventsPerRun, std::ostream& output=std::cout )
+{
+	output << "Usage:" << "\n"
+			<< "\t" << executableName << " [--output <output filename>] [--format <CHUNKED | PROTOBUF | MMAP>] [--eventsPerRun <number>] [--quantise] [--codec <NONE | GZIP | LZ4 | ZSTD>] [--sparse] [--append] [--collapse] [--index] [--threads <number>] [--grid <trigger>:<parameter>=<value>[,<value>...]] <menu file> <input ntuple 1> [input ntuple 2 [...] ]" << "\n"
+			<< "\t" << "\t" << "Creates an l1menu::ReducedSample from the input files specified on the command line. If" << "\n"
+			<< "\t" << "\t" << "no output filename is given the output file is called \"" << defaultOutputFilename( l1menu::ReducedSample::FileFormat::CHUNKED ) << "\"," << "\n"
+			<< "\t" << "\t" << "or \"" << defaultOutputFilename( l1menu::ReducedSample::FileFormat::PROTOBUF ) << "\" and \"" << defaultOutputFilename( l1menu::ReducedSample::FileFormat::MEMORYMAPPED ) << "\" for the PROTOBUF and MMAP formats." << "\n"
+			<< "\t" << "\t" << "The default format is CHUNKED, which is compressed in chunks that can be decompressed in" << "\n"
+			<< "\t" << "\t" << "parallel. Versions of this code from before CHUNKED was added can't read it. PROTOBUF is the" << "\n"
+			<< "\t" << "\t" << "original compressed format, which was the default (and called \"reducedSample.proto\") before" << "\n"
+			<< "\t" << "\t" << "that. MMAP is larger on disk but is memory mapped when loaded, so is much quicker to open." << "\n"
+			<< "\t" << "\t" << "--eventsPerRun sets how many events go in each chunk (CHUNKED) or Run (PROTOBUF), default " << defaultEventsPerRun << "." << "\n"
+			<< "\t" << "\t" << "--quantise rounds the thresholds down to multiples of 0.5 GeV, the step thresholds are set in," << "\n"
+			<< "\t" << "\t" << "so rates at any threshold that is a multiple of 0.5 GeV are unchanged. It makes CHUNKED files" << "\n"
+			<< "\t" << "\t" << "several times smaller. --codec sets the compression used for CHUNKED files," << "\n"
+			<< "\t" << "\t" << "the default is GZIP. LZ4 is the quickest to load, ZSTD gives the smallest files." << "\n"
+			<< "\t" << "\t" << "--sparse only stores the thresholds that aren't -1 in CHUNKED files, which makes them smaller" << "\n"
+			<< "\t" << "\t" << "and quicker to load, but they can't then be read by older versions of the code." << "\n"
+			<< "\t" << "\t" << "--append adds the events onto the end of an existing CHUNKED output file that was made with" << "\n"
+			<< "\t" << "\t" << "the same menu, keeping the quantisation and codec already used in the file." << "\n"
+			<< "\t" << "\t" << "--collapse merges events with identical thresholds into single weighted rows. The output" << "\n"
+			<< "\t" << "\t" << "is then much smaller and quicker to use, but can't be in the PROTOBUF format." << "\n"
+			<< "\t" << "\t" << "--index stores each threshold column sorted with the cumulative weights in a CHUNKED" << "\n"
+			<< "\t" << "\t" << "output, so that rates and rate plots of single threshold triggers don't need the events." << "\n"
+			<< "\t" << "\t" << "--threads sets how many threads are used to process the input files, the default is one" << "\n"
+			<< "\t" << "\t" << "per core. The output is the same whatever the number." << "\n"
+			<< "\t" << "\t" << "--grid also stores the thresholds for each of the listed values of a non threshold parameter," << "\n"
+			<< "\t" << "\t" << "e.g. \"--grid L1_SingleJetC:regionCut=4.5,5.5,6.5\". Triggers with any of those values can then" << "\n"
+			<< "\t" << "\t" << "be studied with the output. It can be given more than once, and a trigger with more than" << "\n"
+			<< "\t" << "\t" << "one parameter in the grid gets every combination of them." << "\n"
+			<< "\n"
+			<< "\t" << executableName << " --help" << "\n"
+			<< "\t" << "\t" << "prints this help message" << "\n"
+			<< std::endl;
+}
 
 int main( int argc, char* argv[] )
 {
-	std::string outputFilename="reducedSample.proto";
+	std::string outputFilename;
+	l1menu::ReducedSample::FileFormat fileFormat=l1menu::ReducedSample::FileFormat::CHUNKED;
+	size_t eventsPerRun=20000;
+	bool quantiseThresholds=false;
+	bool collapseIdenticalEvents=false;
+	bool buildThresholdIndex=false;
+	l1menu::ReducedSample::Codec codec=l1menu::ReducedSample::Codec::GZIP;
+	bool sparseEncoding=false;
+	bool appendToOutput=false;
+	size_t numberOfThreads=0;
+	l1menu::ReducedSample::ParameterGrid parameterGrid;
+	std::string menuFilename;
+	std::vector<std::string> inputFilenames;
 
-	if( argc<3 )
+	l1menu::tools::CommandLineParser commandLineParser;
+	try
 	{
-		std::string executableName=argv[0];
-		size_t lastSlashPosition=executableName.find_last_of('/');
-		if( lastSlashPosition!=std::string::npos ) executableName=executableName.substr( lastSlashPosition+1, std::string::npos );
-		std::cerr << "   Usage: " << executableName << " <menu file> <input ntuple 1> [input ntuple 2 [...] ]" << "\n"
-				<< " Creates an l1menu::ReducedSample in protobuf format from the input files specified on the "
-				<< "command line. The output file is called \"" << outputFilename << "\"." << std::endl;
-		return -1;
-	}
+		commandLineParser.addOption( "output", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "format", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "eventsPerRun", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "quantise", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "codec", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "sparse", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "append", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "collapse", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "index", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "threads", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "grid", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "help", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.parse( argc, argv );
 
-	std::string menuFilename=argv[1];
+		if( commandLineParser.optionHasBeenSet( "help" ) )
+		{
+			printUsage( commandLineParser.executableName(), eventsPerRun );
+			return 0;
+		}
 
-	std::vector<std::string> inputFilenames;
-	for( int index=2; index<argc; ++index ) inputFilenames.push_back( argv[index] );
+		if( commandLineParser.nonOptionArguments().size()<2 ) throw std::runtime_error( "Incorrect number of arguments" );
+		if( commandLineParser.optionHasBeenSet( "output" ) ) outputFilename=commandLineParser.optionArguments("output").back();
+		if( commandLineParser.optionHasBeenSet( "format" ) )
+		{
+			std::string formatString=commandLineParser.optionArguments("format").back();
+			if( formatString=="CHUNKED" ) fileFormat=l1menu::ReducedSample::FileFormat::CHUNKED;
+			else if( formatString=="PROTOBUF" ) fileFormat=l1menu::ReducedSample::FileFormat::PROTOBUF;
+			else if( formatString=="MMAP" ) fileFormat=l1menu::ReducedSample::FileFormat::MEMORYMAPPED;
+			else throw std::runtime_error( "format must be one of 'CHUNKED', 'PROTOBUF' or 'MMAP'" );
+		}
+		if( commandLineParser.optionHasBeenSet( "eventsPerRun" ) )
+		{
+			int eventsPerRunArgument=l1menu::tools::convertStringToInt( commandLineParser.optionArguments("eventsPerRun").back() );
+			if( eventsPerRunArgument<=0 ) throw std::runtime_error( "eventsPerRun must be greater than zero" );
+			eventsPerRun=eventsPerRunArgument;
+		}
+		if( commandLineParser.optionHasBeenSet( "quantise" ) ) quantiseThresholds=true;
+		if( commandLineParser.optionHasBeenSet( "collapse" ) )
+		{
+			if( fileFormat==l1menu::ReducedSample::FileFormat::PROTOBUF ) throw std::runtime_error( "--collapse can't be used with the PROTOBUF format" );
+			collapseIdenticalEvents=true;
+		}
+		if( commandLineParser.optionHasBeenSet( "codec" ) )
+		{
+			std::string codecString=commandLineParser.optionArguments("codec").back();
+			if( codecString=="NONE" ) codec=l1menu::ReducedSample::Codec::NONE;
+			else if( codecString=="GZIP" ) codec=l1menu::ReducedSample::Codec::GZIP;
+			else if( codecString=="LZ4" ) codec=l1menu::ReducedSample::Codec::LZ4;
+			else if( codecString=="ZSTD" ) codec=l1menu::ReducedSample::Codec::ZSTD;
+			else throw std::runtime_error( "codec must be one of 'NONE', 'GZIP', 'LZ4' or 'ZSTD'" );
+		}
+		if( commandLineParser.optionHasBeenSet( "sparse" ) )
+		{
+			if( fileFormat!=l1menu::ReducedSample::FileFormat::CHUNKED ) throw std::runtime_error( "--sparse can only be used with the CHUNKED format" );
+			sparseEncoding=true;
+		}
+		if( commandLineParser.optionHasBeenSet( "append" ) )
+		{
+			if( fileFormat!=l1menu::ReducedSample::FileFormat::CHUNKED ) throw std::runtime_error( "--append can only be used with the CHUNKED format" );
+			appendToOutput=true;
+		}
+		if( commandLineParser.optionHasBeenSet( "index" ) )
+		{
+			if( fileFormat!=l1menu::ReducedSample::FileFormat::CHUNKED || appendToOutput ) throw std::runtime_error( "--index can only be used with the CHUNKED format, and not with --append" );
+			buildThresholdIndex=true;
+		}
+
+		if( commandLineParser.optionHasBeenSet( "threads" ) )
+		{
+			int threadsArgument=l1menu::tools::convertStringToInt( commandLineParser.optionArguments("threads").back() );
+			if( threadsArgument<=0 ) throw std::runtime_error( "threads must be greater than zero" );
+			numberOfThreads=threadsArgument;
+		}
+
+		if( commandLineParser.optionHasBeenSet( "grid" ) )
+		{
+			for( const auto& gridString : commandLineParser.optionArguments("grid") )
+			{
+				// Should be of the form "<trigger>:<parameter>=<value>,<value>,..."
+				std::vector<std::string> triggerAndRest=l1menu::tools::splitByDelimeters( gridString, ":" );
+				if( triggerAndRest.size()!=2 ) throw std::runtime_error( "grid must be of the form <trigger>:<parameter>=<value>[,<value>...]" );
+				std::vector<std::string> parameterAndValues=l1menu::tools::splitByDelimeters( triggerAndRest[1], "=" );
+				if( parameterAndValues.size()!=2 ) throw std::runtime_error( "grid must be of the form <trigger>:<parameter>=<value>[,<value>...]" );
+
+				std::vector<float>& values=parameterGrid[triggerAndRest[0]][parameterAndValues[0]];
+				for( const auto& valueString : l1menu::tools::splitByDelimeters( parameterAndValues[1], "," ) ) values.push_back( l1menu::tools::convertStringToFloat(valueString) );
+			}
+		}
+
+		if( outputFilename.empty() ) outputFilename=defaultOutputFilename( fileFormat );
+
+		menuFilename=commandLineParser.nonOptionArguments()[0];
+		inputFilenames.assign( commandLineParser.nonOptionArguments().begin()+1, commandLineParser.nonOptionArguments().end() );
+	} // end of try block
+	catch( std::exception& error )
+	{
+		std::cerr << "Error parsing the command line: " << error.what() << std::endl;
+		printUsage( commandLineParser.executableName(), eventsPerRun, std::cerr );
+		return -1;
+	}
 
 
 	try
@@ -33,17 +178,26 @@ int main( int argc, char* argv[] )
 		std::cout << "Loading menu from file " << menuFilename << std::endl;
 		std::unique_ptr<l1menu::TriggerMenu> pMyMenu=l1menu::tools::loadMenu( menuFilename );
 
-		l1menu::ReducedSample outputReducedSample( *pMyMenu );
+		l1menu::ReducedSample outputReducedSample( *pMyMenu, parameterGrid );
+		outputReducedSample.setEventsPerRun( eventsPerRun );
+		outputReducedSample.setThresholdQuantisation( quantiseThresholds );
+		outputReducedSample.setCodec( codec );
+		outputReducedSample.setSparseEncoding( sparseEncoding );
+
+		outputReducedSample.addNtupleFiles( inputFilenames, numberOfThreads );
+		if( collapseIdenticalEvents ) outputReducedSample.collapseIdenticalEvents();
+		if( buildThresholdIndex ) outputReducedSample.buildThresholdIndex();
 
-		for( const auto& filename : inputFilenames )
+		if( appendToOutput )
 		{
-			l1menu::FullSample inputSample;
-			inputSample.loadFile(filename);
-			outputReducedSample.addSample( inputSample );
+			outputReducedSample.appendToFile( outputFilename );
+			std::cout << "Reduced sample appended to " << outputFilename << std::endl;
+		}
+		else
+		{
+			outputReducedSample.saveToFile( outputFilename, fileFormat );
+			std::cout << "Reduced sample saved to " << outputFilename << std::endl;
 		}
-
-		outputReducedSample.saveToFile( outputFilename );
-		std::cout << "Reduced sample saved to " << outputFilename << std::endl;
 	}
 	catch( std::exception& error )
 	{
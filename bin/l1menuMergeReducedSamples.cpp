@@ -0,0 +1,105 @@
+#include "l1menu/ReducedSample.h"
+#include "l1menu/tools/CommandLineParser.h"
+#include "l1menu/tools/stringManipulation.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+void printUsage( const std::string& executableName, const std::string& defaultOutputFilename, std::ostream& output=std::cout )
+{
+	output << "Usage:" << "\n"
+			<< "\t" << executableName << " [--output <output filename>] <input sample 1> [input sample 2 [...] ]" << "\n"
+			<< "\t" << "\t" << "Merges l1menu::ReducedSample files that were made with the same menu into a single file. If" << "\n"
+			<< "\t" << "\t" << "no output filename is given the output file is called \"" << defaultOutputFilename << "\"." << "\n"
+			<< "\n"
+			<< "\t" << executableName << " --split <number of files> [--output <output filename>] <input sample>" << "\n"
+			<< "\t" << "\t" << "Splits a l1menu::ReducedSample file into the given number of files with equal numbers of events." << "\n"
+			<< "\t" << "\t" << "The output files are numbered, e.g. \"reducedSample_0.chunked\", \"reducedSample_1.chunked\" etcetera" << "\n"
+			<< "\t" << "\t" << "if the output filename is \"reducedSample.chunked\"." << "\n"
+			<< "\n"
+			<< "\t" << "\t" << "Either way the files are processed one part at a time, so memory use stays constant no matter" << "\n"
+			<< "\t" << "\t" << "how big the samples are. The output is always in the CHUNKED format, with the same quantisation" << "\n"
+			<< "\t" << "\t" << "and codec as the (first) input if that was CHUNKED too." << "\n"
+			<< "\n"
+			<< "\t" << executableName << " --help" << "\n"
+			<< "\t" << "\t" << "prints this help message" << "\n"
+			<< std::endl;
+}
+
+/** @brief Inserts "_<number>" before the extension of the filename, or at the end if it doesn't have one. */
+std::string numberedFilename( const std::string& filename, size_t number )
+{
+	size_t extensionPosition=filename.find_last_of( '.' );
+	size_t lastSlashPosition=filename.find_last_of( '/' );
+	if( extensionPosition==std::string::npos || (lastSlashPosition!=std::string::npos && extensionPosition<lastSlashPosition) ) extensionPosition=filename.size();
+
+	return filename.substr( 0, extensionPosition )+"_"+std::to_string(number)+filename.substr( extensionPosition );
+}
+
+int main( int argc, char* argv[] )
+{
+	std::string outputFilename="mergedSample.chunked";
+	size_t numberOfSplitFiles=0;
+	std::vector<std::string> inputFilenames;
+
+	l1menu::tools::CommandLineParser commandLineParser;
+	try
+	{
+		commandLineParser.addOption( "output", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "split", l1menu::tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "help", l1menu::tools::CommandLineParser::NoArgument );
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet( "help" ) )
+		{
+			printUsage( commandLineParser.executableName(), outputFilename );
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet( "output" ) ) outputFilename=commandLineParser.optionArguments("output").back();
+		if( commandLineParser.optionHasBeenSet( "split" ) )
+		{
+			int splitArgument=l1menu::tools::convertStringToInt( commandLineParser.optionArguments("split").back() );
+			if( splitArgument<=0 ) throw std::runtime_error( "the number of files to split into must be greater than zero" );
+			numberOfSplitFiles=splitArgument;
+			if( commandLineParser.nonOptionArguments().size()!=1 ) throw std::runtime_error( "only one input file can be split at a time" );
+		}
+		else if( commandLineParser.nonOptionArguments().empty() ) throw std::runtime_error( "Incorrect number of arguments" );
+
+		inputFilenames=commandLineParser.nonOptionArguments();
+	} // end of try block
+	catch( std::exception& error )
+	{
+		std::cerr << "Error parsing the command line: " << error.what() << std::endl;
+		printUsage( commandLineParser.executableName(), outputFilename, std::cerr );
+		return -1;
+	}
+
+
+	try
+	{
+		if( numberOfSplitFiles>0 )
+		{
+			std::vector<std::string> outputFilenames;
+			for( size_t fileNumber=0; fileNumber<numberOfSplitFiles; ++fileNumber ) outputFilenames.push_back( numberedFilename( outputFilename, fileNumber ) );
+
+			std::cout << "Splitting " << inputFilenames.front() << " into " << numberOfSplitFiles << " files" << std::endl;
+			l1menu::ReducedSample::splitFile( inputFilenames.front(), outputFilenames );
+			for( const auto& filename : outputFilenames ) std::cout << "Reduced sample saved to " << filename << std::endl;
+		}
+		else
+		{
+			std::cout << "Merging " << inputFilenames.size() << " files" << std::endl;
+			l1menu::ReducedSample::mergeFiles( inputFilenames, outputFilename );
+			std::cout << "Reduced sample saved to " << outputFilename << std::endl;
+		}
+	}
+	catch( std::exception& error )
+	{
+		std::cerr << "Exception caught: " << error.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
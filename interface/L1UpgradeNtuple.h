@@ -138,6 +138,10 @@ public:
 	//void Test();
 	//void Test2();
 	Long64_t GetEntries();
+	/// @brief The ntuple files in the chain, in order
+	const std::vector<std::string>& GetListOfNtuples() const;
+	/// @brief Adds up the pile up weights in one ntuple file, reading nothing else. Returns false if the file can't be read.
+	static bool SumOfWeights( const std::string & fname, double & sumOfWeights );
 
 private:
 	bool CheckFirstFile();
@@ -9,6 +9,7 @@
 namespace l1menu
 {
 	class L1TriggerDPGEvent;
+	class TriggerMenu;
 }
 
 
@@ -34,12 +35,72 @@ namespace l1menu
 		FullSample& operator=( const FullSample& otherFullSample );
 		FullSample& operator=( FullSample&& otherFullSample ) noexcept;
 
+		/** @brief Loads the libraries ROOT needs to read the ntuples and switches on its thread safety.
+		 *
+		 * This is done when the first FullSample is created, but it's safest done on the main thread before
+		 * any other threads are started. Code that creates FullSamples on other threads, for example
+		 * ReducedSample::addNtupleFiles(), should call this first. Calling it again does nothing.
+		 */
+		static void initialiseROOT();
+
 		void loadFile( const std::string& filename );
 		void loadFilesFromList( const std::string& filenameOfList );
 		const l1menu::L1TriggerDPGEvent& getFullEvent( size_t eventNumber ) const;
 
+		/** @brief Set how many threads read and decode events from the ntuples in forEachBlock() and sumOfWeights().
+		 *
+		 * In forEachBlock() each thread opens its own copy of the ntuple chain and works on a different
+		 * range of entries, so it costs opening the files once per thread the first time it's used.
+		 * sumOfWeights() just gives each thread a different file. The blocks are still
+		 * given to the forEachBlock() function one at a time, in order, on the calling thread, so the
+		 * results are exactly the same whatever the number. Zero means one per core. The default is one.
+		 *
+		 * Whatever the number, forEachBlock() reads the events ahead on a background thread while the
+		 * function works on the blocks already read, so even one reader opens its own copy of the chain.
+		 * The threads share a fixed number of events read ahead, so more threads don't use more memory
+		 * for events.
+		 */
+		void setNumberOfThreads( size_t numberOfThreads );
+		size_t numberOfThreads() const;
+
+		/** @brief Set the size in bytes of the ROOT read cache (TTreeCache) given to each tree in the ntuple chain.
+		 *
+		 * The cache learns which branches are used over the first few entries of each file, and after
+		 * that reads the baskets for all of them in one go instead of one request per basket. That's
+		 * most of the time on network or spinning disk storage. Each reader has its own, so with
+		 * several threads the memory is this times the number of threads times the number of trees
+		 * read (usually three). Zero switches the cache off. The default is 10 MB.
+		 */
+		void setReadCacheSize( size_t bytes );
+		size_t readCacheSize() const;
+
+		/** @brief Set the file used to remember the sum of weights of each ntuple file between jobs.
+		 *
+		 * sumOfWeights() only reads the weights, but that's still a pass over every event. So the total for
+		 * each file is stored along with the file's size and modification time, and used again while those
+		 * stay the same. Only files on a local filesystem are remembered. The default is
+		 * ".l1menuSumOfWeightsCache" in the home directory, an empty string switches it off.
+		 */
+		void setSumOfWeightsCacheFile( const std::string& filename );
+		const std::string& sumOfWeightsCacheFile() const;
+
+		/** @brief Only read and decode the collections of L1 objects that the triggers in the menu look at.
+		 *
+		 * Takes the union of ITrigger::requiredCollections() over the menu, switches off every ntuple
+		 * branch that isn't needed for those collections and skips decoding the others, so they appear
+		 * empty in the events. Triggers that aren't in the menu can give the wrong answer afterwards. The
+		 * default is to read everything. Energy sums also need the jets, since HTT and HTM are worked out
+		 * from them.
+		 */
+		void setRequiredCollections( const l1menu::TriggerMenu& menu );
+		/** @brief Sets the collections directly, as l1menu::ITrigger::Collection values OR'd together. */
+		void setRequiredCollections( unsigned int collections );
+		unsigned int requiredCollections() const;
+
 		virtual size_t numberOfEvents() const;
 		virtual const l1menu::IEvent& getEvent( size_t eventNumber ) const;
+		virtual std::unique_ptr<l1menu::IEvent> getEventCopy( size_t eventNumber ) const;
+		virtual void forEachBlock( size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const;
 		virtual std::unique_ptr<l1menu::ICachedTrigger> createCachedTrigger( const l1menu::ITrigger& trigger ) const;
 		virtual float eventRate() const;
 		virtual void setEventRate( float rate );
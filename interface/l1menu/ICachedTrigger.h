@@ -7,6 +7,7 @@
 namespace l1menu
 {
 	class IEvent;
+	class IEventBlock;
 }
 
 
@@ -28,6 +29,14 @@ namespace l1menu
 		virtual ~ICachedTrigger() {}
 		/** @brief Whether or not the event passes this trigger. */
 		virtual bool apply( const l1menu::IEvent& event ) = 0;
+		/** @brief Applies the trigger to every event in the block.
+		 *
+		 * @param[in]  eventBlock   The events to test. Must have come from the same sample that created
+		 *                          this ICachedTrigger.
+		 * @param[out] pResults     An array of at least eventBlock.size() entries which is filled with
+		 *                          whether or not each event passes.
+		 */
+		virtual void apply( const l1menu::IEventBlock& eventBlock, bool* pResults ) = 0;
 	}; // end of class ICachedTrigger
 
 } // end of namespace l1menu
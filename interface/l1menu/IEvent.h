@@ -23,6 +23,9 @@ namespace l1menu
 		virtual ~IEvent() {}
 		virtual bool passesTrigger( const l1menu::ITrigger& trigger ) const = 0;
 		virtual float weight() const = 0; ///< @brief The weighting this event has been given
+		/** @brief The sum of the squared weights of the events this one stands for. Just weight() squared
+		 * unless identical events have been collapsed into one (see ReducedSample::collapseIdenticalEvents). */
+		virtual float weightSquared() const = 0;
 		virtual const l1menu::ISample& sample() const = 0; ///< @brief The sample that this event came from.
 	};
 
@@ -0,0 +1,52 @@
+#ifndef l1menu_IEventBlock_h
+#define l1menu_IEventBlock_h
+
+#include <stddef.h> // required for size_t
+
+//
+// Forward declarations
+//
+namespace l1menu
+{
+	class IEvent;
+	class ISample;
+}
+
+namespace l1menu
+{
+	/** @brief Interface for a contiguous range of events from an ISample.
+	 *
+	 * Given to the callback of ISample::forEachBlock() so that callers can loop over events in
+	 * blocks, and give a whole block to ICachedTrigger::apply at once rather than making virtual
+	 * calls for every single event. Only valid for the duration of the callback.
+	 *
+	 * Blocks from ReducedSample::forEachBlockPassingAny() can have gaps where events were left out,
+	 * in which case firstEventNumber() is the number of the first event and the others can't be
+	 * worked out from it. The weights are still contiguous arrays in the same order as the events.
+	 */
+	class IEventBlock
+	{
+	public:
+		virtual ~IEventBlock() {}
+		/** @brief The number in the sample of the first event in this block. */
+		virtual size_t firstEventNumber() const = 0;
+		/** @brief The number of events in this block. */
+		virtual size_t size() const = 0;
+		/** @brief Contiguous array of size() event weights. */
+		virtual const float* weights() const = 0;
+		/** @brief Contiguous array of size() sums of squared weights, or nullptr if every entry is a single
+		 * event so that they're just the weights squared. Only ReducedSamples with identical events collapsed
+		 * have these. */
+		virtual const float* weightsSquared() const = 0;
+		/** @brief Get an event from this block, where index is from 0 to size()-1.
+		 *
+		 * Like ISample::getEvent, the reference is only guaranteed to be valid until the next
+		 * call. */
+		virtual const l1menu::IEvent& getEvent( size_t index ) const = 0;
+		virtual const l1menu::ISample& sample() const = 0; ///< @brief The sample that these events came from.
+	};
+
+} // end of namespace l1menu
+
+
+#endif
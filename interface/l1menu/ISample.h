@@ -2,6 +2,7 @@
 #define l1menu_ISample_h
 
 #include <memory>
+#include <functional>
 
 //
 // Forward declarations
@@ -13,6 +14,7 @@ namespace l1menu
 	class IEvent;
 	class ITrigger;
 	class ICachedTrigger;
+	class IEventBlock;
 }
 
 
@@ -29,7 +31,29 @@ namespace l1menu
 		virtual ~ISample() {}
 
 		virtual size_t numberOfEvents() const = 0;
+		/** @brief Get an event from the sample.
+		 *
+		 * The reference is to an event held by the sample, which is overwritten by the next call. So only one
+		 * event can be held at a time, and this can't be used from more than one thread at once. Use
+		 * getEventCopy() for either of those.
+		 */
 		virtual const l1menu::IEvent& getEvent( size_t eventNumber ) const = 0;
+		/** @brief An independent copy of an event, that isn't changed when any other event is asked for.
+		 *
+		 * Any number of these can be held at once, and this can be called from several threads at once
+		 * (but not at the same time as getEvent()). The copy is only valid while the sample exists and
+		 * isn't modified.
+		 */
+		virtual std::unique_ptr<l1menu::IEvent> getEventCopy( size_t eventNumber ) const = 0;
+		/** @brief Calls the function with consecutive blocks of events, in order, until every event has been seen.
+		 *
+		 * Each block has at most blockSize events, but could have fewer. This is the
+		 * fastest way to loop over the sample, because the concrete ISample can provide the events in
+		 * whatever way is most efficient for it, and the block can be given to ICachedTrigger::apply.
+		 *
+		 * @throw std::runtime_error     If blockSize is zero.
+		 */
+		virtual void forEachBlock( size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const = 0;
 
 		virtual std::unique_ptr<l1menu::ICachedTrigger> createCachedTrigger( const l1menu::ITrigger& trigger ) const = 0;
 		/** @brief The rate at which events are occurring. I.e. the trigger rate if every event passed. */
@@ -49,10 +49,34 @@ namespace l1menu
 	 */
 	class ITrigger : public l1menu::ITriggerDescription
 	{
+	public:
+		/** @brief The collections of L1 objects a trigger can look at, as bits so that they can be combined. */
+		enum Collection { EG=1, JETS=2, TAUS=4, MUONS=8, ENERGY_SUMS=16, ALL_COLLECTIONS=31 };
 	public:
 		virtual ~ITrigger() {}
 		virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const = 0;
 		virtual bool thresholdsAreCorrelated() const = 0;
+		/** @brief Sets the thresholds to the tightest the event would pass, worked out directly from the objects in the event.
+		 *
+		 * Optional, the default does nothing and returns false. l1menu::tools::setTriggerThresholdsAsTightAsPossible()
+		 * tries this first and falls back to finding each threshold by bisection, with around twenty calls to apply()
+		 * per threshold, if it returns false. Since that's what most of the time creating a ReducedSample goes on, it's
+		 * worth implementing for any trigger where it's simple, e.g. the highest qualifying jet Et for a single jet
+		 * trigger. Each threshold should be set to the highest value that the event still passes with all of the
+		 * other thresholds at zero, and true returned. If the event can't pass whatever the thresholds, every
+		 * threshold should be set to -1 (and true still returned). Don't implement it for triggers with correlated
+		 * thresholds. If it returns false it mustn't have changed anything.
+		 */
+		virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event ) { return false; }
+		/** @brief Which of the collections in Collection the trigger looks at, OR'd together.
+		 *
+		 * Optional, the default says it needs everything. l1menu::FullSample uses this to switch off the ntuple
+		 * branches, and skip decoding the collections, that none of the triggers in the menu look at. Most of the
+		 * time reading a FullSample goes on reading and decoding objects that are never used, so it's worth
+		 * implementing for every trigger. Returning too little means apply() sees empty collections, so if in
+		 * doubt leave the default.
+		 */
+		virtual unsigned int requiredCollections() const { return ALL_COLLECTIONS; }
 		/** @brief A version of the method from ITriggerEvent that allows the parameter to be changed. */
 		virtual float& parameter( const std::string& parameterName ) = 0;
 
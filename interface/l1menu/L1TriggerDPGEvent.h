@@ -47,6 +47,7 @@ namespace l1menu
 		//
 		virtual bool passesTrigger( const l1menu::ITrigger& trigger ) const;
 		virtual float weight() const;
+		virtual float weightSquared() const;
 		virtual const l1menu::ISample& sample() const;
 	protected:
 		/** @brief Hide implementation details in a pimple.
@@ -11,16 +11,16 @@ namespace l1menu
 {
 	class ITrigger;
 	class ReducedSample;
-}
-namespace l1menuprotobuf
-{
-	class Event;
+	class ReducedSamplePrivateMembers;
 }
 
 
 namespace l1menu
 {
 	/** @brief Interface for a simplified event format. The event just has the minimum threshold to pass for each trigger recorded.
+	 *
+	 * The data isn't held in the event itself. ReducedSample stores each trigger parameter in its own contiguous
+	 * column, so this is just an index into those columns.
 	 *
 	 * @author Mark Grimes (mark.grimes@bristol.ac.uk)
 	 * @date 28/May/2013
@@ -28,21 +28,28 @@ namespace l1menu
 	class ReducedEvent : public l1menu::IEvent
 	{
 		friend class l1menu::ReducedSample;
+		friend class l1menu::ReducedSamplePrivateMembers;
 	public:
 		typedef size_t ParameterID;
 	public:
 		ReducedEvent( const l1menu::ReducedSample& sample );
 		virtual ~ReducedEvent();
 		virtual float parameterValue( ParameterID parameterNumber ) const;
+		/** @brief The position of this event in the ReducedSample it came from. */
+		size_t eventNumber() const { return eventNumber_; }
 
 		//
 		// These are the methods required by the l1menu::IEvent interface.
 		//
 		virtual bool passesTrigger( const l1menu::ITrigger& trigger ) const;
 		virtual float weight() const;
+		virtual float weightSquared() const;
 		virtual const l1menu::ISample& sample() const;
 	private:
-		l1menuprotobuf::Event* pProtobufEvent_;
+		size_t eventNumber_; ///< @brief The position of this event in the sample's columns
+		const float* const* pParameterColumns_; ///< @brief The start of each of the sample's parameter columns
+		const float* pWeights_; ///< @brief The start of the sample's weight column
+		const float* pWeightsSquared_; ///< @brief The start of the sample's squared weight column, or null if it doesn't have one
 		const l1menu::ReducedSample& sample_; ///< @brief The sample that this event is from
 	};
 
@@ -4,6 +4,8 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
+#include <utility>
 
 #include "l1menu/ReducedEvent.h"
 #include "l1menu/ISample.h"
@@ -27,26 +29,215 @@ namespace l1menu
 	class ReducedSample : public l1menu::ISample
 	{
 	public:
-		/** @brief Load from a file in protobuf format. */
-		ReducedSample( const std::string& filename );
+		/** @brief The different formats the sample can be saved in.
+		 *
+		 * PROTOBUF is the original gzipped protobuf format (file format version 1). MEMORYMAPPED is
+		 * (file format version 2) the same header but followed by uncompressed, aligned columns of
+		 * floats. It's larger on disk, but is mapped into memory when loaded so opening is almost
+		 * instant and the data is read in place. CHUNKED (file format version 3) splits the events
+		 * into chunks of eventsPerRun() events that are compressed independently, with an index
+		 * at the end of the file so that the chunks can be decompressed in parallel when loaded.
+		 * All are loaded by the filename constructor.
+		 */
+		enum class FileFormat { PROTOBUF, MEMORYMAPPED, CHUNKED };
+
+		/** @brief The compression used for the chunks of the CHUNKED format.
+		 *
+		 * LZ4 is the quickest to load and a good choice for working copies on local disk. ZSTD gives
+		 * the smallest files, so is better for archiving. GZIP is in between. The codec is recorded in
+		 * the file, so files are loaded the same way whichever was used. The numbers are what's stored
+		 * in the file so they mustn't change.
+		 */
+		enum class Codec { NONE=0, GZIP=1, LZ4=2, ZSTD=3 };
+
+		/** @brief Values of non threshold parameters to store thresholds for, keyed by trigger name and then parameter name. */
+		typedef std::map< std::string, std::map< std::string,std::vector<float> > > ParameterGrid;
+
+		/** @brief Load from a file in any of the formats in FileFormat.
+		 *
+		 * @param[in] filename        The file to load.
+		 * @param[in] streamFromFile  If true, and the file is in the PROTOBUF or CHUNKED format, only the header
+		 *                            is read now. The events are read from the file one Run at a time every
+		 *                            time forEachBlock() is called, so memory use stays constant regardless
+		 *                            of the sample size. getEvent() can't be used, and numberOfEvents() and
+		 *                            sumOfWeights() need a pass over the file the first time they're called
+		 *                            (unless forEachBlock() has already been called, or the file is CHUNKED
+		 *                            which has the totals in its index). Anything that needs the
+		 *                            whole sample, e.g. addSample() or saveToFile(), reads it all in first.
+		 */
+		ReducedSample( const std::string& filename, bool streamFromFile=false );
+		/** @brief Load from a file, but only the columns needed for the given menu.
+		 *
+		 * Only triggers in the file that could be used for one of the triggers in projectionMenu are kept,
+		 * i.e. the ones getTriggerParameterIdentifiers() would find with allowOlderVersion set. The sample's
+		 * trigger menu is then just those triggers, so memory use and load time scale with the menu being
+		 * studied rather than the menu the sample was made with. The thresholds in projectionMenu are
+		 * irrelevant. For CHUNKED files the unwanted columns are still decompressed but aren't decoded or
+		 * stored. Otherwise the same as the constructor above.
+		 */
+		ReducedSample( const std::string& filename, const l1menu::TriggerMenu& projectionMenu, bool streamFromFile=false );
 		ReducedSample( const l1menu::FullSample& originalSample, const l1menu::TriggerMenu& triggerMenu );
 		ReducedSample( const l1menu::TriggerMenu& triggerMenu );
+		/** @brief Create an empty sample that stores thresholds for several values of some non threshold parameters.
+		 *
+		 * Each trigger in the menu with an entry in nonThresholdParameterGrid is replaced by a copy for
+		 * every combination of the values listed for it, e.g. regionCut 4.5, 5.5 and 6.5 for "L1_SingleJetC".
+		 * Anything that looks up a trigger in the sample (rate(), createCachedTrigger() and so on) matches
+		 * the non threshold parameters exactly, so picks the column for whichever values the trigger has.
+		 * That way one pass over the ntuples does for a whole scan of e.g. the eta acceptance. The grid
+		 * copies are in getTriggerMenu() and are saved to file like any other trigger. Throws if a trigger in
+		 * the grid isn't in the menu, or a parameter is a threshold, isn't one of the trigger's parameters or
+		 * has no values.
+		 */
+		ReducedSample( const l1menu::TriggerMenu& triggerMenu, const ParameterGrid& nonThresholdParameterGrid );
 		virtual ~ReducedSample();
 
 		void addSample( const l1menu::FullSample& originalSample );
+		/** @brief Adds the events from L1 DPG ntuple files, working out the thresholds on several threads.
+		 *
+		 * The files are split into ranges of a few thousand events, and each range is loaded into its own
+		 * FullSample on whichever thread is free. The results are added in the order of the files and the
+		 * events within them, so the sample is exactly the same as if each file had been loaded into a
+		 * FullSample and given to addSample() in turn.
+		 *
+		 * @param[in] ntupleFilenames   The ntuple files, in the order the events should be added.
+		 * @param[in] numberOfThreads   The maximum number of threads to use. If zero, the number of hardware
+		 *                              threads is used.
+		 */
+		void addNtupleFiles( const std::vector<std::string>& ntupleFilenames, size_t numberOfThreads=0 );
+
+		/** @brief Save to a file in any of the formats in FileFormat. The protobuf messages are in src/protobuf/l1menu.proto.
+		 *
+		 * The default is still PROTOBUF so that files saved by existing code can be read by older versions. */
+		void saveToFile( const std::string& filename, FileFormat format=FileFormat::PROTOBUF ) const;
+
+		/** @brief Adds the events in this sample onto the end of an existing file in the CHUNKED format.
+		 *
+		 * Only the new events are written, so the time taken doesn't depend on how big the file already
+		 * is. The file has to have been made with exactly the same trigger menu, otherwise an exception
+		 * is thrown. The events are stored with the quantisation and codec already used in the file. If
+		 * the file doesn't exist it's created, the same as saveToFile() with the CHUNKED format. The file can't be read while
+		 * this is running, and will be unreadable if it's interrupted. Any threshold index in the file
+		 * is removed, since it would no longer be correct.
+		 */
+		void appendToFile( const std::string& filename ) const;
+
+		/** @brief Merges ReducedSample files into a single CHUNKED file, without loading them into memory.
+		 *
+		 * The input files can be in any format, but all have to have been made with exactly the same
+		 * trigger menu. The output uses the codec of the first input. If all of the inputs store their
+		 * columns the same way (quantisation and sparse encoding) the output does too, otherwise it stores
+		 * plain floats. Chunks of CHUNKED inputs stored the same way as the output are copied across
+		 * without being decompressed. If anything goes wrong the output file is removed.
+		 */
+		static void mergeFiles( const std::vector<std::string>& inputFilenames, const std::string& outputFilename );
 
-		/** @brief Save to a file in protobuf format (protobuf in src/protobuf/l1menu.proto). */
-		void saveToFile( const std::string& filename ) const;
+		/** @brief Splits a ReducedSample file into CHUNKED files with (as close as possible) equal numbers of
+		 * consecutive events, in a single pass without loading it into memory. If anything goes wrong
+		 * the output files are removed. */
+		static void splitFile( const std::string& inputFilename, const std::vector<std::string>& outputFilenames );
+
+		/** @brief Replace events that have identical thresholds with a single row.
+		 *
+		 * Each row's weight is the sum of the weights of the events it replaces, and it also keeps the
+		 * sum of their squared weights so that the errors on rates are unchanged. Since most events
+		 * fail most triggers, or only pass at a handful of thresholds, this can cut the number of rows
+		 * by a large factor, especially after setThresholdQuantisation() or when loaded with a
+		 * projection menu. Afterwards numberOfEvents() and getEvent() refer to rows rather than the
+		 * original events. Collapsed samples can be saved in the CHUNKED and MEMORYMAPPED formats,
+		 * which store the sums of squared weights, but not in PROTOBUF.
+		 */
+		void collapseIdenticalEvents();
+		bool eventsAreCollapsed() const;
+
+		/** @brief Sorts each parameter column and sums up the weights, so that single threshold rates are a binary search.
+		 *
+		 * Each column has the tightest threshold each event passes, so the weight passing any threshold
+		 * is the weight of the events with a value that isn't below it. With the index built that can be
+		 * found without looping over the events, see weightPassingThreshold(). rate() uses it for menus
+		 * with a single trigger that has a single threshold, and TriggerRatePlot for plots of those
+		 * triggers. The index is saved in CHUNKED files and loaded with them (even when streaming), but
+		 * isn't stored in the other formats or by mergeFiles() and splitFile(). Anything that changes the
+		 * thresholds or weights, e.g. addSample(), removes it.
+		 */
+		void buildThresholdIndex();
+		bool hasThresholdIndex() const;
+		/** @brief The summed weight ('first') and summed squared weight ('second') of the events that pass the
+		 * threshold for the parameter, found from the threshold index.
+		 *
+		 * The parameter is one of the identifiers from getTriggerParameterIdentifiers(). The event passes if
+		 * its value for the parameter isn't below the threshold, so this only gives the weight passing a
+		 * trigger if the trigger has just the one threshold. Throws if there's no threshold index.
+		 */
+		std::pair<double,double> weightPassingThreshold( l1menu::ReducedEvent::ParameterID parameter, float threshold ) const;
+
+		/** @brief Round the thresholds down onto the granularity the hardware can apply them at.
+		 *
+		 * Each parameter gets a grid of evenly spaced thresholds starting at zero, with the spacing the
+		 * step the hardware applies thresholds in (0.5 GeV). Thresholds already in the sample and any added
+		 * later are rounded down onto the grid, so rates for thresholds on the grid (i.e. any the hardware
+		 * can apply) are unchanged. When saved in the CHUNKED format quantised thresholds are stored as 8 or 16 bit
+		 * indices into the grid, which is kept in the file so the sample stays quantised when loaded.
+		 * Turning quantisation off doesn't restore any precision, it only stops further rounding. */
+		void setThresholdQuantisation( bool quantise );
+		bool thresholdsAreQuantised() const;
+
+		/** @brief Set how many events go in each Run (PROTOBUF format) or chunk (CHUNKED format) when saving.
+		 *
+		 * Smaller chunks give more to do in parallel when loading and less memory when streaming, larger
+		 * ones compress slightly better. Defaults to 20000. */
+		void setEventsPerRun( size_t eventsPerRun );
+		size_t eventsPerRun() const;
+
+		/** @brief Set the compression used when saving in the CHUNKED format. Defaults to GZIP, or whatever
+		 * the file used if the sample was loaded from a CHUNKED file. */
+		void setCodec( Codec codec );
+		Codec codec() const;
+		/** @brief Set whether columns saved in the CHUNKED format only store the values that aren't -1.
+		 *
+		 * Most triggers don't fire for most events, so most of their thresholds are -1. With this set each
+		 * column in each chunk has a bitmap of which events have a value, which makes files smaller and
+		 * quicker to load when the columns are mostly -1. Files written like this can't be read by older
+		 * versions of the code, so it defaults to off, or whatever the file used if the sample was loaded
+		 * from a CHUNKED file.
+		 */
+		void setSparseEncoding( bool sparseEncoding );
+		bool sparseEncoding() const;
 
 		const l1menu::TriggerMenu& getTriggerMenu() const;
 		bool containsTrigger( const l1menu::ITrigger& trigger, bool allowOlderVersion=false ) const;
-		const std::map<std::string,ReducedEvent::ParameterID> getTriggerParameterIdentifiers( const l1menu::ITrigger& trigger, bool allowOlderVersion=false ) const;
+		/** @brief The parameter identifiers (column numbers) for each of the trigger's thresholds, keyed by the threshold name.
+		 *
+		 * Throws if the sample doesn't have a matching trigger, i.e. one with the same name, version (or an
+		 * older version if allowOlderVersion is true) and non threshold parameters. The answer is worked out
+		 * once for each distinct trigger and then remembered, so this is cheap enough to call for every
+		 * event. The reference stays valid for as long as the sample. Safe to call from several threads.
+		 */
+		const std::map<std::string,ReducedEvent::ParameterID>& getTriggerParameterIdentifiers( const l1menu::ITrigger& trigger, bool allowOlderVersion=false ) const;
+
+		/** @brief The same as forEachBlock(), except that parts of the sample where no event can pass any of the triggers are left out.
+		 *
+		 * The largest value of each column is kept for every few thousand events (and for each chunk of
+		 * CHUNKED files, in the file), so a part can be left out if every trigger has a threshold above
+		 * the largest value for it. When streaming from a CHUNKED file those chunks aren't even read.
+		 * At high thresholds that can be most of the sample. When all of the sample is in memory, events
+		 * where every trigger that could pass has a threshold above -1 for a column the event doesn't
+		 * have a value in are left out too, so blocks aren't necessarily contiguous (see IEventBlock).
+		 * The thresholds are copied at the start, so
+		 * the triggers can be changed by the function. Each trigger has to be one createCachedTrigger()
+		 * would accept.
+		 *
+		 * @return  The summed weight of the events that were left out.
+		 */
+		double forEachBlockPassingAny( const std::vector<const l1menu::ITrigger*>& triggers, size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const;
 
 		//
 		// Implementations required for the ISample interface
 		//
 		virtual size_t numberOfEvents() const;
 		virtual const l1menu::IEvent& getEvent( size_t eventNumber ) const;
+		virtual std::unique_ptr<l1menu::IEvent> getEventCopy( size_t eventNumber ) const;
+		virtual void forEachBlock( size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const;
 		virtual std::unique_ptr<l1menu::ICachedTrigger> createCachedTrigger( const l1menu::ITrigger& trigger ) const;
 		virtual float eventRate() const;
 		virtual void setEventRate( float rate );
@@ -16,6 +16,7 @@ namespace l1menu
 	class ITriggerDescription;
 	class ICachedTrigger;
 	class ISample;
+	class ReducedSample;
 }
 
 
@@ -125,7 +126,9 @@ namespace l1menu
 		 * This is purely for performance reasons, because there's some logic in here that can be considerably
 		 * faster than looping over the provided vector and calling addSample() on each one. FullSample needs
 		 * to do a lot of work to read a new event, so reading each event for each TriggerRatePlot is much
-		 * slower than reading the event once and passing it to each TriggerRatePlot.
+		 * slower than reading the event once and passing it to each TriggerRatePlot. If the sample is a
+		 * ReducedSample with a threshold index, plots that can be filled from that are, and the events
+		 * are only looped over for the rest (if there are any).
 		 */
 		static void addSample( const l1menu::ISample& sample, std::vector<TriggerRatePlot>& ratePlots );
 	protected:
@@ -144,6 +147,11 @@ namespace l1menu
 		bool histogramOwnedByMe_;
 		/// The implementation that the public methods delegate to
 		void addEvent( const l1menu::IEvent& event, const std::unique_ptr<l1menu::ICachedTrigger>& pCachedTrigger, float weightPerEvent );
+		/** @brief Fills the plot from the sample's threshold index if it can, i.e. if the sample has one and the
+		 * trigger's only threshold is the versus parameter. Returns false, without touching the plot, if not. */
+		bool addSampleFromThresholdIndex( const l1menu::ReducedSample& sample, float weightPerEvent );
+		/** @brief Sets the versus parameter in pTrigger_, and any parameters scaled along with it. */
+		void setVersusParameter( float value );
 	};
 }
 #endif
@@ -74,16 +74,31 @@ namespace l1menu
 		/** @brief Examines the file and creates the appropriate concrete implementation of ISample for it.
 		 *
 		 * Currently only works for ReducedSample, which makes this function a bit pointless. I'll add
-		 * support for FullSample soon.
+		 * support for FullSample soon. All three of the ReducedSample file formats (PROTOBUF, version 1;
+		 * MEMORYMAPPED, version 2; and CHUNKED, version 3) start with the same magic number, and the
+		 * ReducedSample constructor tells them apart by the file format version that follows it.
+		 * FullSamples are left reading the ntuples with one thread, since each thread opens its own copy
+		 * of the files. Use FullSample::setNumberOfThreads() on the result for more.
 		 *
-		 * @param[in]  filename     The filename of the file to open. If the file doesn't exist a std::runtime_error
-		 *                          is thrown.
-		 * @return                  A pointer to the ISample created.
+		 * @param[in]  filename       The filename of the file to open. If the file doesn't exist a std::runtime_error
+		 *                            is thrown.
+		 * @param[in]  streamFromFile If the file is a ReducedSample, read events from the file as they're needed
+		 *                            rather than load them all now. Good for one pass jobs on large samples but
+		 *                            the ISample can only be looped over with forEachBlock(). See the
+		 *                            ReducedSample constructor for details.
+		 * @return                    A pointer to the ISample created.
 		 *
 		 * @author Mark Grimes (mark.grimes@bristol.ac.uk)
 		 * @date 07/Jul/2013
 		 */
-		std::unique_ptr<l1menu::ISample> loadSample( const std::string& filename );
+		std::unique_ptr<l1menu::ISample> loadSample( const std::string& filename, bool streamFromFile=false );
+
+		/** @brief Same as the version above, but if the file is a ReducedSample only the columns needed for the given menu are loaded.
+		 *
+		 * See the ReducedSample constructor that takes a projection menu. FullSamples only read and decode
+		 * the collections that the menu's triggers look at, see FullSample::setRequiredCollections().
+		 */
+		std::unique_ptr<l1menu::ISample> loadSample( const std::string& filename, const l1menu::TriggerMenu& projectionMenu, bool streamFromFile=false );
 
 		/** @brief Loads the menu from a file on disk.
 		 *
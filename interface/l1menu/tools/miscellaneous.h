@@ -10,6 +10,7 @@
 #include <memory>
 #include <utility>
 #include <iosfwd>
+#include <functional>
 
 //
 // Forward declarations
@@ -63,6 +64,9 @@ namespace l1menu
 		 *
 		 * If no thresholds can be found that would let the trigger pass the supplied event, a std::runtime_error is thrown.
 		 *
+		 * If the trigger implements ITrigger::setThresholdsAsTightAsPossible() the thresholds are taken from that, exactly
+		 * and much more quickly. Otherwise each one is found by bisection to within the tolerance.
+		 *
 		 * @param[in]  event      The event to test the trigger on.
 		 * @param[out] trigger    The trigger to check and modify.
 		 * @param[in]  tolerance  The trigger thresholds will be modified to be within this tolerance of thresholds that would
@@ -120,6 +124,20 @@ namespace l1menu
 		 * @date 08/Jul/2013
 		 */
 		std::pair<float,float> simpleLinearFit( const std::vector< std::pair<float,float> >& dataPoints );
+
+		/** @brief Calls the function once for each index from 0 to numberOfItems-1, spread over several threads.
+		 *
+		 * Indices are handed out to the threads in order as each one becomes free, so there's no guarantee
+		 * which thread gets which index. The function must therefore be safe to call concurrently. If any
+		 * call throws an exception, no more indices are handed out and the first exception is rethrown in
+		 * the calling thread once all of the threads have finished.
+		 *
+		 * @param[in]  numberOfItems     The number of times to call the function.
+		 * @param[in]  function          The function to call, with the index as the parameter.
+		 * @param[in]  numberOfThreads   The maximum number of threads to use. If zero, the number of hardware
+		 *                               threads is used.
+		 */
+		void parallelFor( size_t numberOfItems, const std::function<void(size_t)>& function, size_t numberOfThreads=0 );
 	} // end of the tools namespace
 } // end of the l1menu namespace
 #endif
@@ -2,13 +2,32 @@
 
 #include <stdexcept>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <TSystem.h>
+#include <TThread.h>
+#include <TChain.h>
 #include "FWCore/FWLite/interface/AutoLibraryLoader.h"
 
 #include "l1menu/L1TriggerDPGEvent.h"
+#include "l1menu/ITrigger.h"
+#include "l1menu/TriggerMenu.h"
 #include "l1menu/ICachedTrigger.h"
+#include "l1menu/IEventBlock.h"
 #include "l1menu/IMenuRate.h"
+#include "l1menu/tools/miscellaneous.h"
 #include "./implementation/MenuRateImplementation.h"
 #include "L1UpgradeNtuple.h"
 #include "UserCode/L1TriggerUpgrade/interface/L1AnalysisDataFormat.h"
@@ -33,9 +52,116 @@ namespace // Use the unnamed namespace for things only used in this file
 	public:
 		CachedTriggerImplementation( const l1menu::ITrigger& trigger ) : trigger_(trigger) {}
 		virtual bool apply( const l1menu::IEvent& event ) { return event.passesTrigger( trigger_ ); }
+		virtual void apply( const l1menu::IEventBlock& eventBlock, bool* pResults )
+		{
+			for( size_t index=0; index<eventBlock.size(); ++index ) pResults[index]=eventBlock.getEvent(index).passesTrigger( trigger_ );
+		}
 	protected:
 		const l1menu::ITrigger& trigger_;
 	}; // end of class CachedTriggerImplementation
+
+	/** @brief The IEventBlock implementation for FullSample.
+	 *
+	 * FullSample only ever has the one event loaded from the ntuple, so this holds copies of the
+	 * events for the whole block. The copies are reused from block to block to save on allocations.
+	 */
+	class FullEventBlock : public l1menu::IEventBlock
+	{
+	public:
+		FullEventBlock( const l1menu::ISample& sample ) : sample_(sample), firstEventNumber_(0), size_(0) {}
+		/** @brief Sets which events the block holds, which then have to be filled in with setEvent(). */
+		void resize( size_t firstEventNumber, size_t size )
+		{
+			firstEventNumber_=firstEventNumber;
+			size_=size;
+			if( events_.size()<size ) events_.resize( size, l1menu::L1TriggerDPGEvent( sample_ ) );
+			weights_.resize( size );
+		}
+		/** @brief Different threads can set different events at the same time. */
+		void setEvent( size_t index, const l1menu::L1TriggerDPGEvent& event )
+		{
+			events_[index]=event;
+			weights_[index]=event.weight();
+		}
+		virtual size_t firstEventNumber() const { return firstEventNumber_; }
+		virtual size_t size() const { return size_; }
+		virtual const float* weights() const { return weights_.data(); }
+		virtual const float* weightsSquared() const { return nullptr; }
+		virtual const l1menu::IEvent& getEvent( size_t index ) const { return events_[index]; }
+		virtual const l1menu::ISample& sample() const { return sample_; }
+	private:
+		const l1menu::ISample& sample_;
+		size_t firstEventNumber_;
+		size_t size_; ///< @brief The number of events in use. Can be less than events_.size() because they're reused.
+		std::vector<l1menu::L1TriggerDPGEvent> events_;
+		std::vector<float> weights_;
+	}; // end of class FullEventBlock
+
+	/** @brief What's remembered about each ntuple file in the sum of weights cache file. */
+	struct SumOfWeightsCacheEntry
+	{
+		long long fileSize;
+		long long modificationTime;
+		double sumOfWeights;
+	};
+
+	/** @brief Gets the absolute path, size and modification time of a file. Returns false if it's not a local file, in which case it isn't cached. */
+	bool getCacheKey( const std::string& filename, std::string& absolutePath, SumOfWeightsCacheEntry& entry )
+	{
+		struct stat fileStatus;
+		if( ::stat( filename.c_str(), &fileStatus )!=0 ) return false;
+		char* pAbsolutePath=::realpath( filename.c_str(), nullptr );
+		if( pAbsolutePath==nullptr ) return false;
+		absolutePath=pAbsolutePath;
+		std::free( pAbsolutePath );
+		entry.fileSize=fileStatus.st_size;
+		entry.modificationTime=fileStatus.st_mtime;
+		return true;
+	}
+
+	std::map<std::string,SumOfWeightsCacheEntry> readSumOfWeightsCache( const std::string& cacheFilename )
+	{
+		// Each line is the size, modification time and sum of weights, then the path last since it
+		// could have spaces in. A missing file is the same as an empty one, and I skip anything that
+		// doesn't parse since the worst that can happen is the file gets read again.
+		std::map<std::string,SumOfWeightsCacheEntry> returnValue;
+		std::ifstream inputFile( cacheFilename.c_str() );
+		std::string line;
+		while( std::getline( inputFile, line ) )
+		{
+			std::istringstream lineStream( line );
+			SumOfWeightsCacheEntry entry;
+			std::string path;
+			if( !(lineStream >> entry.fileSize >> entry.modificationTime >> entry.sumOfWeights) ) continue;
+			lineStream.ignore( 1 );
+			if( !std::getline( lineStream, path ) || path.empty() ) continue;
+			returnValue[path]=entry;
+		}
+		return returnValue;
+	}
+
+	void writeSumOfWeightsCache( const std::string& cacheFilename, const std::map<std::string,SumOfWeightsCacheEntry>& cache )
+	{
+		// Written to a temporary file and renamed, so that another job reading it at the same time never
+		// sees half a file. If it can't be written it doesn't matter, the weights just get read again.
+		const std::string temporaryFilename=cacheFilename+".tmp"+std::to_string( static_cast<long long>( ::getpid() ) );
+		{
+			std::ofstream outputFile( temporaryFilename.c_str() );
+			if( !outputFile.is_open() ) return;
+			outputFile << std::setprecision(17);
+			for( const auto& pathAndEntry : cache )
+			{
+				outputFile << pathAndEntry.second.fileSize << " " << pathAndEntry.second.modificationTime << " " << pathAndEntry.second.sumOfWeights << " " << pathAndEntry.first << "\n";
+			}
+			if( !outputFile.good() )
+			{
+				outputFile.close();
+				std::remove( temporaryFilename.c_str() );
+				return;
+			}
+		}
+		if( std::rename( temporaryFilename.c_str(), cacheFilename.c_str() )!=0 ) std::remove( temporaryFilename.c_str() );
+	}
 } // end of the unnamed namespace
 
 namespace l1menu
@@ -47,22 +173,61 @@ namespace l1menu
 		static const double PHIBIN[];
 		static const size_t ETABINS;
 		static const double ETABIN[];
+		static const size_t ETALOOKUPCELLS;
+		/// @brief For each of ETALOOKUPCELLS equal cells between the first and last ETABIN, the index of the bin its lower edge is in
+		static const std::vector<int> ETALOOKUP;
+		static std::vector<int> makeEtaLookup();
 
-		static bool libraryLoaderInitiated; ///< @brief Flag to say if libFWCoreFWLite.so has been loaded and the AutoLibraryLoader enabled
+		static std::once_flag libraryLoaderInitiated; ///< @brief Flag to say if libFWCoreFWLite.so has been loaded and the AutoLibraryLoader enabled
 
 		double degree( double radian );
 		int phiINjetCoord( double phi );
 		int etaINjetCoord( double eta );
+		/** @brief Converts the first "number" values with phiINjetCoord() or etaINjetCoord() and appends them to output.
+		 * Throws std::out_of_range if there aren't that many values, the same as the at() calls they replace. */
+		template<class T_input,class T_output> void appendPhiINjetCoord( const std::vector<T_input>& values, size_t number, std::vector<T_output>& output );
+		template<class T_input,class T_output> void appendEtaINjetCoord( const std::vector<T_input>& values, size_t number, std::vector<T_output>& output );
 		double calculateHTT( const L1Analysis::L1AnalysisDataFormat& event );
 		double calculateHTM( const L1Analysis::L1AnalysisDataFormat& event );
 	public:
 		FullSamplePrivateMembers( FullSample* pThisObject );
+		// These are only needed because the mutex can't be copied. Each copy has its own.
+		FullSamplePrivateMembers( const FullSamplePrivateMembers& otherPrivateMembers );
+		FullSamplePrivateMembers& operator=( const FullSamplePrivateMembers& otherPrivateMembers );
+		/** @brief Loads libFWCoreFWLite.so and switches on ROOT's thread safety, the first time it's called. */
+		static void initialiseROOT();
+		void loadFile( const std::string& filename, bool isListOfFiles );
+		/** @brief Loads the entry from the ntuple and fills currentEvent with it. */
+		const l1menu::L1TriggerDPGEvent& readEvent( size_t eventNumber );
 		void fillDataStructure( int selectDataInput );
 		void fillL1Bits();
+		/** @brief Switches off the ntuple branches not needed for requiredCollections. Has to be redone after every file is loaded. */
+		void setBranchStatuses();
+		/** @brief Gives every tree that's read a TTreeCache of readCacheSize, which learns the branches setBranchStatuses() left on. */
+		void setReadCache();
+		/** @brief Makes sure there are at least numberOfReaders entries in workerReaders. */
+		void createWorkerReaders( size_t numberOfReaders );
+		/** @brief The number of threads to actually use for this many events, with no more than one per MINIMUM_EVENTS_PER_THREAD. */
+		size_t threadsToUse( size_t numberOfEvents ) const;
+		FullSample* pThisObject_;
 		L1UpgradeNtuple inputNtuple;
 		l1menu::L1TriggerDPGEvent currentEvent;
+		std::mutex currentEventMutex; ///< @brief Held by getEventCopy() while currentEvent is filled and copied
 		float sumOfWeights;
+		long long numberOfEvents; ///< @brief Cached because GetEntries() on a TChain isn't always cheap. -1 means not yet known.
 		float eventRate;
+		std::vector<int> etaBinBuffer; ///< @brief Reused by fillDataStructure() for collections that need converting before duplicates are removed
+		std::vector<int> phiBinBuffer; ///< @brief Reused by fillDataStructure() for collections that need converting before duplicates are removed
+		/// @brief Every file given to loadFile() or loadFilesFromList() (where the bool is true) in order, so that worker readers can open the same chain
+		std::vector< std::pair<std::string,bool> > loadedFiles;
+		size_t numberOfThreads; ///< @brief As set by FullSample::setNumberOfThreads(), zero means one per core
+		unsigned int requiredCollections; ///< @brief The l1menu::ITrigger::Collection values that are read and decoded, OR'd together
+		size_t readCacheSize; ///< @brief Bytes of TTreeCache for each tree, zero for none
+		std::string sumOfWeightsCacheFile; ///< @brief Where the sum of weights for each ntuple file is remembered, empty for nowhere
+		/// @brief Readers with their own ntuple chain and event, one for each thread used by forEachBlock(). Only created when first needed.
+		std::vector< std::unique_ptr<FullSamplePrivateMembers> > workerReaders;
+		static const size_t MINIMUM_EVENTS_PER_THREAD;
+		static const size_t EVENTS_READ_AHEAD; ///< @brief Roughly how many events forEachBlock() reads at a time, shared between the threads
 	};
 }
 
@@ -70,19 +235,168 @@ const size_t l1menu::FullSamplePrivateMembers::PHIBINS=18;
 const double l1menu::FullSamplePrivateMembers::PHIBIN[]={10,30,50,70,90,110,130,150,170,190,210,230,250,270,290,310,330,350};
 const size_t l1menu::FullSamplePrivateMembers::ETABINS=23;
 const double l1menu::FullSamplePrivateMembers::ETABIN[]={-5.,-4.5,-4.,-3.5,-3.,-2.172,-1.74,-1.392,-1.044,-0.696,-0.348,0,0.348,0.696,1.044,1.392,1.74,2.172,3.,3.5,4.,4.5,5.};
-bool l1menu::FullSamplePrivateMembers::libraryLoaderInitiated=false;
+std::once_flag l1menu::FullSamplePrivateMembers::libraryLoaderInitiated;
+const size_t l1menu::FullSamplePrivateMembers::ETALOOKUPCELLS=1000;
+const std::vector<int> l1menu::FullSamplePrivateMembers::ETALOOKUP=l1menu::FullSamplePrivateMembers::makeEtaLookup();
+const size_t l1menu::FullSamplePrivateMembers::MINIMUM_EVENTS_PER_THREAD=1000;
+const size_t l1menu::FullSamplePrivateMembers::EVENTS_READ_AHEAD=8192;
 
 l1menu::FullSamplePrivateMembers::FullSamplePrivateMembers( FullSample* pThisObject )
-	: currentEvent(*pThisObject), sumOfWeights(-1), eventRate(1)
+	: pThisObject_(pThisObject), currentEvent(*pThisObject), sumOfWeights(-1), numberOfEvents(-1), eventRate(1), numberOfThreads(1), requiredCollections(l1menu::ITrigger::ALL_COLLECTIONS),
+	  readCacheSize(10*1024*1024)
 {
-	if( !libraryLoaderInitiated )
+	const char* pHomeDirectory=std::getenv( "HOME" );
+	if( pHomeDirectory!=nullptr ) sumOfWeightsCacheFile=std::string(pHomeDirectory)+"/.l1menuSumOfWeightsCache";
+
+	initialiseROOT();
+}
+
+void l1menu::FullSamplePrivateMembers::initialiseROOT()
+{
+	// FullSamples can be created on several threads at once (e.g. by ReducedSample::addNtupleFiles())
+	// so this has to be done only once in a thread safe way. Each FullSample has its own TChains, but
+	// ROOT's global state still needs protecting, which is what TThread::Initialize() switches on.
+	std::call_once( libraryLoaderInitiated, []()
 	{
+		TThread::Initialize();
 		gSystem->Load("libFWCoreFWLite.so");
 		AutoLibraryLoader::enable();
-		libraryLoaderInitiated=true;
+	} );
+}
+
+l1menu::FullSamplePrivateMembers::FullSamplePrivateMembers( const FullSamplePrivateMembers& otherPrivateMembers )
+	: pThisObject_(otherPrivateMembers.pThisObject_), inputNtuple(otherPrivateMembers.inputNtuple), currentEvent(otherPrivateMembers.currentEvent), sumOfWeights(otherPrivateMembers.sumOfWeights),
+	  numberOfEvents(otherPrivateMembers.numberOfEvents), eventRate(otherPrivateMembers.eventRate), loadedFiles(otherPrivateMembers.loadedFiles), numberOfThreads(otherPrivateMembers.numberOfThreads),
+	  requiredCollections(otherPrivateMembers.requiredCollections), readCacheSize(otherPrivateMembers.readCacheSize),
+	  sumOfWeightsCacheFile(otherPrivateMembers.sumOfWeightsCacheFile)
+{
+	// Worker readers aren't copied, the copy opens its own if it needs them
+}
+
+l1menu::FullSamplePrivateMembers& l1menu::FullSamplePrivateMembers::operator=( const FullSamplePrivateMembers& otherPrivateMembers )
+{
+	inputNtuple=otherPrivateMembers.inputNtuple;
+	currentEvent=otherPrivateMembers.currentEvent;
+	sumOfWeights=otherPrivateMembers.sumOfWeights;
+	numberOfEvents=otherPrivateMembers.numberOfEvents;
+	eventRate=otherPrivateMembers.eventRate;
+	loadedFiles=otherPrivateMembers.loadedFiles;
+	numberOfThreads=otherPrivateMembers.numberOfThreads;
+	requiredCollections=otherPrivateMembers.requiredCollections;
+	readCacheSize=otherPrivateMembers.readCacheSize;
+	sumOfWeightsCacheFile=otherPrivateMembers.sumOfWeightsCacheFile;
+	workerReaders.clear();
+	return *this;
+}
+
+void l1menu::FullSamplePrivateMembers::loadFile( const std::string& filename, bool isListOfFiles )
+{
+	sumOfWeights=-1;
+	numberOfEvents=-1;
+	if( isListOfFiles ) inputNtuple.OpenWithList( filename );
+	else inputNtuple.Open( filename );
+	loadedFiles.push_back( std::make_pair( filename, isListOfFiles ) );
+	workerReaders.clear(); // They'd have the old chain, so need to be opened again
+	setBranchStatuses();
+	setReadCache();
+}
+
+void l1menu::FullSamplePrivateMembers::setBranchStatuses()
+{
+	if( inputNtuple.fChain==nullptr ) return; // Nothing loaded yet, this gets called again when there is
+
+	// Nothing in the reco, L1Extra, menu, simulation or generator trees is ever used, nor anything in
+	// the L1Tree except the event information, so switch everything off and then switch back on what
+	// fillDataStructure() looks at. Friends have to be done separately because they're separate chains.
+	for( TChain* pChain : { inputNtuple.fChain, inputNtuple.ftreeEmu, inputNtuple.ftreemuon, inputNtuple.ftreereco, inputNtuple.ftreeExtra,
+			inputNtuple.ftreeEmuExtra, inputNtuple.ftreeMenu, inputNtuple.ftreeUpgrade } )
+	{
+		if( pChain!=nullptr ) pChain->SetBranchStatus( "*", 0 );
+	}
+	inputNtuple.fChain->SetBranchStatus( "Event", 1 );
+
+	// The muons come from the re-emulated GMT
+	if( inputNtuple.dol1emu && (requiredCollections & l1menu::ITrigger::MUONS) ) inputNtuple.ftreeEmu->SetBranchStatus( "GMT", 1 );
+
+	if( inputNtuple.dol1upgrade )
+	{
+		// Everything else is in the L1ExtraUpgrade object, which is split into a branch per member. I only
+		// touch the members that exist so that this still works if the format changes slightly.
+		inputNtuple.ftreeUpgrade->SetBranchStatus( "L1ExtraUpgrade", 1 );
+		auto switchOff=[this]( const std::vector<const char*>& branchNames )
+		{
+			for( const auto& branchName : branchNames )
+			{
+				if( inputNtuple.ftreeUpgrade->GetBranch(branchName)!=nullptr ) inputNtuple.ftreeUpgrade->SetBranchStatus( branchName, 0 );
+			}
+		};
+		if( !(requiredCollections & l1menu::ITrigger::EG) )
+		{
+			switchOff( { "nEG", "egEt", "egEta", "egPhi", "egBx", "nIsoEG", "isoEGEt", "isoEGEta", "isoEGPhi", "isoEGBx" } );
+		}
+		if( !(requiredCollections & l1menu::ITrigger::JETS) )
+		{
+			switchOff( { "nJets", "jetEt", "jetEta", "jetPhi", "jetBx", "nFwdJets", "fwdJetEt", "fwdJetEta", "fwdJetPhi", "fwdJetBx" } );
+		}
+		if( !(requiredCollections & l1menu::ITrigger::TAUS) )
+		{
+			switchOff( { "nTau", "tauEt", "tauEta", "tauPhi", "tauBx", "nIsoTau", "isoTauEt", "isoTauEta", "isoTauPhi", "isoTauBx" } );
+		}
+		if( !(requiredCollections & l1menu::ITrigger::ENERGY_SUMS) )
+		{
+			switchOff( { "nMet", "et", "met", "metPhi", "metBx", "nMht", "ht", "mht", "mhtPhi", "mhtBx" } );
+		}
+	}
+}
+
+void l1menu::FullSamplePrivateMembers::setReadCache()
+{
+	if( inputNtuple.fChain==nullptr ) return;
+
+	// Setting zero first throws away any cache that has already learnt the branches, since which
+	// ones are switched on might have changed. The chains make a new cache for each file as they
+	// get to it, which learns whatever branches are read over its first entries.
+	for( TChain* pChain : { inputNtuple.fChain, inputNtuple.ftreeEmu, inputNtuple.ftreeUpgrade } )
+	{
+		if( pChain==nullptr ) continue;
+		pChain->SetCacheSize( 0 );
+		if( readCacheSize>0 ) pChain->SetCacheSize( readCacheSize );
 	}
 }
 
+const l1menu::L1TriggerDPGEvent& l1menu::FullSamplePrivateMembers::readEvent( size_t eventNumber )
+{
+	inputNtuple.LoadTree(eventNumber);
+	inputNtuple.GetEntry(eventNumber);
+	// This next call fills currentEvent with the information in inputNtuple
+	fillDataStructure( 22 );
+	fillL1Bits();
+
+	return currentEvent;
+}
+
+void l1menu::FullSamplePrivateMembers::createWorkerReaders( size_t numberOfReaders )
+{
+	// Opening the files changes ROOT's global state, so I do it here on the calling thread. Each
+	// reader has an event that says it came from this sample, the same as currentEvent.
+	while( workerReaders.size()<numberOfReaders )
+	{
+		std::unique_ptr<FullSamplePrivateMembers> pReader( new FullSamplePrivateMembers( pThisObject_ ) );
+		pReader->requiredCollections=requiredCollections;
+		pReader->readCacheSize=readCacheSize;
+		for( const auto& loadedFile : loadedFiles ) pReader->loadFile( loadedFile.first, loadedFile.second );
+		workerReaders.push_back( std::move(pReader) );
+	}
+}
+
+size_t l1menu::FullSamplePrivateMembers::threadsToUse( size_t numberOfEvents ) const
+{
+	size_t returnValue=numberOfThreads;
+	if( returnValue==0 ) returnValue=std::thread::hardware_concurrency();
+	if( returnValue==0 ) returnValue=1; // hardware_concurrency() can return zero if it doesn't know
+	return std::max<size_t>( 1, std::min( returnValue, numberOfEvents/MINIMUM_EVENTS_PER_THREAD ) );
+}
+
 double l1menu::FullSamplePrivateMembers::degree( double radian )
 {
 	if( radian<0 ) return 360.+(radian/M_PI*180.);
@@ -91,26 +405,64 @@ double l1menu::FullSamplePrivateMembers::degree( double radian )
 
 int l1menu::FullSamplePrivateMembers::phiINjetCoord( double phi )
 {
-	size_t phiIdx=0;
-	double phidegree=degree( phi );
-	for( size_t idx=0; idx<PHIBINS; idx++ )
-	{
-		if( phidegree>=PHIBIN[idx] and phidegree<PHIBIN[idx+1] ) phiIdx=idx;
-		else if( phidegree>=PHIBIN[PHIBINS-1] || phidegree<=PHIBIN[0] ) phiIdx=idx;
-	}
-	phiIdx=phiIdx+1;
-	if( phiIdx==18 ) phiIdx=0;
-	return int( phiIdx );
+	// The bins are 20 degrees wide starting at PHIBIN[0], except the one either side of zero which
+	// is bin 0. So I can go straight to the bin and then check it against the edges, in case rounding
+	// has put it one out.
+	const double phidegree=degree( phi );
+	if( std::isnan(phidegree) ) return 1; // Never matches anything, which always came out as 1
+	if( phidegree>=PHIBIN[PHIBINS-1] || phidegree<=PHIBIN[0] ) return 0;
+
+	int phiIdx=std::min<int>( PHIBINS-2, std::max<int>( 0, (phidegree-PHIBIN[0])/(PHIBIN[1]-PHIBIN[0]) ) );
+	while( phiIdx>0 && phidegree<PHIBIN[phiIdx] ) --phiIdx;
+	while( phiIdx<static_cast<int>(PHIBINS)-2 && phidegree>=PHIBIN[phiIdx+1] ) ++phiIdx;
+	return phiIdx+1;
 }
 
 int l1menu::FullSamplePrivateMembers::etaINjetCoord( double eta )
 {
-	size_t etaIdx=0.;
-	for( size_t idx=0; idx<ETABINS; idx++ )
+	// Anything below the first edge (or NaN) is in the first region, and anything above the last
+	// in the last region. Otherwise the lookup table gives a first guess which I check against the
+	// edges, in case the value is in a cell with an edge in it or rounding has put it in the wrong
+	// cell.
+	if( !(eta>=ETABIN[0]) ) return 0;
+	if( eta>=ETABIN[ETABINS-1] ) return ETABINS-2;
+
+	const size_t cell=std::min<size_t>( ETALOOKUPCELLS-1, (eta-ETABIN[0])*ETALOOKUPCELLS/(ETABIN[ETABINS-1]-ETABIN[0]) );
+	int etaIdx=ETALOOKUP[cell];
+	while( etaIdx>0 && eta<ETABIN[etaIdx] ) --etaIdx;
+	while( etaIdx<static_cast<int>(ETABINS)-2 && eta>=ETABIN[etaIdx+1] ) ++etaIdx;
+	return etaIdx;
+}
+
+std::vector<int> l1menu::FullSamplePrivateMembers::makeEtaLookup()
+{
+	std::vector<int> returnValue( ETALOOKUPCELLS );
+	int etaIdx=0;
+	for( size_t cell=0; cell<ETALOOKUPCELLS; ++cell )
 	{
-		if( eta>=ETABIN[idx] and eta<ETABIN[idx+1] ) etaIdx=idx;
+		const double cellLowerEdge=ETABIN[0]+(ETABIN[ETABINS-1]-ETABIN[0])*cell/ETALOOKUPCELLS;
+		while( etaIdx<static_cast<int>(ETABINS)-2 && cellLowerEdge>=ETABIN[etaIdx+1] ) ++etaIdx;
+		returnValue[cell]=etaIdx;
 	}
-	return int( etaIdx );
+	return returnValue;
+}
+
+template<class T_input,class T_output>
+void l1menu::FullSamplePrivateMembers::appendPhiINjetCoord( const std::vector<T_input>& values, size_t number, std::vector<T_output>& output )
+{
+	if( number>values.size() ) throw std::out_of_range( "FullSample - the ntuple has fewer phi values than objects" );
+	const size_t originalSize=output.size();
+	output.resize( originalSize+number );
+	for( size_t index=0; index<number; ++index ) output[originalSize+index]=phiINjetCoord( values[index] );
+}
+
+template<class T_input,class T_output>
+void l1menu::FullSamplePrivateMembers::appendEtaINjetCoord( const std::vector<T_input>& values, size_t number, std::vector<T_output>& output )
+{
+	if( number>values.size() ) throw std::out_of_range( "FullSample - the ntuple has fewer eta values than objects" );
+	const size_t originalSize=output.size();
+	output.resize( originalSize+number );
+	for( size_t index=0; index<number; ++index ) output[originalSize+index]=etaINjetCoord( values[index] );
 }
 
 double l1menu::FullSamplePrivateMembers::calculateHTT( const L1Analysis::L1AnalysisDataFormat& event )
@@ -194,166 +546,192 @@ void l1menu::FullSamplePrivateMembers::fillDataStructure( int selectDataInput )
 
 			// NOTES:  Stage 1 has EG Relaxed and EG Isolated.  The isolated EG are a subset of the Relaxed.
 			//         so sort through the relaxed list and flag those that also appear in the isolated list.
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nEG; i++ )
+			if( requiredCollections & l1menu::ITrigger::EG )
 			{
+				// Real phi and eta values, but the triggers want bins so convert them a whole collection at a time
+				appendPhiINjetCoord( inputNtuple.l1upgrade_->egPhi, inputNtuple.l1upgrade_->nEG, analysisDataFormat.Phiel );
+				appendEtaINjetCoord( inputNtuple.l1upgrade_->egEta, inputNtuple.l1upgrade_->nEG, analysisDataFormat.Etael );
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nEG; i++ )
+				{
 
-				analysisDataFormat.Bxel.push_back( inputNtuple.l1upgrade_->egBx.at( i ) );
-				analysisDataFormat.Etel.push_back( inputNtuple.l1upgrade_->egEt.at( i ) );
-				analysisDataFormat.Phiel.push_back( phiINjetCoord( inputNtuple.l1upgrade_->egPhi.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with phiINjetCoord
-				analysisDataFormat.Etael.push_back( etaINjetCoord( inputNtuple.l1upgrade_->egEta.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with etaINjetCoord
+					analysisDataFormat.Bxel.push_back( inputNtuple.l1upgrade_->egBx.at( i ) );
+					analysisDataFormat.Etel.push_back( inputNtuple.l1upgrade_->egEt.at( i ) );
 
-				// Check whether this EG is located in the isolation list
-				bool isolated=false;
-				bool fnd=false;
-				unsigned int isoEG=0;
-				while( !fnd && isoEG < inputNtuple.l1upgrade_->nIsoEG )
-				{
-					if( inputNtuple.l1upgrade_->isoEGPhi.at( isoEG )==inputNtuple.l1upgrade_->egPhi.at( i )
-							&& inputNtuple.l1upgrade_->isoEGEta.at( isoEG )==inputNtuple.l1upgrade_->egEta.at( i ) )
+					// Check whether this EG is located in the isolation list
+					bool isolated=false;
+					bool fnd=false;
+					unsigned int isoEG=0;
+					while( !fnd && isoEG < inputNtuple.l1upgrade_->nIsoEG )
 					{
-						isolated=true;
-						fnd=true;
+						if( inputNtuple.l1upgrade_->isoEGPhi.at( isoEG )==inputNtuple.l1upgrade_->egPhi.at( i )
+								&& inputNtuple.l1upgrade_->isoEGEta.at( isoEG )==inputNtuple.l1upgrade_->egEta.at( i ) )
+						{
+							isolated=true;
+							fnd=true;
+						}
+						isoEG++;
 					}
-					isoEG++;
+					analysisDataFormat.Isoel.push_back( isolated );
+					analysisDataFormat.Nele++;
 				}
-				analysisDataFormat.Isoel.push_back( isolated );
-				analysisDataFormat.Nele++;
 			}
 
 			// Note:  Taus are in the jet list.  Decide what to do with them. For now
 			//  leave them the there as jets (not even flagged..)
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nJets; i++ )
+			if( requiredCollections & l1menu::ITrigger::JETS )
 			{
-
-				// For each jet look for a possible duplicate if so remove it.
-				bool duplicate=false;
-				for( unsigned int j=0; j<i; j++ )
+				// Converted in one go, but only the ones that aren't duplicates are copied into the event
+				phiBinBuffer.clear();
+				etaBinBuffer.clear();
+				appendPhiINjetCoord( inputNtuple.l1upgrade_->jetPhi, inputNtuple.l1upgrade_->nJets, phiBinBuffer );
+				appendEtaINjetCoord( inputNtuple.l1upgrade_->jetEta, inputNtuple.l1upgrade_->nJets, etaBinBuffer );
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nJets; i++ )
 				{
-					if( inputNtuple.l1upgrade_->jetBx.at( i )==inputNtuple.l1upgrade_->jetBx.at( j )
-							&& inputNtuple.l1upgrade_->jetEt.at( i )==inputNtuple.l1upgrade_->jetEt.at( j )
-							&& inputNtuple.l1upgrade_->jetEta.at( i )==inputNtuple.l1upgrade_->jetEta.at( j )
-							&& inputNtuple.l1upgrade_->jetPhi.at( i )==inputNtuple.l1upgrade_->jetPhi.at( j ) )
+
+					// For each jet look for a possible duplicate if so remove it.
+					bool duplicate=false;
+					for( unsigned int j=0; j<i; j++ )
+					{
+						if( inputNtuple.l1upgrade_->jetBx.at( i )==inputNtuple.l1upgrade_->jetBx.at( j )
+								&& inputNtuple.l1upgrade_->jetEt.at( i )==inputNtuple.l1upgrade_->jetEt.at( j )
+								&& inputNtuple.l1upgrade_->jetEta.at( i )==inputNtuple.l1upgrade_->jetEta.at( j )
+								&& inputNtuple.l1upgrade_->jetPhi.at( i )==inputNtuple.l1upgrade_->jetPhi.at( j ) )
+						{
+							duplicate=true;
+							//printf("Duplicate jet found and removed \n");
+						}
+					}
+
+					if( !duplicate )
 					{
-						duplicate=true;
-						//printf("Duplicate jet found and removed \n");
+						analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->jetBx.at( i ) );
+						analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->jetEt.at( i ) );
+						analysisDataFormat.Phijet.push_back( phiBinBuffer[i] );
+						analysisDataFormat.Etajet.push_back( etaBinBuffer[i] );
+						analysisDataFormat.Taujet.push_back( false );
+						analysisDataFormat.isoTaujet.push_back( false );
+						//analysisDataFormat.Fwdjet.push_back(false); //COMMENT OUT IF JET ETA FIX
+
+						//if(fabs(inputNtuple.l1upgrade_->jetEta.at(i))>=3.0) printf("Et %f  Eta  %f  iEta  %f Phi %f  iPhi  %f \n",analysisDataFormat.Etjet.at(analysisDataFormat.Njet),inputNtuple.l1upgrade_->jetEta.at(i),analysisDataFormat.Etajet.at(analysisDataFormat.Njet),inputNtuple.l1upgrade_->jetPhi.at(i),analysisDataFormat.Phijet.at(analysisDataFormat.Njet));
+						//  Eta Jet Fix.  Some Jets with eta>3 has appeared in central jet list.  Move them by hand
+						//  This is a problem in Stage 2 Jet code.
+						(fabs( inputNtuple.l1upgrade_->jetEta.at( i ) )>=3.0) ? analysisDataFormat.Fwdjet.push_back( true ) : analysisDataFormat.Fwdjet.push_back( false );
+
+						analysisDataFormat.Njet++;
 					}
 				}
 
-				if( !duplicate )
+				appendPhiINjetCoord( inputNtuple.l1upgrade_->fwdJetPhi, inputNtuple.l1upgrade_->nFwdJets, analysisDataFormat.Phijet );
+				appendEtaINjetCoord( inputNtuple.l1upgrade_->fwdJetEta, inputNtuple.l1upgrade_->nFwdJets, analysisDataFormat.Etajet );
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nFwdJets; i++ )
 				{
-					analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->jetBx.at( i ) );
-					analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->jetEt.at( i ) );
-					analysisDataFormat.Phijet.push_back( phiINjetCoord( inputNtuple.l1upgrade_->jetPhi.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with phiINjetCoord
-					analysisDataFormat.Etajet.push_back( etaINjetCoord( inputNtuple.l1upgrade_->jetEta.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with etaINjetCoord
+
+					analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->fwdJetBx.at( i ) );
+					analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->fwdJetEt.at( i ) );
 					analysisDataFormat.Taujet.push_back( false );
 					analysisDataFormat.isoTaujet.push_back( false );
-					//analysisDataFormat.Fwdjet.push_back(false); //COMMENT OUT IF JET ETA FIX
-
-					//if(fabs(inputNtuple.l1upgrade_->jetEta.at(i))>=3.0) printf("Et %f  Eta  %f  iEta  %f Phi %f  iPhi  %f \n",analysisDataFormat.Etjet.at(analysisDataFormat.Njet),inputNtuple.l1upgrade_->jetEta.at(i),analysisDataFormat.Etajet.at(analysisDataFormat.Njet),inputNtuple.l1upgrade_->jetPhi.at(i),analysisDataFormat.Phijet.at(analysisDataFormat.Njet));
-					//  Eta Jet Fix.  Some Jets with eta>3 has appeared in central jet list.  Move them by hand
-					//  This is a problem in Stage 2 Jet code.
-					(fabs( inputNtuple.l1upgrade_->jetEta.at( i ) )>=3.0) ? analysisDataFormat.Fwdjet.push_back( true ) : analysisDataFormat.Fwdjet.push_back( false );
+					analysisDataFormat.Fwdjet.push_back( true );
 
 					analysisDataFormat.Njet++;
 				}
 			}
 
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nFwdJets; i++ )
-			{
-
-				analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->fwdJetBx.at( i ) );
-				analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->fwdJetEt.at( i ) );
-				analysisDataFormat.Phijet.push_back( phiINjetCoord( inputNtuple.l1upgrade_->fwdJetPhi.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with phiINjetCoord
-				analysisDataFormat.Etajet.push_back( etaINjetCoord( inputNtuple.l1upgrade_->fwdJetEta.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with etaINjetCoord
-				analysisDataFormat.Taujet.push_back( false );
-				analysisDataFormat.isoTaujet.push_back( false );
-				analysisDataFormat.Fwdjet.push_back( true );
-
-				analysisDataFormat.Njet++;
-			}
-
 			// NOTES:  Stage 1 has Tau Relaxed and TauIsolated.  The isolated Tau are a subset of the Relaxed.
 			//         so sort through the relaxed list and flag those that also appear in the isolated list.
 
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nTau; i++ )
+			if( requiredCollections & l1menu::ITrigger::TAUS )
 			{
-
-				// remove duplicates
-				bool duplicate=false;
-				for( unsigned int j=0; j<i; j++ )
+				phiBinBuffer.clear();
+				etaBinBuffer.clear();
+				appendPhiINjetCoord( inputNtuple.l1upgrade_->tauPhi, inputNtuple.l1upgrade_->nTau, phiBinBuffer );
+				appendEtaINjetCoord( inputNtuple.l1upgrade_->tauEta, inputNtuple.l1upgrade_->nTau, etaBinBuffer );
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nTau; i++ )
 				{
-					if( inputNtuple.l1upgrade_->tauBx.at( i )==inputNtuple.l1upgrade_->tauBx.at( j )
-							&& inputNtuple.l1upgrade_->tauEt.at( i )==inputNtuple.l1upgrade_->tauEt.at( j )
-							&& inputNtuple.l1upgrade_->tauEta.at( i )==inputNtuple.l1upgrade_->tauEta.at( j )
-							&& inputNtuple.l1upgrade_->tauPhi.at( i )==inputNtuple.l1upgrade_->tauPhi.at( j ) )
+
+					// remove duplicates
+					bool duplicate=false;
+					for( unsigned int j=0; j<i; j++ )
 					{
-						duplicate=true;
-						//printf("Duplicate jet found and removed \n");
+						if( inputNtuple.l1upgrade_->tauBx.at( i )==inputNtuple.l1upgrade_->tauBx.at( j )
+								&& inputNtuple.l1upgrade_->tauEt.at( i )==inputNtuple.l1upgrade_->tauEt.at( j )
+								&& inputNtuple.l1upgrade_->tauEta.at( i )==inputNtuple.l1upgrade_->tauEta.at( j )
+								&& inputNtuple.l1upgrade_->tauPhi.at( i )==inputNtuple.l1upgrade_->tauPhi.at( j ) )
+						{
+							duplicate=true;
+							//printf("Duplicate jet found and removed \n");
+						}
 					}
-				}
 
-				if( !duplicate )
-				{
-					analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->tauBx.at( i ) );
-					analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->tauEt.at( i ) );
-					analysisDataFormat.Phijet.push_back( phiINjetCoord( inputNtuple.l1upgrade_->tauPhi.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with phiINjetCoord
-					analysisDataFormat.Etajet.push_back( etaINjetCoord( inputNtuple.l1upgrade_->tauEta.at( i ) ) ); //PROBLEM: real value, trigger wants bin convert with etaINjetCoord
-					analysisDataFormat.Taujet.push_back( true );
-					analysisDataFormat.Fwdjet.push_back( false );
-
-					bool isolated=false;
-					bool fnd=false;
-					unsigned int isoTau=0;
-					while( !fnd && isoTau < inputNtuple.l1upgrade_->nIsoTau )
+					if( !duplicate )
 					{
-						if( inputNtuple.l1upgrade_->isoTauPhi.at( isoTau )==inputNtuple.l1upgrade_->tauPhi.at( i )
-								&& inputNtuple.l1upgrade_->isoTauEta.at( isoTau )==inputNtuple.l1upgrade_->tauEta.at( i ) )
+						analysisDataFormat.Bxjet.push_back( inputNtuple.l1upgrade_->tauBx.at( i ) );
+						analysisDataFormat.Etjet.push_back( inputNtuple.l1upgrade_->tauEt.at( i ) );
+						analysisDataFormat.Phijet.push_back( phiBinBuffer[i] );
+						analysisDataFormat.Etajet.push_back( etaBinBuffer[i] );
+						analysisDataFormat.Taujet.push_back( true );
+						analysisDataFormat.Fwdjet.push_back( false );
+
+						bool isolated=false;
+						bool fnd=false;
+						unsigned int isoTau=0;
+						while( !fnd && isoTau < inputNtuple.l1upgrade_->nIsoTau )
 						{
-							isolated=true;
-							fnd=true;
+							if( inputNtuple.l1upgrade_->isoTauPhi.at( isoTau )==inputNtuple.l1upgrade_->tauPhi.at( i )
+									&& inputNtuple.l1upgrade_->isoTauEta.at( isoTau )==inputNtuple.l1upgrade_->tauEta.at( i ) )
+							{
+								isolated=true;
+								fnd=true;
+							}
+							isoTau++;
 						}
-						isoTau++;
-					}
-					analysisDataFormat.isoTaujet.push_back( isolated );
+						analysisDataFormat.isoTaujet.push_back( isolated );
 
-					analysisDataFormat.Njet++;
-				} // duplicate check
+						analysisDataFormat.Njet++;
+					} // duplicate check
+				}
 			}
 
-			// Fill energy sums  (Are overflow flags accessible in l1extra?)
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nMet; i++ )
+			// Fill energy sums  (Are overflow flags accessible in l1extra?). HTT and HTM are calculated from
+			// the jets above, which is why FullSample::setRequiredCollections() turns the jets on with these.
+			if( requiredCollections & l1menu::ITrigger::ENERGY_SUMS )
 			{
-				//if(inputNtuple.l1upgrade_->metBx.at(i)==0) {
-				analysisDataFormat.ETT=inputNtuple.l1upgrade_->et.at( i );
-				analysisDataFormat.ETM=inputNtuple.l1upgrade_->met.at( i );
-				analysisDataFormat.PhiETM=inputNtuple.l1upgrade_->metPhi.at( i );
-			}
-			analysisDataFormat.OvETT=0; //not available in l1extra
-			analysisDataFormat.OvETM=0; //not available in l1extra
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nMet; i++ )
+				{
+					//if(inputNtuple.l1upgrade_->metBx.at(i)==0) {
+					analysisDataFormat.ETT=inputNtuple.l1upgrade_->et.at( i );
+					analysisDataFormat.ETM=inputNtuple.l1upgrade_->met.at( i );
+					analysisDataFormat.PhiETM=inputNtuple.l1upgrade_->metPhi.at( i );
+				}
+				analysisDataFormat.OvETT=0; //not available in l1extra
+				analysisDataFormat.OvETM=0; //not available in l1extra
 
-			for( unsigned int i=0; i<inputNtuple.l1upgrade_->nMht; i++ )
-			{
-				if( inputNtuple.l1upgrade_->mhtBx.at( i )==0 )
+				for( unsigned int i=0; i<inputNtuple.l1upgrade_->nMht; i++ )
 				{
-					analysisDataFormat.HTT=calculateHTT( analysisDataFormat ); //inputNtuple.l1upgrade_->ht.at(i) ;
-					analysisDataFormat.HTM=calculateHTM( analysisDataFormat ); //inputNtuple.l1upgrade_->mht.at(i) ;
-					analysisDataFormat.PhiHTM=0.; //inputNtuple.l1upgrade_->mhtPhi.at(i) ;
+					if( inputNtuple.l1upgrade_->mhtBx.at( i )==0 )
+					{
+						analysisDataFormat.HTT=calculateHTT( analysisDataFormat ); //inputNtuple.l1upgrade_->ht.at(i) ;
+						analysisDataFormat.HTM=calculateHTM( analysisDataFormat ); //inputNtuple.l1upgrade_->mht.at(i) ;
+						analysisDataFormat.PhiHTM=0.; //inputNtuple.l1upgrade_->mhtPhi.at(i) ;
+					}
 				}
+				analysisDataFormat.OvHTM=0; //not available in l1extra
+				analysisDataFormat.OvHTT=0; //not available in l1extra
 			}
-			analysisDataFormat.OvHTM=0; //not available in l1extra
-			analysisDataFormat.OvHTT=0; //not available in l1extra
 
 			// Get the muon information  from reEmul GMT
-			for( int i=0; i<inputNtuple.gmtEmu_->N; i++ )
+			if( requiredCollections & l1menu::ITrigger::MUONS )
 			{
+				for( int i=0; i<inputNtuple.gmtEmu_->N; i++ )
+				{
 
-				analysisDataFormat.Bxmu.push_back( inputNtuple.gmtEmu_->CandBx[i] );
-				analysisDataFormat.Ptmu.push_back( inputNtuple.gmtEmu_->Pt[i] );
-				analysisDataFormat.Phimu.push_back( inputNtuple.gmtEmu_->Phi[i] );
-				analysisDataFormat.Etamu.push_back( inputNtuple.gmtEmu_->Eta[i] );
-				analysisDataFormat.Qualmu.push_back( inputNtuple.gmtEmu_->Qual[i] );
-				analysisDataFormat.Isomu.push_back( false );
-				analysisDataFormat.Nmu++;
+					analysisDataFormat.Bxmu.push_back( inputNtuple.gmtEmu_->CandBx[i] );
+					analysisDataFormat.Ptmu.push_back( inputNtuple.gmtEmu_->Pt[i] );
+					analysisDataFormat.Phimu.push_back( inputNtuple.gmtEmu_->Phi[i] );
+					analysisDataFormat.Etamu.push_back( inputNtuple.gmtEmu_->Eta[i] );
+					analysisDataFormat.Qualmu.push_back( inputNtuple.gmtEmu_->Qual[i] );
+					analysisDataFormat.Isomu.push_back( false );
+					analysisDataFormat.Nmu++;
+				}
 			}
 
 		break;
@@ -401,6 +779,11 @@ l1menu::FullSample::FullSample()
 	// No operation besides the initialiser list
 }
 
+void l1menu::FullSample::initialiseROOT()
+{
+	l1menu::FullSamplePrivateMembers::initialiseROOT();
+}
+
 l1menu::FullSample::~FullSample()
 {
 	delete pImple_;
@@ -409,13 +792,18 @@ l1menu::FullSample::~FullSample()
 l1menu::FullSample::FullSample( const l1menu::FullSample& otherFullSample )
 	: pImple_( new FullSamplePrivateMembers(*otherFullSample.pImple_) )
 {
-	// No operation besides the initialiser list
+	pImple_->pThisObject_=this; // So that worker readers made from now on have events from this sample
 }
 
 l1menu::FullSample::FullSample( l1menu::FullSample&& otherFullSample ) noexcept
 	: pImple_( otherFullSample.pImple_ )
 {
 	otherFullSample.pImple_=NULL;
+	if( pImple_!=NULL )
+	{
+		pImple_->pThisObject_=this;
+		pImple_->workerReaders.clear(); // Their events would say they came from the other sample
+	}
 }
 
 l1menu::FullSample& l1menu::FullSample::operator=( const l1menu::FullSample& otherFullSample )
@@ -428,39 +816,89 @@ l1menu::FullSample& l1menu::FullSample::operator=( l1menu::FullSample&& otherFul
 {
 	pImple_=otherFullSample.pImple_;
 	otherFullSample.pImple_=NULL;
+	if( pImple_!=NULL )
+	{
+		pImple_->pThisObject_=this;
+		pImple_->workerReaders.clear(); // Their events would say they came from the other sample
+	}
 	return *this;
 }
 
 void l1menu::FullSample::loadFile( const std::string& filename )
 {
-	pImple_->sumOfWeights=-1;
-	pImple_->inputNtuple.Open( filename );
+	pImple_->loadFile( filename, false );
 }
 
 void l1menu::FullSample::loadFilesFromList( const std::string& filenameOfList )
 {
-	pImple_->sumOfWeights=-1;
-	pImple_->inputNtuple.OpenWithList( filenameOfList );
+	pImple_->loadFile( filenameOfList, true );
 }
 
 const l1menu::L1TriggerDPGEvent& l1menu::FullSample::getFullEvent( size_t eventNumber ) const
 {
-	// Make sure the event number requested is valid. Use static_cast to get rid
-	// of the "comparison between signed and unsigned" compiler warning.
-	if( eventNumber>static_cast<size_t>(pImple_->inputNtuple.GetEntries()) ) throw std::runtime_error( "Requested event number is out of range" );
+	// Make sure the event number requested is valid.
+	if( eventNumber>=numberOfEvents() ) throw std::runtime_error( "Requested event number is out of range" );
+
+	return pImple_->readEvent( eventNumber );
+}
 
-	pImple_->inputNtuple.LoadTree(eventNumber);
-	pImple_->inputNtuple.GetEntry(eventNumber);
-	// This next call fills pImple_->currentEvent with the information in pImple_->inputNtuple
-	pImple_->fillDataStructure( 22 );
-	pImple_->fillL1Bits();
+void l1menu::FullSample::setRequiredCollections( const l1menu::TriggerMenu& menu )
+{
+	unsigned int collections=0;
+	for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber ) collections|=menu.getTrigger(triggerNumber).requiredCollections();
+	setRequiredCollections( collections );
+}
 
-	return pImple_->currentEvent;
+void l1menu::FullSample::setRequiredCollections( unsigned int collections )
+{
+	if( collections & l1menu::ITrigger::ENERGY_SUMS ) collections|=l1menu::ITrigger::JETS;
+	pImple_->requiredCollections=collections;
+	pImple_->workerReaders.clear(); // Easier to open them again than change them all
+	pImple_->setBranchStatuses();
+	pImple_->setReadCache();
+}
+
+unsigned int l1menu::FullSample::requiredCollections() const
+{
+	return pImple_->requiredCollections;
+}
+
+void l1menu::FullSample::setNumberOfThreads( size_t numberOfThreads )
+{
+	pImple_->numberOfThreads=numberOfThreads;
+}
+
+size_t l1menu::FullSample::numberOfThreads() const
+{
+	return pImple_->numberOfThreads;
+}
+
+void l1menu::FullSample::setReadCacheSize( size_t bytes )
+{
+	pImple_->readCacheSize=bytes;
+	pImple_->workerReaders.clear();
+	pImple_->setReadCache();
+}
+
+size_t l1menu::FullSample::readCacheSize() const
+{
+	return pImple_->readCacheSize;
+}
+
+void l1menu::FullSample::setSumOfWeightsCacheFile( const std::string& filename )
+{
+	pImple_->sumOfWeightsCacheFile=filename;
+}
+
+const std::string& l1menu::FullSample::sumOfWeightsCacheFile() const
+{
+	return pImple_->sumOfWeightsCacheFile;
 }
 
 size_t l1menu::FullSample::numberOfEvents() const
 {
-	return static_cast<size_t>( pImple_->inputNtuple.GetEntries() );
+	if( pImple_->numberOfEvents==-1 ) pImple_->numberOfEvents=pImple_->inputNtuple.GetEntries();
+	return static_cast<size_t>( pImple_->numberOfEvents );
 }
 
 const l1menu::IEvent& l1menu::FullSample::getEvent( size_t eventNumber ) const
@@ -469,6 +907,71 @@ const l1menu::IEvent& l1menu::FullSample::getEvent( size_t eventNumber ) const
 	return getFullEvent( eventNumber );
 }
 
+std::unique_ptr<l1menu::IEvent> l1menu::FullSample::getEventCopy( size_t eventNumber ) const
+{
+	// Reading from the ntuple fills the one event the sample holds, so only one thread at a time
+	// can do that and copy the result.
+	std::lock_guard<std::mutex> lock( pImple_->currentEventMutex );
+	return std::unique_ptr<l1menu::IEvent>( new l1menu::L1TriggerDPGEvent( getFullEvent(eventNumber) ) );
+}
+
+void l1menu::FullSample::forEachBlock( size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const
+{
+	if( blockSize==0 ) throw std::runtime_error( "FullSample::forEachBlock() was called with a block size of zero" );
+
+	const size_t totalEvents=numberOfEvents();
+	const size_t numberOfThreads=pImple_->threadsToUse( totalEvents );
+	pImple_->createWorkerReaders( numberOfThreads );
+
+	// The events are read a round of blocks at a time. A round is as many whole blocks as fit in
+	// EVENTS_READ_AHEAD events, or one block if they're bigger than that, so the memory used doesn't
+	// depend on the number of threads. Each reader fills a contiguous share of the round's events so
+	// that it goes through its chain in order, which is what the read cache wants. While the function
+	// works through one round on this thread, the next is read on a background thread. That way the
+	// time waiting for the disk overlaps with the function, and the next file in the chain gets
+	// opened before it's needed.
+	const size_t blocksPerRound=std::max<size_t>( 1, FullSamplePrivateMembers::EVENTS_READ_AHEAD/blockSize );
+	const size_t eventsPerRound=blocksPerRound*blockSize;
+	auto readRound=[&]( std::vector< ::FullEventBlock >& blocks, size_t firstEventNumber )
+	{
+		const size_t eventsInRound=std::min( eventsPerRound, totalEvents-firstEventNumber );
+		for( size_t blockNumber=0; blockNumber<blocks.size(); ++blockNumber )
+		{
+			const size_t firstEventInBlock=std::min( eventsInRound, blockNumber*blockSize );
+			blocks[blockNumber].resize( firstEventNumber+firstEventInBlock, std::min( eventsInRound, firstEventInBlock+blockSize )-firstEventInBlock );
+		}
+
+		const size_t threadsInRound=std::min( numberOfThreads, eventsInRound );
+		l1menu::tools::parallelFor( threadsInRound, [&]( size_t threadNumber )
+		{
+			FullSamplePrivateMembers& reader=*pImple_->workerReaders[threadNumber];
+			const size_t lastIndex=(threadNumber+1)*eventsInRound/threadsInRound;
+			for( size_t index=threadNumber*eventsInRound/threadsInRound; index<lastIndex; ++index )
+			{
+				blocks[index/blockSize].setEvent( index%blockSize, reader.readEvent(firstEventNumber+index) );
+			}
+		}, threadsInRound );
+	};
+
+	std::vector< ::FullEventBlock > rounds[2]={ std::vector< ::FullEventBlock >( blocksPerRound, ::FullEventBlock( *this ) ), std::vector< ::FullEventBlock >( blocksPerRound, ::FullEventBlock( *this ) ) };
+	size_t currentRound=0;
+	if( totalEvents>0 ) readRound( rounds[currentRound], 0 );
+	for( size_t firstEventNumber=0; firstEventNumber<totalEvents; firstEventNumber+=eventsPerRound )
+	{
+		// If the function throws, the future's destructor waits for the read to finish before rounds goes
+		std::future<void> nextRound;
+		if( firstEventNumber+eventsPerRound<totalEvents ) nextRound=std::async( std::launch::async, readRound, std::ref(rounds[1-currentRound]), firstEventNumber+eventsPerRound );
+
+		for( const auto& block : rounds[currentRound] )
+		{
+			if( block.size()>0 ) function( block );
+		}
+
+		if( nextRound.valid() ) nextRound.get(); // Passes on any exception from reading
+		currentRound=1-currentRound;
+	}
+}
+
 std::unique_ptr<l1menu::ICachedTrigger> l1menu::FullSample::createCachedTrigger( const l1menu::ITrigger& trigger ) const
 {
 	return std::unique_ptr<l1menu::ICachedTrigger>( new CachedTriggerImplementation(trigger) );
@@ -488,13 +991,54 @@ float l1menu::FullSample::sumOfWeights() const
 {
 	if( pImple_->sumOfWeights==-1 )
 	{
-		pImple_->sumOfWeights=0;
-		for( int eventNumber=0; eventNumber<pImple_->inputNtuple.GetEntries(); ++eventNumber )
+		// Each file is done separately, reading only the weights, and not at all if the cache file has
+		// its total for the same size and modification time. The file totals are added in the order of
+		// the chain so that the answer is the same every time.
+		const std::vector<std::string>& ntupleFilenames=pImple_->inputNtuple.GetListOfNtuples();
+		std::map<std::string,::SumOfWeightsCacheEntry> cache;
+		if( !pImple_->sumOfWeightsCacheFile.empty() ) cache=::readSumOfWeightsCache( pImple_->sumOfWeightsCacheFile );
+
+		std::vector<double> fileSumOfWeights( ntupleFilenames.size(), 0 );
+		std::vector<std::string> absolutePaths( ntupleFilenames.size() );
+		std::vector< ::SumOfWeightsCacheEntry > cacheEntries( ntupleFilenames.size() );
+		std::vector<bool> isCacheable( ntupleFilenames.size(), false );
+		std::vector<size_t> filesToRead;
+		for( size_t fileNumber=0; fileNumber<ntupleFilenames.size(); ++fileNumber )
+		{
+			if( !pImple_->sumOfWeightsCacheFile.empty() ) isCacheable[fileNumber]=::getCacheKey( ntupleFilenames[fileNumber], absolutePaths[fileNumber], cacheEntries[fileNumber] );
+			const auto iFindResult=( isCacheable[fileNumber] ? cache.find( absolutePaths[fileNumber] ) : cache.end() );
+			if( iFindResult!=cache.end() && iFindResult->second.fileSize==cacheEntries[fileNumber].fileSize
+					&& iFindResult->second.modificationTime==cacheEntries[fileNumber].modificationTime )
+			{
+				fileSumOfWeights[fileNumber]=iFindResult->second.sumOfWeights;
+			}
+			else filesToRead.push_back( fileNumber );
+		}
+
+		l1menu::tools::parallelFor( filesToRead.size(), [&]( size_t index )
+		{
+			const size_t fileNumber=filesToRead[index];
+			if( !L1UpgradeNtuple::SumOfWeights( ntupleFilenames[fileNumber], fileSumOfWeights[fileNumber] ) )
+			{
+				throw std::runtime_error( "FullSample::sumOfWeights() couldn't read the weights from "+ntupleFilenames[fileNumber] );
+			}
+		}, pImple_->numberOfThreads );
+
+		// Read the cache again before adding to it, in case another job has written to it in the meantime
+		bool cacheChanged=false;
+		if( !pImple_->sumOfWeightsCacheFile.empty() ) cache=::readSumOfWeightsCache( pImple_->sumOfWeightsCacheFile );
+		for( const auto fileNumber : filesToRead )
 		{
-			pImple_->inputNtuple.LoadTree(eventNumber);
-			pImple_->inputNtuple.GetEntry(eventNumber);
-			pImple_->sumOfWeights+=pImple_->inputNtuple.event_->puWeight;
+			if( !isCacheable[fileNumber] ) continue;
+			cacheEntries[fileNumber].sumOfWeights=fileSumOfWeights[fileNumber];
+			cache[absolutePaths[fileNumber]]=cacheEntries[fileNumber];
+			cacheChanged=true;
 		}
+		if( cacheChanged ) ::writeSumOfWeightsCache( pImple_->sumOfWeightsCacheFile, cache );
+
+		double sumOfWeights=0;
+		for( const auto fileSum : fileSumOfWeights ) sumOfWeights+=fileSum;
+		pImple_->sumOfWeights=sumOfWeights;
 	}
 
 	return pImple_->sumOfWeights;
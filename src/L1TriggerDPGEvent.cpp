@@ -87,6 +87,11 @@ float l1menu::L1TriggerDPGEvent::weight() const
 	return pImple_->weight;
 }
 
+float l1menu::L1TriggerDPGEvent::weightSquared() const
+{
+	return pImple_->weight*pImple_->weight;
+}
+
 const l1menu::ISample& l1menu::L1TriggerDPGEvent::sample() const
 {
 	return *pImple_->pParentSample_;
@@ -2,10 +2,9 @@
 
 #include "l1menu/ITrigger.h"
 #include "l1menu/ReducedSample.h"
-#include "protobuf/l1menu.pb.h"
 
 l1menu::ReducedEvent::ReducedEvent( const l1menu::ReducedSample& sample )
-	: sample_(sample)
+	: eventNumber_(0), pParameterColumns_(nullptr), pWeights_(nullptr), pWeightsSquared_(nullptr), sample_(sample)
 {
 	// No operation
 }
@@ -17,7 +16,7 @@ l1menu::ReducedEvent::~ReducedEvent()
 
 float l1menu::ReducedEvent::parameterValue( ParameterID parameterNumber ) const
 {
-	return pProtobufEvent_->threshold(parameterNumber);
+	return pParameterColumns_[parameterNumber][eventNumber_];
 }
 
 bool l1menu::ReducedEvent::passesTrigger( const l1menu::ITrigger& trigger ) const
@@ -35,8 +34,13 @@ bool l1menu::ReducedEvent::passesTrigger( const l1menu::ITrigger& trigger ) cons
 
 float l1menu::ReducedEvent::weight() const
 {
-	if( pProtobufEvent_->has_weight() ) return pProtobufEvent_->weight();
-	else return 1;
+	return pWeights_[eventNumber_];
+}
+
+float l1menu::ReducedEvent::weightSquared() const
+{
+	if( pWeightsSquared_==nullptr ) return pWeights_[eventNumber_]*pWeights_[eventNumber_];
+	else return pWeightsSquared_[eventNumber_];
 }
 
 const l1menu::ISample& l1menu::ReducedEvent::sample() const
@@ -3,9 +3,18 @@
 #include <vector>
 #include <stdexcept>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cmath>
 #include <algorithm>
+#include <limits>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
 #include "l1menu/ReducedEvent.h"
 #include "l1menu/FullSample.h"
 #include "l1menu/TriggerMenu.h"
@@ -13,14 +22,26 @@
 #include "l1menu/ICachedTrigger.h"
 #include "l1menu/L1TriggerDPGEvent.h"
 #include "l1menu/IEvent.h"
+#include "l1menu/IEventBlock.h"
 #include "l1menu/IMenuRate.h"
 #include "l1menu/ITriggerRate.h"
 #include "l1menu/tools/miscellaneous.h"
 #include "./implementation/MenuRateImplementation.h"
+#include "./implementation/ChunkedSampleFile.h"
+#include "./implementation/ThresholdGrid.h"
+#include "./implementation/ThresholdIndex.h"
 #include "protobuf/l1menu.pb.h"
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/gzip_stream.h>
 
+//
+// Forward declarations
+//
+namespace l1menu
+{
+	class ReducedSamplePrivateMembers;
+}
+
 namespace // unnamed namespace
 {
 	/** @brief Sentry that closes a Unix file descriptor when it goes out of scope.
@@ -36,7 +57,371 @@ namespace // unnamed namespace
 		int fileDescriptor_;
 	};
 
+	/** @brief Opens a file to be read with protobuf, and closes it again when it goes out of scope.
+	 */
+	class ProtobufInputFile
+	{
+	public:
+		ProtobufInputFile( const std::string& filename )
+			: fileDescriptor_( open( filename.c_str(), O_RDONLY ) ), fileSentry_( fileDescriptor_ ), fileInput_( fileDescriptor_ )
+		{
+			if( fileDescriptor_<0 ) throw std::runtime_error( "ReducedSample - couldn't open the file "+filename );
+		}
+		int fileDescriptor() const { return fileDescriptor_; }
+		google::protobuf::io::FileInputStream& stream() { return fileInput_; }
+	private:
+		int fileDescriptor_;
+		UnixFileSentry fileSentry_; // Use this as an exception safe way of closing the input file
+		google::protobuf::io::FileInputStream fileInput_;
+	};
+
+	/** @brief Returns true if both filenames refer to the same file, false if they don't or either doesn't exist. */
+	bool isSameFile( const std::string& filename, const std::string& otherFilename )
+	{
+		struct stat fileStatus, otherFileStatus;
+		if( stat( filename.c_str(), &fileStatus )!=0 || stat( otherFilename.c_str(), &otherFileStatus )!=0 ) return false;
+		return fileStatus.st_dev==otherFileStatus.st_dev && fileStatus.st_ino==otherFileStatus.st_ino;
+	}
+
+	/** @brief Sentry that maps a file into memory read only, and unmaps it when it goes out of scope.
+	 *
+	 * The mapping is shared, so several processes reading the same file share the page cache. The
+	 * file descriptor can be closed once this has been constructed.
+	 */
+	class MemoryMappedFile
+	{
+	public:
+		MemoryMappedFile( int fileDescriptor, size_t size ) : size_(size)
+		{
+			pData_=mmap( nullptr, size_, PROT_READ, MAP_SHARED, fileDescriptor, 0 );
+			if( pData_==MAP_FAILED ) throw std::runtime_error( "ReducedSample initialise from file - unable to memory map the file" );
+		}
+		~MemoryMappedFile() { munmap( pData_, size_ ); }
+		const char* data() const { return static_cast<const char*>(pData_); }
+		size_t size() const { return size_; }
+	private:
+		MemoryMappedFile( const MemoryMappedFile& ); // Not copyable
+		MemoryMappedFile& operator=( const MemoryMappedFile& );
+		void* pData_;
+		size_t size_;
+	};
+
+	/** @brief Rounds the number up to the next multiple of alignment. */
+	size_t roundUp( size_t number, size_t alignment )
+	{
+		return ( (number+alignment-1)/alignment )*alignment;
+	}
+
+	/** @brief Returns true if a trigger stored in a sample can be used to work out whether events pass the given trigger.
+	 *
+	 * The names have to match, and the versions too unless allowOlderVersion is true in which case the
+	 * sample's version can be older. All of the non threshold parameters have to match, i.e. the sample
+	 * has to have been made with the same eta cuts or whatever. I don't care if the thresholds don't
+	 * match because that's what's stored in the sample.
+	 */
+	bool sampleTriggerMatches( const l1menu::ITrigger& triggerInSample, const l1menu::ITrigger& trigger, bool allowOlderVersion )
+	{
+		if( triggerInSample.name()!=trigger.name() ) return false;
+		if( allowOlderVersion )
+		{
+			if( triggerInSample.version()>trigger.version() ) return false;
+		}
+		else
+		{
+			if( triggerInSample.version()!=trigger.version() ) return false;
+		}
+
+		std::vector<std::string> parameterNames=l1menu::tools::getNonThresholdParameterNames( trigger );
+		for( const auto& parameterName : parameterNames )
+		{
+			if( trigger.parameter(parameterName)!=triggerInSample.parameter(parameterName) ) return false;
+		}
+
+		return true;
+	}
+
+	/** @brief What ReducedSample::getTriggerParameterIdentifiers() finds for a trigger, so that it only has to be worked out once.
+	 */
+	struct TriggerColumns
+	{
+		bool triggerWasFound;
+		std::map<std::string,l1menu::ReducedEvent::ParameterID> parameterIdentifiers;
+	};
+
+	/** @brief A key that's the same for all triggers of the same type, i.e. the same name and version. */
+	std::string triggerTypeKey( const l1menu::ITrigger& trigger )
+	{
+		std::string returnValue=trigger.name();
+		const unsigned int version=trigger.version();
+		returnValue.push_back( '\0' );
+		returnValue.append( reinterpret_cast<const char*>(&version), sizeof(version) );
+		return returnValue;
+	}
+
+	/** @brief A range of events from one ntuple file, and the thresholds worked out for them.
+	 *
+	 * Used by ReducedSample::addNtupleFiles() so that each range can be worked on in a different thread
+	 * and the results added to the sample in order afterwards.
+	 */
+	struct NtupleEventRange
+	{
+		size_t fileNumber;
+		size_t firstEventNumber;
+		size_t lastEventNumber; ///< @brief One past the last event in the range
+		std::vector< std::vector<float> > thresholdColumns;
+		std::vector<float> weights;
+		std::vector<float> weightsSquared;
+	};
+
+	/** @brief A copy of the menu where each trigger in the grid is replaced by a copy for every combination of the values listed for it. */
+	l1menu::TriggerMenu expandOverParameterGrid( const l1menu::TriggerMenu& menu, const l1menu::ReducedSample::ParameterGrid& grid )
+	{
+		// A misspelt trigger name would otherwise just be ignored
+		for( const auto& triggerGrid : grid )
+		{
+			bool triggerIsInMenu=false;
+			for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber )
+			{
+				if( menu.getTrigger(triggerNumber).name()==triggerGrid.first ) triggerIsInMenu=true;
+			}
+			if( !triggerIsInMenu ) throw std::runtime_error( "ReducedSample - the grid has the trigger \""+triggerGrid.first+"\" which isn't in the menu" );
+		}
+
+		l1menu::TriggerMenu returnValue;
+		for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber )
+		{
+			const l1menu::ITrigger& trigger=menu.getTrigger(triggerNumber);
+			const auto iTriggerGrid=grid.find( trigger.name() );
+			if( iTriggerGrid==grid.end() )
+			{
+				returnValue.addTrigger( trigger );
+				continue;
+			}
+
+			// Check the parameters before doing anything with them. ITrigger::parameter() would throw for
+			// a name that doesn't exist, but varying a threshold would quietly give nonsense.
+			const auto parameterNames=trigger.parameterNames();
+			const auto thresholdNames=l1menu::tools::getThresholdNames(trigger);
+			for( const auto& parameterValues : iTriggerGrid->second )
+			{
+				if( std::find( parameterNames.begin(), parameterNames.end(), parameterValues.first )==parameterNames.end() ) throw std::runtime_error( "ReducedSample - the grid has a parameter \""+parameterValues.first+"\" that "+trigger.name()+" doesn't have" );
+				if( std::find( thresholdNames.begin(), thresholdNames.end(), parameterValues.first )!=thresholdNames.end() ) throw std::runtime_error( "ReducedSample - the grid can't be used for \""+parameterValues.first+"\" in "+trigger.name()+" because it's a threshold" );
+				if( parameterValues.second.empty() ) throw std::runtime_error( "ReducedSample - the grid has no values for \""+parameterValues.first+"\" in "+trigger.name() );
+			}
+
+			// Step through every combination of values, like the digits of a counter
+			std::vector<size_t> valueIndices( iTriggerGrid->second.size(), 0 );
+			bool finished=false;
+			while( !finished )
+			{
+				l1menu::ITrigger& newTrigger=returnValue.addTrigger( trigger );
+				size_t parameterNumber=0;
+				for( const auto& parameterValues : iTriggerGrid->second )
+				{
+					newTrigger.parameter(parameterValues.first)=parameterValues.second[valueIndices[parameterNumber]];
+					++parameterNumber;
+				}
+
+				finished=true;
+				parameterNumber=0;
+				for( const auto& parameterValues : iTriggerGrid->second )
+				{
+					if( ++valueIndices[parameterNumber]<parameterValues.second.size() )
+					{
+						finished=false;
+						break;
+					}
+					valueIndices[parameterNumber]=0;
+					++parameterNumber;
+				}
+			}
+		}
+
+		return returnValue;
+	}
+
+	/** @brief Whether any of the columns in a chunked file only store the values that aren't -1. */
+	bool anyColumnSparse( const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings )
+	{
+		for( const auto& encoding : columnEncodings )
+		{
+			if( encoding.sparse ) return true;
+		}
+		return false;
+	}
+
+	/** @brief Adds the triggers listed in the header onto the end of the menu, with the parameters set to what they were when the sample was made. */
+	void addHeaderTriggersToMenu( const l1menuprotobuf::SampleHeader& header, l1menu::TriggerMenu& menu )
+	{
+		for( const auto& inputTrigger : header.trigger() )
+		{
+			l1menu::ITrigger& trigger=menu.addTrigger( inputTrigger.name(), inputTrigger.version() );
+
+			// Run through all of the parameters and set them to what they were
+			// when the sample was made.
+			for( const auto& inputParameter : inputTrigger.parameter() )
+			{
+				trigger.parameter(inputParameter.name())=inputParameter.value();
+			}
+
+			// I should probably check the threshold names exist. I'll do it another time.
+		}
+	}
+
+	/** @brief Hashes and compares events by their thresholds, so that event numbers can be used as keys of
+	 * an unordered_map that finds identical events.
+	 */
+	class EventThresholdsComparison
+	{
+	public:
+		EventThresholdsComparison( const std::vector<const float*>& parameterColumns ) : parameterColumns_(parameterColumns) {}
+		size_t operator()( size_t eventNumber ) const
+		{
+			size_t hash=0;
+			for( const float* pColumn : parameterColumns_ ) hash^=std::hash<float>()( pColumn[eventNumber] )+0x9e3779b9+(hash<<6)+(hash>>2);
+			return hash;
+		}
+		bool operator()( size_t eventNumber, size_t otherEventNumber ) const
+		{
+			for( const float* pColumn : parameterColumns_ )
+			{
+				if( pColumn[eventNumber]!=pColumn[otherEventNumber] ) return false;
+			}
+			return true;
+		}
+	private:
+		const std::vector<const float*>& parameterColumns_;
+	};
+
+	/** @brief Statistics for a range of events in a ReducedSample, so that it can be skipped if none of them can pass.
+	 */
+	struct ZoneMap
+	{
+		double sumOfWeights;
+		std::vector<float> maximumValues; ///< @brief The largest value in each parameter column, or infinity if there's a NaN
+		/// @brief For each parameter column in turn, candidateWordsPerColumn words with a bit set (lowest bit first) for each event whose value isn't -1
+		std::vector<uint64_t> candidateBits;
+		size_t candidateWordsPerColumn;
+	};
+
+	/** @brief Decides from the largest value of each column in a range of events whether any of them could pass any of a set of triggers.
+	 *
+	 * An event passes a trigger if none of its values are below the trigger's thresholds, so if any
+	 * of a trigger's thresholds are above the largest value for it none of the events can pass. The
+	 * thresholds are copied when this is constructed, so the triggers can change afterwards.
+	 */
+	class ZoneMapCheck
+	{
+	public:
+		ZoneMapCheck( const l1menu::ReducedSample& sample, const std::vector<const l1menu::ITrigger*>& triggers )
+		{
+			for( const auto pTrigger : triggers )
+			{
+				std::vector< std::pair<l1menu::ReducedEvent::ParameterID,float> > thresholds;
+				std::vector<l1menu::ReducedEvent::ParameterID> candidateColumns;
+				for( const auto& identifier : sample.getTriggerParameterIdentifiers(*pTrigger) )
+				{
+					const float threshold=pTrigger->parameter(identifier.first);
+					thresholds.push_back( std::make_pair( identifier.second, threshold ) );
+					// A value of -1 is below this threshold, so only events with a value can pass
+					if( threshold>-1 ) candidateColumns.push_back( identifier.second );
+				}
+				triggerThresholds_.push_back( thresholds );
+				triggerCandidateColumns_.push_back( candidateColumns );
+			}
+		}
+		/** @brief pMaximumValues has the largest value for each of the sample's parameter columns. */
+		bool anyCouldPass( const float* pMaximumValues ) const
+		{
+			for( size_t triggerNumber=0; triggerNumber<triggerThresholds_.size(); ++triggerNumber )
+			{
+				if( couldPass( triggerNumber, pMaximumValues ) ) return true;
+			}
+			return false;
+		}
+		/** @brief Sets the bits in candidateBits for the events in the zone that might pass any of the triggers.
+		 *
+		 * Events can only pass a trigger if they have a value in every column where its threshold is above
+		 * -1. Returns false, leaving candidateBits undefined, if one of the triggers that could pass has no
+		 * such columns, since then every event is a candidate.
+		 */
+		bool findCandidates( const ::ZoneMap& zoneMap, std::vector<uint64_t>& candidateBits ) const
+		{
+			const size_t numberOfWords=zoneMap.candidateWordsPerColumn;
+			candidateBits.assign( numberOfWords, 0 );
+			std::vector<uint64_t> triggerBits( numberOfWords );
+			for( size_t triggerNumber=0; triggerNumber<triggerThresholds_.size(); ++triggerNumber )
+			{
+				if( !couldPass( triggerNumber, zoneMap.maximumValues.data() ) ) continue;
+
+				const auto& candidateColumns=triggerCandidateColumns_[triggerNumber];
+				if( candidateColumns.empty() ) return false;
+				triggerBits.assign( numberOfWords, ~static_cast<uint64_t>(0) );
+				for( const auto columnNumber : candidateColumns )
+				{
+					const uint64_t* pColumnBits=&zoneMap.candidateBits[columnNumber*numberOfWords];
+					for( size_t word=0; word<numberOfWords; ++word ) triggerBits[word]&=pColumnBits[word];
+				}
+				for( size_t word=0; word<numberOfWords; ++word ) candidateBits[word]|=triggerBits[word];
+			}
+			return true;
+		}
+	private:
+		bool couldPass( size_t triggerNumber, const float* pMaximumValues ) const
+		{
+			for( const auto& threshold : triggerThresholds_[triggerNumber] )
+			{
+				if( pMaximumValues[threshold.first]<threshold.second ) return false;
+			}
+			return true;
+		}
+		std::vector< std::vector< std::pair<l1menu::ReducedEvent::ParameterID,float> > > triggerThresholds_;
+		std::vector< std::vector<l1menu::ReducedEvent::ParameterID> > triggerCandidateColumns_; ///< @brief The columns where each trigger's threshold is above -1
+	};
+
+	/** @brief The IEventBlock implementation for ReducedSample.
+	 *
+	 * Usually just a range of the sample's columns. columnOffset() is where the block starts in the columns,
+	 * which isn't necessarily the same as firstEventNumber() if not all of the sample is in memory. If
+	 * setGathered() was used instead of setRange() the events are the ones at columnIndices() in the
+	 * columns, and the weights are copies gathered from those indices.
+	 */
+	class ReducedEventBlock : public l1menu::IEventBlock
+	{
+	public:
+		ReducedEventBlock( const l1menu::ReducedSample& sample, l1menu::ReducedSamplePrivateMembers& sampleMembers )
+			: sample_(sample), sampleMembers_(sampleMembers), firstEventNumber_(0), size_(0), columnOffset_(0), pColumnIndices_(nullptr), pGatheredWeights_(nullptr), pGatheredWeightsSquared_(nullptr) {}
+		void setRange( size_t firstEventNumber, size_t size, size_t columnOffset ) { firstEventNumber_=firstEventNumber; size_=size; columnOffset_=columnOffset; pColumnIndices_=nullptr; }
+		/** @brief Only valid when all of the sample is in memory, so that column indices are event numbers. pWeightsSquared can be null if the sample has none. */
+		void setGathered( const size_t* pColumnIndices, const float* pWeights, const float* pWeightsSquared, size_t size )
+		{
+			pColumnIndices_=pColumnIndices; pGatheredWeights_=pWeights; pGatheredWeightsSquared_=pWeightsSquared;
+			size_=size; columnOffset_=0; firstEventNumber_=pColumnIndices[0];
+		}
+		size_t columnOffset() const { return columnOffset_; }
+		/** @brief The column index of each event, or nullptr if the events are contiguous from columnOffset(). */
+		const size_t* columnIndices() const { return pColumnIndices_; }
+		virtual size_t firstEventNumber() const { return firstEventNumber_; }
+		virtual size_t size() const { return size_; }
+		virtual const float* weights() const;
+		virtual const float* weightsSquared() const;
+		virtual const l1menu::IEvent& getEvent( size_t index ) const;
+		virtual const l1menu::ISample& sample() const { return sample_; }
+	private:
+		const l1menu::ReducedSample& sample_;
+		l1menu::ReducedSamplePrivateMembers& sampleMembers_;
+		size_t firstEventNumber_;
+		size_t size_;
+		size_t columnOffset_;
+		const size_t* pColumnIndices_;
+		const float* pGatheredWeights_;
+		const float* pGatheredWeightsSquared_;
+	};
+
 	/** @brief An object that stores pointers to trigger parameters to avoid costly string comparisons.
+	 *
+	 * Also keeps a reference to the sample's column pointers, so that the event's values can be
+	 * read straight out of the contiguous parameter columns.
 	 *
 	 * @author Mark Grimes (mark.grimes@bristol.ac.uk)
 	 * @date 26/Jun/2013
@@ -44,7 +429,8 @@ namespace // unnamed namespace
 	class CachedTriggerImplementation : public l1menu::ICachedTrigger
 	{
 	public:
-		CachedTriggerImplementation( const l1menu::ReducedSample& sample, const l1menu::ITrigger& trigger )
+		CachedTriggerImplementation( const l1menu::ReducedSample& sample, const l1menu::ITrigger& trigger, const std::vector<const float*>& parameterColumns )
+			: parameterColumns_(parameterColumns)
 		{
 			const auto& parameterIdentifiers=sample.getTriggerParameterIdentifiers(trigger);
 
@@ -60,30 +446,43 @@ namespace // unnamed namespace
 			// it's not even worth it. Anyway, I'm banking that no one will ever pass an
 			// event that wasn't created with the same sample that this proxy was created
 			// with.
-			const l1menu::ReducedEvent* pEvent=static_cast<const l1menu::ReducedEvent*>(&event);
+			const size_t eventNumber=static_cast<const l1menu::ReducedEvent*>(&event)->eventNumber();
 			for( const auto& identifier : identifiers_ )
 			{
-				if( pEvent->parameterValue(identifier.first) < *identifier.second ) return false;
+				if( parameterColumns_[identifier.first][eventNumber] < *identifier.second ) return false;
 			}
 
 			// If control got this far then all of the thresholds passed, and
 			// I can pass the event.
 			return true;
 		}
+		virtual void apply( const l1menu::IEventBlock& eventBlock, bool* pResults )
+		{
+			// Same reasoning as above for the static_cast. Loop over each parameter in turn so that
+			// the inner loop just runs along one column.
+			const ReducedEventBlock& block=*static_cast<const ReducedEventBlock*>(&eventBlock);
+			const size_t columnOffset=block.columnOffset();
+			const size_t* pColumnIndices=block.columnIndices();
+			const size_t blockSize=eventBlock.size();
+			std::fill( pResults, pResults+blockSize, true );
+			for( const auto& identifier : identifiers_ )
+			{
+				const float* pColumn=parameterColumns_[identifier.first]+columnOffset;
+				const float threshold=*identifier.second;
+				if( pColumnIndices==nullptr )
+				{
+					for( size_t index=0; index<blockSize; ++index ) pResults[index]=pResults[index] && !(pColumn[index]<threshold);
+				}
+				else
+				{
+					for( size_t index=0; index<blockSize; ++index ) pResults[index]=pResults[index] && !(pColumn[pColumnIndices[index]]<threshold);
+				}
+			}
+		}
 	protected:
 		std::vector< std::pair<l1menu::ReducedEvent::ParameterID,const float*> > identifiers_;
+		const std::vector<const float*>& parameterColumns_; ///< @brief Reference so that it stays valid if the sample's columns are reallocated
 	}; // end of class ReducedSampleCachedTrigger
-
-	float sumWeights( const l1menuprotobuf::Run& run )
-	{
-		float returnValue=0;
-		for( const auto& event : run.event() )
-		{
-			if( event.has_weight() ) returnValue+=event.weight();
-			else returnValue+=1;
-		}
-		return returnValue;
-	}
 }
 
 namespace l1menu
@@ -99,27 +498,198 @@ namespace l1menu
 		l1menu::TriggerMenu mutableTriggerMenu_;
 	public:
 		ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const l1menu::TriggerMenu& newTriggerMenu );
-		ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const std::string& filename );
+		/** @brief Loads from file, keeping only the triggers needed for pProjectionMenu if it's not null. */
+		ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const std::string& filename, bool streamFromFile, const l1menu::TriggerMenu* pProjectionMenu );
 		//void copyMenuToProtobufSample();
+		/** @brief Checks the magic number at the start of the file and returns the file format version. */
+		google::protobuf::uint32 readFileFormatVersion( google::protobuf::io::ZeroCopyInputStream& fileInput ) const;
+		/** @brief Reads the gzipped protobuf format (version 1) after the magic number and version.
+		 *
+		 * The header is read into the header parameter, and then the function is called for each Run
+		 * in the file. The Run is only valid for the duration of the call. If the function is empty
+		 * only the header is read. */
+		void readProtobufRuns( google::protobuf::io::ZeroCopyInputStream& fileInput, l1menuprotobuf::SampleHeader& header, const std::function<void(const l1menuprotobuf::Run&)>& function ) const;
+		/** @brief Reads the whole of the protobuf format (version 1) into the columns. */
+		void readProtobufFormat( google::protobuf::io::ZeroCopyInputStream& fileInput );
+		/** @brief Maps the file into memory and points the columns at it (version 2). */
+		void readMemoryMappedFormat( int fileDescriptor );
+		/** @brief Reads the chunked format (version 3), decompressing the chunks in parallel. */
+		void readChunkedFormat( const std::string& filename );
+		/** @brief Sets protobufSampleHeader and the columns from the header read from a file.
+		 *
+		 * If there's a projection menu only the triggers that it needs are kept, and fileColumnNumbers
+		 * is filled with where each of their columns are in the file. */
+		void setHeaderFromFile( const l1menuprotobuf::SampleHeader& fileHeader );
+		/** @brief The number in the file of the given parameter column. */
+		size_t fileColumnNumber( size_t columnNumber ) const;
+		/** @brief One pointer for every column in the file, pointing at the given offset into thresholdColumns for
+		 * the columns that are kept and null for those that aren't. Used to read chunks from a chunked file. */
+		std::vector<float*> fileColumnPointers( size_t offset );
+		/** @brief Picks out the column encodings for the columns that are kept from those for every column in the file. */
+		std::vector<l1menu::implementation::ColumnEncoding> projectColumnEncodings( const std::vector<l1menu::implementation::ColumnEncoding>& fileColumnEncodings ) const;
+		/** @brief Sets thresholdIndex from the chunked file, leaving it empty if the file doesn't have one. */
+		void readThresholdIndex( const l1menu::implementation::ChunkedSampleFileReader& reader );
+		/** @brief Sets thresholdGrids from the column encodings in a chunked file, leaving it empty if none are quantised. */
+		void setGridsFromColumnEncodings( const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings );
+		/** @brief Makes sure there is one column for each of the parameters listed in protobufSampleHeader. */
+		void resizeColumnsFromHeader();
+		/** @brief Creates mutableTriggerMenu_ from the triggers listed in protobufSampleHeader. */
+		void copyMenuFromProtobufHeader();
+		/** @brief Adds the events in a protobuf Run onto the end of the columns. */
+		void appendRun( const l1menuprotobuf::Run& run );
+		/** @brief Makes sure parameterColumns and the event point to the current column memory.
+		 * Needs to be called whenever the columns could have been reallocated. */
+		void updateColumnPointers();
+		/** @brief If the data is in a memory mapped file, copies it into thresholdColumns and weights so
+		 * that it can be modified. Then releases the mapping. */
+		void copyMappedFileToColumns();
+		/** @brief If the sample is being streamed from file, reads the whole file into the columns so that
+		 * it can be used like any other sample. */
+		void loadStreamedFile();
+		/** @brief Loops over the file given to the streaming constructor, one Run at a time. Each Run
+		 * is put in the columns and then the blocks are given to the function.
+		 *
+		 * If pZoneMapCheck isn't null, chunks of a chunked file where it says no event can pass aren't
+		 * read. The summed weight of the events in them is returned. */
+		double streamBlocks( const l1menu::ReducedSample& thisObject, size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function, const ::ZoneMapCheck* pZoneMapCheck=nullptr );
+		/** @brief Fills zoneMaps for the events in the columns, if it hasn't been done already. Can be
+		 * called from several threads at once. */
+		void buildZoneMaps();
+		/** @brief Reads through the streamed file to count the events and sum their weights, if it hasn't been done already. */
+		void calculateStreamedTotals();
+		void saveChunkedFormat( const std::string& filename ) const;
+		/** @brief Adds the events onto the end of an existing chunked file, after checking the menu matches. */
+		void appendChunkedFormat( const std::string& filename ) const;
+		/** @brief Splits the events into chunks of eventsPerRun events and gives them to the writer. */
+		void writeChunks( l1menu::implementation::ChunkedSampleFileWriter& writer ) const;
+		/** @brief How createWriterLike() stores the columns. The same as the file being streamed if that's a
+		 * chunked file, otherwise empty (all FLOAT32) unless sparseEncoding is set. */
+		std::vector<l1menu::implementation::ColumnEncoding> writerColumnEncodings() const;
+		/** @brief Creates a writer for a new chunked file that stores events the same way as the file being
+		 * streamed, if that's a chunked file, so that the chunks can be copied across as they are. The sums
+		 * of squared weights are stored if hasWeightsSquared is true. */
+		std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> createWriterLike( const std::string& filename, bool hasWeightsSquared ) const;
+		/** @brief Creates a writer for a new chunked file with this sample's header and codec, but the given column encodings. */
+		std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> createWriter( const std::string& filename, const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings, bool hasWeightsSquared ) const;
+		/** @brief Copies the events to chunked files in a single pass, one Run or chunk at a time if streaming.
+		 *
+		 * Events numbered from shardBoundaries[i] up to (but not including) shardBoundaries[i+1] go to
+		 * writers[i]. Whole chunks that go to a writer with the same codec and column encodings are copied
+		 * without being decompressed. */
+		void copyEventsToWriters( const l1menu::ReducedSample& thisObject, const std::vector<size_t>& shardBoundaries, const std::vector<l1menu::implementation::ChunkedSampleFileWriter*>& writers );
+		void saveProtobufFormat( int fileDescriptor ) const;
+		void saveMemoryMappedFormat( int fileDescriptor ) const;
+		/** @brief Works out the tightest thresholds each trigger passes for a range of events in the FullSample.
+		 *
+		 * The thresholds are added onto the end of newThresholdColumns, which must have the same number
+		 * of columns as thresholdColumns, and the weights onto newWeights. The squared weights are added
+		 * onto newWeightsSquared if eventsAreCollapsed. Nothing in this object is changed, so it can be
+		 * called from several threads at once as long as each has its own FullSample and output vectors. */
+		void reduceEvents( const l1menu::FullSample& originalSample, size_t firstEventNumber, size_t lastEventNumber, std::vector< std::vector<float> >& newThresholdColumns, std::vector<float>& newWeights, std::vector<float>& newWeightsSquared ) const;
+		/** @brief Adds the weights of the events from firstEventNumber onwards onto sumOfWeights, and updates
+		 * everything else that depends on the events after some have been added onto the end of the columns. */
+		void finishAddingEvents( size_t firstEventNumber );
+		/** @brief Replaces all events with identical thresholds by a single row with their summed weight and summed squared weight. */
+		void collapseIdenticalEvents();
+		/** @brief Which columns hold the thresholds for the trigger, remembered after the first time it's asked for.
+		 *
+		 * The lookup is keyed on the trigger's name, version and non threshold parameter values, which are
+		 * all that sampleTriggerMatches() looks at. The menu doesn't change after construction so nothing
+		 * in the cache ever goes stale, and entries are never removed so the reference stays valid. Can be
+		 * called from several threads at once. */
+		const ::TriggerColumns& triggerColumns( const l1menu::ITrigger& trigger, bool allowOlderVersion );
+		/** @brief Works out triggerColumns() without the cache, with a pass over the menu. */
+		::TriggerColumns findTriggerColumns( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const;
+		/** @brief Points the event at the given position in the columns and returns it. */
+		const l1menu::ReducedEvent& eventAtColumnIndex( size_t columnIndex );
 		l1menu::ReducedEvent event;
 		const l1menu::TriggerMenu& triggerMenu; // External const access to mutableTriggerMenu_
 		float eventRate;
 		float sumOfWeights;
 		l1menuprotobuf::SampleHeader protobufSampleHeader;
-		// Protobuf doesn't implement move semantics so I'll use pointers
-		std::vector<std::unique_ptr<l1menuprotobuf::Run> > protobufRuns;
+		// The events are stored as columns rather than as individual protobuf Events, i.e. one
+		// contiguous array for each varying parameter (in the order they're listed in the header)
+		// plus one for the weights. Loops over events then just run along arrays.
+		std::vector< std::vector<float> > thresholdColumns;
+		std::vector<float> weights;
+		// If identical events have been collapsed into single rows this is the sum of their squared
+		// weights for each row, so that errors can still be calculated. Otherwise it's empty.
+		bool eventsAreCollapsed;
+		std::vector<float> weightsSquared;
+		// If the thresholds are quantised this has the grid for each column, otherwise it's empty.
+		std::vector<l1menu::implementation::ThresholdGrid> thresholdGrids;
+		// If the threshold index has been built or loaded this has the index for each column, otherwise
+		// it's empty. Anything that changes the thresholds or weights has to clear it.
+		std::vector<l1menu::implementation::ThresholdIndex> thresholdIndex;
+		// Statistics for each consecutive ZONE_MAP_SIZE events in the columns. Only worked out when first
+		// needed, and has to be cleared whenever the columns change. The mutex is so that const methods
+		// on several threads can all ask for them to be built at once.
+		std::vector<::ZoneMap> zoneMaps;
+		std::mutex zoneMapsMutex;
+		// If the sample was loaded from a memory mapped file the columns above are empty and the
+		// data is read in place from the mapping instead. These are what should be used to read the
+		// data, since they point to whichever one is in use.
+		std::unique_ptr<::MemoryMappedFile> pMappedFile;
+		std::vector<const float*> parameterColumns; ///< @brief Pointers to the start of each parameter column
+		const float* pWeights;
+		const float* pWeightsSquared; ///< @brief Null unless eventsAreCollapsed
+		size_t numberOfEvents;
+		// If the sample is streamed from a file, the columns only hold the current Run of the file.
+		// numberOfEvents and sumOfWeights are for the whole file, but are only worked out if asked for.
+		std::string streamedFilename; ///< @brief Empty unless streaming
+		google::protobuf::uint32 streamedFileFormatVersion;
+		bool streamedTotalsKnown;
+		size_t eventsPerRun; ///< @brief The number of events in each Run or chunk when saving. Defaults to EVENTS_PER_RUN.
+		l1menu::ReducedSample::Codec codec; ///< @brief The compression used when saving in the chunked format
+		bool sparseEncoding; ///< @brief Whether columns saved in the chunked format only store values that aren't -1
+		// If the sample was loaded with a projection menu only some of the columns in the file are kept.
+		// fileColumnNumbers has the column number in the file for each one kept, or is empty if they
+		// all were.
+		std::unique_ptr<l1menu::TriggerMenu> pProjectionMenu;
+		std::vector<size_t> fileColumnNumbers;
+		size_t numberOfFileColumns;
+		// Caches for triggerColumns(). The non threshold parameter names are keyed by triggerTypeKey(), and
+		// the columns by that plus allowOlderVersion and the non threshold parameter values.
+		std::mutex triggerColumnsMutex;
+		std::unordered_map< std::string,std::vector<std::string> > nonThresholdParameterNames;
+		std::unordered_map<std::string,::TriggerColumns> triggerColumnsCache;
 		const static int EVENTS_PER_RUN;
 		const static char PROTOBUF_MESSAGE_DELIMETER;
 		const static std::string FILE_FORMAT_MAGIC_NUMBER;
+		const static size_t COLUMN_ALIGNMENT;
+		const static size_t ZONE_MAP_SIZE;
+		const static size_t NTUPLE_EVENTS_PER_TASK;
 	};
 
 	const int ReducedSamplePrivateMembers::EVENTS_PER_RUN=20000;
 	const char ReducedSamplePrivateMembers::PROTOBUF_MESSAGE_DELIMETER='\n';
 	const std::string ReducedSamplePrivateMembers::FILE_FORMAT_MAGIC_NUMBER="l1menuReducedSample";
+	const size_t ReducedSamplePrivateMembers::COLUMN_ALIGNMENT=64;
+	const size_t ReducedSamplePrivateMembers::ZONE_MAP_SIZE=4096;
+	const size_t ReducedSamplePrivateMembers::NTUPLE_EVENTS_PER_TASK=10000;
+}
+
+const float* ::ReducedEventBlock::weights() const
+{
+	if( pColumnIndices_!=nullptr ) return pGatheredWeights_;
+	return sampleMembers_.pWeights+columnOffset_;
+}
+
+const float* ::ReducedEventBlock::weightsSquared() const
+{
+	if( sampleMembers_.pWeightsSquared==nullptr ) return nullptr;
+	else if( pColumnIndices_!=nullptr ) return pGatheredWeightsSquared_;
+	else return sampleMembers_.pWeightsSquared+columnOffset_;
+}
+
+const l1menu::IEvent& ::ReducedEventBlock::getEvent( size_t index ) const
+{
+	if( pColumnIndices_!=nullptr ) return sampleMembers_.eventAtColumnIndex( pColumnIndices_[index] );
+	return sampleMembers_.eventAtColumnIndex( columnOffset_+index );
 }
 
 l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const l1menu::TriggerMenu& newTriggerMenu )
-	: mutableTriggerMenu_( newTriggerMenu ), event(thisObject), triggerMenu( mutableTriggerMenu_ ), eventRate(1), sumOfWeights(0)
+	: mutableTriggerMenu_( newTriggerMenu ), event(thisObject), triggerMenu( mutableTriggerMenu_ ), eventRate(1), sumOfWeights(0), eventsAreCollapsed(false), pWeights(nullptr), pWeightsSquared(nullptr), numberOfEvents(0), streamedFileFormatVersion(0), streamedTotalsKnown(false), eventsPerRun(EVENTS_PER_RUN), codec(l1menu::ReducedSample::Codec::GZIP), sparseEncoding(false), numberOfFileColumns(0)
 {
 	GOOGLE_PROTOBUF_VERIFY_VERSION;
 
@@ -150,45 +720,95 @@ l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::
 		const auto thresholdNames=l1menu::tools::getThresholdNames(trigger);
 		for( const auto& thresholdName : thresholdNames ) pProtobufTrigger->add_varying_parameter(thresholdName);
 
-	} // end of loop over triggers
+		// One column for each of those parameters
+		thresholdColumns.resize( thresholdColumns.size()+thresholdNames.size() );
 
-	// Always make sure there is at least one Run ready to be added to
-	std::unique_ptr<l1menuprotobuf::Run> pNewRun( new l1menuprotobuf::Run );
-	protobufRuns.push_back( std::move( pNewRun ) );
+	} // end of loop over triggers
 
+	updateColumnPointers();
 }
 
-l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const std::string& filename )
-	: event(thisObject), triggerMenu(mutableTriggerMenu_), eventRate(1), sumOfWeights(0)
+l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::ReducedSample& thisObject, const std::string& filename, bool streamFromFile, const l1menu::TriggerMenu* pNewProjectionMenu )
+	: event(thisObject), triggerMenu(mutableTriggerMenu_), eventRate(1), sumOfWeights(0), eventsAreCollapsed(false), pWeights(nullptr), pWeightsSquared(nullptr), numberOfEvents(0), streamedFileFormatVersion(0), streamedTotalsKnown(false), eventsPerRun(EVENTS_PER_RUN), codec(l1menu::ReducedSample::Codec::GZIP), sparseEncoding(false), numberOfFileColumns(0)
 {
 	GOOGLE_PROTOBUF_VERIFY_VERSION;
 
-	// Open the file with read ability
-	int fileDescriptor = open( filename.c_str(), O_RDONLY );
-	if( fileDescriptor==0 ) throw std::runtime_error( "ReducedSample initialise from file - couldn't open file" );
-	::UnixFileSentry fileSentry( fileDescriptor ); // Use this as an exception safe way of closing the input file
-	google::protobuf::io::FileInputStream fileInput( fileDescriptor );
+	// Keep a copy of the projection menu, because the file might need reading again later if streaming
+	if( pNewProjectionMenu!=nullptr ) pProjectionMenu.reset( new l1menu::TriggerMenu(*pNewProjectionMenu) );
 
-	// First read the magic number at the start of the file and make sure it
-	// matches what I expect. This is uncompressed so I'll wrap it in a block
-	// to make sure the CodedInputStream is destructed before creating a new
-	// one with gzip input.
-	{
-		google::protobuf::io::CodedInputStream codedInput( &fileInput );
+	::ProtobufInputFile inputFile( filename );
+	google::protobuf::io::ZeroCopyInputStream& fileInput=inputFile.stream();
 
-		// As a read buffer, I'll create a string the correct size (filled with an arbitrary
-		// character) and read straight into that.
-		std::string readMagicNumber;
-		if( !codedInput.ReadString( &readMagicNumber, FILE_FORMAT_MAGIC_NUMBER.size() ) ) throw std::runtime_error( "ReducedSample initialise from file - error reading magic number" );
-		if( readMagicNumber!=FILE_FORMAT_MAGIC_NUMBER ) throw std::runtime_error( "ReducedSample - tried to initialise with a file that is not the correct format" );
+	google::protobuf::uint32 fileformatVersion=readFileFormatVersion( fileInput );
+
+	// Version 1 is gzipped protobuf messages, version 2 is the memory mapped columns and version 3
+	// is the chunked format. There's no point streaming the memory mapped format, it only gets read
+	// as it's used anyway.
+	if( fileformatVersion==2 ) readMemoryMappedFormat( inputFile.fileDescriptor() );
+	else if( fileformatVersion==3 )
+	{
+		if( streamFromFile )
+		{
+			// Only need the header and footer now. The footer has the totals, so I might as well
+			// fill them in since it's no extra work.
+			l1menu::implementation::ChunkedSampleFileReader reader( filename );
+			setHeaderFromFile( reader.header() );
+			setGridsFromColumnEncodings( projectColumnEncodings( reader.columnEncodings() ) );
+			codec=reader.codec();
+			sparseEncoding=::anyColumnSparse( reader.columnEncodings() );
+			eventsAreCollapsed=reader.hasWeightsSquared();
+			readThresholdIndex( reader );
+			updateColumnPointers();
+			double chunkSumOfWeights=0;
+			for( const auto& indexEntry : reader.chunkIndex() ) chunkSumOfWeights+=indexEntry.sumOfWeights;
+			numberOfEvents=reader.numberOfEvents();
+			sumOfWeights=chunkSumOfWeights;
+			streamedTotalsKnown=true;
+			streamedFilename=filename;
+			streamedFileFormatVersion=fileformatVersion;
+		}
+		else readChunkedFormat( filename );
+	}
+	else
+	{
+		if( fileformatVersion>3 ) std::cerr << "Warning: Attempting to read a ReducedSample with version " << fileformatVersion << " with code that only knows up to version 3." << std::endl;
 
-		google::protobuf::uint32 fileformatVersion;
-		if( !codedInput.ReadVarint32( &fileformatVersion ) ) throw std::runtime_error( "ReducedSample initialise from file - error reading file format version" );
-		// So far I only have (and ever expect to have) one version of the file
-		// format, imaginatively versioned "1". You never know though...
-		if( fileformatVersion>1 ) std::cerr << "Warning: Attempting to read a ReducedSample with version " << fileformatVersion << " with code that only knows up to version 1." << std::endl;
+		if( streamFromFile )
+		{
+			// Only read the header now. The events are read each time forEachBlock is called.
+			l1menuprotobuf::SampleHeader fileHeader;
+			readProtobufRuns( fileInput, fileHeader, nullptr );
+			setHeaderFromFile( fileHeader );
+			updateColumnPointers();
+			streamedFilename=filename;
+			streamedFileFormatVersion=fileformatVersion;
+		}
+		else readProtobufFormat( fileInput );
 	}
 
+	copyMenuFromProtobufHeader();
+}
+
+google::protobuf::uint32 l1menu::ReducedSamplePrivateMembers::readFileFormatVersion( google::protobuf::io::ZeroCopyInputStream& fileInput ) const
+{
+	// The magic number and version are uncompressed. The CodedInputStream is destructed at the end
+	// of this method, so that the rest of the file can be read with gzip input if required.
+	google::protobuf::io::CodedInputStream codedInput( &fileInput );
+
+	// First read the magic number at the start of the file and make sure it
+	// matches what I expect.
+	std::string readMagicNumber;
+	if( !codedInput.ReadString( &readMagicNumber, FILE_FORMAT_MAGIC_NUMBER.size() ) ) throw std::runtime_error( "ReducedSample initialise from file - error reading magic number" );
+	if( readMagicNumber!=FILE_FORMAT_MAGIC_NUMBER ) throw std::runtime_error( "ReducedSample - tried to initialise with a file that is not the correct format" );
+
+	google::protobuf::uint32 fileformatVersion;
+	if( !codedInput.ReadVarint32( &fileformatVersion ) ) throw std::runtime_error( "ReducedSample initialise from file - error reading file format version" );
+
+	return fileformatVersion;
+}
+
+void l1menu::ReducedSamplePrivateMembers::readProtobufRuns( google::protobuf::io::ZeroCopyInputStream& fileInput, l1menuprotobuf::SampleHeader& header, const std::function<void(const l1menuprotobuf::Run&)>& function ) const
+{
 	google::protobuf::io::GzipInputStream gzipInput( &fileInput );
 	google::protobuf::io::CodedInputStream codedInput( &gzipInput );
 
@@ -203,10 +823,14 @@ l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::
 	// Read the size of the header message
 	if( !codedInput.ReadVarint64( &messageSize ) ) throw std::runtime_error( "ReducedSample initialise from file - error reading message size for header" );
 	google::protobuf::io::CodedInputStream::Limit readLimit=codedInput.PushLimit(messageSize);
-	if( !protobufSampleHeader.ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "ReducedSample initialise from file - some unknown error while reading header" );
+	if( !header.ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "ReducedSample initialise from file - some unknown error while reading header" );
 	codedInput.PopLimit(readLimit);
 
-	// Keep looping until there is nothing more to be read from the file.
+	if( !function ) return;
+
+	// Keep looping until there is nothing more to be read from the file. I only need the one
+	// protobuf object, since each Run is finished with before the next one is read.
+	l1menuprotobuf::Run protobufRun;
 	while( codedInput.ReadVarint64( &messageSize ) )
 	{
 		readLimit=codedInput.PushLimit(messageSize);
@@ -219,299 +843,1400 @@ l1menu::ReducedSamplePrivateMembers::ReducedSamplePrivateMembers( const l1menu::
 			totalBytesLimit+=messageSize*5; // Might as well set it a little higher than necessary while I'm at it.
 			codedInput.SetTotalBytesLimit( totalBytesLimit, -1 );
 		}
-		std::unique_ptr<l1menuprotobuf::Run> pNewRun( new l1menuprotobuf::Run );
-		if( !pNewRun->ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "ReducedSample initialise from file - some unknown error while reading run" );
-		protobufRuns.push_back( std::move( pNewRun ) );
+		protobufRun.Clear();
+		if( !protobufRun.ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "ReducedSample initialise from file - some unknown error while reading run" );
+		function( protobufRun );
 
 		codedInput.PopLimit(readLimit);
 	}
+}
 
+void l1menu::ReducedSamplePrivateMembers::readProtobufFormat( google::protobuf::io::ZeroCopyInputStream& fileInput )
+{
+	// The header has always been read by the time the first Run is given to the function, so
+	// the columns can be set up from it then.
+	l1menuprotobuf::SampleHeader fileHeader;
+	bool headerIsSet=false;
+	readProtobufRuns( fileInput, fileHeader, [&]( const l1menuprotobuf::Run& run )
+	{
+		if( !headerIsSet )
+		{
+			setHeaderFromFile( fileHeader );
+			headerIsSet=true;
+		}
+		appendRun( run );
+	} );
+	if( !headerIsSet ) setHeaderFromFile( fileHeader ); // In case there were no Runs in the file
+
+	sumOfWeights=0;
+	for( const auto& weight : weights ) sumOfWeights+=weight;
+	numberOfEvents=weights.size();
+	updateColumnPointers();
+}
 
-	// Always make sure there is at least one Run ready to be added to. Later
-	// code assumes there is already a run there.
-	if( protobufRuns.empty() )
+void l1menu::ReducedSamplePrivateMembers::readMemoryMappedFormat( int fileDescriptor )
+{
+	struct stat fileStatus;
+	if( fstat( fileDescriptor, &fileStatus )!=0 ) throw std::runtime_error( "ReducedSample initialise from file - unable to get the file size" );
+	const size_t fileSize=fileStatus.st_size;
+
+	// The file layout is described in saveMemoryMappedFormat. Everything apart from the
+	// header is fixed width, so I can just work out where everything should be and check
+	// the file is big enough.
+	size_t position=FILE_FORMAT_MAGIC_NUMBER.size()+1; // Version 2 is a single byte as a varint
+	if( fileSize<position+sizeof(google::protobuf::uint64) ) throw std::runtime_error( "ReducedSample initialise from file - file is truncated" );
+
+	pMappedFile.reset( new ::MemoryMappedFile( fileDescriptor, fileSize ) );
+	const char* pFileStart=pMappedFile->data();
+
+	google::protobuf::uint64 headerSize;
+	std::memcpy( &headerSize, pFileStart+position, sizeof(headerSize) );
+	position+=sizeof(headerSize);
+	if( fileSize<position+headerSize ) throw std::runtime_error( "ReducedSample initialise from file - file is truncated" );
+	l1menuprotobuf::SampleHeader fileHeader;
+	if( !fileHeader.ParseFromArray( pFileStart+position, headerSize ) ) throw std::runtime_error( "ReducedSample initialise from file - some unknown error while reading header" );
+	position+=headerSize;
+
+	google::protobuf::uint64 storedNumberOfEvents;
+	google::protobuf::uint32 numberOfColumns;
+	if( fileSize<position+sizeof(storedNumberOfEvents)+sizeof(numberOfColumns)+sizeof(sumOfWeights) ) throw std::runtime_error( "ReducedSample initialise from file - file is truncated" );
+	std::memcpy( &storedNumberOfEvents, pFileStart+position, sizeof(storedNumberOfEvents) );
+	position+=sizeof(storedNumberOfEvents);
+	std::memcpy( &numberOfColumns, pFileStart+position, sizeof(numberOfColumns) );
+	position+=sizeof(numberOfColumns);
+	std::memcpy( &sumOfWeights, pFileStart+position, sizeof(sumOfWeights) );
+	position+=sizeof(sumOfWeights);
+
+	setHeaderFromFile( fileHeader ); // The columns stay empty, but it keeps the size consistent
+	// There's one extra column if identical events were collapsed, for the sum of squared weights
+	if( numberOfColumns!=numberOfFileColumns && numberOfColumns!=numberOfFileColumns+1 ) throw std::runtime_error( "ReducedSample initialise from file - the number of columns doesn't match the trigger menu" );
+	eventsAreCollapsed=( numberOfColumns==numberOfFileColumns+1 );
+
+	// The columns start at the next alignment boundary, weights first and then each of the
+	// parameters. Each one is padded out to the alignment as well.
+	const size_t dataOffset=::roundUp( position, COLUMN_ALIGNMENT );
+	const size_t columnStride=::roundUp( storedNumberOfEvents*sizeof(float), COLUMN_ALIGNMENT );
+	if( fileSize<dataOffset+columnStride*(numberOfColumns+1) ) throw std::runtime_error( "ReducedSample initialise from file - file is truncated" );
+
+	numberOfEvents=storedNumberOfEvents;
+	pWeights=reinterpret_cast<const float*>( pFileStart+dataOffset );
+	parameterColumns.clear();
+	for( size_t columnNumber=0; columnNumber<thresholdColumns.size(); ++columnNumber )
 	{
-		std::unique_ptr<l1menuprotobuf::Run> pNewRun( new l1menuprotobuf::Run );
-		protobufRuns.push_back( std::move( pNewRun ) );
+		parameterColumns.push_back( reinterpret_cast<const float*>( pFileStart+dataOffset+columnStride*(fileColumnNumber(columnNumber)+1) ) );
 	}
+	if( eventsAreCollapsed ) pWeightsSquared=reinterpret_cast<const float*>( pFileStart+dataOffset+columnStride*numberOfColumns );
 
-	// Count up the sum of the weights of all events
-	for( const auto& pRun : protobufRuns )
+	event.pParameterColumns_=parameterColumns.data();
+	event.pWeights_=pWeights;
+	event.pWeightsSquared_=pWeightsSquared;
+}
+
+void l1menu::ReducedSamplePrivateMembers::readChunkedFormat( const std::string& filename )
+{
+	l1menu::implementation::ChunkedSampleFileReader reader( filename );
+	setHeaderFromFile( reader.header() );
+	setGridsFromColumnEncodings( projectColumnEncodings( reader.columnEncodings() ) );
+	codec=reader.codec();
+	sparseEncoding=::anyColumnSparse( reader.columnEncodings() );
+	readThresholdIndex( reader );
+
+	// I know how many events are in each chunk from the footer, so I can size the columns now
+	// and have each chunk decompressed straight into the right place.
+	const auto& chunkIndex=reader.chunkIndex();
+	std::vector<size_t> firstEventInChunk;
+	size_t totalEvents=0;
+	for( const auto& indexEntry : chunkIndex )
 	{
-		sumOfWeights+=sumWeights( *pRun );
+		firstEventInChunk.push_back( totalEvents );
+		totalEvents+=indexEntry.numberOfEvents;
 	}
 
-	// I have all of the information in the protobuf members, but I also need the trigger information
-	// in the form of l1menu::TriggerMenu. Copy out the required information.
-	for( int triggerNumber=0; triggerNumber<protobufSampleHeader.trigger_size(); ++triggerNumber )
+	weights.resize( totalEvents );
+	for( auto& column : thresholdColumns ) column.resize( totalEvents );
+	eventsAreCollapsed=reader.hasWeightsSquared();
+	weightsSquared.resize( eventsAreCollapsed ? totalEvents : 0 );
+
+	l1menu::tools::parallelFor( chunkIndex.size(), [&]( size_t chunkNumber )
 	{
-		const l1menuprotobuf::Trigger& inputTrigger=protobufSampleHeader.trigger(triggerNumber);
+		float* pChunkWeightsSquared= eventsAreCollapsed ? weightsSquared.data()+firstEventInChunk[chunkNumber] : nullptr;
+		reader.readChunk( chunkNumber, weights.data()+firstEventInChunk[chunkNumber], fileColumnPointers( firstEventInChunk[chunkNumber] ), pChunkWeightsSquared );
+	} );
+
+	sumOfWeights=0;
+	for( const auto& weight : weights ) sumOfWeights+=weight;
+	numberOfEvents=totalEvents;
+	updateColumnPointers();
+}
 
-		mutableTriggerMenu_.addTrigger( inputTrigger.name(), inputTrigger.version() );
-		// Get a reference to the trigger I just created
-		l1menu::ITrigger& trigger=mutableTriggerMenu_.getTrigger(triggerNumber);
+void l1menu::ReducedSamplePrivateMembers::setHeaderFromFile( const l1menuprotobuf::SampleHeader& fileHeader )
+{
+	numberOfFileColumns=0;
+	for( const auto& trigger : fileHeader.trigger() ) numberOfFileColumns+=trigger.varying_parameter_size();
+	fileColumnNumbers.clear();
+	protobufSampleHeader=fileHeader;
 
-		// Run through all of the parameters and set them to what they were
-		// when the sample was made.
-		for( int parameterNumber=0; parameterNumber<inputTrigger.parameter_size(); ++parameterNumber )
+	if( pProjectionMenu )
+	{
+		// To make sure I use exactly the same criteria as getTriggerParameterIdentifiers, make the
+		// triggers as they would be in the sample's menu and compare them the same way.
+		l1menu::TriggerMenu fileMenu;
+		::addHeaderTriggersToMenu( fileHeader, fileMenu );
+
+		protobufSampleHeader.clear_trigger();
+		size_t firstColumnOfTrigger=0;
+		for( int triggerNumber=0; triggerNumber<fileHeader.trigger_size(); ++triggerNumber )
 		{
-			const auto& inputParameter=inputTrigger.parameter(parameterNumber);
-			trigger.parameter(inputParameter.name())=inputParameter.value();
+			const l1menuprotobuf::Trigger& fileTrigger=fileHeader.trigger(triggerNumber);
+
+			bool triggerIsRequired=false;
+			for( size_t projectionTriggerNumber=0; projectionTriggerNumber<pProjectionMenu->numberOfTriggers() && !triggerIsRequired; ++projectionTriggerNumber )
+			{
+				triggerIsRequired=::sampleTriggerMatches( fileMenu.getTrigger(triggerNumber), pProjectionMenu->getTrigger(projectionTriggerNumber), true );
+			}
+
+			if( triggerIsRequired )
+			{
+				*protobufSampleHeader.add_trigger()=fileTrigger;
+				for( int parameterNumber=0; parameterNumber<fileTrigger.varying_parameter_size(); ++parameterNumber ) fileColumnNumbers.push_back( firstColumnOfTrigger+parameterNumber );
+			}
+			firstColumnOfTrigger+=fileTrigger.varying_parameter_size();
 		}
 
-		// I should probably check the threshold names exist. I'll do it another time.
+		// If nothing was left out the columns are the same as in the file
+		if( protobufSampleHeader.trigger_size()==fileHeader.trigger_size() ) fileColumnNumbers.clear();
 	}
 
+	resizeColumnsFromHeader();
 }
 
-l1menu::ReducedSample::ReducedSample( const l1menu::FullSample& originalSample, const l1menu::TriggerMenu& triggerMenu )
-	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, triggerMenu ) )
+size_t l1menu::ReducedSamplePrivateMembers::fileColumnNumber( size_t columnNumber ) const
 {
-	addSample( originalSample );
-	setEventRate( originalSample.eventRate() );
+	if( fileColumnNumbers.empty() ) return columnNumber;
+	else return fileColumnNumbers[columnNumber];
 }
 
-l1menu::ReducedSample::ReducedSample( const l1menu::TriggerMenu& triggerMenu )
-	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, triggerMenu ) )
+std::vector<float*> l1menu::ReducedSamplePrivateMembers::fileColumnPointers( size_t offset )
 {
-	// No operation besides the initialiser list
+	std::vector<float*> returnValue( numberOfFileColumns, nullptr );
+	for( size_t columnNumber=0; columnNumber<thresholdColumns.size(); ++columnNumber )
+	{
+		returnValue[fileColumnNumber(columnNumber)]=thresholdColumns[columnNumber].data()+offset;
+	}
+	return returnValue;
 }
 
-l1menu::ReducedSample::ReducedSample( const std::string& filename )
-	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, filename ) )
+std::vector<l1menu::implementation::ColumnEncoding> l1menu::ReducedSamplePrivateMembers::projectColumnEncodings( const std::vector<l1menu::implementation::ColumnEncoding>& fileColumnEncodings ) const
 {
-	// No operation except the initialiser list
+	if( fileColumnNumbers.empty() ) return fileColumnEncodings;
+
+	std::vector<l1menu::implementation::ColumnEncoding> returnValue;
+	for( const auto columnNumber : fileColumnNumbers ) returnValue.push_back( fileColumnEncodings[columnNumber] );
+	return returnValue;
 }
 
-l1menu::ReducedSample::~ReducedSample()
+void l1menu::ReducedSamplePrivateMembers::readThresholdIndex( const l1menu::implementation::ChunkedSampleFileReader& reader )
 {
-	// No operation. Just need one defined otherwise the default one messes up
-	// the unique_ptr deletion because ReducedSamplePrivateMembers isn't
-	// defined elsewhere.
+	thresholdIndex.clear();
+	if( !reader.hasThresholdIndex() ) return;
+
+	// The file has an index for every column in it, but I only want the ones that were kept
+	std::vector<l1menu::implementation::ThresholdIndex> fileThresholdIndex=reader.readThresholdIndex();
+	for( size_t columnNumber=0; columnNumber<thresholdColumns.size(); ++columnNumber )
+	{
+		thresholdIndex.push_back( std::move(fileThresholdIndex[fileColumnNumber(columnNumber)]) );
+	}
 }
 
-void l1menu::ReducedSample::addSample( const l1menu::FullSample& originalSample )
+void l1menu::ReducedSamplePrivateMembers::setGridsFromColumnEncodings( const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings )
 {
-	l1menuprotobuf::Run* pCurrentRun=pImple_->protobufRuns.back().get();
-
-	for( size_t eventNumber=0; eventNumber<originalSample.numberOfEvents(); ++eventNumber )
+	thresholdGrids.clear();
+	bool anyColumnQuantised=false;
+	for( const auto& encoding : columnEncodings )
 	{
-		// Split the events up into groups in arbitrary numbers. This is to get around
-		// a protobuf aversion to long messages.
-		if( pCurrentRun->event_size() >= pImple_->EVENTS_PER_RUN )
-		{
-			// Gone over the arbitrary limit, so create a new protobuf Run and start
-			// using that instead.
-			std::unique_ptr<l1menuprotobuf::Run> pNewRun( new l1menuprotobuf::Run );
-			pImple_->protobufRuns.push_back( std::move( pNewRun ) );
-			pCurrentRun=pImple_->protobufRuns.back().get();
-		}
+		if( encoding.type!=l1menu::implementation::ColumnEncoding::FLOAT32 ) anyColumnQuantised=true;
+	}
+	if( !anyColumnQuantised ) return;
 
-		const l1menu::L1TriggerDPGEvent& event=originalSample.getFullEvent( eventNumber );
-		l1menuprotobuf::Event* pProtobufEvent=pCurrentRun->add_event();
-		if( event.weight()!=1 ) pProtobufEvent->set_weight( event.weight() );
+	// Columns stored as floats get an invalid grid, so they won't be quantised
+	for( const auto& encoding : columnEncodings )
+	{
+		if( encoding.type==l1menu::implementation::ColumnEncoding::FLOAT32 ) thresholdGrids.push_back( l1menu::implementation::ThresholdGrid() );
+		else thresholdGrids.push_back( encoding.grid );
+	}
+}
 
-		// Loop over all of the triggers
-		for( size_t triggerNumber=0; triggerNumber<pImple_->triggerMenu.numberOfTriggers(); ++triggerNumber )
-		{
-			std::unique_ptr<l1menu::ITrigger> pTrigger=pImple_->triggerMenu.getTriggerCopy(triggerNumber);
-			std::vector<std::string> thresholdNames=l1menu::tools::getThresholdNames(*pTrigger);
+void l1menu::ReducedSamplePrivateMembers::resizeColumnsFromHeader()
+{
+	size_t numberOfParameters=0;
+	for( const auto& trigger : protobufSampleHeader.trigger() ) numberOfParameters+=trigger.varying_parameter_size();
+	thresholdColumns.resize( numberOfParameters );
+}
 
-			try
+void l1menu::ReducedSamplePrivateMembers::copyMenuFromProtobufHeader()
+{
+	// I have all of the information in the protobuf members, but I also need the trigger information
+	// in the form of l1menu::TriggerMenu. Copy out the required information.
+	::addHeaderTriggersToMenu( protobufSampleHeader, mutableTriggerMenu_ );
+}
+
+void l1menu::ReducedSamplePrivateMembers::appendRun( const l1menuprotobuf::Run& run )
+{
+	// I don't reserve space for the Run here. Asking for exactly the new size each time would
+	// reallocate every column for every Run, which is quadratic in the size of the file.
+	for( const auto& event : run.event() )
+	{
+		if( static_cast<size_t>(event.threshold_size())!=numberOfFileColumns ) throw std::runtime_error( "ReducedSample - an event has a different number of thresholds to the trigger menu" );
+
+		for( size_t parameterNumber=0; parameterNumber<thresholdColumns.size(); ++parameterNumber )
+		{
+			thresholdColumns[parameterNumber].push_back( event.threshold(fileColumnNumber(parameterNumber)) );
+		}
+
+		weights.push_back( event.has_weight() ? event.weight() : 1 );
+	}
+}
+
+void l1menu::ReducedSamplePrivateMembers::updateColumnPointers()
+{
+	parameterColumns.clear();
+	for( const auto& column : thresholdColumns ) parameterColumns.push_back( column.data() );
+	pWeights=weights.data();
+	pWeightsSquared= eventsAreCollapsed ? weightsSquared.data() : nullptr;
+
+	event.pParameterColumns_=parameterColumns.data();
+	event.pWeights_=pWeights;
+	event.pWeightsSquared_=pWeightsSquared;
+}
+
+void l1menu::ReducedSamplePrivateMembers::reduceEvents( const l1menu::FullSample& originalSample, size_t firstEventNumber, size_t lastEventNumber, std::vector< std::vector<float> >& newThresholdColumns, std::vector<float>& newWeights, std::vector<float>& newWeightsSquared ) const
+{
+	// Every call gets its own copies of the triggers so that several threads can do this at once. The
+	// threshold names are the same for every event and are slow to get, so I only do that once.
+	std::vector< std::unique_ptr<l1menu::ITrigger> > triggers;
+	std::vector< std::vector<std::string> > thresholdNames;
+	for( size_t triggerNumber=0; triggerNumber<triggerMenu.numberOfTriggers(); ++triggerNumber )
+	{
+		triggers.push_back( triggerMenu.getTriggerCopy(triggerNumber) );
+		thresholdNames.push_back( l1menu::tools::getThresholdNames(*triggers.back()) );
+	}
+
+	for( size_t eventNumber=firstEventNumber; eventNumber<lastEventNumber; ++eventNumber )
+	{
+		const l1menu::L1TriggerDPGEvent& event=originalSample.getFullEvent( eventNumber );
+		newWeights.push_back( event.weight() );
+		if( eventsAreCollapsed ) newWeightsSquared.push_back( event.weightSquared() );
+
+		// The columns are in the same order as the triggers and their thresholds, so
+		// I can just step through them as I go.
+		auto iColumn=newThresholdColumns.begin();
+
+		// Loop over all of the triggers
+		for( size_t triggerNumber=0; triggerNumber<triggers.size(); ++triggerNumber )
+		{
+			l1menu::ITrigger& trigger=*triggers[triggerNumber];
+			bool eventCanPass=true;
+
+			// If the trigger can work out the thresholds directly from the event that's much quicker
+			// than the bisection, and doesn't need an exception when the event fails.
+			if( trigger.setThresholdsAsTightAsPossible( event ) )
+			{
+				for( const auto& thresholdName : thresholdNames[triggerNumber] )
+				{
+					if( trigger.parameter(thresholdName)<0 ) eventCanPass=false;
+				}
+			}
+			else
+			{
+				// The bisection for correlated thresholds depends on what they were beforehand, so start
+				// from the menu's thresholds each time as if it was a fresh copy of the trigger.
+				const l1menu::ITrigger& menuTrigger=triggerMenu.getTrigger(triggerNumber);
+				for( const auto& thresholdName : thresholdNames[triggerNumber] ) trigger.parameter(thresholdName)=menuTrigger.parameter(thresholdName);
+
+				try
+				{
+					l1menu::tools::setTriggerThresholdsAsTightAsPossible( event, trigger, 0.001 );
+				}
+				catch( std::exception& error )
+				{
+					// setTriggerThresholdsAsTightAsPossible() couldn't find thresholds
+					eventCanPass=false;
+				}
+			}
+
+			if( eventCanPass )
 			{
-				l1menu::tools::setTriggerThresholdsAsTightAsPossible( event, *pTrigger, 0.001 );
 				// Set all of the parameters to match the thresholds in the trigger
-				for( const auto& thresholdName : thresholdNames )
+				for( const auto& thresholdName : thresholdNames[triggerNumber] )
 				{
-					pProtobufEvent->add_threshold( pTrigger->parameter(thresholdName) );
+					float threshold=trigger.parameter(thresholdName);
+					if( !thresholdGrids.empty() ) threshold=thresholdGrids[iColumn-newThresholdColumns.begin()].snap( threshold );
+					(iColumn++)->push_back( threshold );
 				}
 			}
-			catch( std::exception& error )
+			else
 			{
-				// setTriggerThresholdsAsTightAsPossible() couldn't find thresholds so record
-				// -1 for everything.
-				// Range based for loop gives me a warning because I don't use the thresholdName.
-				for( size_t index=0; index<thresholdNames.size(); ++index ) pProtobufEvent->add_threshold(-1);
-			} // end of try block that sets the trigger thresholds
+				// Record -1 for everything. Range based for loop gives me a warning because I
+				// don't use the thresholdName.
+				for( size_t index=0; index<thresholdNames[triggerNumber].size(); ++index ) (iColumn++)->push_back(-1);
+			}
 
 		} // end of loop over triggers
-
-		pImple_->sumOfWeights+=event.weight();
 	} // end of loop over events
 }
 
-void l1menu::ReducedSample::saveToFile( const std::string& filename ) const
+void l1menu::ReducedSamplePrivateMembers::finishAddingEvents( size_t firstEventNumber )
 {
-	// Open the file. Parameters are filename, write ability and create, rw-r--r-- permissions.
-	int fileDescriptor = open( filename.c_str(), O_WRONLY | O_CREAT, 0644 );
-	if( fileDescriptor==0 ) throw std::runtime_error( "ReducedSample save to file - couldn't open file" );
-	::UnixFileSentry fileSentry( fileDescriptor ); // Use this as an exception safe way of closing the output file
+	for( size_t eventNumber=firstEventNumber; eventNumber<weights.size(); ++eventNumber ) sumOfWeights+=weights[eventNumber];
 
-	// Setup the protobuf file handlers
-	google::protobuf::io::FileOutputStream fileOutput( fileDescriptor );
+	thresholdIndex.clear();
+	zoneMaps.clear();
+	numberOfEvents=weights.size();
+	updateColumnPointers();
+}
 
-	// I want the magic number and file format identifier uncompressed, so
-	// I'll write those before switching to using gzipped output.
-	{ // Block to make sure codedOutput is destructed before the gzip version is created
-		google::protobuf::io::CodedOutputStream codedOutput( &fileOutput );
+const ::TriggerColumns& l1menu::ReducedSamplePrivateMembers::triggerColumns( const l1menu::ITrigger& trigger, bool allowOlderVersion )
+{
+	// Getting the non threshold parameter names is quite slow, and they're the same for every trigger
+	// of the same type, so I cache those too. The values are added to the key as raw bytes so that a
+	// NaN still matches itself, otherwise every call with one would add a new entry.
+	std::string key=::triggerTypeKey( trigger );
 
-		// Write a magic number at the start of all files
-		codedOutput.WriteString( pImple_->FILE_FORMAT_MAGIC_NUMBER );
-		// Write an integer that specifies what version of the file format I'm using. I
-		// have no intention of changing the format but I might as well keep the option
-		// open.
-		codedOutput.WriteVarint32( 1 );
+	std::lock_guard<std::mutex> lock( triggerColumnsMutex );
+
+	auto iParameterNames=nonThresholdParameterNames.find( key );
+	if( iParameterNames==nonThresholdParameterNames.end() )
+	{
+		iParameterNames=nonThresholdParameterNames.insert( std::make_pair( key, l1menu::tools::getNonThresholdParameterNames(trigger) ) ).first;
 	}
 
-	google::protobuf::io::GzipOutputStream gzipOutput( &fileOutput );
-	google::protobuf::io::CodedOutputStream codedOutput( &gzipOutput );
+	key.push_back( allowOlderVersion ? 1 : 0 );
+	for( const auto& parameterName : iParameterNames->second )
+	{
+		const float value=trigger.parameter( parameterName );
+		key.append( reinterpret_cast<const char*>(&value), sizeof(value) );
+	}
 
-	// Write the size of the header message into the file...
-	codedOutput.WriteVarint64( pImple_->protobufSampleHeader.ByteSize() );
-	// ...and then write the header
-	pImple_->protobufSampleHeader.SerializeToCodedStream( &codedOutput );
+	auto iTriggerColumns=triggerColumnsCache.find( key );
+	if( iTriggerColumns==triggerColumnsCache.end() )
+	{
+		iTriggerColumns=triggerColumnsCache.insert( std::make_pair( key, findTriggerColumns( trigger, allowOlderVersion ) ) ).first;
+	}
+	return iTriggerColumns->second;
+}
+
+::TriggerColumns l1menu::ReducedSamplePrivateMembers::findTriggerColumns( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const
+{
+	::TriggerColumns returnValue;
 
-	// Now go through each of the runs and do the same for those
-	for( const auto& pRun : pImple_->protobufRuns )
+	// Need to find out how many parameters there are for each event. Basically the sum
+	// of the number of thresholds for all triggers.
+	size_t parameterNumber=0;
+	returnValue.triggerWasFound=false;
+	for( size_t triggerNumber=0; triggerNumber<triggerMenu.numberOfTriggers(); ++triggerNumber )
 	{
-		codedOutput.WriteVarint64( pRun->ByteSize() );
-		pRun->SerializeToCodedStream( &codedOutput );
+		const l1menu::ITrigger& triggerInMenu=triggerMenu.getTrigger(triggerNumber);
+
+		// See if this trigger in the menu is the same as the one passed as a parameter
+		returnValue.triggerWasFound=::sampleTriggerMatches( triggerInMenu, trigger, allowOlderVersion );
+
+		std::vector<std::string> thresholdNames=l1menu::tools::getThresholdNames(triggerInMenu);
+		if( returnValue.triggerWasFound )
+		{
+			for( const auto& thresholdName : thresholdNames )
+			{
+				returnValue.parameterIdentifiers[thresholdName]=parameterNumber;
+				++parameterNumber;
+			}
+			break;
+		}
+		else parameterNumber+=thresholdNames.size();
 	}
 
+	return returnValue;
 }
 
-size_t l1menu::ReducedSample::numberOfEvents() const
+const l1menu::ReducedEvent& l1menu::ReducedSamplePrivateMembers::eventAtColumnIndex( size_t columnIndex )
 {
-	size_t numberOfEvents=0;
-	for( const auto& pRun : pImple_->protobufRuns ) numberOfEvents+=pRun->event_size();
-	return numberOfEvents;
+	event.eventNumber_=columnIndex;
+	return event;
 }
 
-const l1menu::TriggerMenu& l1menu::ReducedSample::getTriggerMenu() const
+void l1menu::ReducedSamplePrivateMembers::copyMappedFileToColumns()
 {
-	return pImple_->triggerMenu;
+	if( !pMappedFile ) return;
+
+	weights.assign( pWeights, pWeights+numberOfEvents );
+	if( eventsAreCollapsed ) weightsSquared.assign( pWeightsSquared, pWeightsSquared+numberOfEvents );
+	for( size_t columnNumber=0; columnNumber<thresholdColumns.size(); ++columnNumber )
+	{
+		thresholdColumns[columnNumber].assign( parameterColumns[columnNumber], parameterColumns[columnNumber]+numberOfEvents );
+	}
+
+	updateColumnPointers();
+	pMappedFile.reset();
 }
 
-bool l1menu::ReducedSample::containsTrigger( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const
+void l1menu::ReducedSamplePrivateMembers::loadStreamedFile()
 {
-	// Loop over all of the triggers in the menu, and see if there is one
-	// where the name and version match.
-	for( size_t triggerNumber=0; triggerNumber<pImple_->triggerMenu.numberOfTriggers(); ++triggerNumber )
+	if( streamedFilename.empty() ) return;
+
+	for( auto& column : thresholdColumns ) column.clear();
+	weights.clear();
+	weightsSquared.clear();
+	if( streamedFileFormatVersion==3 ) readChunkedFormat( streamedFilename );
+	else
 	{
-		const l1menu::ITrigger& triggerInMenu=pImple_->triggerMenu.getTrigger(triggerNumber);
-		if( triggerInMenu.name()!=trigger.name() ) continue;
-		if( allowOlderVersion )
+		::ProtobufInputFile inputFile( streamedFilename );
+		readFileFormatVersion( inputFile.stream() );
+		readProtobufFormat( inputFile.stream() );
+	}
+
+	streamedFilename.clear();
+	streamedTotalsKnown=false;
+}
+
+double l1menu::ReducedSamplePrivateMembers::streamBlocks( const l1menu::ReducedSample& thisObject, size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function, const ::ZoneMapCheck* pZoneMapCheck )
+{
+	// Each Run (or chunk) replaces whatever is in the columns, so memory use only ever goes up to the
+	// size of the largest one. Blocks don't span Runs, so some might be smaller than blockSize.
+	::ReducedEventBlock block( thisObject, *this );
+	size_t firstEventInRun=0;
+	float streamedSumOfWeights=0;
+	double skippedSumOfWeights=0;
+	auto processColumns=[&]()
+	{
+		updateColumnPointers();
+
+		for( size_t columnOffset=0; columnOffset<weights.size(); columnOffset+=blockSize )
 		{
-			if( triggerInMenu.version()>trigger.version() ) continue;
+			block.setRange( firstEventInRun+columnOffset, std::min( blockSize, weights.size()-columnOffset ), columnOffset );
+			function( block );
 		}
-		else
+
+		firstEventInRun+=weights.size();
+		for( const auto& weight : weights ) streamedSumOfWeights+=weight;
+	};
+
+	if( streamedFileFormatVersion==3 )
+	{
+		l1menu::implementation::ChunkedSampleFileReader reader( streamedFilename );
+		std::vector<float> chunkMaximumValues( thresholdColumns.size() );
+		for( size_t chunkNumber=0; chunkNumber<reader.chunkIndex().size(); ++chunkNumber )
 		{
-			if( triggerInMenu.version()!=trigger.version() ) continue;
+			const auto& indexEntry=reader.chunkIndex()[chunkNumber];
+			const size_t eventsInChunk=indexEntry.numberOfEvents;
+
+			// Don't even read the chunk if the zone map in the footer says nothing in it can pass
+			if( pZoneMapCheck!=nullptr && indexEntry.hasColumnRanges() )
+			{
+				for( size_t columnNumber=0; columnNumber<thresholdColumns.size(); ++columnNumber ) chunkMaximumValues[columnNumber]=indexEntry.maximumValues[fileColumnNumber(columnNumber)];
+				if( !pZoneMapCheck->anyCouldPass( chunkMaximumValues.data() ) )
+				{
+					firstEventInRun+=eventsInChunk;
+					streamedSumOfWeights+=indexEntry.sumOfWeights;
+					skippedSumOfWeights+=indexEntry.sumOfWeights;
+					continue;
+				}
+			}
+
+			weights.resize( eventsInChunk );
+			for( auto& column : thresholdColumns ) column.resize( eventsInChunk );
+			if( eventsAreCollapsed ) weightsSquared.resize( eventsInChunk );
+			reader.readChunk( chunkNumber, weights.data(), fileColumnPointers(0), eventsAreCollapsed ? weightsSquared.data() : nullptr );
+			processColumns();
 		}
+	}
+	else
+	{
+		::ProtobufInputFile inputFile( streamedFilename );
+		readFileFormatVersion( inputFile.stream() );
+		l1menuprotobuf::SampleHeader header;
+		readProtobufRuns( inputFile.stream(), header, [&]( const l1menuprotobuf::Run& run )
+		{
+			for( auto& column : thresholdColumns ) column.clear();
+			weights.clear();
+			appendRun( run );
+			processColumns();
+		} );
+	}
 
-		// If control got this far then there is a trigger with the required name
-		// and sufficient version. I now need to check all of the non threshold parameters
-		// to make sure they match, i.e. make sure the ReducedSample was made with the same
-		// eta cuts or whatever.
-		// I don't care if the thresholds don't match because that's what's stored in the
-		// ReducedSample.
-		std::vector<std::string> parameterNames=l1menu::tools::getNonThresholdParameterNames( trigger );
-		bool allParametersMatch=true;
-		for( const auto& parameterName : parameterNames )
+	// Might as well keep the totals now that I've been through the whole file
+	numberOfEvents=firstEventInRun;
+	sumOfWeights=streamedSumOfWeights;
+	streamedTotalsKnown=true;
+	return skippedSumOfWeights;
+}
+
+void l1menu::ReducedSamplePrivateMembers::buildZoneMaps()
+{
+	std::lock_guard<std::mutex> lock( zoneMapsMutex );
+	if( !zoneMaps.empty() ) return;
+
+	std::vector<::ZoneMap> newZoneMaps( (numberOfEvents+ZONE_MAP_SIZE-1)/ZONE_MAP_SIZE );
+	l1menu::tools::parallelFor( newZoneMaps.size(), [&]( size_t zoneNumber )
+	{
+		const size_t firstEventNumber=zoneNumber*ZONE_MAP_SIZE;
+		const size_t endEventNumber=std::min( firstEventNumber+ZONE_MAP_SIZE, numberOfEvents );
+		::ZoneMap& zoneMap=newZoneMaps[zoneNumber];
+
+		zoneMap.sumOfWeights=0;
+		for( size_t eventNumber=firstEventNumber; eventNumber<endEventNumber; ++eventNumber ) zoneMap.sumOfWeights+=pWeights[eventNumber];
+		zoneMap.candidateWordsPerColumn=(ZONE_MAP_SIZE+63)/64;
+		zoneMap.candidateBits.assign( zoneMap.candidateWordsPerColumn*parameterColumns.size(), 0 );
+		for( size_t columnNumber=0; columnNumber<parameterColumns.size(); ++columnNumber )
 		{
-			if( trigger.parameter(parameterName)!=triggerInMenu.parameter(parameterName) ) allParametersMatch=false;
+			const float* pColumn=parameterColumns[columnNumber];
+			uint64_t* pColumnBits=&zoneMap.candidateBits[columnNumber*zoneMap.candidateWordsPerColumn];
+			float maximum=-std::numeric_limits<float>::infinity();
+			for( size_t eventNumber=firstEventNumber; eventNumber<endEventNumber; ++eventNumber )
+			{
+				if( std::isnan(pColumn[eventNumber]) ) maximum=std::numeric_limits<float>::infinity();
+				else if( pColumn[eventNumber]>maximum ) maximum=pColumn[eventNumber];
+
+				const size_t indexInZone=eventNumber-firstEventNumber;
+				if( pColumn[eventNumber]!=-1 ) pColumnBits[indexInZone/64]|=( static_cast<uint64_t>(1)<<(indexInZone%64) );
+			}
+			zoneMap.maximumValues.push_back( maximum );
 		}
+	} );
+	zoneMaps.swap( newZoneMaps );
+}
 
-		if( allParametersMatch ) return true;
-	} // end of loop over triggers
+void l1menu::ReducedSamplePrivateMembers::calculateStreamedTotals()
+{
+	if( streamedFilename.empty() || streamedTotalsKnown ) return;
+
+	::ProtobufInputFile inputFile( streamedFilename );
+	readFileFormatVersion( inputFile.stream() );
+
+	l1menuprotobuf::SampleHeader header;
+	size_t streamedNumberOfEvents=0;
+	float streamedSumOfWeights=0;
+	readProtobufRuns( inputFile.stream(), header, [&]( const l1menuprotobuf::Run& run )
+	{
+		streamedNumberOfEvents+=run.event_size();
+		for( const auto& event : run.event() ) streamedSumOfWeights+=( event.has_weight() ? event.weight() : 1 );
+	} );
 
-	// If control got this far then no trigger was found that matched
-	return false;
+	numberOfEvents=streamedNumberOfEvents;
+	sumOfWeights=streamedSumOfWeights;
+	streamedTotalsKnown=true;
 }
 
-const std::map<std::string,size_t> l1menu::ReducedSample::getTriggerParameterIdentifiers( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const
+void l1menu::ReducedSamplePrivateMembers::saveChunkedFormat( const std::string& filename ) const
 {
-	std::map<std::string,size_t> returnValue;
+	// Store quantised columns in as few bits as possible
+	std::vector<l1menu::implementation::ColumnEncoding> columnEncodings;
+	for( size_t columnNumber=0; columnNumber<thresholdGrids.size(); ++columnNumber )
+	{
+		columnEncodings.push_back( l1menu::implementation::ColumnEncoding::narrowestFor( thresholdGrids[columnNumber], parameterColumns[columnNumber], numberOfEvents ) );
+	}
+	if( sparseEncoding )
+	{
+		columnEncodings.resize( parameterColumns.size() );
+		for( auto& encoding : columnEncodings ) encoding.sparse=true;
+	}
 
-	// Need to find out how many parameters there are for each event. Basically the sum
-	// of the number of thresholds for all triggers.
-	size_t parameterNumber=0;
-	bool triggerWasFound=true;
-	for( size_t triggerNumber=0; triggerNumber<pImple_->triggerMenu.numberOfTriggers(); ++triggerNumber )
+	l1menu::implementation::ChunkedSampleFileWriter writer( filename, protobufSampleHeader, columnEncodings, codec, eventsAreCollapsed );
+	writeChunks( writer );
+	if( !thresholdIndex.empty() ) writer.writeThresholdIndex( thresholdIndex );
+	writer.close();
+}
+
+void l1menu::ReducedSamplePrivateMembers::appendChunkedFormat( const std::string& filename ) const
+{
+	std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> pWriter=l1menu::implementation::ChunkedSampleFileWriter::openForAppend( filename );
+
+	// The events only make sense if they were made with exactly the same menu. The header only has
+	// the menu in it, so I can just compare that.
+	if( pWriter->header().SerializeAsString()!=protobufSampleHeader.SerializeAsString() )
 	{
-		const l1menu::ITrigger& triggerInMenu=pImple_->triggerMenu.getTrigger(triggerNumber);
+		throw std::runtime_error( "ReducedSample::appendToFile - the trigger menu in "+filename+" is not the same as the one this sample was made with" );
+	}
 
-		triggerWasFound=true; // Set to true, then back to false if any of the tests fail
-		// See if this trigger in the menu is the same as the one passed as a parameter
-		if( triggerInMenu.name()!=trigger.name() ) triggerWasFound=false;
-		if( allowOlderVersion )
+	// New events have to use the encodings already in the file. If the file is quantised the thresholds
+	// get rounded down onto its grid, but they also have to fit in the same number of bits.
+	const auto& columnEncodings=pWriter->columnEncodings();
+	for( size_t columnNumber=0; columnNumber<columnEncodings.size(); ++columnNumber )
+	{
+		const auto& fileEncoding=columnEncodings[columnNumber];
+		if( fileEncoding.type==l1menu::implementation::ColumnEncoding::FLOAT32 ) continue;
+		const auto requiredEncoding=l1menu::implementation::ColumnEncoding::narrowestFor( fileEncoding.grid, parameterColumns[columnNumber], numberOfEvents );
+		if( requiredEncoding.type==l1menu::implementation::ColumnEncoding::FLOAT32 || requiredEncoding.type>fileEncoding.type )
 		{
-			if( triggerInMenu.version()>trigger.version() ) triggerWasFound=false;
+			throw std::runtime_error( "ReducedSample::appendToFile - some thresholds are too large to be stored in the quantised columns of "+filename+". Load and save the whole sample instead." );
 		}
-		else
+	}
+
+	writeChunks( *pWriter );
+	pWriter->close();
+}
+
+void l1menu::ReducedSamplePrivateMembers::writeChunks( l1menu::implementation::ChunkedSampleFileWriter& writer ) const
+{
+	std::vector<const float*> chunkColumns( parameterColumns.size() );
+	for( size_t firstEventInChunk=0; firstEventInChunk<numberOfEvents; firstEventInChunk+=eventsPerRun )
+	{
+		const size_t eventsInChunk=std::min( eventsPerRun, numberOfEvents-firstEventInChunk );
+		for( size_t columnNumber=0; columnNumber<parameterColumns.size(); ++columnNumber ) chunkColumns[columnNumber]=parameterColumns[columnNumber]+firstEventInChunk;
+		writer.writeChunk( pWeights+firstEventInChunk, chunkColumns, eventsInChunk, pWeightsSquared==nullptr ? nullptr : pWeightsSquared+firstEventInChunk );
+	}
+}
+
+std::vector<l1menu::implementation::ColumnEncoding> l1menu::ReducedSamplePrivateMembers::writerColumnEncodings() const
+{
+	std::vector<l1menu::implementation::ColumnEncoding> columnEncodings;
+	if( !streamedFilename.empty() && streamedFileFormatVersion==3 )
+	{
+		l1menu::implementation::ChunkedSampleFileReader reader( streamedFilename );
+		columnEncodings=projectColumnEncodings( reader.columnEncodings() );
+	}
+	else if( sparseEncoding ) columnEncodings.assign( parameterColumns.size(), l1menu::implementation::ColumnEncoding( l1menu::implementation::ColumnEncoding::FLOAT32, l1menu::implementation::ThresholdGrid(), true ) );
+
+	return columnEncodings;
+}
+
+std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> l1menu::ReducedSamplePrivateMembers::createWriterLike( const std::string& filename, bool hasWeightsSquared ) const
+{
+	return createWriter( filename, writerColumnEncodings(), hasWeightsSquared );
+}
+
+std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> l1menu::ReducedSamplePrivateMembers::createWriter( const std::string& filename, const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings, bool hasWeightsSquared ) const
+{
+	return std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter>( new l1menu::implementation::ChunkedSampleFileWriter( filename, protobufSampleHeader, columnEncodings, codec, hasWeightsSquared ) );
+}
+
+void l1menu::ReducedSamplePrivateMembers::copyEventsToWriters( const l1menu::ReducedSample& thisObject, const std::vector<size_t>& shardBoundaries, const std::vector<l1menu::implementation::ChunkedSampleFileWriter*>& writers )
+{
+	if( shardBoundaries.size()!=writers.size()+1 ) throw std::runtime_error( "ReducedSample - the number of shard boundaries doesn't match the number of files" );
+	for( const auto pWriter : writers )
+	{
+		if( pWriter->header().SerializeAsString()!=protobufSampleHeader.SerializeAsString() ) throw std::runtime_error( "ReducedSample - can't copy events between samples made with different trigger menus" );
+	}
+
+	// Writes a range of events to whichever writers they belong to. The range doesn't have to line
+	// up with the shards.
+	auto writeSlices=[&]( size_t firstEventNumber, size_t size, const float* pRangeWeights, const std::vector<const float*>& rangeColumns, const float* pRangeWeightsSquared )
+	{
+		std::vector<const float*> sliceColumns( rangeColumns.size() );
+		for( size_t shardNumber=0; shardNumber<writers.size(); ++shardNumber )
 		{
-			if( triggerInMenu.version()!=trigger.version() ) triggerWasFound=false;
+			const size_t sliceStart=std::max( firstEventNumber, shardBoundaries[shardNumber] );
+			const size_t sliceEnd=std::min( firstEventNumber+size, shardBoundaries[shardNumber+1] );
+			if( sliceStart>=sliceEnd ) continue;
+
+			for( size_t columnNumber=0; columnNumber<rangeColumns.size(); ++columnNumber ) sliceColumns[columnNumber]=rangeColumns[columnNumber]+sliceStart-firstEventNumber;
+			writers[shardNumber]->writeChunk( pRangeWeights+sliceStart-firstEventNumber, sliceColumns, sliceEnd-sliceStart, pRangeWeightsSquared==nullptr ? nullptr : pRangeWeightsSquared+sliceStart-firstEventNumber );
 		}
+	};
+
+	if( streamedFilename.empty() || streamedFileFormatVersion!=3 )
+	{
+		// No chunks to copy, so just go through the blocks. If streaming the columns only hold the
+		// current Run, which is what the block's column offset is relative to.
+		thisObject.forEachBlock( eventsPerRun, [&]( const l1menu::IEventBlock& eventBlock )
+		{
+			const size_t columnOffset=static_cast<const ::ReducedEventBlock*>(&eventBlock)->columnOffset();
+			std::vector<const float*> blockColumns;
+			for( const float* pColumn : parameterColumns ) blockColumns.push_back( pColumn+columnOffset );
+			writeSlices( eventBlock.firstEventNumber(), eventBlock.size(), pWeights+columnOffset, blockColumns, eventBlock.weightsSquared() );
+		} );
+		return;
+	}
 
-		// If control got this far then there is a trigger with the required name
-		// and sufficient version. I now need to check all of the non threshold parameters
-		// to make sure they match, i.e. make sure the ReducedSample was made with the same
-		// eta cuts or whatever.
-		// I don't care if the thresholds don't match because that's what's stored in the
-		// ReducedSample.
-		if( triggerWasFound ) // Trigger can still fail, but no point doing this check if it already has
+	l1menu::implementation::ChunkedSampleFileReader reader( streamedFilename );
+	std::string compressedChunk;
+	size_t firstEventInChunk=0;
+	for( size_t chunkNumber=0; chunkNumber<reader.chunkIndex().size(); ++chunkNumber )
+	{
+		const auto& indexEntry=reader.chunkIndex()[chunkNumber];
+		const size_t eventsInChunk=indexEntry.numberOfEvents;
+
+		// See if the whole chunk goes to a single writer that can take it as it is. It can't if some
+		// of the columns in the file aren't being kept.
+		l1menu::implementation::ChunkedSampleFileWriter* pCopyWriter=nullptr;
+		for( size_t shardNumber=0; shardNumber<writers.size() && fileColumnNumbers.empty(); ++shardNumber )
 		{
-			std::vector<std::string> parameterNames=l1menu::tools::getNonThresholdParameterNames( trigger );
-			for( const auto& parameterName : parameterNames )
+			if( shardBoundaries[shardNumber]<=firstEventInChunk && firstEventInChunk+eventsInChunk<=shardBoundaries[shardNumber+1]
+					&& writers[shardNumber]->codec()==reader.codec() && writers[shardNumber]->columnEncodings()==reader.columnEncodings()
+					&& writers[shardNumber]->hasWeightsSquared()==reader.hasWeightsSquared() )
 			{
-				if( trigger.parameter(parameterName)!=triggerInMenu.parameter(parameterName) ) triggerWasFound=false;
+				pCopyWriter=writers[shardNumber];
 			}
 		}
 
-		std::vector<std::string> thresholdNames=l1menu::tools::getThresholdNames(triggerInMenu);
-		if( triggerWasFound )
+		if( pCopyWriter!=nullptr )
 		{
-			for( const auto& thresholdName : thresholdNames )
+			reader.readCompressedChunk( chunkNumber, compressedChunk );
+			pCopyWriter->writeCompressedChunk( indexEntry, compressedChunk );
+		}
+		else if( firstEventInChunk<shardBoundaries.back() && firstEventInChunk+eventsInChunk>shardBoundaries.front() )
+		{
+			weights.resize( eventsInChunk );
+			std::vector<const float*> constChunkColumns;
+			for( auto& column : thresholdColumns )
 			{
-				returnValue[thresholdName]=parameterNumber;
-				++parameterNumber;
+				column.resize( eventsInChunk );
+				constChunkColumns.push_back( column.data() );
 			}
-			break;
+			if( eventsAreCollapsed ) weightsSquared.resize( eventsInChunk );
+			reader.readChunk( chunkNumber, weights.data(), fileColumnPointers(0), eventsAreCollapsed ? weightsSquared.data() : nullptr );
+			writeSlices( firstEventInChunk, eventsInChunk, weights.data(), constChunkColumns, eventsAreCollapsed ? weightsSquared.data() : nullptr );
 		}
-		else parameterNumber+=thresholdNames.size();
+
+		firstEventInChunk+=eventsInChunk;
+	}
+	updateColumnPointers();
+}
+
+void l1menu::ReducedSamplePrivateMembers::saveProtobufFormat( int fileDescriptor ) const
+{
+	// There's nowhere in the protobuf Event message to put the sum of squared weights, so collapsed
+	// events can't be saved unless none of them were actually merged with any others.
+	if( pWeightsSquared!=nullptr )
+	{
+		for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+		{
+			if( pWeightsSquared[eventNumber]!=pWeights[eventNumber]*pWeights[eventNumber] ) throw std::runtime_error( "ReducedSample save to file - samples with identical events collapsed can't be saved in the PROTOBUF format, use CHUNKED or MEMORYMAPPED" );
+		}
+	}
+
+	// Setup the protobuf file handlers
+	google::protobuf::io::FileOutputStream fileOutput( fileDescriptor );
+
+	// I want the magic number and file format identifier uncompressed, so
+	// I'll write those before switching to using gzipped output.
+	{ // Block to make sure codedOutput is destructed before the gzip version is created
+		google::protobuf::io::CodedOutputStream codedOutput( &fileOutput );
+
+		// Write a magic number at the start of all files
+		codedOutput.WriteString( FILE_FORMAT_MAGIC_NUMBER );
+		// Write an integer that specifies what version of the file format I'm using.
+		codedOutput.WriteVarint32( 1 );
+	}
+
+	google::protobuf::io::GzipOutputStream gzipOutput( &fileOutput );
+	google::protobuf::io::CodedOutputStream codedOutput( &gzipOutput );
+
+	// Write the size of the header message into the file...
+	codedOutput.WriteVarint64( protobufSampleHeader.ByteSize() );
+	// ...and then write the header
+	protobufSampleHeader.SerializeToCodedStream( &codedOutput );
+
+	// The events are held in columns, so I need to convert them back into protobuf Runs. Split the
+	// events up into groups in arbitrary numbers. This is to get around a protobuf aversion to long
+	// messages.
+	l1menuprotobuf::Run protobufRun;
+	for( size_t firstEventInRun=0; firstEventInRun<numberOfEvents; firstEventInRun+=eventsPerRun )
+	{
+		const size_t lastEventInRun=std::min( numberOfEvents, firstEventInRun+eventsPerRun );
+
+		protobufRun.Clear();
+		for( size_t eventNumber=firstEventInRun; eventNumber<lastEventInRun; ++eventNumber )
+		{
+			l1menuprotobuf::Event* pProtobufEvent=protobufRun.add_event();
+			for( const auto& pColumn : parameterColumns ) pProtobufEvent->add_threshold( pColumn[eventNumber] );
+			if( pWeights[eventNumber]!=1 ) pProtobufEvent->set_weight( pWeights[eventNumber] );
+		}
+
+		codedOutput.WriteVarint64( protobufRun.ByteSize() );
+		protobufRun.SerializeToCodedStream( &codedOutput );
+	}
+}
+
+void l1menu::ReducedSamplePrivateMembers::saveMemoryMappedFormat( int fileDescriptor ) const
+{
+	// The layout of the file is:
+	//     magic number                       uncompressed, same as version 1
+	//     version                            varint32, value 2 (so a single byte)
+	//     header size                        fixed64
+	//     SampleHeader                       uncompressed protobuf message
+	//     number of events                   fixed64
+	//     number of parameter columns        fixed32
+	//     sum of weights                     32 bit float
+	//     zero padding to COLUMN_ALIGNMENT
+	//     weights column, then one column for each parameter in the order they're listed in
+	//     the header, then the sum of squared weights column if identical events have been
+	//     collapsed (the number of columns is then one more than the number of parameters).
+	//     Each column is numberOfEvents 32 bit floats, zero padded to COLUMN_ALIGNMENT.
+	// All numbers and floats are in the native little endian byte order, so that the columns can
+	// be used directly from the mapped memory without any conversion.
+	google::protobuf::io::FileOutputStream fileOutput( fileDescriptor );
+	google::protobuf::io::CodedOutputStream codedOutput( &fileOutput );
+
+	codedOutput.WriteString( FILE_FORMAT_MAGIC_NUMBER );
+	codedOutput.WriteVarint32( 2 );
+
+	const size_t headerSize=protobufSampleHeader.ByteSize();
+	codedOutput.WriteLittleEndian64( headerSize );
+	protobufSampleHeader.SerializeToCodedStream( &codedOutput );
+
+	google::protobuf::uint32 sumOfWeightsBits;
+	std::memcpy( &sumOfWeightsBits, &sumOfWeights, sizeof(sumOfWeightsBits) );
+	codedOutput.WriteLittleEndian64( numberOfEvents );
+	codedOutput.WriteLittleEndian32( parameterColumns.size()+(pWeightsSquared==nullptr ? 0 : 1) );
+	codedOutput.WriteLittleEndian32( sumOfWeightsBits );
+
+	// Work out the position by hand rather than use ByteCount(), because that's an int and the
+	// files can get larger than that.
+	const size_t position=FILE_FORMAT_MAGIC_NUMBER.size()+1+8+headerSize+8+4+4;
+	const size_t columnBytes=numberOfEvents*sizeof(float);
+	const std::string padding( COLUMN_ALIGNMENT, '\0' );
+	codedOutput.WriteRaw( padding.data(), ::roundUp( position, COLUMN_ALIGNMENT )-position );
+
+	std::vector<const float*> allColumns( 1, pWeights );
+	allColumns.insert( allColumns.end(), parameterColumns.begin(), parameterColumns.end() );
+	if( pWeightsSquared!=nullptr ) allColumns.push_back( pWeightsSquared );
+	for( const float* pColumn : allColumns )
+	{
+		// WriteRaw takes an int for the size, so write large columns in blocks.
+		const char* pBytes=reinterpret_cast<const char*>( pColumn );
+		const size_t maximumBlockSize=1<<30;
+		for( size_t bytesWritten=0; bytesWritten<columnBytes; bytesWritten+=maximumBlockSize )
+		{
+			codedOutput.WriteRaw( pBytes+bytesWritten, std::min( maximumBlockSize, columnBytes-bytesWritten ) );
+		}
+		codedOutput.WriteRaw( padding.data(), ::roundUp( columnBytes, COLUMN_ALIGNMENT )-columnBytes );
+	}
+
+	if( codedOutput.HadError() ) throw std::runtime_error( "ReducedSample save to file - error while writing the file" );
+}
+
+void l1menu::ReducedSamplePrivateMembers::collapseIdenticalEvents()
+{
+	// Find which row each event goes in. The map is keyed on the number of the first event with each
+	// set of thresholds, but hashed and compared on the thresholds themselves. Rows are numbered in
+	// the order their first event appears, so the order of the sample is kept as far as possible.
+	::EventThresholdsComparison comparison( parameterColumns );
+	std::unordered_map<size_t,size_t,::EventThresholdsComparison,::EventThresholdsComparison> rowNumbers( numberOfEvents, comparison, comparison );
+	std::vector<size_t> rowOfEvent( numberOfEvents );
+	size_t numberOfRows=0;
+	for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+	{
+		auto insertResult=rowNumbers.insert( std::make_pair( eventNumber, numberOfRows ) );
+		if( insertResult.second ) ++numberOfRows;
+		rowOfEvent[eventNumber]=insertResult.first->second;
+	}
+
+	// Sum in double precision since there could be very many events in a row
+	std::vector<double> rowWeights( numberOfRows, 0 );
+	std::vector<double> rowWeightsSquared( numberOfRows, 0 );
+	for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+	{
+		rowWeights[rowOfEvent[eventNumber]]+=pWeights[eventNumber];
+		rowWeightsSquared[rowOfEvent[eventNumber]]+=( pWeightsSquared==nullptr ? pWeights[eventNumber]*pWeights[eventNumber] : pWeightsSquared[eventNumber] );
+	}
+
+	// An event is the first in its row if its row number is the next one not seen yet. The first event
+	// in a row is never after the event it replaces, so I can move them down the columns in place.
+	for( auto& column : thresholdColumns )
+	{
+		size_t nextRow=0;
+		for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+		{
+			if( rowOfEvent[eventNumber]==nextRow ) column[nextRow++]=column[eventNumber];
+		}
+		column.resize( numberOfRows );
+	}
+	weights.assign( rowWeights.begin(), rowWeights.end() );
+	weightsSquared.assign( rowWeightsSquared.begin(), rowWeightsSquared.end() );
+
+	eventsAreCollapsed=true;
+	numberOfEvents=numberOfRows;
+	zoneMaps.clear();
+	updateColumnPointers();
+}
+
+l1menu::ReducedSample::ReducedSample( const l1menu::FullSample& originalSample, const l1menu::TriggerMenu& triggerMenu )
+	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, triggerMenu ) )
+{
+	addSample( originalSample );
+	setEventRate( originalSample.eventRate() );
+}
+
+l1menu::ReducedSample::ReducedSample( const l1menu::TriggerMenu& triggerMenu )
+	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, triggerMenu ) )
+{
+	// No operation besides the initialiser list
+}
+
+l1menu::ReducedSample::ReducedSample( const l1menu::TriggerMenu& triggerMenu, const ParameterGrid& nonThresholdParameterGrid )
+	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, ::expandOverParameterGrid( triggerMenu, nonThresholdParameterGrid ) ) )
+{
+	// No operation besides the initialiser list
+}
+
+l1menu::ReducedSample::ReducedSample( const std::string& filename, bool streamFromFile )
+	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, filename, streamFromFile, nullptr ) )
+{
+	// No operation except the initialiser list
+}
+
+l1menu::ReducedSample::ReducedSample( const std::string& filename, const l1menu::TriggerMenu& projectionMenu, bool streamFromFile )
+	: pImple_( new l1menu::ReducedSamplePrivateMembers( *this, filename, streamFromFile, &projectionMenu ) )
+{
+	// No operation except the initialiser list
+}
+
+l1menu::ReducedSample::~ReducedSample()
+{
+	// No operation. Just need one defined otherwise the default one messes up
+	// the unique_ptr deletion because ReducedSamplePrivateMembers isn't
+	// defined elsewhere.
+}
+
+void l1menu::ReducedSample::addSample( const l1menu::FullSample& originalSample )
+{
+	// If the data is in a memory mapped file or being streamed I need to have my own copy
+	// before I can add to it.
+	pImple_->copyMappedFileToColumns();
+	pImple_->loadStreamedFile();
+
+	const size_t firstNewEventNumber=pImple_->weights.size();
+	// I don't reserve space here. Asking for exactly the new size would reallocate every column
+	// each time a file is added, which is quadratic in the number of files.
+	pImple_->reduceEvents( originalSample, 0, originalSample.numberOfEvents(), pImple_->thresholdColumns, pImple_->weights, pImple_->weightsSquared );
+	pImple_->finishAddingEvents( firstNewEventNumber );
+}
+
+void l1menu::ReducedSample::addNtupleFiles( const std::vector<std::string>& ntupleFilenames, size_t numberOfThreads )
+{
+	pImple_->copyMappedFileToColumns();
+	pImple_->loadStreamedFile();
+
+	// The FullSamples are created on the worker threads, so ROOT has to be set up here first
+	l1menu::FullSample::initialiseROOT();
+
+	// Find out how many events are in each file first, so that the work can be split into even sized
+	// ranges. Each range gets its own FullSample since they can't be shared between threads.
+	std::vector<size_t> eventsInFile( ntupleFilenames.size() );
+	l1menu::tools::parallelFor( ntupleFilenames.size(), [&]( size_t fileNumber )
+	{
+		l1menu::FullSample inputSample;
+		inputSample.loadFile( ntupleFilenames[fileNumber] );
+		eventsInFile[fileNumber]=inputSample.numberOfEvents();
+	}, numberOfThreads );
+
+	std::vector<::NtupleEventRange> eventRanges;
+	for( size_t fileNumber=0; fileNumber<ntupleFilenames.size(); ++fileNumber )
+	{
+		for( size_t firstEventNumber=0; firstEventNumber<eventsInFile[fileNumber]; firstEventNumber+=pImple_->NTUPLE_EVENTS_PER_TASK )
+		{
+			::NtupleEventRange eventRange;
+			eventRange.fileNumber=fileNumber;
+			eventRange.firstEventNumber=firstEventNumber;
+			eventRange.lastEventNumber=std::min( eventsInFile[fileNumber], firstEventNumber+pImple_->NTUPLE_EVENTS_PER_TASK );
+			eventRanges.push_back( std::move(eventRange) );
+		}
+	}
+
+	l1menu::tools::parallelFor( eventRanges.size(), [&]( size_t rangeNumber )
+	{
+		::NtupleEventRange& eventRange=eventRanges[rangeNumber];
+		l1menu::FullSample inputSample;
+		inputSample.setRequiredCollections( pImple_->triggerMenu ); // Only read what the menu needs from the ntuple
+		inputSample.loadFile( ntupleFilenames[eventRange.fileNumber] );
+		eventRange.thresholdColumns.resize( pImple_->thresholdColumns.size() );
+		pImple_->reduceEvents( inputSample, eventRange.firstEventNumber, eventRange.lastEventNumber, eventRange.thresholdColumns, eventRange.weights, eventRange.weightsSquared );
+	}, numberOfThreads );
+
+	// Now add the ranges on in the order they were in the files, so that the result is exactly
+	// the same as adding each file in turn with addSample(). I free each one as I go to keep
+	// the memory down. Like addSample() I let the columns grow by themselves rather than reserving
+	// exactly the new size, which would make repeated calls quadratic.
+	const size_t firstNewEventNumber=pImple_->weights.size();
+
+	for( auto& eventRange : eventRanges )
+	{
+		for( size_t columnNumber=0; columnNumber<pImple_->thresholdColumns.size(); ++columnNumber )
+		{
+			pImple_->thresholdColumns[columnNumber].insert( pImple_->thresholdColumns[columnNumber].end(), eventRange.thresholdColumns[columnNumber].begin(), eventRange.thresholdColumns[columnNumber].end() );
+		}
+		pImple_->weights.insert( pImple_->weights.end(), eventRange.weights.begin(), eventRange.weights.end() );
+		pImple_->weightsSquared.insert( pImple_->weightsSquared.end(), eventRange.weightsSquared.begin(), eventRange.weightsSquared.end() );
+		eventRange=::NtupleEventRange();
+	}
+
+	pImple_->finishAddingEvents( firstNewEventNumber );
+}
+
+void l1menu::ReducedSample::saveToFile( const std::string& filename, l1menu::ReducedSample::FileFormat format ) const
+{
+	// The save routines work from the columns, so if streaming I need everything in memory.
+	pImple_->loadStreamedFile();
+	// Memory mapped files are mapped shared, so if the output is the file that was loaded, truncating
+	// it would pull the data out from under the mapping (and the next read of it would be a SIGBUS).
+	// Copy everything into memory first so that it doesn't matter where the output goes.
+	pImple_->copyMappedFileToColumns();
+
+	// The chunked writer takes care of opening the file itself
+	if( format==FileFormat::CHUNKED )
+	{
+		pImple_->saveChunkedFormat( filename );
+		return;
+	}
+
+	// Open the file. Parameters are filename, write ability, create and truncate, rw-r--r-- permissions.
+	int fileDescriptor = open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fileDescriptor<0 ) throw std::runtime_error( "ReducedSample save to file - couldn't open file" );
+	::UnixFileSentry fileSentry( fileDescriptor ); // Use this as an exception safe way of closing the output file
+
+	if( format==FileFormat::MEMORYMAPPED ) pImple_->saveMemoryMappedFormat( fileDescriptor );
+	else pImple_->saveProtobufFormat( fileDescriptor );
+}
+
+void l1menu::ReducedSample::appendToFile( const std::string& filename ) const
+{
+	// If there's nothing there yet this is the same as saving
+	if( access( filename.c_str(), F_OK )!=0 )
+	{
+		saveToFile( filename, FileFormat::CHUNKED );
+		return;
+	}
+
+	pImple_->loadStreamedFile();
+	pImple_->appendChunkedFormat( filename );
+}
+
+void l1menu::ReducedSample::mergeFiles( const std::vector<std::string>& inputFilenames, const std::string& outputFilename )
+{
+	if( inputFilenames.empty() ) throw std::runtime_error( "ReducedSample::mergeFiles - no input files were given" );
+	for( const auto& inputFilename : inputFilenames )
+	{
+		if( ::isSameFile( inputFilename, outputFilename ) ) throw std::runtime_error( "ReducedSample::mergeFiles - the output file "+outputFilename+" is also one of the inputs" );
+	}
+
+	// If any of the inputs have identical events collapsed the output needs somewhere to put the sums
+	// of squared weights. If all of the inputs store their columns the same way the output does too,
+	// so that the chunks can be copied across without decompressing. Otherwise the values in one input
+	// might not fit the encoding of another (e.g. a different quantisation grid), so the output is
+	// stored as plain floats. Opening the inputs only reads the headers so this is quick.
+	bool anyInputIsCollapsed=false;
+	std::vector<l1menu::implementation::ColumnEncoding> columnEncodings;
+	for( size_t inputNumber=0; inputNumber<inputFilenames.size(); ++inputNumber )
+	{
+		l1menu::ReducedSample inputSample( inputFilenames[inputNumber], true );
+		if( inputSample.pImple_->eventsAreCollapsed ) anyInputIsCollapsed=true;
+		if( inputNumber==0 ) columnEncodings=inputSample.pImple_->writerColumnEncodings();
+		else if( inputSample.pImple_->writerColumnEncodings()!=columnEncodings ) columnEncodings.clear();
+	}
+
+	std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> pWriter;
+	{ // Block to limit the scope of firstSample
+		l1menu::ReducedSample firstSample( inputFilenames.front(), true );
+		pWriter=firstSample.pImple_->createWriter( outputFilename, columnEncodings, anyInputIsCollapsed );
+	}
+
+	try
+	{
+		const std::vector<size_t> shardBoundaries={ 0, std::numeric_limits<size_t>::max() };
+		for( const auto& inputFilename : inputFilenames )
+		{
+			l1menu::ReducedSample inputSample( inputFilename, true );
+			inputSample.pImple_->copyEventsToWriters( inputSample, shardBoundaries, { pWriter.get() } );
+		}
+
+		pWriter->close();
+	}
+	catch( ... )
+	{
+		// Don't leave a partly written file lying around that can't be read
+		pWriter.reset();
+		::unlink( outputFilename.c_str() );
+		throw;
+	}
+}
+
+void l1menu::ReducedSample::splitFile( const std::string& inputFilename, const std::vector<std::string>& outputFilenames )
+{
+	if( outputFilenames.empty() ) throw std::runtime_error( "ReducedSample::splitFile - no output files were given" );
+	for( const auto& outputFilename : outputFilenames )
+	{
+		if( ::isSameFile( inputFilename, outputFilename ) ) throw std::runtime_error( "ReducedSample::splitFile - the output file "+outputFilename+" is also the input" );
+	}
+
+	l1menu::ReducedSample inputSample( inputFilename, true );
+	const size_t totalNumberOfEvents=inputSample.numberOfEvents();
+
+	std::vector<size_t> shardBoundaries;
+	std::vector< std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> > writers;
+	std::vector<l1menu::implementation::ChunkedSampleFileWriter*> writerPointers;
+	for( size_t shardNumber=0; shardNumber<outputFilenames.size(); ++shardNumber )
+	{
+		shardBoundaries.push_back( totalNumberOfEvents*shardNumber/outputFilenames.size() );
+		writers.push_back( inputSample.pImple_->createWriterLike( outputFilenames[shardNumber], inputSample.pImple_->eventsAreCollapsed ) );
+		writerPointers.push_back( writers.back().get() );
+	}
+	shardBoundaries.push_back( totalNumberOfEvents );
+
+	try
+	{
+		inputSample.pImple_->copyEventsToWriters( inputSample, shardBoundaries, writerPointers );
+		for( auto& pWriter : writers ) pWriter->close();
+	}
+	catch( ... )
+	{
+		// Don't leave partly written files lying around that can't be read
+		writers.clear();
+		for( const auto& outputFilename : outputFilenames ) ::unlink( outputFilename.c_str() );
+		throw;
+	}
+}
+
+void l1menu::ReducedSample::collapseIdenticalEvents()
+{
+	pImple_->copyMappedFileToColumns();
+	pImple_->loadStreamedFile();
+	pImple_->collapseIdenticalEvents();
+}
+
+bool l1menu::ReducedSample::eventsAreCollapsed() const
+{
+	return pImple_->eventsAreCollapsed;
+}
+
+void l1menu::ReducedSample::buildThresholdIndex()
+{
+	pImple_->loadStreamedFile();
+
+	// Each column's index is independent of the others, so they can be built in parallel
+	std::vector<l1menu::implementation::ThresholdIndex> newThresholdIndex( pImple_->parameterColumns.size() );
+	l1menu::tools::parallelFor( newThresholdIndex.size(), [&]( size_t columnNumber )
+	{
+		newThresholdIndex[columnNumber]=l1menu::implementation::ThresholdIndex::forColumn( pImple_->parameterColumns[columnNumber], pImple_->pWeights, pImple_->pWeightsSquared, pImple_->numberOfEvents );
+	} );
+	pImple_->thresholdIndex.swap( newThresholdIndex );
+}
+
+bool l1menu::ReducedSample::hasThresholdIndex() const
+{
+	return !pImple_->thresholdIndex.empty();
+}
+
+std::pair<double,double> l1menu::ReducedSample::weightPassingThreshold( l1menu::ReducedEvent::ParameterID parameter, float threshold ) const
+{
+	if( pImple_->thresholdIndex.empty() ) throw std::runtime_error( "ReducedSample::weightPassingThreshold() called for a sample without a threshold index" );
+	if( parameter>=pImple_->thresholdIndex.size() ) throw std::runtime_error( "ReducedSample::weightPassingThreshold() called with an invalid parameter" );
+
+	return pImple_->thresholdIndex[parameter].weightPassing( threshold );
+}
+
+void l1menu::ReducedSample::setThresholdQuantisation( bool quantise )
+{
+	if( !quantise )
+	{
+		pImple_->thresholdGrids.clear();
+		return;
 	}
 
+	// Need my own copy of the data to be able to change it. Snapping the thresholds changes which
+	// ones each event passes, so the threshold index has to go as well.
+	pImple_->copyMappedFileToColumns();
+	pImple_->loadStreamedFile();
+	pImple_->thresholdIndex.clear();
+	pImple_->zoneMaps.clear();
+
+	// The columns are in the order the varying parameters are listed in the header. Every parameter
+	// of a trigger gets the same grid.
+	pImple_->thresholdGrids.clear();
+	for( const auto& trigger : pImple_->protobufSampleHeader.trigger() )
+	{
+		pImple_->thresholdGrids.insert( pImple_->thresholdGrids.end(), trigger.varying_parameter_size(), l1menu::implementation::ThresholdGrid::forTriggerParameter( trigger.name() ) );
+	}
+
+	for( size_t columnNumber=0; columnNumber<pImple_->thresholdColumns.size(); ++columnNumber )
+	{
+		const auto& grid=pImple_->thresholdGrids[columnNumber];
+		for( auto& threshold : pImple_->thresholdColumns[columnNumber] ) threshold=grid.snap( threshold );
+	}
+}
+
+bool l1menu::ReducedSample::thresholdsAreQuantised() const
+{
+	return !pImple_->thresholdGrids.empty();
+}
+
+void l1menu::ReducedSample::setEventsPerRun( size_t eventsPerRun )
+{
+	if( eventsPerRun==0 ) throw std::runtime_error( "ReducedSample::setEventsPerRun - the number of events per run must be greater than zero" );
+	pImple_->eventsPerRun=eventsPerRun;
+}
+
+size_t l1menu::ReducedSample::eventsPerRun() const
+{
+	return pImple_->eventsPerRun;
+}
+
+void l1menu::ReducedSample::setCodec( l1menu::ReducedSample::Codec codec )
+{
+	pImple_->codec=codec;
+}
+
+l1menu::ReducedSample::Codec l1menu::ReducedSample::codec() const
+{
+	return pImple_->codec;
+}
+
+void l1menu::ReducedSample::setSparseEncoding( bool sparseEncoding )
+{
+	pImple_->sparseEncoding=sparseEncoding;
+}
+
+bool l1menu::ReducedSample::sparseEncoding() const
+{
+	return pImple_->sparseEncoding;
+}
+
+size_t l1menu::ReducedSample::numberOfEvents() const
+{
+	pImple_->calculateStreamedTotals();
+	return pImple_->numberOfEvents;
+}
+
+const l1menu::TriggerMenu& l1menu::ReducedSample::getTriggerMenu() const
+{
+	return pImple_->triggerMenu;
+}
+
+bool l1menu::ReducedSample::containsTrigger( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const
+{
+	return pImple_->triggerColumns( trigger, allowOlderVersion ).triggerWasFound;
+}
+
+const std::map<std::string,size_t>& l1menu::ReducedSample::getTriggerParameterIdentifiers( const l1menu::ITrigger& trigger, bool allowOlderVersion ) const
+{
+	const ::TriggerColumns& triggerColumns=pImple_->triggerColumns( trigger, allowOlderVersion );
+
 	// There could conceivably be a trigger that was found but has no thresholds
 	// (I guess - it would be a pretty pointless trigger though). To indicate the
 	// difference between that and a trigger that wasn't found I'll respectively
-	// return the empty vector or throw an exception.
-	if( !triggerWasFound ) throw std::runtime_error( "l1menu::ReducedSample::getTriggerParameterIdentifiers() called for a trigger that was not used to create the sample - "+trigger.name() );
+	// return the empty map or throw an exception.
+	if( !triggerColumns.triggerWasFound ) throw std::runtime_error( "l1menu::ReducedSample::getTriggerParameterIdentifiers() called for a trigger that was not used to create the sample - "+trigger.name() );
 
-	return returnValue;
+	return triggerColumns.parameterIdentifiers;
 }
 
 const l1menu::IEvent& l1menu::ReducedSample::getEvent( size_t eventNumber ) const
 {
-	for( const auto& pRun : pImple_->protobufRuns )
+	if( !pImple_->streamedFilename.empty() ) throw std::runtime_error( "ReducedSample::getEvent(eventNumber) can't be used when streaming from file, use forEachBlock() instead" );
+	if( eventNumber>=pImple_->numberOfEvents ) throw std::runtime_error( "ReducedSample::getEvent(eventNumber) was asked for an invalid eventNumber" );
+
+	return pImple_->eventAtColumnIndex( eventNumber );
+}
+
+std::unique_ptr<l1menu::IEvent> l1menu::ReducedSample::getEventCopy( size_t eventNumber ) const
+{
+	if( !pImple_->streamedFilename.empty() ) throw std::runtime_error( "ReducedSample::getEventCopy(eventNumber) can't be used when streaming from file, use forEachBlock() instead" );
+	if( eventNumber>=pImple_->numberOfEvents ) throw std::runtime_error( "ReducedSample::getEventCopy(eventNumber) was asked for an invalid eventNumber" );
+
+	// The event is just an index into the columns, so it's cheap to make a new one. I don't copy
+	// pImple_->event because getEvent() could be changing it on another thread.
+	std::unique_ptr<l1menu::ReducedEvent> pNewEvent( new l1menu::ReducedEvent(*this) );
+	pNewEvent->eventNumber_=eventNumber;
+	pNewEvent->pParameterColumns_=pImple_->parameterColumns.data();
+	pNewEvent->pWeights_=pImple_->pWeights;
+	pNewEvent->pWeightsSquared_=pImple_->pWeightsSquared;
+	return std::unique_ptr<l1menu::IEvent>( pNewEvent.release() );
+}
+
+void l1menu::ReducedSample::forEachBlock( size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const
+{
+	if( blockSize==0 ) throw std::runtime_error( "ReducedSample::forEachBlock() was called with a block size of zero" );
+
+	if( !pImple_->streamedFilename.empty() )
+	{
+		pImple_->streamBlocks( *this, blockSize, function );
+		return;
+	}
+
+	// Everything is already in the columns, so the blocks are just ranges of them.
+	::ReducedEventBlock block( *this, *pImple_ );
+	for( size_t firstEventNumber=0; firstEventNumber<pImple_->numberOfEvents; firstEventNumber+=blockSize )
+	{
+		block.setRange( firstEventNumber, std::min( blockSize, pImple_->numberOfEvents-firstEventNumber ), firstEventNumber );
+		function( block );
+	}
+}
+
+double l1menu::ReducedSample::forEachBlockPassingAny( const std::vector<const l1menu::ITrigger*>& triggers, size_t blockSize, const std::function<void(const l1menu::IEventBlock&)>& function ) const
+{
+	if( blockSize==0 ) throw std::runtime_error( "ReducedSample::forEachBlockPassingAny() was called with a block size of zero" );
+
+	const ::ZoneMapCheck zoneMapCheck( *this, triggers );
+	if( !pImple_->streamedFilename.empty() ) return pImple_->streamBlocks( *this, blockSize, function, &zoneMapCheck );
+
+	// Go through the zone maps, and only split up the ones that could have something passing into blocks.
+	// Blocks don't span zone maps, so some might be smaller than blockSize.
+	pImple_->buildZoneMaps();
+	double skippedSumOfWeights=0;
+	::ReducedEventBlock block( *this, *pImple_ );
+	std::vector<uint64_t> candidateBits;
+	std::vector<size_t> candidateEventNumbers;
+	std::vector<float> candidateWeights;
+	std::vector<float> candidateWeightsSquared;
+	for( size_t zoneNumber=0; zoneNumber<pImple_->zoneMaps.size(); ++zoneNumber )
 	{
-		if( eventNumber<static_cast<size_t>(pRun->event_size()) )
+		const ::ZoneMap& zoneMap=pImple_->zoneMaps[zoneNumber];
+		if( !zoneMapCheck.anyCouldPass( zoneMap.maximumValues.data() ) )
+		{
+			skippedSumOfWeights+=zoneMap.sumOfWeights;
+			continue;
+		}
+
+		const size_t firstEventInZone=zoneNumber*l1menu::ReducedSamplePrivateMembers::ZONE_MAP_SIZE;
+		const size_t endOfZone=std::min( firstEventInZone+l1menu::ReducedSamplePrivateMembers::ZONE_MAP_SIZE, pImple_->numberOfEvents );
+
+		// Most thresholds are -1 for most events, so often only a few events in the zone could pass. If
+		// that's less than half of them it's quicker to gather those into blocks than go through them all.
+		if( zoneMapCheck.findCandidates( zoneMap, candidateBits ) )
+		{
+			candidateEventNumbers.clear();
+			for( size_t word=0; word<candidateBits.size(); ++word )
+			{
+				for( uint64_t bits=candidateBits[word]; bits!=0; bits&=bits-1 )
+				{
+					candidateEventNumbers.push_back( firstEventInZone+word*64+__builtin_ctzll(bits) );
+				}
+			}
+
+			if( candidateEventNumbers.size()*2<=endOfZone-firstEventInZone )
+			{
+				candidateWeights.clear();
+				candidateWeightsSquared.clear();
+				double candidateSumOfWeights=0;
+				for( const auto eventNumber : candidateEventNumbers )
+				{
+					candidateWeights.push_back( pImple_->pWeights[eventNumber] );
+					candidateSumOfWeights+=pImple_->pWeights[eventNumber];
+					if( pImple_->pWeightsSquared!=nullptr ) candidateWeightsSquared.push_back( pImple_->pWeightsSquared[eventNumber] );
+				}
+				skippedSumOfWeights+=zoneMap.sumOfWeights-candidateSumOfWeights;
+
+				for( size_t firstIndex=0; firstIndex<candidateEventNumbers.size(); firstIndex+=blockSize )
+				{
+					block.setGathered( &candidateEventNumbers[firstIndex], &candidateWeights[firstIndex],
+							pImple_->pWeightsSquared==nullptr ? nullptr : &candidateWeightsSquared[firstIndex],
+							std::min( blockSize, candidateEventNumbers.size()-firstIndex ) );
+					function( block );
+				}
+				continue;
+			}
+		}
+
+		for( size_t firstEventNumber=firstEventInZone; firstEventNumber<endOfZone; firstEventNumber+=blockSize )
 		{
-			pImple_->event.pProtobufEvent_=pRun->mutable_event(eventNumber);
-			return pImple_->event;
+			block.setRange( firstEventNumber, std::min( blockSize, endOfZone-firstEventNumber ), firstEventNumber );
+			function( block );
 		}
-		// Event must be in a later run, so reduce the number by how many events
-		// were in this run and look again.
-		eventNumber-=pRun->event_size();
 	}
 
-	// Should always find the event before getting to this point, so throw an
-	// exception if this happens.
-	throw std::runtime_error( "ReducedSample::getEvent(eventNumber) was asked for an invalid eventNumber" );
+	return skippedSumOfWeights;
 }
 
 std::unique_ptr<l1menu::ICachedTrigger> l1menu::ReducedSample::createCachedTrigger( const l1menu::ITrigger& trigger ) const
 {
-	return std::unique_ptr<l1menu::ICachedTrigger>( new CachedTriggerImplementation(*this,trigger) );
+	return std::unique_ptr<l1menu::ICachedTrigger>( new CachedTriggerImplementation(*this,trigger,pImple_->parameterColumns) );
 }
 
 float l1menu::ReducedSample::eventRate() const
@@ -526,11 +2251,36 @@ void l1menu::ReducedSample::setEventRate( float rate )
 
 float l1menu::ReducedSample::sumOfWeights() const
 {
+	pImple_->calculateStreamedTotals();
 	return pImple_->sumOfWeights;
 }
 
 std::shared_ptr<const l1menu::IMenuRate> l1menu::ReducedSample::rate( const l1menu::TriggerMenu& menu ) const
 {
+	// A menu with just one trigger that only has one threshold can be done straight from the threshold
+	// index, without looking at any of the events. The total and pure rates are just the trigger rate.
+	if( menu.numberOfTriggers()==1 && !pImple_->thresholdIndex.empty() )
+	{
+		const l1menu::ITrigger& trigger=menu.getTrigger(0);
+		const auto parameterIdentifiers=getTriggerParameterIdentifiers( trigger );
+		if( parameterIdentifiers.size()==1 )
+		{
+			const auto& parameterIdentifier=*parameterIdentifiers.begin();
+			const std::pair<double,double> weightPassing=weightPassingThreshold( parameterIdentifier.second, trigger.parameter(parameterIdentifier.first) );
+			const float fraction=weightPassing.first/sumOfWeights();
+			const float fractionError=std::sqrt(weightPassing.second)/sumOfWeights();
+			const float scaling=eventRate();
+
+			std::shared_ptr<l1menu::implementation::MenuRateImplementation> pMenuRate( new l1menu::implementation::MenuRateImplementation );
+			pMenuRate->addTriggerRate( l1menu::implementation::TriggerRateImplementation( trigger, fraction, fractionError, fraction*scaling, fractionError*scaling, fraction, fractionError, fraction*scaling, fractionError*scaling ) );
+			pMenuRate->setTotalFraction( fraction );
+			pMenuRate->setTotalFractionError( fractionError );
+			pMenuRate->setTotalRate( fraction*scaling );
+			pMenuRate->setTotalRateError( fractionError*scaling );
+			return pMenuRate;
+		}
+	}
+
 	// TODO make sure the TriggerMenu is valid for this sample
 	return std::shared_ptr<const l1menu::IMenuRate>( new l1menu::implementation::MenuRateImplementation( menu, *this ) );
 }
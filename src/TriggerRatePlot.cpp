@@ -4,11 +4,14 @@
 #include "l1menu/ICachedTrigger.h"
 #include "l1menu/L1TriggerDPGEvent.h"
 #include "l1menu/IEvent.h"
+#include "l1menu/IEventBlock.h"
 #include "l1menu/ISample.h"
+#include "l1menu/ReducedSample.h"
 #include "l1menu/TriggerTable.h"
 #include "l1menu/tools/miscellaneous.h"
 #include "l1menu/tools/stringManipulation.h"
 #include <TH1F.h>
+#include <TArrayD.h>
 #include <sstream>
 #include <algorithm>
 #include <stdexcept>
@@ -222,15 +225,27 @@ void l1menu::TriggerRatePlot::addSample( const l1menu::ISample& sample )
 {
 	float weightPerEvent=sample.eventRate()/sample.sumOfWeights();
 
+	// If the sample has the threshold index I might not need to look at the events at all
+	const l1menu::ReducedSample* pReducedSample=dynamic_cast<const l1menu::ReducedSample*>( &sample );
+	if( pReducedSample!=nullptr && addSampleFromThresholdIndex( *pReducedSample, weightPerEvent ) ) return;
+
 	// Create a cached trigger, which depending on the concrete type of the ISample
 	// may or may not significantly increase the speed at which this next loop happens.
 	std::unique_ptr<l1menu::ICachedTrigger> pCachedTrigger=sample.createCachedTrigger( *pTrigger_ );
 
-	for( size_t eventNumber=0; eventNumber<sample.numberOfEvents(); ++eventNumber )
+	auto processBlock=[&]( const l1menu::IEventBlock& eventBlock )
 	{
-		addEvent( sample.getEvent(eventNumber), pCachedTrigger, weightPerEvent );
-	} // end of loop over events
+		for( size_t index=0; index<eventBlock.size(); ++index ) addEvent( eventBlock.getEvent(index), pCachedTrigger, weightPerEvent );
+	}; // end of loop over events
 
+	// Events that fail with the threshold at the lowest bin don't fill anything, so ReducedSample can
+	// leave out the parts of the sample where that's true for every event.
+	if( pReducedSample!=nullptr )
+	{
+		setVersusParameter( pHistogram_->GetBinLowEdge(1) );
+		pReducedSample->forEachBlockPassingAny( { pTrigger_.get() }, 4096, processBlock );
+	}
+	else sample.forEachBlock( 4096, processBlock );
 }
 
 void l1menu::TriggerRatePlot::addEvent( const l1menu::IEvent& event, const std::unique_ptr<l1menu::ICachedTrigger>& pCachedTrigger, float weightPerEvent )
@@ -246,19 +261,14 @@ void l1menu::TriggerRatePlot::addEvent( const l1menu::IEvent& event, const std::
 	// First need to perform a check that the first bin passes. If it doesn't then
 	// the histogram doesn't need filling at all and I can return.
 	//
-	(*pParameter_)=pHistogram_->GetBinLowEdge(lowBin);
-	// Scale accordingly any other parameters that should be scaled. Remember that
-	// in parameterScalingPair, 'first' is a pointer to the threshold to be changed
-	// and 'second' is the ratio of the first threshold it should be.
-	for( const auto& parameterScalingPair : otherParameterScalings_ ) *(parameterScalingPair.first)=parameterScalingPair.second*(*pParameter_);
+	setVersusParameter( pHistogram_->GetBinLowEdge(lowBin) );
 	if( !pCachedTrigger->apply(event) ) return;
 
 	//
 	// Also check the highest bin. If that passes then I just fill every bin,
 	// otherwise I need to find the point at which the trigger fails.
 	//
-	(*pParameter_)=pHistogram_->GetBinLowEdge(highBin);
-	for( const auto& parameterScalingPair : otherParameterScalings_ ) *(parameterScalingPair.first)=parameterScalingPair.second*(*pParameter_);
+	setVersusParameter( pHistogram_->GetBinLowEdge(highBin) );
 
 	if( pCachedTrigger->apply(event) ) lowBin=highBin;
 	else
@@ -267,8 +277,7 @@ void l1menu::TriggerRatePlot::addEvent( const l1menu::IEvent& event, const std::
 		{
 			size_t middleBin=(highBin+lowBin)/2;
 
-			(*pParameter_)=pHistogram_->GetBinLowEdge(middleBin);
-			for( const auto& parameterScalingPair : otherParameterScalings_ ) *(parameterScalingPair.first)=parameterScalingPair.second*(*pParameter_);
+			setVersusParameter( pHistogram_->GetBinLowEdge(middleBin) );
 
 			if( pCachedTrigger->apply(event) ) lowBin=middleBin;
 			else highBin=middleBin;
@@ -278,11 +287,50 @@ void l1menu::TriggerRatePlot::addEvent( const l1menu::IEvent& event, const std::
 	//
 	// Now I know which bins need filling, loop over them and fill.
 	//
+	// If the event is several identical events collapsed together, Fill() records the square of their
+	// summed weight for the errors. Correct that to the sum of their squared weights.
+	const float weight=event.weight()*weightPerEvent;
+	const float weightSquaredCorrection=(event.weightSquared()-event.weight()*event.weight())*weightPerEvent*weightPerEvent;
+	TArrayD* pSumOfWeightsSquared=pHistogram_->GetSumw2();
 	for( size_t binNumber=1; binNumber<=lowBin; ++binNumber )
 	{
-		pHistogram_->Fill( pHistogram_->GetBinCenter(binNumber), event.weight()*weightPerEvent );
+		pHistogram_->Fill( pHistogram_->GetBinCenter(binNumber), weight );
+		if( weightSquaredCorrection!=0 && pSumOfWeightsSquared->GetSize()>0 ) (*pSumOfWeightsSquared)[binNumber]+=weightSquaredCorrection;
+	}
+
+}
+
+void l1menu::TriggerRatePlot::setVersusParameter( float value )
+{
+	(*pParameter_)=value;
+	// Scale accordingly any other parameters that should be scaled. Remember that
+	// in parameterScalingPair, 'first' is a pointer to the threshold to be changed
+	// and 'second' is the ratio of the first threshold it should be.
+	for( const auto& parameterScalingPair : otherParameterScalings_ ) *(parameterScalingPair.first)=parameterScalingPair.second*(*pParameter_);
+}
+
+bool l1menu::TriggerRatePlot::addSampleFromThresholdIndex( const l1menu::ReducedSample& sample, float weightPerEvent )
+{
+	if( !sample.hasThresholdIndex() || !otherParameterScalings_.empty() ) return false;
+
+	const auto parameterIdentifiers=sample.getTriggerParameterIdentifiers( *pTrigger_ );
+	if( parameterIdentifiers.size()!=1 || parameterIdentifiers.begin()->first!=versusParameter_ ) return false;
+	const l1menu::ReducedEvent::ParameterID parameter=parameterIdentifiers.begin()->second;
+
+	// Each bin gets the weight of the events that pass with the threshold at its low edge, the same as
+	// addEvent() would give it. Fill() isn't used because it only takes a single weight, so I need to
+	// add to the sum of squared weights myself.
+	TArrayD* pSumOfWeightsSquared=pHistogram_->GetSumw2();
+	for( int binNumber=1; binNumber<=pHistogram_->GetNbinsX(); ++binNumber )
+	{
+		const std::pair<double,double> weightPassing=sample.weightPassingThreshold( parameter, pHistogram_->GetBinLowEdge(binNumber) );
+		pHistogram_->AddBinContent( binNumber, weightPassing.first*weightPerEvent );
+		if( pSumOfWeightsSquared->GetSize()>0 ) (*pSumOfWeightsSquared)[binNumber]+=weightPassing.second*weightPerEvent*weightPerEvent;
 	}
+	// AddBinContent() doesn't keep the statistics up to date, so get them recalculated from the bins
+	pHistogram_->ResetStats();
 
+	return true;
 }
 
 const l1menu::ITriggerDescription& l1menu::TriggerRatePlot::getTrigger() const
@@ -453,26 +501,53 @@ void l1menu::TriggerRatePlot::addSample( const l1menu::ISample& sample, std::vec
 {
 	float weightPerEvent=sample.eventRate()/sample.sumOfWeights();
 
+	// If the sample has the threshold index some or all of the plots can be filled without looking at
+	// the events, so only keep a note of the ones that still need them.
+	const l1menu::ReducedSample* pReducedSample=dynamic_cast<const l1menu::ReducedSample*>( &sample );
+	std::vector<TriggerRatePlot*> ratePlotsNeedingEvents;
+	for( auto& ratePlot : ratePlots )
+	{
+		if( pReducedSample==nullptr || !ratePlot.addSampleFromThresholdIndex( *pReducedSample, weightPerEvent ) ) ratePlotsNeedingEvents.push_back( &ratePlot );
+	}
+	if( ratePlotsNeedingEvents.empty() ) return;
+
 	// Create cached triggers for each of the rate plots, which depending on the concrete type
 	// of the ISample may or may not significantly increase the speed at which this next loop happens.
 	std::vector< std::unique_ptr<l1menu::ICachedTrigger> > cachedTriggers;
-	for( const auto& ratePlot : ratePlots ) cachedTriggers.push_back( sample.createCachedTrigger( *ratePlot.pTrigger_ ) );
+	for( const auto pRatePlot : ratePlotsNeedingEvents ) cachedTriggers.push_back( sample.createCachedTrigger( *pRatePlot->pTrigger_ ) );
 
 	// Now instead of calling addSample() for each TriggerRatePlot individually, get each IEvent from the sample
 	// and pass that to each rate plot. This is because (depending on the ISample concrete type) getting the
 	// IEvent can be computationally expensive.
 	std::vector< std::unique_ptr<l1menu::ICachedTrigger> >::const_iterator iTrigger;
-	std::vector<TriggerRatePlot>::iterator iRatePlot;
-	for( size_t eventNumber=0; eventNumber<sample.numberOfEvents(); ++eventNumber )
+	std::vector<TriggerRatePlot*>::iterator iRatePlot;
+	auto processBlock=[&]( const l1menu::IEventBlock& eventBlock )
 	{
-		const l1menu::IEvent& event=sample.getEvent(eventNumber);
+		for( size_t index=0; index<eventBlock.size(); ++index )
+		{
+			const l1menu::IEvent& event=eventBlock.getEvent(index);
+
+			for( iTrigger=cachedTriggers.begin(), iRatePlot=ratePlotsNeedingEvents.begin();
+				iTrigger!=cachedTriggers.end() && iRatePlot!=ratePlotsNeedingEvents.end();
+				++iTrigger, ++iRatePlot )
+			{
+				(*iRatePlot)->addEvent( event, *iTrigger, weightPerEvent );
+			}
+		}
+	}; // end of loop over events
 
-		for( iTrigger=cachedTriggers.begin(), iRatePlot=ratePlots.begin();
-			iTrigger!=cachedTriggers.end() && iRatePlot!=ratePlots.end();
-			++iTrigger, ++iRatePlot )
+	// Events that fail every trigger with the thresholds at the lowest bins don't fill anything, so
+	// ReducedSample can leave out the parts of the sample where that's true for every event.
+	if( pReducedSample!=nullptr )
+	{
+		std::vector<const l1menu::ITrigger*> triggers;
+		for( const auto pRatePlot : ratePlotsNeedingEvents )
 		{
-			iRatePlot->addEvent( event, *iTrigger, weightPerEvent );
+			pRatePlot->setVersusParameter( pRatePlot->pHistogram_->GetBinLowEdge(1) );
+			triggers.push_back( pRatePlot->pTrigger_.get() );
 		}
-	} // end of loop over events
+		pReducedSample->forEachBlockPassingAny( triggers, 4096, processBlock );
+	}
+	else sample.forEachBlock( 4096, processBlock );
 
 }
@@ -0,0 +1,894 @@
+#include "ChunkedSampleFile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <lz4.h>
+#include <zstd.h>
+
+namespace // unnamed namespace
+{
+	const std::string FILE_FORMAT_MAGIC_NUMBER="l1menuReducedSample";
+	const google::protobuf::uint32 FILE_FORMAT_VERSION=3;
+	const std::string FOOTER_MAGIC_NUMBER="l1menuRSfooter";
+	const int ZSTD_COMPRESSION_LEVEL=9; ///< @brief zstd is for archiving, so favour size over speed a bit more than its default of 3
+
+	/** @brief Appends the raw bytes of the object onto the end of the string. */
+	template<class T> void appendRaw( std::string& buffer, const T& value )
+	{
+		buffer.append( reinterpret_cast<const char*>(&value), sizeof(T) );
+	}
+
+	/** @brief Copies the raw bytes at the position in the buffer into the object, and moves the position on. */
+	template<class T> void extractRaw( const std::string& buffer, size_t& position, T& value )
+	{
+		if( position+sizeof(T)>buffer.size() ) throw std::runtime_error( "ChunkedSampleFileReader - the file is corrupt" );
+		std::memcpy( &value, buffer.data()+position, sizeof(T) );
+		position+=sizeof(T);
+	}
+
+	/** @brief Writes the data to the ZeroCopyOutputStream, which has no limit on the size unlike CodedOutputStream. */
+	void writeToStream( google::protobuf::io::ZeroCopyOutputStream& output, const void* pData, size_t size )
+	{
+		const char* pInput=static_cast<const char*>(pData);
+		void* pBuffer;
+		int bufferSize;
+		while( size>0 )
+		{
+			if( !output.Next( &pBuffer, &bufferSize ) ) throw std::runtime_error( "ChunkedSampleFileWriter - error while compressing a chunk" );
+			size_t bytesToCopy=std::min( size, static_cast<size_t>(bufferSize) );
+			std::memcpy( pBuffer, pInput, bytesToCopy );
+			pInput+=bytesToCopy;
+			size-=bytesToCopy;
+			if( bytesToCopy<static_cast<size_t>(bufferSize) ) output.BackUp( bufferSize-bytesToCopy );
+		}
+	}
+
+	/** @brief Reads exactly size bytes from the ZeroCopyInputStream into pData. */
+	void readFromStream( google::protobuf::io::ZeroCopyInputStream& input, void* pData, size_t size )
+	{
+		char* pOutput=static_cast<char*>(pData);
+		const void* pBuffer;
+		int bufferSize;
+		while( size>0 )
+		{
+			if( !input.Next( &pBuffer, &bufferSize ) ) throw std::runtime_error( "ChunkedSampleFileReader - a chunk is shorter than the footer says it is" );
+			size_t bytesToCopy=std::min( size, static_cast<size_t>(bufferSize) );
+			std::memcpy( pOutput, pBuffer, bytesToCopy );
+			pOutput+=bytesToCopy;
+			size-=bytesToCopy;
+			if( bytesToCopy<static_cast<size_t>(bufferSize) ) input.BackUp( bufferSize-bytesToCopy );
+		}
+	}
+
+	/** @brief Sets the minimum and maximum of each column as they'll be read back, i.e. after any rounding
+	 * onto the grid. A NaN passes every threshold, so it makes the maximum infinity. */
+	void setColumnRanges( l1menu::implementation::ChunkIndexEntry& indexEntry, const std::vector<l1menu::implementation::ColumnEncoding>& columnEncodings, const std::vector<const float*>& parameterColumns, size_t numberOfEvents )
+	{
+		indexEntry.minimumValues.clear();
+		indexEntry.maximumValues.clear();
+		for( size_t columnNumber=0; columnNumber<parameterColumns.size(); ++columnNumber )
+		{
+			const float* pColumn=parameterColumns[columnNumber];
+			float minimum=std::numeric_limits<float>::infinity();
+			float maximum=-std::numeric_limits<float>::infinity();
+			for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+			{
+				const float value=pColumn[eventNumber];
+				if( std::isnan(value) ) maximum=std::numeric_limits<float>::infinity();
+				else
+				{
+					if( value<minimum ) minimum=value;
+					if( value>maximum ) maximum=value;
+				}
+			}
+
+			// Rounding onto the grid doesn't change the order, so I can just round the results
+			const auto& encoding=columnEncodings[columnNumber];
+			if( encoding.type!=l1menu::implementation::ColumnEncoding::FLOAT32 && numberOfEvents>0 )
+			{
+				if( std::isfinite(minimum) ) minimum=encoding.grid.snap( minimum );
+				if( std::isfinite(maximum) ) maximum=encoding.grid.snap( maximum );
+			}
+			indexEntry.minimumValues.push_back( minimum );
+			indexEntry.maximumValues.push_back( maximum );
+		}
+	}
+
+	/** @brief The code stored for a value in a quantised column, 0 for -1 or the grid index plus one. */
+	template<class T> T gridCode( const l1menu::implementation::ThresholdGrid& grid, float value )
+	{
+		if( value==-1 ) return 0;
+		const size_t code=grid.floorIndex(value)+1;
+		if( code>std::numeric_limits<T>::max() ) throw std::runtime_error( "ChunkedSampleFileWriter - a threshold is too large for the quantised column it's being written to" );
+		return code;
+	}
+
+	/** @brief The number of bytes a column takes up in an uncompressed chunk. Not valid for sparse columns,
+	 * where it depends on how many values are -1. */
+	size_t encodedColumnSize( const l1menu::implementation::ColumnEncoding& encoding, size_t numberOfEvents )
+	{
+		if( encoding.type==l1menu::implementation::ColumnEncoding::GRID8 ) return numberOfEvents*sizeof(uint8_t);
+		else if( encoding.type==l1menu::implementation::ColumnEncoding::GRID16 ) return numberOfEvents*sizeof(uint16_t);
+		else return numberOfEvents*sizeof(float);
+	}
+
+	/** @brief The same encoding, but not sparse. */
+	l1menu::implementation::ColumnEncoding denseEncoding( const l1menu::implementation::ColumnEncoding& encoding )
+	{
+		l1menu::implementation::ColumnEncoding returnValue=encoding;
+		returnValue.sparse=false;
+		return returnValue;
+	}
+
+	/** @brief Encodes the column as the encoding says. */
+	void writeColumn( google::protobuf::io::ZeroCopyOutputStream& output, const l1menu::implementation::ColumnEncoding& encoding, const float* pColumn, size_t numberOfEvents )
+	{
+		if( encoding.sparse )
+		{
+			if( numberOfEvents>std::numeric_limits<uint32_t>::max() ) throw std::runtime_error( "ChunkedSampleFileWriter - too many events in a chunk for a sparse column" );
+
+			std::vector<float> storedValues;
+			std::vector<uint8_t> bitmap( (numberOfEvents+7)/8, 0 );
+			for( size_t index=0; index<numberOfEvents; ++index )
+			{
+				if( pColumn[index]==-1 ) continue;
+				storedValues.push_back( pColumn[index] );
+				bitmap[index/8]|=( 1<<(index%8) );
+			}
+
+			// If there aren't enough -1 values to pay for the bitmap, store everything
+			const l1menu::implementation::ColumnEncoding valueEncoding=::denseEncoding( encoding );
+			if( bitmap.size()+::encodedColumnSize( valueEncoding, storedValues.size() ) < ::encodedColumnSize( valueEncoding, numberOfEvents ) )
+			{
+				const uint32_t numberOfValues=storedValues.size();
+				::writeToStream( output, &numberOfValues, sizeof(numberOfValues) );
+				::writeToStream( output, bitmap.data(), bitmap.size() );
+				writeColumn( output, valueEncoding, storedValues.data(), storedValues.size() );
+			}
+			else
+			{
+				const uint32_t numberOfValues=numberOfEvents;
+				::writeToStream( output, &numberOfValues, sizeof(numberOfValues) );
+				writeColumn( output, valueEncoding, pColumn, numberOfEvents );
+			}
+		}
+		else if( encoding.type==l1menu::implementation::ColumnEncoding::FLOAT32 )
+		{
+			::writeToStream( output, pColumn, numberOfEvents*sizeof(float) );
+		}
+		else if( encoding.type==l1menu::implementation::ColumnEncoding::GRID8 )
+		{
+			std::vector<uint8_t> codes( numberOfEvents );
+			for( size_t index=0; index<numberOfEvents; ++index ) codes[index]=::gridCode<uint8_t>( encoding.grid, pColumn[index] );
+			::writeToStream( output, codes.data(), codes.size()*sizeof(uint8_t) );
+		}
+		else
+		{
+			std::vector<uint16_t> codes( numberOfEvents );
+			for( size_t index=0; index<numberOfEvents; ++index ) codes[index]=::gridCode<uint16_t>( encoding.grid, pColumn[index] );
+			::writeToStream( output, codes.data(), codes.size()*sizeof(uint16_t) );
+		}
+	}
+
+	/** @brief Decompresses a column written by writeColumn back into floats. */
+	void readColumn( google::protobuf::io::ZeroCopyInputStream& input, const l1menu::implementation::ColumnEncoding& encoding, float* pColumn, size_t numberOfEvents )
+	{
+		if( encoding.sparse )
+		{
+			uint32_t numberOfValues;
+			::readFromStream( input, &numberOfValues, sizeof(numberOfValues) );
+			if( numberOfValues>numberOfEvents ) throw std::runtime_error( "ChunkedSampleFileReader - a sparse column is corrupt" );
+			const l1menu::implementation::ColumnEncoding valueEncoding=::denseEncoding( encoding );
+			if( numberOfValues==numberOfEvents )
+			{
+				readColumn( input, valueEncoding, pColumn, numberOfEvents );
+				return;
+			}
+
+			std::vector<uint8_t> bitmap( (numberOfEvents+7)/8 );
+			::readFromStream( input, bitmap.data(), bitmap.size() );
+			std::vector<float> storedValues( numberOfValues );
+			readColumn( input, valueEncoding, storedValues.data(), storedValues.size() );
+
+			size_t valueNumber=0;
+			for( size_t index=0; index<numberOfEvents; ++index )
+			{
+				if( bitmap[index/8] & ( 1<<(index%8) ) )
+				{
+					if( valueNumber==numberOfValues ) throw std::runtime_error( "ChunkedSampleFileReader - a sparse column is corrupt" );
+					pColumn[index]=storedValues[valueNumber++];
+				}
+				else pColumn[index]=-1;
+			}
+			if( valueNumber!=numberOfValues ) throw std::runtime_error( "ChunkedSampleFileReader - a sparse column is corrupt" );
+		}
+		else if( encoding.type==l1menu::implementation::ColumnEncoding::FLOAT32 )
+		{
+			::readFromStream( input, pColumn, numberOfEvents*sizeof(float) );
+		}
+		else if( encoding.type==l1menu::implementation::ColumnEncoding::GRID8 )
+		{
+			std::vector<uint8_t> codes( numberOfEvents );
+			::readFromStream( input, codes.data(), codes.size()*sizeof(uint8_t) );
+			for( size_t index=0; index<numberOfEvents; ++index ) pColumn[index]= codes[index]==0 ? -1 : encoding.grid.value(codes[index]-1);
+		}
+		else
+		{
+			std::vector<uint16_t> codes( numberOfEvents );
+			::readFromStream( input, codes.data(), codes.size()*sizeof(uint16_t) );
+			for( size_t index=0; index<numberOfEvents; ++index ) pColumn[index]= codes[index]==0 ? -1 : encoding.grid.value(codes[index]-1);
+		}
+	}
+
+	/** @brief Moves the input past a column written by writeColumn without decoding it. */
+	void skipColumn( google::protobuf::io::ZeroCopyInputStream& input, const l1menu::implementation::ColumnEncoding& encoding, size_t numberOfEvents )
+	{
+		size_t bytesToSkip=::encodedColumnSize( encoding, numberOfEvents );
+		if( encoding.sparse )
+		{
+			uint32_t numberOfValues;
+			::readFromStream( input, &numberOfValues, sizeof(numberOfValues) );
+			if( numberOfValues>numberOfEvents ) throw std::runtime_error( "ChunkedSampleFileReader - a sparse column is corrupt" );
+			bytesToSkip=::encodedColumnSize( encoding, numberOfValues );
+			if( numberOfValues<numberOfEvents ) bytesToSkip+=(numberOfEvents+7)/8;
+		}
+		if( !input.Skip( bytesToSkip ) ) throw std::runtime_error( "ChunkedSampleFileReader - a chunk is shorter than the footer says it is" );
+	}
+
+	/** @brief Compresses the whole of the input with the given codec. */
+	std::string compressChunk( l1menu::ReducedSample::Codec codec, const std::string& input )
+	{
+		std::string output;
+		if( codec==l1menu::ReducedSample::Codec::NONE ) output=input;
+		else if( codec==l1menu::ReducedSample::Codec::GZIP )
+		{
+			google::protobuf::io::StringOutputStream stringOutput( &output );
+			google::protobuf::io::GzipOutputStream gzipOutput( &stringOutput );
+			::writeToStream( gzipOutput, input.data(), input.size() );
+			if( !gzipOutput.Close() ) throw std::runtime_error( "ChunkedSampleFileWriter - error while compressing a chunk" );
+		}
+		else if( codec==l1menu::ReducedSample::Codec::LZ4 )
+		{
+			if( input.size()>static_cast<size_t>(LZ4_MAX_INPUT_SIZE) ) throw std::runtime_error( "ChunkedSampleFileWriter - chunk is too large for LZ4, use fewer events per chunk" );
+			output.resize( LZ4_compressBound( input.size() ) );
+			int compressedSize=LZ4_compress_default( input.data(), &output[0], input.size(), output.size() );
+			if( compressedSize<=0 && !input.empty() ) throw std::runtime_error( "ChunkedSampleFileWriter - error while compressing a chunk" );
+			output.resize( compressedSize );
+		}
+		else if( codec==l1menu::ReducedSample::Codec::ZSTD )
+		{
+			output.resize( ZSTD_compressBound( input.size() ) );
+			size_t compressedSize=ZSTD_compress( &output[0], output.size(), input.data(), input.size(), ZSTD_COMPRESSION_LEVEL );
+			if( ZSTD_isError( compressedSize ) ) throw std::runtime_error( std::string("ChunkedSampleFileWriter - error while compressing a chunk: ")+ZSTD_getErrorName( compressedSize ) );
+			output.resize( compressedSize );
+		}
+		else throw std::runtime_error( "ChunkedSampleFileWriter - unknown codec" );
+
+		return output;
+	}
+
+	/** @brief Decompresses the input into the output, which has to be exactly the right size already. */
+	void decompressChunk( l1menu::ReducedSample::Codec codec, const std::string& input, std::string& output )
+	{
+		if( codec==l1menu::ReducedSample::Codec::NONE )
+		{
+			if( input.size()!=output.size() ) throw std::runtime_error( "ChunkedSampleFileReader - a chunk is not the size the footer says it is" );
+			output=input;
+		}
+		else if( codec==l1menu::ReducedSample::Codec::GZIP )
+		{
+			google::protobuf::io::ArrayInputStream arrayInput( input.data(), input.size() );
+			google::protobuf::io::GzipInputStream gzipInput( &arrayInput );
+			if( !output.empty() ) ::readFromStream( gzipInput, &output[0], output.size() );
+		}
+		else if( codec==l1menu::ReducedSample::Codec::LZ4 )
+		{
+			if( output.empty() ) return;
+			int decompressedSize=LZ4_decompress_safe( input.data(), &output[0], input.size(), output.size() );
+			if( decompressedSize<0 || static_cast<size_t>(decompressedSize)!=output.size() ) throw std::runtime_error( "ChunkedSampleFileReader - a chunk is corrupt" );
+		}
+		else if( codec==l1menu::ReducedSample::Codec::ZSTD )
+		{
+			size_t decompressedSize=ZSTD_decompress( &output[0], output.size(), input.data(), input.size() );
+			if( ZSTD_isError( decompressedSize ) || decompressedSize!=output.size() ) throw std::runtime_error( "ChunkedSampleFileReader - a chunk is corrupt" );
+		}
+		else throw std::runtime_error( "ChunkedSampleFileReader - unknown codec" );
+	}
+
+	size_t numberOfParametersInHeader( const l1menuprotobuf::SampleHeader& header )
+	{
+		size_t numberOfParameters=0;
+		for( const auto& trigger : header.trigger() ) numberOfParameters+=trigger.varying_parameter_size();
+		return numberOfParameters;
+	}
+} // end of the unnamed namespace
+
+bool l1menu::implementation::ChunkIndexEntry::hasColumnRanges() const
+{
+	return sumOfWeightsSquared>=0;
+}
+
+l1menu::implementation::ColumnEncoding::ColumnEncoding()
+	: type(FLOAT32), sparse(false)
+{
+	// No operation
+}
+
+l1menu::implementation::ColumnEncoding::ColumnEncoding( Type newType, const l1menu::implementation::ThresholdGrid& newGrid, bool newSparse )
+	: type(newType), grid(newGrid), sparse(newSparse)
+{
+	if( type!=FLOAT32 && !grid.isValid() ) throw std::runtime_error( "ColumnEncoding - quantised columns need a valid grid" );
+}
+
+bool l1menu::implementation::ColumnEncoding::operator==( const ColumnEncoding& otherEncoding ) const
+{
+	if( type!=otherEncoding.type || sparse!=otherEncoding.sparse ) return false;
+	if( type==FLOAT32 ) return true; // The grid isn't used so doesn't matter
+	return grid.origin()==otherEncoding.grid.origin() && grid.step()==otherEncoding.grid.step();
+}
+
+l1menu::implementation::ColumnEncoding l1menu::implementation::ColumnEncoding::narrowestFor( const l1menu::implementation::ThresholdGrid& grid, const float* pColumn, size_t numberOfEvents )
+{
+	if( !grid.isValid() ) return ColumnEncoding();
+
+	// Anything the grid can't hold, e.g. NaN or infinity, has to be kept as a float
+	size_t maximumCode=0;
+	for( size_t index=0; index<numberOfEvents; ++index )
+	{
+		if( pColumn[index]==-1 ) continue;
+		if( !grid.contains(pColumn[index]) ) return ColumnEncoding();
+		maximumCode=std::max( maximumCode, grid.floorIndex(pColumn[index])+1 );
+	}
+
+	if( maximumCode<=std::numeric_limits<uint8_t>::max() ) return ColumnEncoding( GRID8, grid );
+	else if( maximumCode<=std::numeric_limits<uint16_t>::max() ) return ColumnEncoding( GRID16, grid );
+	else return ColumnEncoding();
+}
+
+l1menu::implementation::ChunkedSampleFileWriter::ChunkedSampleFileWriter( const std::string& filename, const l1menuprotobuf::SampleHeader& header, const std::vector<ColumnEncoding>& columnEncodings, l1menu::ReducedSample::Codec codec, bool hasWeightsSquared )
+	: header_(header), position_(0), numberOfParameters_( ::numberOfParametersInHeader(header) ), columnEncodings_(columnEncodings), codec_(codec), hasWeightsSquared_(hasWeightsSquared),
+	  hasThresholdIndex_(false), thresholdIndexPosition_(0), thresholdIndexCompressedSize_(0), thresholdIndexUncompressedSize_(0)
+{
+	if( columnEncodings_.empty() ) columnEncodings_.resize( numberOfParameters_ );
+	if( columnEncodings_.size()!=numberOfParameters_ ) throw std::runtime_error( "ChunkedSampleFileWriter - the number of column encodings doesn't match the header" );
+
+	// Parameters are filename, write ability, create and truncate, rw-r--r-- permissions.
+	fileDescriptor_=open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileWriter - couldn't open the file "+filename );
+
+	std::string buffer;
+	{ // Block so that codedOutput is flushed into the buffer before I use it
+		google::protobuf::io::StringOutputStream stringOutput( &buffer );
+		google::protobuf::io::CodedOutputStream codedOutput( &stringOutput );
+		codedOutput.WriteString( FILE_FORMAT_MAGIC_NUMBER );
+		codedOutput.WriteVarint32( FILE_FORMAT_VERSION );
+		const uint8_t codecNumber=static_cast<uint8_t>(codec_);
+		codedOutput.WriteRaw( &codecNumber, sizeof(codecNumber) );
+		codedOutput.WriteLittleEndian64( header.ByteSize() );
+		header.SerializeToCodedStream( &codedOutput );
+	}
+
+	// The sum of squared weights column, if there is one, is listed after the parameters
+	std::vector<ColumnEncoding> allColumnEncodings=columnEncodings_;
+	if( hasWeightsSquared_ ) allColumnEncodings.push_back( ColumnEncoding() );
+
+	std::string columnTable;
+	const uint32_t recordSize=sizeof(uint8_t)+sizeof(float)*2;
+	::appendRaw( columnTable, static_cast<uint32_t>(allColumnEncodings.size()) );
+	for( const auto& encoding : allColumnEncodings )
+	{
+		::appendRaw( columnTable, recordSize );
+		::appendRaw( columnTable, static_cast<uint8_t>( encoding.sparse ? (encoding.type | ColumnEncoding::SPARSE_FLAG) : encoding.type ) );
+		::appendRaw( columnTable, encoding.grid.origin() );
+		::appendRaw( columnTable, encoding.grid.step() );
+	}
+	::appendRaw( buffer, static_cast<uint32_t>(columnTable.size()) );
+	buffer+=columnTable;
+
+	writeBytes( buffer );
+}
+
+l1menu::implementation::ChunkedSampleFileWriter::ChunkedSampleFileWriter()
+	: fileDescriptor_(-1), position_(0), numberOfParameters_(0), codec_(l1menu::ReducedSample::Codec::GZIP), hasWeightsSquared_(false),
+	  hasThresholdIndex_(false), thresholdIndexPosition_(0), thresholdIndexCompressedSize_(0), thresholdIndexUncompressedSize_(0)
+{
+	// No operation
+}
+
+std::unique_ptr<l1menu::implementation::ChunkedSampleFileWriter> l1menu::implementation::ChunkedSampleFileWriter::openForAppend( const std::string& filename )
+{
+	// Use a reader to check the file and get everything that's already in it
+	l1menu::implementation::ChunkedSampleFileReader existingFile( filename );
+
+	std::unique_ptr<ChunkedSampleFileWriter> pWriter( new ChunkedSampleFileWriter );
+	pWriter->header_=existingFile.header();
+	pWriter->numberOfParameters_=existingFile.numberOfParameters();
+	pWriter->columnEncodings_=existingFile.columnEncodings();
+	pWriter->codec_=existingFile.codec();
+	pWriter->hasWeightsSquared_=existingFile.hasWeightsSquared();
+	pWriter->chunkIndex_=existingFile.chunkIndex();
+
+	// New chunks go over the top of the old footer, and the old threshold index if there is one
+	pWriter->fileDescriptor_=open( filename.c_str(), O_WRONLY );
+	if( pWriter->fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileWriter - couldn't open the file "+filename );
+	pWriter->position_=existingFile.endOfChunks();
+	if( lseek( pWriter->fileDescriptor_, pWriter->position_, SEEK_SET )<0 ) throw std::runtime_error( "ChunkedSampleFileWriter - couldn't seek to the end of the chunks in "+filename );
+
+	return pWriter;
+}
+
+l1menu::implementation::ChunkedSampleFileWriter::~ChunkedSampleFileWriter()
+{
+	if( fileDescriptor_>=0 ) ::close( fileDescriptor_ );
+}
+
+void l1menu::implementation::ChunkedSampleFileWriter::writeChunk( const float* pWeights, const std::vector<const float*>& parameterColumns, size_t numberOfEvents, const float* pWeightsSquared )
+{
+	if( fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileWriter::writeChunk() called after the file was closed" );
+	if( hasThresholdIndex_ ) throw std::runtime_error( "ChunkedSampleFileWriter::writeChunk() called after the threshold index was written" );
+	if( parameterColumns.size()!=numberOfParameters_ ) throw std::runtime_error( "ChunkedSampleFileWriter::writeChunk() given the wrong number of columns for the header" );
+
+	// If the file has no sum of squared weights column I can still write rows where it's just the
+	// weight squared, since that's what's assumed when reading.
+	std::vector<float> calculatedWeightsSquared;
+	if( hasWeightsSquared_ && pWeightsSquared==nullptr )
+	{
+		calculatedWeightsSquared.resize( numberOfEvents );
+		for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber ) calculatedWeightsSquared[eventNumber]=pWeights[eventNumber]*pWeights[eventNumber];
+		pWeightsSquared=calculatedWeightsSquared.data();
+	}
+	else if( !hasWeightsSquared_ && pWeightsSquared!=nullptr )
+	{
+		for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+		{
+			if( pWeightsSquared[eventNumber]!=pWeights[eventNumber]*pWeights[eventNumber] ) throw std::runtime_error( "ChunkedSampleFileWriter::writeChunk() - the file can't store collapsed events because it has no sum of squared weights column" );
+		}
+	}
+
+	ChunkIndexEntry indexEntry;
+	indexEntry.offset=position_;
+	indexEntry.numberOfEvents=numberOfEvents;
+	indexEntry.sumOfWeights=0;
+	indexEntry.sumOfWeightsSquared=0;
+	for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+	{
+		indexEntry.sumOfWeights+=pWeights[eventNumber];
+		indexEntry.sumOfWeightsSquared+=( pWeightsSquared==nullptr ? pWeights[eventNumber]*pWeights[eventNumber] : pWeightsSquared[eventNumber] );
+	}
+	::setColumnRanges( indexEntry, columnEncodings_, parameterColumns, numberOfEvents );
+
+	std::string uncompressedChunk;
+	{ // Block so that the stream is flushed before I use the string
+		google::protobuf::io::StringOutputStream stringOutput( &uncompressedChunk );
+		::writeToStream( stringOutput, pWeights, numberOfEvents*sizeof(float) );
+		for( size_t columnNumber=0; columnNumber<parameterColumns.size(); ++columnNumber )
+		{
+			::writeColumn( stringOutput, columnEncodings_[columnNumber], parameterColumns[columnNumber], numberOfEvents );
+		}
+		if( hasWeightsSquared_ ) ::writeToStream( stringOutput, pWeightsSquared, numberOfEvents*sizeof(float) );
+	}
+	std::string compressedChunk=::compressChunk( codec_, uncompressedChunk );
+	indexEntry.compressedSize=compressedChunk.size();
+	indexEntry.uncompressedSize=uncompressedChunk.size();
+
+	writeBytes( compressedChunk );
+	chunkIndex_.push_back( indexEntry );
+}
+
+void l1menu::implementation::ChunkedSampleFileWriter::writeCompressedChunk( const ChunkIndexEntry& indexEntry, const std::string& compressedChunk )
+{
+	if( fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileWriter::writeCompressedChunk() called after the file was closed" );
+	if( hasThresholdIndex_ ) throw std::runtime_error( "ChunkedSampleFileWriter::writeCompressedChunk() called after the threshold index was written" );
+	if( compressedChunk.size()!=indexEntry.compressedSize ) throw std::runtime_error( "ChunkedSampleFileWriter::writeCompressedChunk() given a chunk that doesn't match its index entry" );
+
+	ChunkIndexEntry newIndexEntry=indexEntry;
+	newIndexEntry.offset=position_;
+	writeBytes( compressedChunk );
+	chunkIndex_.push_back( newIndexEntry );
+}
+
+void l1menu::implementation::ChunkedSampleFileWriter::writeThresholdIndex( const std::vector<ThresholdIndex>& thresholdIndex )
+{
+	if( fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileWriter::writeThresholdIndex() called after the file was closed" );
+	if( hasThresholdIndex_ ) throw std::runtime_error( "ChunkedSampleFileWriter::writeThresholdIndex() called twice" );
+	if( thresholdIndex.size()!=numberOfParameters_ ) throw std::runtime_error( "ChunkedSampleFileWriter::writeThresholdIndex() given the wrong number of columns for the header" );
+
+	std::string uncompressedIndex;
+	for( const auto& columnIndex : thresholdIndex )
+	{
+		const uint64_t numberOfValues=columnIndex.values().size();
+		::appendRaw( uncompressedIndex, numberOfValues );
+		uncompressedIndex.append( reinterpret_cast<const char*>(columnIndex.values().data()), numberOfValues*sizeof(float) );
+		uncompressedIndex.append( reinterpret_cast<const char*>(columnIndex.cumulativeWeights().data()), numberOfValues*sizeof(double) );
+		uncompressedIndex.append( reinterpret_cast<const char*>(columnIndex.cumulativeWeightsSquared().data()), numberOfValues*sizeof(double) );
+	}
+	std::string compressedIndex=::compressChunk( codec_, uncompressedIndex );
+
+	thresholdIndexPosition_=position_;
+	thresholdIndexCompressedSize_=compressedIndex.size();
+	thresholdIndexUncompressedSize_=uncompressedIndex.size();
+	writeBytes( compressedIndex );
+	hasThresholdIndex_=true;
+}
+
+void l1menu::implementation::ChunkedSampleFileWriter::close()
+{
+	if( fileDescriptor_<0 ) return;
+
+	const uint64_t footerPosition=position_;
+
+	std::string buffer;
+	::appendRaw( buffer, static_cast<uint32_t>(chunkIndex_.size()) );
+	for( const auto& indexEntry : chunkIndex_ )
+	{
+		// Chunks copied from files written before the statistics were stored don't have them
+		uint32_t recordSize=sizeof(uint64_t)*3+sizeof(double);
+		if( indexEntry.hasColumnRanges() ) recordSize+=sizeof(double)+sizeof(float)*2*numberOfParameters_+sizeof(uint64_t);
+
+		::appendRaw( buffer, recordSize );
+		::appendRaw( buffer, indexEntry.offset );
+		::appendRaw( buffer, indexEntry.compressedSize );
+		::appendRaw( buffer, indexEntry.numberOfEvents );
+		::appendRaw( buffer, indexEntry.sumOfWeights );
+		if( !indexEntry.hasColumnRanges() ) continue;
+		::appendRaw( buffer, indexEntry.sumOfWeightsSquared );
+		for( size_t columnNumber=0; columnNumber<numberOfParameters_; ++columnNumber )
+		{
+			::appendRaw( buffer, indexEntry.minimumValues[columnNumber] );
+			::appendRaw( buffer, indexEntry.maximumValues[columnNumber] );
+		}
+		::appendRaw( buffer, indexEntry.uncompressedSize );
+	}
+	if( hasThresholdIndex_ )
+	{
+		::appendRaw( buffer, static_cast<uint32_t>(sizeof(uint64_t)*3) );
+		::appendRaw( buffer, thresholdIndexPosition_ );
+		::appendRaw( buffer, thresholdIndexCompressedSize_ );
+		::appendRaw( buffer, thresholdIndexUncompressedSize_ );
+	}
+	::appendRaw( buffer, footerPosition );
+	buffer.append( FOOTER_MAGIC_NUMBER );
+	writeBytes( buffer );
+
+	// Make sure nothing is left over past the footer, e.g. if the file was opened for appending
+	// and the new footer is shorter than what was there before.
+	if( ftruncate( fileDescriptor_, position_ )!=0 ) throw std::runtime_error( "ChunkedSampleFileWriter - error while truncating the file" );
+
+	int result=::close( fileDescriptor_ );
+	fileDescriptor_=-1;
+	if( result!=0 ) throw std::runtime_error( "ChunkedSampleFileWriter - error while closing the file" );
+}
+
+const l1menuprotobuf::SampleHeader& l1menu::implementation::ChunkedSampleFileWriter::header() const
+{
+	return header_;
+}
+
+const std::vector<l1menu::implementation::ColumnEncoding>& l1menu::implementation::ChunkedSampleFileWriter::columnEncodings() const
+{
+	return columnEncodings_;
+}
+
+l1menu::ReducedSample::Codec l1menu::implementation::ChunkedSampleFileWriter::codec() const
+{
+	return codec_;
+}
+
+bool l1menu::implementation::ChunkedSampleFileWriter::hasWeightsSquared() const
+{
+	return hasWeightsSquared_;
+}
+
+void l1menu::implementation::ChunkedSampleFileWriter::writeBytes( const std::string& bytes )
+{
+	size_t bytesWritten=0;
+	while( bytesWritten<bytes.size() )
+	{
+		ssize_t result=::write( fileDescriptor_, bytes.data()+bytesWritten, bytes.size()-bytesWritten );
+		if( result<0 ) throw std::runtime_error( "ChunkedSampleFileWriter - error while writing to the file" );
+		bytesWritten+=result;
+	}
+	position_+=bytes.size();
+}
+
+l1menu::implementation::ChunkedSampleFileReader::ChunkedSampleFileReader( const std::string& filename )
+	: hasThresholdIndex_(false), thresholdIndexPosition_(0), thresholdIndexCompressedSize_(0), thresholdIndexUncompressedSize_(0)
+{
+	fileDescriptor_=open( filename.c_str(), O_RDONLY );
+	if( fileDescriptor_<0 ) throw std::runtime_error( "ChunkedSampleFileReader - couldn't open the file "+filename );
+
+	try
+	{
+		struct stat fileStatus;
+		if( fstat( fileDescriptor_, &fileStatus )!=0 ) throw std::runtime_error( "ChunkedSampleFileReader - unable to get the file size" );
+		const uint64_t fileSize=fileStatus.st_size;
+
+		// Everything up to and including the header size has a fixed length
+		const size_t preambleSize=FILE_FORMAT_MAGIC_NUMBER.size()+1+sizeof(uint8_t)+sizeof(uint64_t);
+		const size_t trailerSize=sizeof(uint64_t)+FOOTER_MAGIC_NUMBER.size();
+		if( fileSize<preambleSize+trailerSize ) throw std::runtime_error( "ChunkedSampleFileReader - the file is truncated" );
+
+		std::string buffer( preambleSize, '\0' );
+		readBytes( 0, preambleSize, &buffer[0] );
+		if( buffer.compare( 0, FILE_FORMAT_MAGIC_NUMBER.size(), FILE_FORMAT_MAGIC_NUMBER )!=0 ) throw std::runtime_error( "ChunkedSampleFileReader - the file is not a ReducedSample" );
+		if( static_cast<unsigned char>(buffer[FILE_FORMAT_MAGIC_NUMBER.size()])!=FILE_FORMAT_VERSION ) throw std::runtime_error( "ChunkedSampleFileReader - the file is not in the chunked format" );
+		size_t position=FILE_FORMAT_MAGIC_NUMBER.size()+1;
+		uint8_t codecNumber;
+		::extractRaw( buffer, position, codecNumber );
+		if( codecNumber>static_cast<uint8_t>(l1menu::ReducedSample::Codec::ZSTD) ) throw std::runtime_error( "ChunkedSampleFileReader - unknown codec, the file might have been written with a newer version of the code" );
+		codec_=static_cast<l1menu::ReducedSample::Codec>(codecNumber);
+		uint64_t headerSize;
+		::extractRaw( buffer, position, headerSize );
+
+		buffer.assign( headerSize, '\0' );
+		if( headerSize>0 ) readBytes( preambleSize, headerSize, &buffer[0] );
+		if( !header_.ParseFromString( buffer ) ) throw std::runtime_error( "ChunkedSampleFileReader - some unknown error while reading header" );
+		numberOfParameters_=::numberOfParametersInHeader( header_ );
+
+		// The column table follows the header
+		uint64_t endOfColumnTable=preambleSize+headerSize;
+		uint32_t columnTableSize;
+		if( fileSize<endOfColumnTable+sizeof(columnTableSize)+trailerSize ) throw std::runtime_error( "ChunkedSampleFileReader - the file is truncated" );
+		readBytes( endOfColumnTable, sizeof(columnTableSize), reinterpret_cast<char*>(&columnTableSize) );
+		endOfColumnTable+=sizeof(columnTableSize);
+		if( fileSize<endOfColumnTable+columnTableSize+trailerSize ) throw std::runtime_error( "ChunkedSampleFileReader - the file is truncated" );
+		buffer.assign( columnTableSize, '\0' );
+		if( columnTableSize>0 ) readBytes( endOfColumnTable, columnTableSize, &buffer[0] );
+		endOfColumnTable+=columnTableSize;
+
+		position=0;
+		uint32_t numberOfColumns;
+		::extractRaw( buffer, position, numberOfColumns );
+		if( numberOfColumns!=numberOfParameters_ && numberOfColumns!=numberOfParameters_+1 ) throw std::runtime_error( "ChunkedSampleFileReader - the number of columns doesn't match the header" );
+		hasWeightsSquared_=( numberOfColumns==numberOfParameters_+1 );
+		for( uint32_t columnNumber=0; columnNumber<numberOfColumns; ++columnNumber )
+		{
+			uint32_t recordSize;
+			::extractRaw( buffer, position, recordSize );
+			const size_t endOfRecord=position+recordSize;
+
+			uint8_t type;
+			float gridOrigin, gridStep;
+			::extractRaw( buffer, position, type );
+			::extractRaw( buffer, position, gridOrigin );
+			::extractRaw( buffer, position, gridStep );
+			if( position>endOfRecord ) throw std::runtime_error( "ChunkedSampleFileReader - the column table is corrupt" );
+			position=endOfRecord; // Skip anything added by later versions of the writer
+
+			const bool sparse=( (type & ColumnEncoding::SPARSE_FLAG)!=0 );
+			type&=~ColumnEncoding::SPARSE_FLAG;
+			if( type==ColumnEncoding::FLOAT32 ) columnEncodings_.push_back( ColumnEncoding( ColumnEncoding::FLOAT32, ThresholdGrid(), sparse ) );
+			else if( type==ColumnEncoding::GRID8 || type==ColumnEncoding::GRID16 ) columnEncodings_.push_back( ColumnEncoding( static_cast<ColumnEncoding::Type>(type), ThresholdGrid( gridOrigin, gridStep ), sparse ) );
+			else throw std::runtime_error( "ChunkedSampleFileReader - unknown column encoding, the file might have been written with a newer version of the code" );
+		}
+		if( hasWeightsSquared_ )
+		{
+			if( columnEncodings_.back().type!=ColumnEncoding::FLOAT32 || columnEncodings_.back().sparse ) throw std::runtime_error( "ChunkedSampleFileReader - the column table is corrupt" );
+			columnEncodings_.pop_back(); // Only the parameter columns are listed in columnEncodings_
+		}
+
+		// Now the trailer at the end of the file, which says where the footer is
+		buffer.assign( trailerSize, '\0' );
+		readBytes( fileSize-trailerSize, trailerSize, &buffer[0] );
+		if( buffer.compare( sizeof(uint64_t), std::string::npos, FOOTER_MAGIC_NUMBER )!=0 ) throw std::runtime_error( "ChunkedSampleFileReader - the file is incomplete, it might not have been closed properly when written" );
+		position=0;
+		::extractRaw( buffer, position, footerPosition_ );
+		if( footerPosition_<endOfColumnTable || footerPosition_>fileSize-trailerSize ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+
+		buffer.assign( fileSize-trailerSize-footerPosition_, '\0' );
+		if( !buffer.empty() ) readBytes( footerPosition_, buffer.size(), &buffer[0] );
+		position=0;
+		uint32_t numberOfChunks;
+		::extractRaw( buffer, position, numberOfChunks );
+		for( uint32_t chunkNumber=0; chunkNumber<numberOfChunks; ++chunkNumber )
+		{
+			uint32_t recordSize;
+			::extractRaw( buffer, position, recordSize );
+			const size_t endOfRecord=position+recordSize;
+
+			ChunkIndexEntry indexEntry;
+			::extractRaw( buffer, position, indexEntry.offset );
+			::extractRaw( buffer, position, indexEntry.compressedSize );
+			::extractRaw( buffer, position, indexEntry.numberOfEvents );
+			::extractRaw( buffer, position, indexEntry.sumOfWeights );
+			indexEntry.sumOfWeightsSquared=-1;
+			indexEntry.uncompressedSize=0;
+			if( position>endOfRecord ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+
+			// The statistics are only there for files written since they were added
+			if( endOfRecord-position>=sizeof(double)+sizeof(float)*2*numberOfParameters_ )
+			{
+				::extractRaw( buffer, position, indexEntry.sumOfWeightsSquared );
+				indexEntry.minimumValues.resize( numberOfParameters_ );
+				indexEntry.maximumValues.resize( numberOfParameters_ );
+				for( size_t columnNumber=0; columnNumber<numberOfParameters_; ++columnNumber )
+				{
+					::extractRaw( buffer, position, indexEntry.minimumValues[columnNumber] );
+					::extractRaw( buffer, position, indexEntry.maximumValues[columnNumber] );
+				}
+				if( endOfRecord-position>=sizeof(uint64_t) ) ::extractRaw( buffer, position, indexEntry.uncompressedSize );
+			}
+			if( indexEntry.offset+indexEntry.compressedSize>footerPosition_ ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+			position=endOfRecord; // Skip anything added by later versions of the writer
+
+			chunkIndex_.push_back( indexEntry );
+		}
+
+		// Files written before the threshold index existed, or without one, end here
+		if( position<buffer.size() )
+		{
+			uint32_t recordSize;
+			::extractRaw( buffer, position, recordSize );
+			const size_t endOfRecord=position+recordSize;
+			::extractRaw( buffer, position, thresholdIndexPosition_ );
+			::extractRaw( buffer, position, thresholdIndexCompressedSize_ );
+			::extractRaw( buffer, position, thresholdIndexUncompressedSize_ );
+			if( position>endOfRecord ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+			if( thresholdIndexPosition_<endOfColumnTable || thresholdIndexPosition_+thresholdIndexCompressedSize_>footerPosition_ ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+			for( const auto& indexEntry : chunkIndex_ )
+			{
+				if( indexEntry.offset+indexEntry.compressedSize>thresholdIndexPosition_ ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+			}
+			hasThresholdIndex_=true;
+		}
+	}
+	catch( ... )
+	{
+		::close( fileDescriptor_ );
+		throw;
+	}
+}
+
+l1menu::implementation::ChunkedSampleFileReader::~ChunkedSampleFileReader()
+{
+	::close( fileDescriptor_ );
+}
+
+const l1menuprotobuf::SampleHeader& l1menu::implementation::ChunkedSampleFileReader::header() const
+{
+	return header_;
+}
+
+const std::vector<l1menu::implementation::ChunkIndexEntry>& l1menu::implementation::ChunkedSampleFileReader::chunkIndex() const
+{
+	return chunkIndex_;
+}
+
+const std::vector<l1menu::implementation::ColumnEncoding>& l1menu::implementation::ChunkedSampleFileReader::columnEncodings() const
+{
+	return columnEncodings_;
+}
+
+l1menu::ReducedSample::Codec l1menu::implementation::ChunkedSampleFileReader::codec() const
+{
+	return codec_;
+}
+
+bool l1menu::implementation::ChunkedSampleFileReader::hasWeightsSquared() const
+{
+	return hasWeightsSquared_;
+}
+
+size_t l1menu::implementation::ChunkedSampleFileReader::numberOfParameters() const
+{
+	return numberOfParameters_;
+}
+
+size_t l1menu::implementation::ChunkedSampleFileReader::numberOfEvents() const
+{
+	size_t returnValue=0;
+	for( const auto& indexEntry : chunkIndex_ ) returnValue+=indexEntry.numberOfEvents;
+	return returnValue;
+}
+
+uint64_t l1menu::implementation::ChunkedSampleFileReader::endOfChunks() const
+{
+	return hasThresholdIndex_ ? thresholdIndexPosition_ : footerPosition_;
+}
+
+bool l1menu::implementation::ChunkedSampleFileReader::hasThresholdIndex() const
+{
+	return hasThresholdIndex_;
+}
+
+std::vector<l1menu::implementation::ThresholdIndex> l1menu::implementation::ChunkedSampleFileReader::readThresholdIndex() const
+{
+	if( !hasThresholdIndex_ ) throw std::runtime_error( "ChunkedSampleFileReader::readThresholdIndex() called for a file without a threshold index" );
+
+	std::string compressedIndex( thresholdIndexCompressedSize_, '\0' );
+	if( !compressedIndex.empty() ) readBytes( thresholdIndexPosition_, compressedIndex.size(), &compressedIndex[0] );
+	std::string uncompressedIndex( thresholdIndexUncompressedSize_, '\0' );
+	::decompressChunk( codec_, compressedIndex, uncompressedIndex );
+
+	std::vector<ThresholdIndex> returnValue;
+	size_t position=0;
+	for( size_t columnNumber=0; columnNumber<numberOfParameters_; ++columnNumber )
+	{
+		uint64_t numberOfValues;
+		::extractRaw( uncompressedIndex, position, numberOfValues );
+		if( numberOfValues>(uncompressedIndex.size()-position)/(sizeof(float)+sizeof(double)*2) ) throw std::runtime_error( "ChunkedSampleFileReader - the threshold index is corrupt" );
+
+		std::vector<float> values( numberOfValues );
+		std::vector<double> cumulativeWeights( numberOfValues );
+		std::vector<double> cumulativeWeightsSquared( numberOfValues );
+		for( auto& value : values ) ::extractRaw( uncompressedIndex, position, value );
+		for( auto& weight : cumulativeWeights ) ::extractRaw( uncompressedIndex, position, weight );
+		for( auto& weightSquared : cumulativeWeightsSquared ) ::extractRaw( uncompressedIndex, position, weightSquared );
+		returnValue.push_back( ThresholdIndex( std::move(values), std::move(cumulativeWeights), std::move(cumulativeWeightsSquared) ) );
+	}
+
+	return returnValue;
+}
+
+void l1menu::implementation::ChunkedSampleFileReader::readChunk( size_t chunkNumber, float* pWeights, const std::vector<float*>& parameterColumns, float* pWeightsSquared ) const
+{
+	if( chunkNumber>=chunkIndex_.size() ) throw std::runtime_error( "ChunkedSampleFileReader::readChunk() asked for an invalid chunk number" );
+	if( parameterColumns.size()!=numberOfParameters_ ) throw std::runtime_error( "ChunkedSampleFileReader::readChunk() given the wrong number of columns" );
+	const ChunkIndexEntry& indexEntry=chunkIndex_[chunkNumber];
+
+	std::string compressedChunk;
+	readCompressedChunk( chunkNumber, compressedChunk );
+
+	// Older files don't store the uncompressed size, but without sparse columns it's fixed by the number
+	// of events and the column encodings
+	size_t uncompressedSize=indexEntry.uncompressedSize;
+	if( uncompressedSize==0 )
+	{
+		uncompressedSize=indexEntry.numberOfEvents*sizeof(float);
+		for( const auto& encoding : columnEncodings_ )
+		{
+			if( encoding.sparse ) throw std::runtime_error( "ChunkedSampleFileReader - the file footer is corrupt" );
+			uncompressedSize+=::encodedColumnSize( encoding, indexEntry.numberOfEvents );
+		}
+		if( hasWeightsSquared_ ) uncompressedSize+=indexEntry.numberOfEvents*sizeof(float);
+	}
+	std::string uncompressedChunk( uncompressedSize, '\0' );
+	::decompressChunk( codec_, compressedChunk, uncompressedChunk );
+
+	google::protobuf::io::ArrayInputStream arrayInput( uncompressedChunk.data(), uncompressedChunk.size() );
+	::readFromStream( arrayInput, pWeights, indexEntry.numberOfEvents*sizeof(float) );
+	for( size_t columnNumber=0; columnNumber<parameterColumns.size(); ++columnNumber )
+	{
+		if( parameterColumns[columnNumber]==nullptr ) ::skipColumn( arrayInput, columnEncodings_[columnNumber], indexEntry.numberOfEvents );
+		else ::readColumn( arrayInput, columnEncodings_[columnNumber], parameterColumns[columnNumber], indexEntry.numberOfEvents );
+	}
+
+	if( pWeightsSquared==nullptr ) return;
+	if( hasWeightsSquared_ ) ::readFromStream( arrayInput, pWeightsSquared, indexEntry.numberOfEvents*sizeof(float) );
+	else
+	{
+		for( size_t eventNumber=0; eventNumber<indexEntry.numberOfEvents; ++eventNumber ) pWeightsSquared[eventNumber]=pWeights[eventNumber]*pWeights[eventNumber];
+	}
+}
+
+void l1menu::implementation::ChunkedSampleFileReader::readCompressedChunk( size_t chunkNumber, std::string& compressedChunk ) const
+{
+	if( chunkNumber>=chunkIndex_.size() ) throw std::runtime_error( "ChunkedSampleFileReader::readCompressedChunk() asked for an invalid chunk number" );
+	const ChunkIndexEntry& indexEntry=chunkIndex_[chunkNumber];
+
+	compressedChunk.assign( indexEntry.compressedSize, '\0' );
+	if( !compressedChunk.empty() ) readBytes( indexEntry.offset, compressedChunk.size(), &compressedChunk[0] );
+}
+
+void l1menu::implementation::ChunkedSampleFileReader::readBytes( uint64_t position, size_t size, char* pBuffer ) const
+{
+	// Use pread so that there's no shared file position, which makes this safe to call from
+	// several threads at once.
+	size_t bytesRead=0;
+	while( bytesRead<size )
+	{
+		ssize_t result=::pread( fileDescriptor_, pBuffer+bytesRead, size-bytesRead, position+bytesRead );
+		if( result<0 ) throw std::runtime_error( "ChunkedSampleFileReader - error while reading the file" );
+		if( result==0 ) throw std::runtime_error( "ChunkedSampleFileReader - the file is truncated" );
+		bytesRead+=result;
+	}
+}
@@ -0,0 +1,251 @@
+#ifndef l1menu_implementation_ChunkedSampleFile_h
+#define l1menu_implementation_ChunkedSampleFile_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "l1menu/ReducedSample.h"
+#include "../protobuf/l1menu.pb.h"
+#include "ThresholdGrid.h"
+#include "ThresholdIndex.h"
+
+
+namespace l1menu
+{
+	namespace implementation
+	{
+		/** @brief Entry in the footer of a chunked ReducedSample file describing one chunk.
+		 *
+		 * As well as where the chunk is, it has statistics so that questions about the chunk can be
+		 * answered without decompressing it. The smallest and largest value of each parameter column
+		 * (i.e. a zone map) say whether any event in the chunk could pass a given threshold. Files
+		 * written before these were stored don't have them, in which case sumOfWeightsSquared is
+		 * -1 and minimumValues and maximumValues are empty. Files written before sparse columns existed
+		 * don't have uncompressedSize either, in which case it's 0.
+		 */
+		struct ChunkIndexEntry
+		{
+			uint64_t offset; ///< @brief Position in the file of the start of the compressed chunk
+			uint64_t compressedSize; ///< @brief Size in bytes of the chunk on disk
+			uint64_t numberOfEvents;
+			double sumOfWeights;
+			double sumOfWeightsSquared;
+			std::vector<float> minimumValues; ///< @brief The smallest value in each parameter column, as it's read back
+			std::vector<float> maximumValues; ///< @brief The largest value in each parameter column, or infinity if there's a NaN
+			uint64_t uncompressedSize; ///< @brief Size of the chunk once decompressed, or 0 if it's not known
+			bool hasColumnRanges() const;
+		};
+
+		/** @brief How a parameter column is stored in the chunks of a chunked ReducedSample file.
+		 *
+		 * The quantised types store each value as an index into the grid, with 0 reserved for -1 (the
+		 * event can never pass) and index+1 for the grid points. Values are rounded down onto the grid
+		 * when written, so the grid should be the one the values were quantised with.
+		 *
+		 * Any of the types can also be sparse. In each chunk a sparse column only stores the values that
+		 * aren't -1, with a bitmap of which events they're for. Most triggers fail most events, so most
+		 * values are usually -1. If a chunk has so few -1 values that the bitmap isn't worth it, every
+		 * value is stored instead.
+		 */
+		struct ColumnEncoding
+		{
+			enum Type : uint8_t { FLOAT32=0, GRID8=1, GRID16=2 };
+			static const uint8_t SPARSE_FLAG=0x80; ///< @brief Set in the type stored in the column table for sparse columns
+			Type type;
+			l1menu::implementation::ThresholdGrid grid; ///< @brief Only used for the quantised types
+			bool sparse;
+
+			ColumnEncoding();
+			ColumnEncoding( Type type, const l1menu::implementation::ThresholdGrid& grid, bool sparse=false );
+			bool operator==( const ColumnEncoding& otherEncoding ) const;
+			/** @brief The narrowest type that can hold every value in the column on the grid, or FLOAT32 if
+			 * the grid is invalid or doesn't fit in 16 bits. */
+			static ColumnEncoding narrowestFor( const l1menu::implementation::ThresholdGrid& grid, const float* pColumn, size_t numberOfEvents );
+		};
+
+		/** @brief Writes ReducedSample files in the chunked format (file format version 3).
+		 *
+		 * The layout of the file is:
+		 *     magic number                       "l1menuReducedSample", same as the other versions
+		 *     version                            varint32, value 3 (so a single byte)
+		 *     codec                              uint8 ReducedSample::Codec used for the chunks
+		 *     header size                        fixed64
+		 *     SampleHeader                       uncompressed protobuf message
+		 *     column table size                  fixed32
+		 *     column table                       fixed32 number of columns, then for each column a fixed32
+		 *                                        record size followed by uint8 ColumnEncoding::Type (with
+		 *                                        ColumnEncoding::SPARSE_FLAG set for sparse columns), float
+		 *                                        grid origin and float grid step. If there's one more column
+		 *                                        than there are parameters in the header, the last one is
+		 *                                        the sum of squared weights (always FLOAT32, not sparse).
+		 *     chunks                             each one independently compressed with the codec
+		 *     threshold index                    optional, compressed with the codec
+		 *     footer                             fixed32 number of chunks, then for each chunk a fixed32 record
+		 *                                        size followed by that many bytes of ChunkIndexEntry fields,
+		 *                                        with the minimum then maximum for each parameter column
+		 *                                        as floats after sumOfWeightsSquared, then the fixed64
+		 *                                        uncompressed size of the chunk.
+		 *                                        If there's a threshold index this is followed by a fixed32
+		 *                                        record size then its fixed64 position, compressed size and
+		 *                                        uncompressed size.
+		 *     footer position                    fixed64
+		 *     footer magic number                FOOTER_MAGIC_NUMBER, so that truncated files can be spotted
+		 * Uncompressed, a chunk is the weights column as 32 bit floats followed by each of the parameter
+		 * columns in the order they're listed in the header, stored as the column table says, and then the
+		 * sum of squared weights column if there is one. That's only there if identical events have been
+		 * collapsed into single rows, see ReducedSample::collapseIdenticalEvents().
+		 *
+		 * A sparse column starts with a fixed32 number of values stored. If that's less than the number of
+		 * events it's followed by a bitmap with a bit for each event (lowest bit of the first byte first)
+		 * set if it has a value, and the other events are -1. Then the values themselves, stored as the
+		 * column's type.
+		 *
+		 * Uncompressed, the threshold index is for each parameter column a fixed64 number of distinct
+		 * values, then the values as 32 bit floats and the ThresholdIndex cumulative weights and cumulative
+		 * squared weights as doubles. All numbers are in the native little endian byte order.
+		 *
+		 * Since every chunk is compressed separately, and the footer says where each one is, the chunks
+		 * can be decompressed in parallel. The record size in the footer is so that more information
+		 * can be added for each chunk later without breaking older readers.
+		 *
+		 * Chunks are written as they're added, and the footer when close() is called. If close() isn't
+		 * called the file is incomplete and can't be read. Existing files can be added to with
+		 * openForAppend(), in which case the new chunks are written over the old footer and close()
+		 * writes a new footer listing both the old and new chunks. Any threshold index is written over
+		 * as well, since it would be out of date.
+		 */
+		class ChunkedSampleFileWriter
+		{
+		public:
+			/** @brief Creates the file, replacing anything that was already there, and writes the header.
+			 *
+			 * @param[in] filename         The file to write.
+			 * @param[in] header           The header describing the trigger menu.
+			 * @param[in] columnEncodings  How each parameter column should be stored. If empty they're all
+			 *                             stored as floats.
+			 * @param[in] codec            How each chunk should be compressed.
+			 * @param[in] hasWeightsSquared Whether to store the sum of squared weights for each row.
+			 */
+			ChunkedSampleFileWriter( const std::string& filename, const l1menuprotobuf::SampleHeader& header, const std::vector<ColumnEncoding>& columnEncodings=std::vector<ColumnEncoding>(), l1menu::ReducedSample::Codec codec=l1menu::ReducedSample::Codec::GZIP, bool hasWeightsSquared=false );
+			/** @brief Opens an existing chunked file so that more chunks can be added to the end.
+			 *
+			 * Nothing in the file changes until the first chunk is written, but after that the file can't
+			 * be read until close() has been called. The header, column encodings and codec are the ones
+			 * already in the file. */
+			static std::unique_ptr<ChunkedSampleFileWriter> openForAppend( const std::string& filename );
+			ChunkedSampleFileWriter( const ChunkedSampleFileWriter& otherWriter )=delete;
+			ChunkedSampleFileWriter& operator=( const ChunkedSampleFileWriter& otherWriter )=delete;
+			~ChunkedSampleFileWriter();
+
+			/** @brief Compresses and writes the events as a single chunk.
+			 *
+			 * @param[in] pWeights          Array of numberOfEvents weights.
+			 * @param[in] parameterColumns  One array of numberOfEvents values for each of the parameters
+			 *                              in the header.
+			 * @param[in] numberOfEvents    The number of events in the chunk.
+			 * @param[in] pWeightsSquared   Array of numberOfEvents sums of squared weights, or nullptr if they're
+			 *                              just the weights squared. If the file doesn't store them they have to
+			 *                              be just the weights squared, otherwise an exception is thrown.
+			 */
+			void writeChunk( const float* pWeights, const std::vector<const float*>& parameterColumns, size_t numberOfEvents, const float* pWeightsSquared=nullptr );
+
+			/** @brief Writes a chunk exactly as it was read from another file by ChunkedSampleFileReader::readCompressedChunk().
+			 *
+			 * Only valid if the other file has the same header, column encodings and codec, which is the
+			 * caller's responsibility to check. The offset in indexEntry is ignored. */
+			void writeCompressedChunk( const ChunkIndexEntry& indexEntry, const std::string& compressedChunk );
+
+			/** @brief Writes the threshold index, one entry for each parameter in the header. No more chunks can
+			 * be written afterwards. */
+			void writeThresholdIndex( const std::vector<ThresholdIndex>& thresholdIndex );
+
+			/** @brief Writes the footer and closes the file. */
+			void close();
+
+			const l1menuprotobuf::SampleHeader& header() const;
+			const std::vector<ColumnEncoding>& columnEncodings() const;
+			l1menu::ReducedSample::Codec codec() const;
+			bool hasWeightsSquared() const;
+		protected:
+			ChunkedSampleFileWriter(); ///< @brief Only used by openForAppend
+			void writeBytes( const std::string& bytes );
+			int fileDescriptor_;
+			l1menuprotobuf::SampleHeader header_;
+			uint64_t position_; ///< @brief Where in the file the next write will go
+			size_t numberOfParameters_;
+			std::vector<ColumnEncoding> columnEncodings_;
+			l1menu::ReducedSample::Codec codec_;
+			bool hasWeightsSquared_;
+			std::vector<ChunkIndexEntry> chunkIndex_;
+			bool hasThresholdIndex_;
+			uint64_t thresholdIndexPosition_;
+			uint64_t thresholdIndexCompressedSize_;
+			uint64_t thresholdIndexUncompressedSize_;
+		};
+
+		/** @brief Reads ReducedSample files in the chunked format (file format version 3).
+		 *
+		 * See ChunkedSampleFileWriter for the format. The header and footer are read on construction,
+		 * the chunks only when asked for. readChunk() can be called from several threads at once.
+		 */
+		class ChunkedSampleFileReader
+		{
+		public:
+			ChunkedSampleFileReader( const std::string& filename );
+			ChunkedSampleFileReader( const ChunkedSampleFileReader& otherReader )=delete;
+			ChunkedSampleFileReader& operator=( const ChunkedSampleFileReader& otherReader )=delete;
+			~ChunkedSampleFileReader();
+
+			const l1menuprotobuf::SampleHeader& header() const;
+			const std::vector<ChunkIndexEntry>& chunkIndex() const;
+			const std::vector<ColumnEncoding>& columnEncodings() const;
+			l1menu::ReducedSample::Codec codec() const;
+			/** @brief Whether the file stores the sum of squared weights for each row. */
+			bool hasWeightsSquared() const;
+			size_t numberOfParameters() const;
+			/** @brief The total number of events in all chunks. */
+			size_t numberOfEvents() const;
+			/** @brief The position in the file just after the last chunk, i.e. where the threshold index or footer starts. */
+			uint64_t endOfChunks() const;
+			/** @brief Whether the file has a threshold index, see ReducedSample::buildThresholdIndex(). */
+			bool hasThresholdIndex() const;
+			/** @brief Reads the threshold index, one entry for each parameter. Throws if the file doesn't have one. */
+			std::vector<ThresholdIndex> readThresholdIndex() const;
+
+			/** @brief Decompresses the chunk into the arrays provided.
+			 *
+			 * @param[in]  chunkNumber        Which chunk to read.
+			 * @param[out] pWeights           Array with space for at least chunkIndex()[chunkNumber].numberOfEvents
+			 *                                entries.
+			 * @param[out] parameterColumns   numberOfParameters() arrays, each the same size as pWeights. Columns
+			 *                                that aren't wanted can be null, in which case they're skipped.
+			 * @param[out] pWeightsSquared    Array the same size as pWeights for the sums of squared weights, or
+			 *                                nullptr if they're not wanted. If the file doesn't store them this is
+			 *                                filled with the weights squared.
+			 */
+			void readChunk( size_t chunkNumber, float* pWeights, const std::vector<float*>& parameterColumns, float* pWeightsSquared=nullptr ) const;
+
+			/** @brief Reads the chunk without decompressing it, so that it can be copied to another file with
+			 * ChunkedSampleFileWriter::writeCompressedChunk(). */
+			void readCompressedChunk( size_t chunkNumber, std::string& compressedChunk ) const;
+		protected:
+			void readBytes( uint64_t position, size_t size, char* pBuffer ) const;
+			int fileDescriptor_;
+			l1menuprotobuf::SampleHeader header_;
+			std::vector<ColumnEncoding> columnEncodings_;
+			l1menu::ReducedSample::Codec codec_;
+			bool hasWeightsSquared_;
+			std::vector<ChunkIndexEntry> chunkIndex_;
+			size_t numberOfParameters_;
+			uint64_t footerPosition_;
+			bool hasThresholdIndex_;
+			uint64_t thresholdIndexPosition_;
+			uint64_t thresholdIndexCompressedSize_;
+			uint64_t thresholdIndexUncompressedSize_;
+		};
+
+	} // end of namespace implementation
+} // end of namespace l1menu
+
+#endif
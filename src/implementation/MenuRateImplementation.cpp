@@ -2,6 +2,7 @@
 
 #include <string>
 #include <utility>
+#include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <fstream>
@@ -11,7 +12,9 @@
 #include "l1menu/ITriggerRate.h"
 #include "l1menu/TriggerMenu.h"
 #include "l1menu/ISample.h"
+#include "l1menu/ReducedSample.h"
 #include "l1menu/IEvent.h"
+#include "l1menu/IEventBlock.h"
 #include "TriggerRateImplementation.h"
 #include "l1menu/tools/XMLFile.h"
 #include "l1menu/tools/XMLElement.h"
@@ -45,38 +48,67 @@ l1menu::implementation::MenuRateImplementation::MenuRateImplementation( const l1
 
 	size_t numberOfLastPassedTrigger=0; // This is just so I can work out the pure rate
 
-	for( size_t eventNumber=0; eventNumber<sample.numberOfEvents(); ++eventNumber )
-	{
-		const l1menu::IEvent& event=sample.getEvent(eventNumber);
-		float weight=event.weight();
-		weightOfAllEvents+=weight;
-
-		size_t numberOfTriggersPassed=0;
+	// Loop over the sample in blocks. Each trigger is applied to the whole block in one go, which
+	// for ReducedSample is a tight loop along the threshold columns. The results for trigger i
+	// and event j in the block are in triggerResults[i*BLOCK_SIZE+j].
+	const size_t BLOCK_SIZE=4096;
+	std::unique_ptr<bool[]> triggerResults( new bool[cachedTriggers.size()*BLOCK_SIZE] );
 
+	auto processBlock=[&]( const l1menu::IEventBlock& eventBlock )
+	{
 		for( size_t triggerNumber=0; triggerNumber<cachedTriggers.size(); ++triggerNumber )
 		{
-			if( cachedTriggers[triggerNumber]->apply(event) )
-			{
-				// If the event passes the trigger, increment the counters
-				++numberOfTriggersPassed;
-				weightOfEventsPassed[triggerNumber]+=weight;
-				weightSquaredOfEventsPassed[triggerNumber]+=(weight*weight);
-				numberOfLastPassedTrigger=triggerNumber; // If only one event passes, this is used to increment the pure counter
-			}
+			cachedTriggers[triggerNumber]->apply( eventBlock, &triggerResults[triggerNumber*BLOCK_SIZE] );
 		}
 
-		// See if I should increment any of the pure or total counters
-		if( numberOfTriggersPassed==1 )
+		const float* weights=eventBlock.weights();
+		const float* weightsSquared=eventBlock.weightsSquared();
+		for( size_t index=0; index<eventBlock.size(); ++index )
 		{
-			weightOfEventsPure[numberOfLastPassedTrigger]+=weight;
-			weightSquaredOfEventsPure[numberOfLastPassedTrigger]+=(weight*weight);
-		}
-		if( numberOfTriggersPassed>0 )
-		{
-			weightOfEventsPassingAnyTrigger+=weight;
-			weightSquaredOfEventsPassingAnyTrigger+=(weight*weight);
+			float weight=weights[index];
+			// Each entry could be several identical events collapsed together, in which case the error
+			// needs the sum of their squared weights rather than the square of the summed weight.
+			float weightSquared= weightsSquared==nullptr ? weight*weight : weightsSquared[index];
+			weightOfAllEvents+=weight;
+
+			size_t numberOfTriggersPassed=0;
+
+			for( size_t triggerNumber=0; triggerNumber<cachedTriggers.size(); ++triggerNumber )
+			{
+				if( triggerResults[triggerNumber*BLOCK_SIZE+index] )
+				{
+					// If the event passes the trigger, increment the counters
+					++numberOfTriggersPassed;
+					weightOfEventsPassed[triggerNumber]+=weight;
+					weightSquaredOfEventsPassed[triggerNumber]+=weightSquared;
+					numberOfLastPassedTrigger=triggerNumber; // If only one event passes, this is used to increment the pure counter
+				}
+			}
+
+			// See if I should increment any of the pure or total counters
+			if( numberOfTriggersPassed==1 )
+			{
+				weightOfEventsPure[numberOfLastPassedTrigger]+=weight;
+				weightSquaredOfEventsPure[numberOfLastPassedTrigger]+=weightSquared;
+			}
+			if( numberOfTriggersPassed>0 )
+			{
+				weightOfEventsPassingAnyTrigger+=weight;
+				weightSquaredOfEventsPassingAnyTrigger+=weightSquared;
+			}
 		}
+	}; // end of lambda for each block
+
+	// ReducedSample can leave out whole parts of the sample where nothing can pass, which at high
+	// thresholds is most of it. The events left out still count towards the total weight.
+	const l1menu::ReducedSample* pReducedSample=dynamic_cast<const l1menu::ReducedSample*>( &sample );
+	if( pReducedSample!=nullptr )
+	{
+		std::vector<const l1menu::ITrigger*> triggers;
+		for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber ) triggers.push_back( &menu.getTrigger( triggerNumber ) );
+		weightOfAllEvents+=pReducedSample->forEachBlockPassingAny( triggers, BLOCK_SIZE, processBlock );
 	}
+	else sample.forEachBlock( BLOCK_SIZE, processBlock );
 
 	float scaling=sample.eventRate();
 
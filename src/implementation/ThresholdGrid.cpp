@@ -0,0 +1,98 @@
+#include "ThresholdGrid.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cstring>
+
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/** @brief The step, in GeV, that the hardware applies thresholds on each type of object in.
+	 *
+	 * The calorimeter trigger works in 0.5 GeV units for everything, including the energy sums, and
+	 * the muon trigger quantises pT in 0.5 GeV steps too. */
+	struct HardwareStep
+	{
+		const char* objectName; ///< @brief How the object appears in trigger names, e.g. "EG" in "L1_SingleIsoEG"
+		float step;
+	};
+	const HardwareStep HARDWARE_STEPS[]={ {"EG",0.5}, {"Tau",0.5}, {"Jet",0.5}, {"Mu",0.5}, {"ETM",0.5}, {"HTT",0.5}, {"HTM",0.5} };
+}
+
+const float l1menu::implementation::ThresholdGrid::DEFAULT_STEP=0.5;
+const size_t l1menu::implementation::ThresholdGrid::MAXIMUM_INDEX=1<<20;
+
+l1menu::implementation::ThresholdGrid::ThresholdGrid()
+	: origin_(0), step_(0)
+{
+	// No operation
+}
+
+l1menu::implementation::ThresholdGrid::ThresholdGrid( float origin, float step )
+	: origin_(origin), step_(step)
+{
+	if( !(step>0) ) throw std::runtime_error( "ThresholdGrid - the step must be greater than zero" );
+}
+
+l1menu::implementation::ThresholdGrid l1menu::implementation::ThresholdGrid::forTriggerParameter( const std::string& triggerName )
+{
+	// Cross triggers have more than one type of object, and I don't want to rely on working out which
+	// leg the parameter belongs to from its name. Using the finest step of any of the objects is always
+	// safe, since thresholds on a coarser grid (with the same origin) are also on the finer one.
+	float step=std::numeric_limits<float>::infinity();
+	for( const auto& hardwareStep : HARDWARE_STEPS )
+	{
+		if( std::strstr( triggerName.c_str(), hardwareStep.objectName )!=nullptr ) step=std::min( step, hardwareStep.step );
+	}
+	if( step==std::numeric_limits<float>::infinity() ) step=DEFAULT_STEP;
+
+	// Thresholds are set in whole steps from zero, so the grid has to start there
+	return ThresholdGrid( 0, step );
+}
+
+bool l1menu::implementation::ThresholdGrid::isValid() const
+{
+	return step_>0;
+}
+
+float l1menu::implementation::ThresholdGrid::origin() const
+{
+	return origin_;
+}
+
+float l1menu::implementation::ThresholdGrid::step() const
+{
+	return step_;
+}
+
+float l1menu::implementation::ThresholdGrid::value( size_t index ) const
+{
+	return origin_+index*step_;
+}
+
+bool l1menu::implementation::ThresholdGrid::contains( float value ) const
+{
+	// Written so that NaN gives false
+	return (value-origin_)/step_<MAXIMUM_INDEX && std::isfinite(value);
+}
+
+size_t l1menu::implementation::ThresholdGrid::floorIndex( float value ) const
+{
+	if( !contains(value) ) throw std::runtime_error( "ThresholdGrid - the value is infinite, NaN or too far above the grid to be rounded onto it" );
+	if( !(value>origin_) ) return 0;
+
+	// The division can be out by a rounding error either way, so check against the grid
+	// points actually used and correct it. Being below the true value is what matters,
+	// otherwise the event would pass thresholds that it shouldn't.
+	size_t index=static_cast<size_t>( std::floor( (value-origin_)/step_ ) );
+	while( index>0 && this->value(index)>value ) --index;
+	while( !(this->value(index+1)>value) ) ++index;
+	return index;
+}
+
+float l1menu::implementation::ThresholdGrid::snap( float value ) const
+{
+	if( value==-1 || !isValid() || !contains(value) ) return value;
+	return this->value( floorIndex(value) );
+}
@@ -0,0 +1,60 @@
+#ifndef l1menu_implementation_ThresholdGrid_h
+#define l1menu_implementation_ThresholdGrid_h
+
+#include <stddef.h> // required for size_t
+#include <string>
+
+namespace l1menu
+{
+	namespace implementation
+	{
+		/** @brief Evenly spaced threshold values that a ReducedSample parameter can be rounded onto.
+		 *
+		 * The hardware can only apply thresholds in fixed steps, so there's no point storing the tightest
+		 * threshold an event passes any more precisely than that. Values are always rounded down onto
+		 * the grid, so an event gives exactly the same result for any threshold that lies on the grid.
+		 * The value -1 (the event can never pass) is left as it is, and so are values the grid can't hold
+		 * (see contains()).
+		 *
+		 * A default constructed grid is invalid, meaning the parameter isn't quantised.
+		 */
+		class ThresholdGrid
+		{
+		public:
+			ThresholdGrid();
+			ThresholdGrid( float origin, float step );
+
+			/** @brief Creates the grid for the parameters of a trigger from the step the hardware applies thresholds
+			 * in for the objects in the trigger, or DEFAULT_STEP if it doesn't recognise any. The grid starts at
+			 * zero, so every threshold the hardware can apply is on it. */
+			static ThresholdGrid forTriggerParameter( const std::string& triggerName );
+
+			bool isValid() const;
+			float origin() const;
+			float step() const;
+
+			/** @brief The grid point with the given index. */
+			float value( size_t index ) const;
+			/** @brief Whether floorIndex() can be used for the value, i.e. it's finite and isn't more than
+			 * MAXIMUM_INDEX steps above the origin. Values below the grid are fine. */
+			bool contains( float value ) const;
+			/** @brief The index of the highest grid point that isn't above the value. Anything below
+			 * the grid gives index 0. Throws a std::runtime_error if contains() is false for the value. */
+			size_t floorIndex( float value ) const;
+			/** @brief Rounds the value down onto the grid, leaving -1 and values the grid doesn't contain()
+			 * as they are. Invalid grids leave every value as it is. */
+			float snap( float value ) const;
+
+			/** @brief The step used if none of the objects the hardware step is known for are in the trigger name. */
+			static const float DEFAULT_STEP;
+			/** @brief The highest index allowed. Keeps each grid point distinguishable from the next as a float. */
+			static const size_t MAXIMUM_INDEX;
+		protected:
+			float origin_;
+			float step_;
+		};
+
+	} // end of namespace implementation
+} // end of namespace l1menu
+
+#endif
@@ -0,0 +1,83 @@
+#include "ThresholdIndex.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+l1menu::implementation::ThresholdIndex::ThresholdIndex()
+{
+	// No operation
+}
+
+l1menu::implementation::ThresholdIndex::ThresholdIndex( std::vector<float> values, std::vector<double> cumulativeWeights, std::vector<double> cumulativeWeightsSquared )
+	: values_( std::move(values) ), cumulativeWeights_( std::move(cumulativeWeights) ), cumulativeWeightsSquared_( std::move(cumulativeWeightsSquared) )
+{
+	if( cumulativeWeights_.size()!=values_.size() || cumulativeWeightsSquared_.size()!=values_.size() ) throw std::runtime_error( "ThresholdIndex - the arrays are not all the same size" );
+	if( !std::is_sorted( values_.begin(), values_.end() ) ) throw std::runtime_error( "ThresholdIndex - the values are not in order" );
+}
+
+l1menu::implementation::ThresholdIndex l1menu::implementation::ThresholdIndex::forColumn( const float* pColumn, const float* pWeights, const float* pWeightsSquared, size_t numberOfEvents )
+{
+	// Sort the event numbers by value rather than the values themselves, so that I can get at the weights
+	std::vector<size_t> eventNumbers( numberOfEvents );
+	for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber ) eventNumbers[eventNumber]=eventNumber;
+
+	// NaN would break the sort. Since a NaN is never below a threshold it passes everything, the
+	// same as infinity, so treat it as that.
+	auto sortValue=[pColumn]( size_t eventNumber ) { return std::isnan(pColumn[eventNumber]) ? std::numeric_limits<float>::infinity() : pColumn[eventNumber]; };
+	std::sort( eventNumbers.begin(), eventNumbers.end(), [&sortValue]( size_t first, size_t second ){ return sortValue(first)<sortValue(second); } );
+
+	// Walk down from the highest value, adding each event's weight on to the running totals
+	ThresholdIndex returnValue;
+	double sumOfWeights=0;
+	double sumOfWeightsSquared=0;
+	for( auto iEventNumber=eventNumbers.rbegin(); iEventNumber!=eventNumbers.rend(); ++iEventNumber )
+	{
+		const float value=sortValue(*iEventNumber);
+		const double weight=pWeights[*iEventNumber];
+		sumOfWeights+=weight;
+		sumOfWeightsSquared+=( pWeightsSquared==nullptr ? weight*weight : pWeightsSquared[*iEventNumber] );
+
+		if( returnValue.values_.empty() || returnValue.values_.back()!=value )
+		{
+			returnValue.values_.push_back( value );
+			returnValue.cumulativeWeights_.push_back( sumOfWeights );
+			returnValue.cumulativeWeightsSquared_.push_back( sumOfWeightsSquared );
+		}
+		else
+		{
+			returnValue.cumulativeWeights_.back()=sumOfWeights;
+			returnValue.cumulativeWeightsSquared_.back()=sumOfWeightsSquared;
+		}
+	}
+
+	// I built it from the top down, but it's stored in ascending order
+	std::reverse( returnValue.values_.begin(), returnValue.values_.end() );
+	std::reverse( returnValue.cumulativeWeights_.begin(), returnValue.cumulativeWeights_.end() );
+	std::reverse( returnValue.cumulativeWeightsSquared_.begin(), returnValue.cumulativeWeightsSquared_.end() );
+	return returnValue;
+}
+
+std::pair<double,double> l1menu::implementation::ThresholdIndex::weightPassing( float threshold ) const
+{
+	// An event passes if its value isn't below the threshold, so I want the first value that's not less than it
+	const size_t index=std::lower_bound( values_.begin(), values_.end(), threshold )-values_.begin();
+	if( index==values_.size() ) return std::make_pair( 0.0, 0.0 );
+	else return std::make_pair( cumulativeWeights_[index], cumulativeWeightsSquared_[index] );
+}
+
+const std::vector<float>& l1menu::implementation::ThresholdIndex::values() const
+{
+	return values_;
+}
+
+const std::vector<double>& l1menu::implementation::ThresholdIndex::cumulativeWeights() const
+{
+	return cumulativeWeights_;
+}
+
+const std::vector<double>& l1menu::implementation::ThresholdIndex::cumulativeWeightsSquared() const
+{
+	return cumulativeWeightsSquared_;
+}
@@ -0,0 +1,53 @@
+#ifndef l1menu_implementation_ThresholdIndex_h
+#define l1menu_implementation_ThresholdIndex_h
+
+#include <stddef.h> // required for size_t
+#include <vector>
+#include <utility>
+
+namespace l1menu
+{
+	namespace implementation
+	{
+		/** @brief The values in a ReducedSample parameter column sorted, with the cumulative weight of the events.
+		 *
+		 * Each column holds the tightest threshold that each event passes, so the events that pass a
+		 * threshold are just the ones with a value that isn't below it. With the distinct values sorted
+		 * and the weights summed from the top down, the weight passing any threshold is a binary search
+		 * rather than a loop over the events.
+		 *
+		 * A default constructed index is empty, i.e. it's for a sample with no events.
+		 */
+		class ThresholdIndex
+		{
+		public:
+			ThresholdIndex();
+			/** @brief Constructor from the stored arrays, e.g. when read from file.
+			 *
+			 * @param[in] values                     The distinct values in ascending order.
+			 * @param[in] cumulativeWeights          For each value the sum of the weights of the events with that
+			 *                                       value or above.
+			 * @param[in] cumulativeWeightsSquared   The same for the sums of squared weights.
+			 */
+			ThresholdIndex( std::vector<float> values, std::vector<double> cumulativeWeights, std::vector<double> cumulativeWeightsSquared );
+
+			/** @brief Creates the index for a column. pWeightsSquared can be null if it's just the weights squared. */
+			static ThresholdIndex forColumn( const float* pColumn, const float* pWeights, const float* pWeightsSquared, size_t numberOfEvents );
+
+			/** @brief The summed weight ('first') and summed squared weight ('second') of the events that
+			 * aren't below the threshold, i.e. that pass a trigger with the threshold set to that. */
+			std::pair<double,double> weightPassing( float threshold ) const;
+
+			const std::vector<float>& values() const;
+			const std::vector<double>& cumulativeWeights() const;
+			const std::vector<double>& cumulativeWeightsSquared() const;
+		protected:
+			std::vector<float> values_;
+			std::vector<double> cumulativeWeights_;
+			std::vector<double> cumulativeWeightsSquared_;
+		};
+
+	} // end of namespace implementation
+} // end of namespace l1menu
+
+#endif
@@ -177,7 +177,50 @@ namespace // Unnamed namespace for things only used in this file
 				<< " Total L1 Rate (pure triggers)    = " << delimeter << std::setw(8) << totalPure << delimeter << " kHz" << std::endl;
 
 	} // end of function dumpTriggerRatesInOldFormat
-}
+
+	/** @brief Implementation of both versions of l1menu::tools::loadSample. pProjectionMenu can be null. */
+	std::unique_ptr<l1menu::ISample> loadSampleImplementation( const std::string& filename, const l1menu::TriggerMenu* pProjectionMenu, bool streamFromFile )
+	{
+		// Open the file, read enough of the start to determine what kind of file
+		// it is, then close it.
+		std::ifstream inputFile( filename, std::ios_base::binary );
+		if( !inputFile.is_open() ) throw std::runtime_error( "The file does not exist or could not be opened" );
+
+		// Look at the first few characters and see if they match some of the file formats
+		const size_t bufferSize=20;
+		char buffer[bufferSize];
+		inputFile.get( buffer, bufferSize );
+		inputFile.close();
+
+		if( std::string(buffer)=="l1menuReducedSample" )
+		{
+			if( pProjectionMenu!=nullptr ) return std::unique_ptr<l1menu::ISample>( new l1menu::ReducedSample(filename,*pProjectionMenu,streamFromFile) );
+			else return std::unique_ptr<l1menu::ISample>( new l1menu::ReducedSample(filename,streamFromFile) );
+		}
+		else
+		{
+			// If it's not a ReducedSample then the only other ISample implementation at the
+			// moment is a FullSample.
+			std::unique_ptr<l1menu::FullSample> pReturnValue( new l1menu::FullSample );
+			if( pProjectionMenu!=nullptr ) pReturnValue->setRequiredCollections( *pProjectionMenu ); // Only read what the menu needs
+
+			if( std::string(buffer).substr(0,4)=="root" )
+			{
+				// File is a root file, so assume it is one of the L1 DPG ntuples and try and load it
+				// into the FullSample.
+				pReturnValue->loadFile( filename );
+				return std::unique_ptr<l1menu::ISample>( pReturnValue.release() );
+			}
+			else
+			{
+				// Assume the file is a list of filenames of L1 DPG ntuples.
+				// TODO Do some checking to see if the characters I've read so far are valid filepath characters.
+				pReturnValue->loadFilesFromList( filename );
+				return std::unique_ptr<l1menu::ISample>( pReturnValue.release() );
+			}
+		}
+	}
+} // end of the unnamed namespace
 
 
 void l1menu::tools::dumpTriggerRates( std::ostream& output, const l1menu::IMenuRate& menuRates, const l1menu::IMenuRate& offlineThresholds, l1menu::tools::FileFormat format )
@@ -308,41 +351,14 @@ void l1menu::tools::dumpTriggerMenu( std::ostream& output, const l1menu::Trigger
 	}
 }
 
-std::unique_ptr<l1menu::ISample> l1menu::tools::loadSample( const std::string& filename )
+std::unique_ptr<l1menu::ISample> l1menu::tools::loadSample( const std::string& filename, bool streamFromFile )
 {
-	// Open the file, read enough of the start to determine what kind of file
-	// it is, then close it.
-	std::ifstream inputFile( filename, std::ios_base::binary );
-	if( !inputFile.is_open() ) throw std::runtime_error( "The file does not exist or could not be opened" );
-
-	// Look at the first few characters and see if they match some of the file formats
-	const size_t bufferSize=20;
-	char buffer[bufferSize];
-	inputFile.get( buffer, bufferSize );
-	inputFile.close();
-
-	if( std::string(buffer)=="l1menuReducedSample" ) return std::unique_ptr<l1menu::ISample>( new l1menu::ReducedSample(filename) );
-	else
-	{
-		// If it's not a ReducedSample then the only other ISample implementation at the
-		// moment is a FullSample.
-		std::unique_ptr<l1menu::FullSample> pReturnValue( new l1menu::FullSample );
+	return ::loadSampleImplementation( filename, nullptr, streamFromFile );
+}
 
-		if( std::string(buffer).substr(0,4)=="root" )
-		{
-			// File is a root file, so assume it is one of the L1 DPG ntuples and try and load it
-			// into the FullSample.
-			pReturnValue->loadFile( filename );
-			return std::unique_ptr<l1menu::ISample>( pReturnValue.release() );
-		}
-		else
-		{
-			// Assume the file is a list of filenames of L1 DPG ntuples.
-			// TODO Do some checking to see if the characters I've read so far are valid filepath characters.
-			pReturnValue->loadFilesFromList( filename );
-			return std::unique_ptr<l1menu::ISample>( pReturnValue.release() );
-		}
-	}
+std::unique_ptr<l1menu::ISample> l1menu::tools::loadSample( const std::string& filename, const l1menu::TriggerMenu& projectionMenu, bool streamFromFile )
+{
+	return ::loadSampleImplementation( filename, &projectionMenu, streamFromFile );
 }
 
 std::unique_ptr<l1menu::TriggerMenu> l1menu::tools::loadMenu( const std::string& filename )
@@ -8,6 +8,9 @@
 #include <ostream>
 #include <fstream>
 #include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include "l1menu/ITrigger.h"
 #include "l1menu/L1TriggerDPGEvent.h"
 #include "l1menu/TriggerTable.h"
@@ -17,6 +20,14 @@
 #include "l1menu/FullSample.h"
 #include "l1menu/ReducedSample.h"
 
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/// @brief The eta edges of the calorimeter regions, region N goes from element N to element N+1
+	const float CALORIMETER_REGION_EDGES[]={ -5.0, -4.5, -4.0, -3.5, -3.0, -2.172, -1.74, -1.392, -1.044, -0.696, -0.348, 0,
+			0.348, 0.696, 1.044, 1.392, 1.74, 2.172, 3.0, 3.5, 4.0, 4.5, 5.0 };
+	const size_t NUMBER_OF_CALORIMETER_REGIONS=sizeof(CALORIMETER_REGION_EDGES)/sizeof(CALORIMETER_REGION_EDGES[0])-1;
+} // end of the unnamed namespace
+
 
 std::vector<std::string> l1menu::tools::getThresholdNames( const l1menu::ITriggerDescription& trigger )
 {
@@ -88,6 +99,17 @@ void l1menu::tools::setTriggerThresholdsAsTightAsPossible( const l1menu::L1Trigg
 	std::vector<std::string> thresholdNames=l1menu::tools::getThresholdNames( trigger );
 	std::map<std::string,float> tightestPossibleThresholds;
 
+	// If the trigger can work the thresholds out directly from the event that's much quicker
+	// than bisection. It sets them all to -1 if the event can't pass.
+	if( trigger.setThresholdsAsTightAsPossible( event ) )
+	{
+		for( const auto& thresholdName : thresholdNames )
+		{
+			if( trigger.parameter(thresholdName)<0 ) throw std::runtime_error( "l1menu::tools::setTriggerThresholdsAsTightAsPossible() - couldn't find a set of thresholds to pass the given event.");
+		}
+		return;
+	}
+
 	//
 	// If the thresholds are correlated, then I can't modify them individually to see if an event will pass
 	// and I'll have to scale them all together. So if they're correlated figure out what the scalings need
@@ -180,44 +202,22 @@ void l1menu::tools::setTriggerThresholdsAsTightAsPossible( const l1menu::L1Trigg
 
 std::pair<float,float> l1menu::tools::calorimeterRegionEtaBounds( size_t calorimeterRegion )
 {
-	if( calorimeterRegion==0 ) return std::make_pair( -5.0, -4.5 );
-	else if( calorimeterRegion==1 ) return std::make_pair( -4.5, -4.0 );
-	else if( calorimeterRegion==2 ) return std::make_pair( -4.0, -3.5 );
-	else if( calorimeterRegion==3 ) return std::make_pair( -3.5, -3.0 );
-	else if( calorimeterRegion==4 ) return std::make_pair( -3.0, -2.172 );
-	else if( calorimeterRegion==5 ) return std::make_pair( -2.172, -1.74 );
-	else if( calorimeterRegion==6 ) return std::make_pair( -1.74, -1.392 );
-	else if( calorimeterRegion==7 ) return std::make_pair( -1.392, -1.044 );
-	else if( calorimeterRegion==8 ) return std::make_pair( -1.044, -0.696 );
-	else if( calorimeterRegion==9 ) return std::make_pair( -0.696, -0.348 );
-	else if( calorimeterRegion==10 ) return std::make_pair( -0.348, 0 );
-	else if( calorimeterRegion==11 ) return std::make_pair( 0, 0.348 );
-	else if( calorimeterRegion==12 ) return std::make_pair( 0.348, 0.696 );
-	else if( calorimeterRegion==13 ) return std::make_pair( 0.696, 1.044 );
-	else if( calorimeterRegion==14 ) return std::make_pair( 1.044, 1.392 );
-	else if( calorimeterRegion==15 ) return std::make_pair( 1.392, 1.74 );
-	else if( calorimeterRegion==16 ) return std::make_pair( 1.74, 2.172 );
-	else if( calorimeterRegion==17 ) return std::make_pair( 2.172, 3.0 );
-	else if( calorimeterRegion==18 ) return std::make_pair( 3.0, 3.5 );
-	else if( calorimeterRegion==19 ) return std::make_pair( 3.5, 4.0 );
-	else if( calorimeterRegion==20 ) return std::make_pair( 4.0, 4.5 );
-	else if( calorimeterRegion==21 ) return std::make_pair( 4.5, 5.0 );
-	else throw std::runtime_error( "l1menu::tools::calorimeterRegionEtaBounds was given an invalid calorimeter region" );
+	if( calorimeterRegion>=::NUMBER_OF_CALORIMETER_REGIONS ) throw std::runtime_error( "l1menu::tools::calorimeterRegionEtaBounds was given an invalid calorimeter region" );
+	return std::make_pair( ::CALORIMETER_REGION_EDGES[calorimeterRegion], ::CALORIMETER_REGION_EDGES[calorimeterRegion+1] );
 }
 
 float l1menu::tools::convertEtaCutToRegionCut( float etaCut )
 {
-	if( etaCut<calorimeterRegionEtaBounds(0).first || etaCut>calorimeterRegionEtaBounds(21).second )
+	const float* pFirstEdge=::CALORIMETER_REGION_EDGES;
+	const float* pEndOfEdges=::CALORIMETER_REGION_EDGES+::NUMBER_OF_CALORIMETER_REGIONS+1;
+	if( etaCut<*pFirstEdge || etaCut>*(pEndOfEdges-1) )
 			throw std::runtime_error( "l1menu::tools::convertEtaCutToRegionCut was given an eta value outside the allowed region" );
 
-	size_t caloRegion;
-	for( caloRegion=0; caloRegion<=21; ++caloRegion )
-	{
-		std::pair<float,float> regionBounds=calorimeterRegionEtaBounds( caloRegion );
-		if( regionBounds.first<=etaCut && etaCut<regionBounds.second ) break;
-	}
+	// The first edge above the cut is the top of its region. A cut right on the top edge of the last
+	// region counts as being in it.
+	size_t caloRegion=std::upper_bound( pFirstEdge, pEndOfEdges, etaCut )-pFirstEdge-1;
+	if( caloRegion>=::NUMBER_OF_CALORIMETER_REGIONS ) caloRegion=::NUMBER_OF_CALORIMETER_REGIONS-1;
 
-	// I should have an answer for which calorimeter region the etaCut corresponds to.
 	// I want to format the result to make sure it's in one half of the symmetric detector.
 	if( caloRegion>10 ) caloRegion=21-caloRegion;
 	return caloRegion;
@@ -291,3 +291,56 @@ std::pair<float,float> l1menu::tools::simpleLinearFit( const std::vector< std::p
 
 	return std::make_pair( slope, intercept );
 }
+
+void l1menu::tools::parallelFor( size_t numberOfItems, const std::function<void(size_t)>& function, size_t numberOfThreads )
+{
+	if( numberOfThreads==0 ) numberOfThreads=std::thread::hardware_concurrency();
+	if( numberOfThreads==0 ) numberOfThreads=1; // hardware_concurrency() can return zero if it doesn't know
+	numberOfThreads=std::min( numberOfThreads, numberOfItems );
+
+	// No point starting threads if there's only one thing to do
+	if( numberOfThreads<=1 )
+	{
+		for( size_t index=0; index<numberOfItems; ++index ) function( index );
+		return;
+	}
+
+	std::atomic<size_t> nextIndex(0);
+	std::exception_ptr pFirstException;
+	std::mutex exceptionMutex;
+
+	auto worker=[&]()
+	{
+		try
+		{
+			size_t index;
+			while( (index=nextIndex++)<numberOfItems ) function( index );
+		}
+		catch( ... )
+		{
+			std::lock_guard<std::mutex> lock( exceptionMutex );
+			if( !pFirstException ) pFirstException=std::current_exception();
+			nextIndex=numberOfItems; // Stop the other threads taking on any more work
+		}
+	};
+
+	// The calling thread does some of the work too, so start one less thread than requested
+	std::vector<std::thread> threads;
+	try
+	{
+		threads.reserve( numberOfThreads-1 );
+		for( size_t threadNumber=1; threadNumber<numberOfThreads; ++threadNumber ) threads.push_back( std::thread(worker) );
+	}
+	catch( ... )
+	{
+		// Destroying a joinable std::thread calls std::terminate, so I need to stop and join
+		// any threads that did start before passing the exception on.
+		nextIndex=numberOfItems;
+		for( auto& thread : threads ) thread.join();
+		throw;
+	}
+	worker();
+	for( auto& thread : threads ) thread.join();
+
+	if( pFirstException ) std::rethrow_exception( pFirstException );
+}
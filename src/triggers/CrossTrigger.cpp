@@ -1,15 +1,18 @@
 #include "CrossTrigger.h"
 
 #include <stdexcept>
+#include "l1menu/tools/miscellaneous.h"
 
 l1menu::triggers::CrossTrigger::CrossTrigger( std::unique_ptr<l1menu::ITrigger> pLeg1, std::unique_ptr<l1menu::ITrigger> pLeg2 )
-: pLeg1_( std::move(pLeg1) ), pLeg2_( std::move(pLeg2) )
+: pLeg1_( std::move(pLeg1) ), pLeg2_( std::move(pLeg2) ),
+  leg1ThresholdNames_( l1menu::tools::getThresholdNames(*pLeg1_) ), leg2ThresholdNames_( l1menu::tools::getThresholdNames(*pLeg2_) )
 {
 	// No operation besides the initialiser list
 }
 
 l1menu::triggers::CrossTrigger::CrossTrigger( l1menu::ITrigger* pLeg1, l1menu::ITrigger* pLeg2 )
-: pLeg1_( pLeg1 ), pLeg2_( pLeg2 )
+: pLeg1_( pLeg1 ), pLeg2_( pLeg2 ),
+  leg1ThresholdNames_( l1menu::tools::getThresholdNames(*pLeg1_) ), leg2ThresholdNames_( l1menu::tools::getThresholdNames(*pLeg2_) )
 {
 	// No operation besides the initialiser list
 }
@@ -57,8 +60,41 @@ bool l1menu::triggers::CrossTrigger::apply( const l1menu::L1TriggerDPGEvent& eve
 	return pLeg1_->apply(event) && pLeg2_->apply(event);
 }
 
+bool l1menu::triggers::CrossTrigger::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	// The event has to pass both legs independently, so each leg's tightest thresholds are the same
+	// as they would be for the leg on its own. If the second leg can't work them out I have to put
+	// the first leg back how it was, since nothing should change if I return false.
+	std::vector<float> originalLeg1Thresholds;
+	for( const auto& thresholdName : leg1ThresholdNames_ ) originalLeg1Thresholds.push_back( pLeg1_->parameter(thresholdName) );
+
+	if( !pLeg1_->setThresholdsAsTightAsPossible( event ) ) return false;
+	if( !pLeg2_->setThresholdsAsTightAsPossible( event ) )
+	{
+		for( size_t index=0; index<leg1ThresholdNames_.size(); ++index ) pLeg1_->parameter(leg1ThresholdNames_[index])=originalLeg1Thresholds[index];
+		return false;
+	}
+
+	// If either leg can't pass then neither can the whole trigger
+	bool eventCanPass=true;
+	for( const auto& thresholdName : leg1ThresholdNames_ ) eventCanPass=eventCanPass && pLeg1_->parameter(thresholdName)>=0;
+	for( const auto& thresholdName : leg2ThresholdNames_ ) eventCanPass=eventCanPass && pLeg2_->parameter(thresholdName)>=0;
+	if( !eventCanPass )
+	{
+		for( const auto& thresholdName : leg1ThresholdNames_ ) pLeg1_->parameter(thresholdName)=-1;
+		for( const auto& thresholdName : leg2ThresholdNames_ ) pLeg2_->parameter(thresholdName)=-1;
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::CrossTrigger::thresholdsAreCorrelated() const
 {
 	// If any thresholds in either of the legs are correlated then the say the whole trigger is
 	return pLeg1_->thresholdsAreCorrelated() || pLeg2_->thresholdsAreCorrelated();
 }
+
+unsigned int l1menu::triggers::CrossTrigger::requiredCollections() const
+{
+	return pLeg1_->requiredCollections() | pLeg2_->requiredCollections();
+}
@@ -30,10 +30,16 @@ namespace l1menu
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			/** @brief Works the thresholds out for each leg separately, if both legs can do it. */
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			std::unique_ptr<l1menu::ITrigger> pLeg1_;
 			std::unique_ptr<l1menu::ITrigger> pLeg2_;
+			// The legs' threshold names, worked out once in the constructor since getThresholdNames() is slow.
+			std::vector<std::string> leg1ThresholdNames_;
+			std::vector<std::string> leg2ThresholdNames_;
 		};
 
 	} // end of namespace triggers
@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float threshold1_;
 			float threshold2_;
@@ -47,6 +48,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -116,6 +118,46 @@ bool l1menu::triggers::DoubleJetCentral_v0::apply( const l1menu::L1TriggerDPGEve
 	return ok;
 }
 
+bool l1menu::triggers::DoubleJetCentral_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	threshold1_=-1;
+	threshold2_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	// Same selection as apply(). threshold1 needs one jet above it and threshold2 two, so
+	// they're the highest and second highest Et.
+	float highest=-1;
+	float secondHighest=-1;
+	for( int ue=0; ue<analysisDataFormat.Njet; ue++ )
+	{
+		if( analysisDataFormat.Bxjet[ue]!=0 ) continue;
+		if( analysisDataFormat.Fwdjet[ue] ) continue;
+		if( analysisDataFormat.Taujet[ue] ) continue;
+		float eta=analysisDataFormat.Etajet[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+
+		float pt=analysisDataFormat.Etjet[ue];
+		if( pt>highest )
+		{
+			secondHighest=highest;
+			highest=pt;
+		}
+		else if( pt>secondHighest ) secondHighest=pt;
+	}
+
+	// If there aren't two objects the event can't pass whatever the thresholds, so leave them at -1
+	if( secondHighest>=0 )
+	{
+		threshold1_=highest;
+		threshold2_=secondHighest;
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::DoubleJetCentral_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -161,3 +203,8 @@ const float& l1menu::triggers::DoubleJetCentral::parameter( const std::string& p
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::DoubleJetCentral::requiredCollections() const
+{
+	return l1menu::ITrigger::JETS;
+}
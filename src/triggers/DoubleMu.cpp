@@ -62,6 +62,43 @@ bool l1menu::triggers::DoubleMu_v0::apply( const l1menu::L1TriggerDPGEvent& even
 	return ok;
 }
 
+bool l1menu::triggers::DoubleMu_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	threshold1_=-1;
+	threshold2_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	// Same selection as apply(). threshold1 needs one muon above it and threshold2 two, so
+	// they're the highest and second highest pT.
+	float highest=-1;
+	float secondHighest=-1;
+	for( int imu=0; imu<analysisDataFormat.Nmu; imu++ )
+	{
+		if( analysisDataFormat.Bxmu.at(imu)!=0 ) continue;
+		if( analysisDataFormat.Qualmu.at(imu)<muonQuality_ ) continue;
+
+		float pt=analysisDataFormat.Ptmu.at(imu);
+		if( pt>highest )
+		{
+			secondHighest=highest;
+			highest=pt;
+		}
+		else if( pt>secondHighest ) secondHighest=pt;
+	}
+
+	// If there aren't two objects the event can't pass whatever the thresholds, so leave them at -1
+	if( secondHighest>=0 )
+	{
+		threshold1_=highest;
+		threshold2_=secondHighest;
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::DoubleMu_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -107,3 +144,8 @@ const float& l1menu::triggers::DoubleMu::parameter( const std::string& parameter
 	else if( parameterName=="muonQuality" ) return muonQuality_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::DoubleMu::requiredCollections() const
+{
+	return l1menu::ITrigger::MUONS;
+}
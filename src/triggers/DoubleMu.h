@@ -36,6 +36,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float threshold1_;
 			float threshold2_;
@@ -52,6 +53,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float threshold1_;
 		}; // end of the ETM base class
@@ -45,6 +46,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -95,6 +97,17 @@ bool l1menu::triggers::ETM_v0::apply( const l1menu::L1TriggerDPGEvent& event ) c
 	return true;
 }
 
+bool l1menu::triggers::ETM_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const bool* PhysicsBits=event.physicsBits();
+
+	// The event passes any threshold up to the ETM itself
+	if( !PhysicsBits[0] ) threshold1_=-1; // ZeroBias
+	else threshold1_=event.rawEvent().ETM;
+
+	return true;
+}
+
 bool l1menu::triggers::ETM_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -134,3 +147,8 @@ const float& l1menu::triggers::ETM::parameter( const std::string& parameterName
 	if( parameterName=="threshold1" ) return threshold1_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::ETM::requiredCollections() const
+{
+	return l1menu::ITrigger::ENERGY_SUMS;
+}
@@ -56,6 +56,17 @@ bool l1menu::triggers::HTM_v0::apply( const l1menu::L1TriggerDPGEvent& event ) c
 	return true;
 }
 
+bool l1menu::triggers::HTM_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const bool* PhysicsBits=event.physicsBits();
+
+	// The event passes any threshold up to the HTM itself
+	if( !PhysicsBits[0] ) threshold1_=-1; // ZeroBias
+	else threshold1_=event.rawEvent().HTM;
+
+	return true;
+}
+
 bool l1menu::triggers::HTM_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -95,3 +106,8 @@ const float& l1menu::triggers::HTM::parameter( const std::string& parameterName
 	if( parameterName=="threshold1" ) return threshold1_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::HTM::requiredCollections() const
+{
+	return l1menu::ITrigger::ENERGY_SUMS;
+}
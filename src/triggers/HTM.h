@@ -35,6 +35,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float threshold1_;
 		}; // end of the HTM base class
@@ -49,6 +50,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
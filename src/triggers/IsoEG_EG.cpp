@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float leg1threshold1_;
 			float leg2threshold1_;
@@ -47,6 +48,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -110,6 +112,46 @@ bool l1menu::triggers::IsoEG_EG_v0::apply( const l1menu::L1TriggerDPGEvent& even
 	return ok;
 }
 
+bool l1menu::triggers::IsoEG_EG_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	leg1threshold1_=-1;
+	leg2threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	// Same selection as apply(). leg1 needs one isolated EG above its threshold and leg2 two of any EG, so
+	// they're the highest isolated Et and the second highest Et.
+	float highestIsolated=-1;
+	float highest=-1;
+	float secondHighest=-1;
+	for( int ue=0; ue<analysisDataFormat.Nele; ue++ )
+	{
+		if( analysisDataFormat.Bxel[ue]!=0 ) continue;
+		float eta=analysisDataFormat.Etael[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+
+		float pt=analysisDataFormat.Etel[ue];
+		if( analysisDataFormat.Isoel[ue] && pt>highestIsolated ) highestIsolated=pt;
+		if( pt>highest )
+		{
+			secondHighest=highest;
+			highest=pt;
+		}
+		else if( pt>secondHighest ) secondHighest=pt;
+	}
+
+	// The event needs two objects, at least one of them isolated, to pass at all
+	if( highestIsolated>=0 && secondHighest>=0 )
+	{
+		leg1threshold1_=highestIsolated;
+		leg2threshold1_=secondHighest;
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::IsoEG_EG_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -155,3 +197,8 @@ const float& l1menu::triggers::IsoEG_EG::parameter( const std::string& parameter
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::IsoEG_EG::requiredCollections() const
+{
+	return l1menu::ITrigger::EG;
+}
@@ -35,6 +35,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float leg1threshold1_;
 			float leg2threshold1_;
@@ -263,3 +264,8 @@ const float& l1menu::triggers::IsoEG_JetCentral::parameter( const std::string& p
 	else if( parameterName=="leg2regionCut" ) return leg2regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::IsoEG_JetCentral::requiredCollections() const
+{
+	return l1menu::ITrigger::EG | l1menu::ITrigger::JETS;
+}
@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float leg1threshold1_;
 			float leg2threshold1_;
@@ -177,3 +178,8 @@ const float& l1menu::triggers::IsoEG_Tau::parameter( const std::string& paramete
 	else if( parameterName=="leg2regionCut" ) return leg2regionCut_;
 	else throw std::logic_error( "Not a valid parameter name (\""+parameterName+"\")" );
 }
+
+unsigned int l1menu::triggers::IsoEG_Tau::requiredCollections() const
+{
+	return l1menu::ITrigger::EG | l1menu::ITrigger::TAUS;
+}
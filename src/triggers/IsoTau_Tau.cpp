@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float leg1threshold1_;
 			float leg2threshold1_;
@@ -47,6 +48,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -111,6 +113,47 @@ bool l1menu::triggers::isoTau_Tau_v0::apply( const l1menu::L1TriggerDPGEvent& ev
 	return ok;
 }
 
+bool l1menu::triggers::isoTau_Tau_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	leg1threshold1_=-1;
+	leg2threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	// Same selection as apply(). leg1 needs one isolated tau above its threshold and leg2 two of any tau,
+	// so they're the highest isolated Et and the second highest Et.
+	float highestIsolated=-1;
+	float highest=-1;
+	float secondHighest=-1;
+	for( int ue=0; ue<analysisDataFormat.Njet; ue++ )
+	{
+		if( analysisDataFormat.Bxjet[ue]!=0 ) continue;
+		if( !analysisDataFormat.Taujet[ue] ) continue;
+		float eta=analysisDataFormat.Etajet[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+
+		float pt=analysisDataFormat.Etjet[ue];
+		if( analysisDataFormat.isoTaujet[ue] && pt>highestIsolated ) highestIsolated=pt;
+		if( pt>highest )
+		{
+			secondHighest=highest;
+			highest=pt;
+		}
+		else if( pt>secondHighest ) secondHighest=pt;
+	}
+
+	// The event needs two objects, at least one of them isolated, to pass at all
+	if( highestIsolated>=0 && secondHighest>=0 )
+	{
+		leg1threshold1_=highestIsolated;
+		leg2threshold1_=secondHighest;
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::isoTau_Tau_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -156,3 +199,8 @@ const float& l1menu::triggers::isoTau_Tau::parameter( const std::string& paramet
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::isoTau_Tau::requiredCollections() const
+{
+	return l1menu::ITrigger::TAUS;
+}
@@ -2,6 +2,10 @@
 
 
 #include <stdexcept>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <functional>
 #include "../implementation/RegisterTriggerMacro.h"
 #include "l1menu/L1TriggerDPGEvent.h"
 #include "UserCode/L1TriggerUpgrade/interface/L1AnalysisDataFormat.h"
@@ -75,6 +79,45 @@ bool l1menu::triggers::MultiJet_v0::apply( const l1menu::L1TriggerDPGEvent& even
 	return ok;
 }
 
+bool l1menu::triggers::MultiJet_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	// With fewer than one jet required the last threshold could be anything, so leave it to the bisection
+	if( numberOfJets_<1 ) return false;
+	const size_t requiredJets=std::ceil( numberOfJets_ );
+
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	threshold1_=-1;
+	threshold2_=-1;
+	threshold3_=-1;
+	threshold4_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	// Same selection as apply()
+	std::vector<float> jetEts;
+	for( int ue=0; ue<analysisDataFormat.Njet; ue++ )
+	{
+		if( analysisDataFormat.Bxjet[ue]!=0 ) continue;
+		if( analysisDataFormat.Fwdjet[ue] ) continue;
+		if( analysisDataFormat.Taujet[ue] ) continue;
+		float eta=analysisDataFormat.Etajet[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+		if( analysisDataFormat.Etjet[ue]>=0 ) jetEts.push_back( analysisDataFormat.Etjet[ue] );
+	}
+
+	// The first three thresholds need one, two and three jets above them, and the last one numberOfJets.
+	// So they're the Ets of the highest, second highest and so on.
+	if( jetEts.size()<std::max<size_t>( 3, requiredJets ) ) return true;
+	std::sort( jetEts.begin(), jetEts.end(), std::greater<float>() );
+	threshold1_=jetEts[0];
+	threshold2_=jetEts[1];
+	threshold3_=jetEts[2];
+	threshold4_=jetEts[requiredJets-1];
+
+	return true;
+}
+
 bool l1menu::triggers::MultiJet_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -129,3 +172,8 @@ const float& l1menu::triggers::MultiJet::parameter( const std::string& parameter
 	else if( parameterName=="numberOfJets" ) return numberOfJets_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::MultiJet::requiredCollections() const
+{
+	return l1menu::ITrigger::JETS;
+}
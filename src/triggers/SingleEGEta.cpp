@@ -65,6 +65,26 @@ bool l1menu::triggers::SingleEGEta_v0::apply( const l1menu::L1TriggerDPGEvent& e
 	return ok;
 }
 
+bool l1menu::triggers::SingleEGEta_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	// Same selection as apply(), but the threshold is just the highest EG Et that passes it
+	threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	for( int ue=0; ue<analysisDataFormat.Nele; ue++ )
+	{
+		if( analysisDataFormat.Bxel[ue]!=0 ) continue;
+		float eta=analysisDataFormat.Etael[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+		if( analysisDataFormat.Etel[ue]>threshold1_ ) threshold1_=analysisDataFormat.Etel[ue];
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::SingleEGEta_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -107,3 +127,8 @@ const float& l1menu::triggers::SingleEGEta::parameter( const std::string& parame
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::SingleEGEta::requiredCollections() const
+{
+	return l1menu::ITrigger::EG;
+}
@@ -31,6 +31,7 @@ namespace l1menu
 			virtual const std::vector<std::string> parameterNames() const;
 			virtual float& parameter( const std::string& parameterName );
 			virtual const float& parameter( const std::string& parameterName ) const;
+			virtual unsigned int requiredCollections() const;
 		protected:
 			float threshold1_;
 			float regionCut_;
@@ -46,6 +47,7 @@ namespace l1menu
 		public:
 			virtual unsigned int version() const;
 			virtual bool apply( const l1menu::L1TriggerDPGEvent& event ) const;
+			virtual bool setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event );
 			virtual bool thresholdsAreCorrelated() const;
 		}; // end of version 0 class
 
@@ -107,6 +109,27 @@ bool l1menu::triggers::SingleIsoTauJet_v0::apply( const l1menu::L1TriggerDPGEven
 	return ok;
 }
 
+bool l1menu::triggers::SingleIsoTauJet_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	// Same selection as apply(), but the threshold is just the highest isolated tau Et that passes it
+	threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	for( int ue=0; ue<analysisDataFormat.Njet; ue++ )
+	{
+		if( analysisDataFormat.Bxjet[ue]!=0 ) continue;
+		if( !analysisDataFormat.isoTaujet[ue] ) continue;
+		float eta=analysisDataFormat.Etajet[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+		if( analysisDataFormat.Etjet[ue]>threshold1_ ) threshold1_=analysisDataFormat.Etjet[ue];
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::SingleIsoTauJet_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -149,3 +172,8 @@ const float& l1menu::triggers::SingleIsoTauJet::parameter( const std::string& pa
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::SingleIsoTauJet::requiredCollections() const
+{
+	return l1menu::ITrigger::TAUS;
+}
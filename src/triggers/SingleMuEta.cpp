@@ -75,6 +75,26 @@ bool l1menu::triggers::SingleMuEta_v0::apply( const l1menu::L1TriggerDPGEvent& e
 	return ok;
 }
 
+bool l1menu::triggers::SingleMuEta_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	// Same selection as apply(), but the threshold is just the highest muon pT that passes it
+	threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	for( int imu=0; imu<analysisDataFormat.Nmu; imu++ )
+	{
+		if( analysisDataFormat.Bxmu.at(imu)!=0 ) continue;
+		if( analysisDataFormat.Qualmu.at(imu)<muonQuality_ ) continue;
+		if( std::fabs(analysisDataFormat.Etamu.at(imu))>etaCut_ ) continue;
+		if( analysisDataFormat.Ptmu.at(imu)>threshold1_ ) threshold1_=analysisDataFormat.Ptmu.at(imu);
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::SingleMuEta_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -120,3 +140,8 @@ const float& l1menu::triggers::SingleMuEta::parameter( const std::string& parame
 	else if( parameterName=="etaCut" ) return etaCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::SingleMuEta::requiredCollections() const
+{
+	return l1menu::ITrigger::MUONS;
+}
@@ -68,6 +68,27 @@ bool l1menu::triggers::SingleTauJet_v0::apply( const l1menu::L1TriggerDPGEvent&
 	return ok;
 }
 
+bool l1menu::triggers::SingleTauJet_v0::setThresholdsAsTightAsPossible( const l1menu::L1TriggerDPGEvent& event )
+{
+	const L1Analysis::L1AnalysisDataFormat& analysisDataFormat=event.rawEvent();
+	const bool* PhysicsBits=event.physicsBits();
+
+	// Same selection as apply(), but the threshold is just the highest tau Et that passes it
+	threshold1_=-1;
+	if( !PhysicsBits[0] ) return true; // ZeroBias
+
+	for( int ue=0; ue<analysisDataFormat.Njet; ue++ )
+	{
+		if( analysisDataFormat.Bxjet[ue]!=0 ) continue;
+		if( !analysisDataFormat.Taujet[ue] ) continue;
+		float eta=analysisDataFormat.Etajet[ue];
+		if( eta<regionCut_ || eta>21.-regionCut_ ) continue;
+		if( analysisDataFormat.Etjet[ue]>threshold1_ ) threshold1_=analysisDataFormat.Etjet[ue];
+	}
+
+	return true;
+}
+
 bool l1menu::triggers::SingleTauJet_v0::thresholdsAreCorrelated() const
 {
 	return false;
@@ -110,3 +131,8 @@ const float& l1menu::triggers::SingleTauJet::parameter( const std::string& param
 	else if( parameterName=="regionCut" ) return regionCut_;
 	else throw std::logic_error( "Not a valid parameter name" );
 }
+
+unsigned int l1menu::triggers::SingleTauJet::requiredCollections() const
+{
+	return l1menu::ITrigger::TAUS;
+}
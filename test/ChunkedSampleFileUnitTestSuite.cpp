@@ -0,0 +1,259 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+
+/** @brief A cppunit TestFixture to test the reading and writing of chunked ReducedSample files.
+ *
+ * Uses the classes in src/implementation directly so that the layout of the chunks is known,
+ * and doesn't need any input files.
+ */
+class ChunkedSampleFileUnitTestSuite : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ChunkedSampleFileUnitTestSuite);
+	CPPUNIT_TEST(testSparseRoundTrip);
+	CPPUNIT_TEST(testSparseDenseFallback);
+	CPPUNIT_TEST(testSparseCorruptionDetected);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+
+protected:
+	/** @brief Checks that sparse and dense columns of each type read back exactly as written, with every codec. */
+	void testSparseRoundTrip();
+	/** @brief Checks that a sparse column only uses the bitmap when it makes the chunk smaller. */
+	void testSparseDenseFallback();
+	/** @brief Checks that a sparse column that doesn't match its bitmap, or a truncated file, throws an exception. */
+	void testSparseCorruptionDetected();
+};
+
+
+
+
+
+#include <cppunit/config/SourcePrefix.h>
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include "implementation/ChunkedSampleFile.h"
+#include "TemporaryFile.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChunkedSampleFileUnitTestSuite);
+
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/** @brief A header for a single trigger with the given number of thresholds, which is all the chunked files need. */
+	l1menuprotobuf::SampleHeader testHeader( size_t numberOfParameters )
+	{
+		l1menuprotobuf::SampleHeader header;
+		l1menuprotobuf::Trigger* pTrigger=header.add_trigger();
+		pTrigger->set_name( "TestTrigger" );
+		pTrigger->set_version( 0 );
+		for( size_t index=0; index<numberOfParameters; ++index ) pTrigger->add_varying_parameter( "threshold"+std::to_string( static_cast<long long>(index+1) ) );
+		return header;
+	}
+
+	/** @brief Columns of events for a chunk, along with pointers in the form ChunkedSampleFileWriter::writeChunk() wants. */
+	struct TestChunk
+	{
+		std::vector<float> weights;
+		std::vector< std::vector<float> > columns;
+		std::vector<const float*> columnPointers() const
+		{
+			std::vector<const float*> returnValue;
+			for( const auto& column : columns ) returnValue.push_back( column.data() );
+			return returnValue;
+		}
+	};
+
+	/** @brief Reads the chunk and checks that it's the same as the one written. */
+	void checkChunk( const l1menu::implementation::ChunkedSampleFileReader& reader, size_t chunkNumber, const TestChunk& expectedChunk )
+	{
+		const size_t numberOfEvents=expectedChunk.weights.size();
+		CPPUNIT_ASSERT_EQUAL( static_cast<uint64_t>(numberOfEvents), reader.chunkIndex()[chunkNumber].numberOfEvents );
+
+		TestChunk chunk;
+		chunk.weights.resize( numberOfEvents );
+		chunk.columns.resize( expectedChunk.columns.size(), std::vector<float>( numberOfEvents ) );
+		std::vector<float*> columnPointers;
+		for( auto& column : chunk.columns ) columnPointers.push_back( column.data() );
+		CPPUNIT_ASSERT_NO_THROW( reader.readChunk( chunkNumber, chunk.weights.data(), columnPointers ) );
+		CPPUNIT_ASSERT( chunk.weights==expectedChunk.weights );
+		for( size_t columnNumber=0; columnNumber<chunk.columns.size(); ++columnNumber )
+		{
+			CPPUNIT_ASSERT_MESSAGE( "Column "+std::to_string( static_cast<long long>(columnNumber) )+" read back differently", chunk.columns[columnNumber]==expectedChunk.columns[columnNumber] );
+		}
+
+		// Skipping every other column has to step over the sparse ones properly
+		for( size_t columnNumber=0; columnNumber<chunk.columns.size(); columnNumber+=2 )
+		{
+			std::fill( chunk.columns[columnNumber].begin(), chunk.columns[columnNumber].end(), 0 );
+			columnPointers[columnNumber]=nullptr;
+		}
+		CPPUNIT_ASSERT_NO_THROW( reader.readChunk( chunkNumber, chunk.weights.data(), columnPointers ) );
+		for( size_t columnNumber=1; columnNumber<chunk.columns.size(); columnNumber+=2 )
+		{
+			CPPUNIT_ASSERT_MESSAGE( "Column "+std::to_string( static_cast<long long>(columnNumber) )+" read back differently after skipping columns", chunk.columns[columnNumber]==expectedChunk.columns[columnNumber] );
+		}
+	}
+
+	/** @brief A single column with a value for every event except "numberOfMissingValues" spread through it, which are -1. */
+	TestChunk singleColumnChunk( size_t numberOfEvents, size_t numberOfMissingValues )
+	{
+		TestChunk chunk;
+		chunk.weights.assign( numberOfEvents, 1 );
+		chunk.columns.resize( 1 );
+		for( size_t index=0; index<numberOfEvents; ++index )
+		{
+			if( index*numberOfMissingValues/numberOfEvents!=(index+1)*numberOfMissingValues/numberOfEvents ) chunk.columns[0].push_back( -1 );
+			else chunk.columns[0].push_back( 10+index );
+		}
+		return chunk;
+	}
+
+	/** @brief Replaces the contents of the file. */
+	void writeFile( const std::string& filename, const std::string& contents )
+	{
+		std::ofstream outputFile( filename.c_str(), std::ios::binary );
+		outputFile.write( contents.data(), contents.size() );
+	}
+
+	/** @brief Writes the chunk to the file with a single FLOAT32 column and no compression, and returns the size of the chunk before compression. */
+	uint64_t writeSingleColumnFile( const std::string& filename, const TestChunk& chunk, bool sparse )
+	{
+		using l1menu::implementation::ColumnEncoding;
+		l1menu::implementation::ChunkedSampleFileWriter writer( filename, ::testHeader(1), { ColumnEncoding( ColumnEncoding::FLOAT32, l1menu::implementation::ThresholdGrid(), sparse ) }, l1menu::ReducedSample::Codec::NONE );
+		writer.writeChunk( chunk.weights.data(), chunk.columnPointers(), chunk.weights.size() );
+		writer.close();
+
+		l1menu::implementation::ChunkedSampleFileReader reader( filename );
+		::checkChunk( reader, 0, chunk );
+		return reader.chunkIndex()[0].uncompressedSize;
+	}
+}
+
+void ChunkedSampleFileUnitTestSuite::setUp()
+{
+
+}
+
+void ChunkedSampleFileUnitTestSuite::testSparseRoundTrip()
+{
+	using l1menu::implementation::ColumnEncoding;
+	using l1menu::implementation::ThresholdGrid;
+	const ThresholdGrid grid( 0, 0.5 );
+	const std::vector<ColumnEncoding> columnEncodings={
+			ColumnEncoding( ColumnEncoding::FLOAT32, ThresholdGrid(), true ), // mostly -1
+			ColumnEncoding( ColumnEncoding::GRID8, grid, true ), // never -1, so stored densely
+			ColumnEncoding( ColumnEncoding::GRID16, grid, true ), // always -1
+			ColumnEncoding( ColumnEncoding::GRID16, grid, true ), // every other value -1
+			ColumnEncoding( ColumnEncoding::FLOAT32, ThresholdGrid(), false ) };
+
+	// A number of events that isn't a multiple of 8, so the bitmap has a partly used byte
+	std::vector<TestChunk> chunks;
+	for( const size_t numberOfEvents : { 1001, 64, 1 } )
+	{
+		TestChunk chunk;
+		chunk.columns.resize( columnEncodings.size() );
+		for( size_t index=0; index<numberOfEvents; ++index )
+		{
+			chunk.weights.push_back( 1+index%7 );
+			chunk.columns[0].push_back( index%10==3 ? index*0.25 : -1 );
+			chunk.columns[1].push_back( (index%200)*0.5 );
+			chunk.columns[2].push_back( -1 );
+			chunk.columns[3].push_back( index%2==0 ? index*0.5 : -1 );
+			chunk.columns[4].push_back( index%3==0 ? -1 : index*0.1 );
+		}
+		chunks.push_back( chunk );
+	}
+
+	TemporaryFile outputFile;
+	for( const auto codec : { l1menu::ReducedSample::Codec::NONE, l1menu::ReducedSample::Codec::GZIP, l1menu::ReducedSample::Codec::LZ4, l1menu::ReducedSample::Codec::ZSTD } )
+	{
+		l1menu::implementation::ChunkedSampleFileWriter writer( outputFile.filename(), ::testHeader( columnEncodings.size() ), columnEncodings, codec );
+		for( const auto& chunk : chunks ) CPPUNIT_ASSERT_NO_THROW( writer.writeChunk( chunk.weights.data(), chunk.columnPointers(), chunk.weights.size() ) );
+		CPPUNIT_ASSERT_NO_THROW( writer.close() );
+
+		l1menu::implementation::ChunkedSampleFileReader reader( outputFile.filename() );
+		CPPUNIT_ASSERT( reader.codec()==codec );
+		CPPUNIT_ASSERT( reader.columnEncodings()==columnEncodings );
+		CPPUNIT_ASSERT_EQUAL( chunks.size(), reader.chunkIndex().size() );
+		for( size_t chunkNumber=0; chunkNumber<chunks.size(); ++chunkNumber ) ::checkChunk( reader, chunkNumber, chunks[chunkNumber] );
+	}
+}
+
+void ChunkedSampleFileUnitTestSuite::testSparseDenseFallback()
+{
+	// With 1000 floats the bitmap is 125 bytes, so it takes 32 missing values to pay for it. A sparse
+	// column that isn't worth it is stored as every value after the count of values, otherwise it has
+	// to be smaller than that.
+	TemporaryFile outputFile;
+	for( const size_t numberOfMissingValues : { 0, 31 } )
+	{
+		const TestChunk chunk=::singleColumnChunk( 1000, numberOfMissingValues );
+		const uint64_t denseSize=::writeSingleColumnFile( outputFile.filename(), chunk, false );
+		const uint64_t sparseSize=::writeSingleColumnFile( outputFile.filename(), chunk, true );
+		CPPUNIT_ASSERT_EQUAL( denseSize+sizeof(uint32_t), sparseSize );
+	}
+	for( const size_t numberOfMissingValues : { 32, 500, 1000 } )
+	{
+		const TestChunk chunk=::singleColumnChunk( 1000, numberOfMissingValues );
+		const uint64_t denseSize=::writeSingleColumnFile( outputFile.filename(), chunk, false );
+		const uint64_t sparseSize=::writeSingleColumnFile( outputFile.filename(), chunk, true );
+		CPPUNIT_ASSERT( sparseSize<denseSize+sizeof(uint32_t) );
+	}
+}
+
+void ChunkedSampleFileUnitTestSuite::testSparseCorruptionDetected()
+{
+	// A value for about one event in ten, so with no compression the chunk is the weights, then the
+	// number of values, the bitmap and the values.
+	const size_t numberOfEvents=1000;
+	const TestChunk chunk=::singleColumnChunk( numberOfEvents, 900 );
+	TemporaryFile goodFile;
+	::writeSingleColumnFile( goodFile.filename(), chunk, true );
+	const std::string goodContents=goodFile.contents();
+	uint64_t countPosition;
+	{
+		l1menu::implementation::ChunkedSampleFileReader reader( goodFile.filename() );
+		countPosition=reader.chunkIndex()[0].offset+numberOfEvents*sizeof(float);
+	}
+	const uint64_t bitmapPosition=countPosition+sizeof(uint32_t);
+	size_t firstValueIndex=0;
+	while( chunk.columns[0][firstValueIndex]==-1 ) ++firstValueIndex;
+	const size_t firstMissingIndex=( firstValueIndex==0 ? 1 : 0 );
+
+	std::vector<std::string> corruptContents;
+	// More values than events
+	const uint32_t tooManyValues=numberOfEvents+1;
+	corruptContents.push_back( goodContents );
+	corruptContents.back().replace( countPosition, sizeof(tooManyValues), reinterpret_cast<const char*>(&tooManyValues), sizeof(tooManyValues) );
+	// A bit set for an event without a value, so there are more bits set than values
+	corruptContents.push_back( goodContents );
+	corruptContents.back()[bitmapPosition+firstMissingIndex/8]^=( 1<<(firstMissingIndex%8) );
+	// A bit cleared for an event with a value, so there are fewer bits set than values
+	corruptContents.push_back( goodContents );
+	corruptContents.back()[bitmapPosition+firstValueIndex/8]^=( 1<<(firstValueIndex%8) );
+
+	TemporaryFile corruptFile;
+	std::vector<float> weights( numberOfEvents ), column( numberOfEvents );
+	for( const auto& contents : corruptContents )
+	{
+		::writeFile( corruptFile.filename(), contents );
+		l1menu::implementation::ChunkedSampleFileReader reader( corruptFile.filename() );
+		CPPUNIT_ASSERT_THROW( reader.readChunk( 0, weights.data(), { column.data() } ), std::runtime_error );
+	}
+
+	// Skipping the column still has to notice the count is too big
+	::writeFile( corruptFile.filename(), corruptContents.front() );
+	{
+		l1menu::implementation::ChunkedSampleFileReader reader( corruptFile.filename() );
+		CPPUNIT_ASSERT_THROW( reader.readChunk( 0, weights.data(), { nullptr } ), std::runtime_error );
+	}
+
+	// A file cut short anywhere can't even be opened
+	for( const size_t truncatedSize : { goodContents.size()-1, static_cast<size_t>(bitmapPosition), static_cast<size_t>(10) } )
+	{
+		::writeFile( corruptFile.filename(), goodContents.substr( 0, truncatedSize ) );
+		CPPUNIT_ASSERT_THROW( l1menu::implementation::ChunkedSampleFileReader reader( corruptFile.filename() ), std::runtime_error );
+	}
+}
@@ -0,0 +1,267 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include "l1menu/TriggerMenu.h"
+
+
+/** @brief A cppunit TestFixture to test FullSample objects.
+ *
+ * Uses the ntuple and menu given on the command line (see unitTestsMain.cpp).
+ */
+class FullSampleUnitTestSuite : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(FullSampleUnitTestSuite);
+	CPPUNIT_TEST(testThreadsAndReadCacheDontChangeResults);
+	CPPUNIT_TEST(testLoadSampleUsesOneThread);
+	CPPUNIT_TEST(testSumOfWeightsCache);
+	CPPUNIT_TEST(testEtaPhiBins);
+	CPPUNIT_TEST_SUITE_END();
+
+protected:
+	std::ostream* pVerboseOutput_;
+	std::unique_ptr<l1menu::TriggerMenu> pTriggerMenu_;
+	std::string inputMenuFilename_;
+	std::string inputNtupleFilename_;
+public:
+	FullSampleUnitTestSuite();
+	void setUp();
+
+protected:
+	/** @brief Checks that rates and the events given to forEachBlock() are exactly the same whatever the number of threads,
+	 * read cache size and block size. */
+	void testThreadsAndReadCacheDontChangeResults();
+	/** @brief Checks that loadSample() leaves FullSamples on one thread, so tools only use more cores when asked to. */
+	void testLoadSampleUsesOneThread();
+	/** @brief Checks that sumOfWeights() gives the same answer with and without the cache file, and only uses entries that match the file. */
+	void testSumOfWeightsCache();
+	/** @brief Checks the eta and phi bins given to the EG candidates against a straightforward search of the bin edges. */
+	void testEtaPhiBins();
+};
+
+
+
+
+
+#include <cppunit/config/SourcePrefix.h>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <sys/stat.h>
+#include "l1menu/FullSample.h"
+#include "l1menu/L1TriggerDPGEvent.h"
+#include "l1menu/ICachedTrigger.h"
+#include "l1menu/IEventBlock.h"
+#include "l1menu/IMenuRate.h"
+#include "l1menu/ITriggerRate.h"
+#include "l1menu/tools/fileIO.h"
+#include "L1UpgradeNtuple.h"
+#include "UserCode/L1TriggerUpgrade/interface/L1AnalysisDataFormat.h"
+#include "UserCode/L1TriggerUpgrade/interface/L1AnalysisL1ExtraUpgradeDataFormat.h"
+#include "TestParameters.h"
+#include "TemporaryFile.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FullSampleUnitTestSuite);
+
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/** @brief The weights of each block from forEachBlock(), followed by whether each trigger in the menu passes each event.
+	 * Also checks that the blocks are full, apart from the last, and follow on from each other. */
+	std::vector<float> blockContents( const l1menu::FullSample& sample, const l1menu::TriggerMenu& menu, size_t blockSize )
+	{
+		std::vector< std::unique_ptr<l1menu::ICachedTrigger> > cachedTriggers;
+		for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber ) cachedTriggers.push_back( sample.createCachedTrigger( menu.getTrigger(triggerNumber) ) );
+
+		std::vector<float> contents;
+		size_t nextEventNumber=0;
+		sample.forEachBlock( blockSize, [&]( const l1menu::IEventBlock& eventBlock )
+		{
+			CPPUNIT_ASSERT_EQUAL( nextEventNumber, eventBlock.firstEventNumber() );
+			CPPUNIT_ASSERT_EQUAL( std::min( blockSize, sample.numberOfEvents()-nextEventNumber ), eventBlock.size() );
+			nextEventNumber+=eventBlock.size();
+			std::unique_ptr<bool[]> results( new bool[eventBlock.size()] );
+			contents.insert( contents.end(), eventBlock.weights(), eventBlock.weights()+eventBlock.size() );
+			for( auto& pCachedTrigger : cachedTriggers )
+			{
+				pCachedTrigger->apply( eventBlock, results.get() );
+				contents.insert( contents.end(), results.get(), results.get()+eventBlock.size() );
+			}
+		} );
+		CPPUNIT_ASSERT_EQUAL( sample.numberOfEvents(), nextEventNumber );
+		return contents;
+	}
+
+	//
+	// The bins used by FullSample to convert eta and phi into calorimeter coordinates, and
+	// the search of them FullSample originally did. The only differences are that this doesn't
+	// read past the end of the arrays, and that eta of 5 or more is put in the last bin.
+	//
+	const size_t PHIBINS=18;
+	const double PHIBIN[]={10,30,50,70,90,110,130,150,170,190,210,230,250,270,290,310,330,350};
+	const size_t ETABINS=23;
+	const double ETABIN[]={-5.,-4.5,-4.,-3.5,-3.,-2.172,-1.74,-1.392,-1.044,-0.696,-0.348,0,0.348,0.696,1.044,1.392,1.74,2.172,3.,3.5,4.,4.5,5.};
+
+	int referencePhiINjetCoord( double phi )
+	{
+		const double phidegree=( phi<0 ? 360.+(phi/M_PI*180.) : phi/M_PI*180. );
+		size_t phiIdx=0;
+		for( size_t idx=0; idx<PHIBINS; idx++ )
+		{
+			if( idx+1<PHIBINS && phidegree>=PHIBIN[idx] && phidegree<PHIBIN[idx+1] ) phiIdx=idx;
+			else if( phidegree>=PHIBIN[PHIBINS-1] || phidegree<=PHIBIN[0] ) phiIdx=idx;
+		}
+		phiIdx=phiIdx+1;
+		if( phiIdx==18 ) phiIdx=0;
+		return int( phiIdx );
+	}
+
+	int referenceEtaINjetCoord( double eta )
+	{
+		if( eta>=ETABIN[ETABINS-1] ) return ETABINS-2;
+		size_t etaIdx=0;
+		for( size_t idx=0; idx+1<ETABINS; idx++ )
+		{
+			if( eta>=ETABIN[idx] && eta<ETABIN[idx+1] ) etaIdx=idx;
+		}
+		return int( etaIdx );
+	}
+
+}
+
+FullSampleUnitTestSuite::FullSampleUnitTestSuite() : pTriggerMenu_( new l1menu::TriggerMenu )
+{
+	pVerboseOutput_=nullptr;
+	//pVerboseOutput_=&std::cout;
+
+	inputMenuFilename_=TestParameters<std::string>::instance().getParameter( "TEST_MENU_FILENAME" );
+	inputNtupleFilename_=TestParameters<std::string>::instance().getParameter( "TEST_NTUPLE_FILENAME" );
+}
+
+void FullSampleUnitTestSuite::setUp()
+{
+	// Add a newline, because cppunit starts this function with half a line already written
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "\n";
+
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Loading menu from file " << inputMenuFilename_ << std::endl;
+	CPPUNIT_ASSERT_NO_THROW( pTriggerMenu_=l1menu::tools::loadMenu( inputMenuFilename_ ) );
+	CPPUNIT_ASSERT_MESSAGE( "TriggerMenu supplied needs at least one trigger for the tests", pTriggerMenu_->numberOfTriggers()>=1 );
+}
+
+void FullSampleUnitTestSuite::testThreadsAndReadCacheDontChangeResults()
+{
+	// One block size smaller than forEachBlock() reads ahead and one bigger
+	const std::vector<size_t> blockSizes={ 1000, 10000 };
+	std::shared_ptr<const l1menu::IMenuRate> pExpectedRate;
+	std::vector< std::vector<float> > expectedContents;
+
+	for( const size_t numberOfThreads : { 1, 4 } )
+	{
+		for( const size_t readCacheSize : { 10000000, 0 } )
+		{
+			if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Checking " << numberOfThreads << " threads with a read cache of " << readCacheSize << " bytes" << std::endl;
+			l1menu::FullSample sample;
+			sample.setNumberOfThreads( numberOfThreads );
+			sample.setReadCacheSize( readCacheSize );
+			sample.setSumOfWeightsCacheFile( "" );
+			CPPUNIT_ASSERT_NO_THROW( sample.loadFile( inputNtupleFilename_ ) );
+
+			std::shared_ptr<const l1menu::IMenuRate> pRate=sample.rate( *pTriggerMenu_ );
+			std::vector< std::vector<float> > contents;
+			for( const size_t blockSize : blockSizes ) contents.push_back( ::blockContents( sample, *pTriggerMenu_, blockSize ) );
+			if( pExpectedRate==nullptr )
+			{
+				pExpectedRate=pRate;
+				expectedContents=contents;
+				continue;
+			}
+
+			// The events are given in the same order whatever the settings, so the sums should be identical
+			CPPUNIT_ASSERT_MESSAGE( "The events given to forEachBlock() changed", contents==expectedContents );
+			CPPUNIT_ASSERT_EQUAL( pExpectedRate->totalFraction(), pRate->totalFraction() );
+			CPPUNIT_ASSERT_EQUAL( pExpectedRate->totalFractionError(), pRate->totalFractionError() );
+			CPPUNIT_ASSERT_EQUAL( pExpectedRate->triggerRates().size(), pRate->triggerRates().size() );
+			for( size_t triggerNumber=0; triggerNumber<pRate->triggerRates().size(); ++triggerNumber )
+			{
+				CPPUNIT_ASSERT_EQUAL( pExpectedRate->triggerRates()[triggerNumber]->fraction(), pRate->triggerRates()[triggerNumber]->fraction() );
+				CPPUNIT_ASSERT_EQUAL( pExpectedRate->triggerRates()[triggerNumber]->fractionError(), pRate->triggerRates()[triggerNumber]->fractionError() );
+				CPPUNIT_ASSERT_EQUAL( pExpectedRate->triggerRates()[triggerNumber]->pureFraction(), pRate->triggerRates()[triggerNumber]->pureFraction() );
+			}
+		}
+	}
+}
+
+void FullSampleUnitTestSuite::testLoadSampleUsesOneThread()
+{
+	std::unique_ptr<l1menu::ISample> pSample;
+	CPPUNIT_ASSERT_NO_THROW( pSample=l1menu::tools::loadSample( inputNtupleFilename_ ) );
+	const l1menu::FullSample* pFullSample=dynamic_cast<const l1menu::FullSample*>( pSample.get() );
+	CPPUNIT_ASSERT( pFullSample!=nullptr );
+	CPPUNIT_ASSERT_EQUAL( static_cast<size_t>(1), pFullSample->numberOfThreads() );
+}
+
+void FullSampleUnitTestSuite::testSumOfWeightsCache()
+{
+	l1menu::FullSample uncachedSample;
+	uncachedSample.setSumOfWeightsCacheFile( "" );
+	CPPUNIT_ASSERT_NO_THROW( uncachedSample.loadFile( inputNtupleFilename_ ) );
+	const float expectedSumOfWeights=uncachedSample.sumOfWeights();
+
+	// The first sample fills the cache and the second should read it back
+	TemporaryFile cacheFile;
+	for( size_t attempt=0; attempt<2; ++attempt )
+	{
+		l1menu::FullSample sample;
+		sample.setSumOfWeightsCacheFile( cacheFile.filename() );
+		CPPUNIT_ASSERT_NO_THROW( sample.loadFile( inputNtupleFilename_ ) );
+		CPPUNIT_ASSERT_EQUAL( expectedSumOfWeights, sample.sumOfWeights() );
+	}
+	CPPUNIT_ASSERT( !cacheFile.contents().empty() );
+
+	// Check the cache really is used by putting a different total in it, then that it's ignored if the
+	// modification time doesn't match.
+	struct stat fileStatus;
+	CPPUNIT_ASSERT( ::stat( inputNtupleFilename_.c_str(), &fileStatus )==0 );
+	char* pAbsolutePath=::realpath( inputNtupleFilename_.c_str(), nullptr );
+	CPPUNIT_ASSERT( pAbsolutePath!=nullptr );
+	const std::string absolutePath=pAbsolutePath;
+	std::free( pAbsolutePath );
+	for( const long long timeDifference : { 0, 1 } )
+	{
+		{
+			std::ofstream outputFile( cacheFile.filename().c_str() );
+			outputFile << fileStatus.st_size << " " << fileStatus.st_mtime+timeDifference << " " << 1234.5 << " " << absolutePath << "\n";
+		}
+		l1menu::FullSample sample;
+		sample.setSumOfWeightsCacheFile( cacheFile.filename() );
+		CPPUNIT_ASSERT_NO_THROW( sample.loadFile( inputNtupleFilename_ ) );
+		CPPUNIT_ASSERT_EQUAL( ( timeDifference==0 ? 1234.5f : expectedSumOfWeights ), sample.sumOfWeights() );
+	}
+}
+
+void FullSampleUnitTestSuite::testEtaPhiBins()
+{
+	L1UpgradeNtuple ntuple;
+	CPPUNIT_ASSERT( ntuple.Open( inputNtupleFilename_ ) );
+	l1menu::FullSample sample;
+	sample.setSumOfWeightsCacheFile( "" );
+	CPPUNIT_ASSERT_NO_THROW( sample.loadFile( inputNtupleFilename_ ) );
+
+	// Every event would take a long time for a large ntuple, this is plenty
+	const size_t numberOfEvents=std::min<size_t>( sample.numberOfEvents(), 10000 );
+	size_t numberOfCandidates=0;
+	for( size_t eventNumber=0; eventNumber<numberOfEvents; ++eventNumber )
+	{
+		ntuple.LoadTree( eventNumber );
+		ntuple.GetEntry( eventNumber );
+		const L1Analysis::L1AnalysisDataFormat& event=sample.getFullEvent( eventNumber ).rawEvent();
+
+		CPPUNIT_ASSERT_EQUAL( static_cast<size_t>(ntuple.l1upgrade_->nEG), event.Etael.size() );
+		CPPUNIT_ASSERT_EQUAL( static_cast<size_t>(ntuple.l1upgrade_->nEG), event.Phiel.size() );
+		for( size_t index=0; index<event.Etael.size(); ++index, ++numberOfCandidates )
+		{
+			CPPUNIT_ASSERT_EQUAL( ::referenceEtaINjetCoord( ntuple.l1upgrade_->egEta.at(index) ), static_cast<int>( event.Etael[index] ) );
+			CPPUNIT_ASSERT_EQUAL( ::referencePhiINjetCoord( ntuple.l1upgrade_->egPhi.at(index) ), static_cast<int>( event.Phiel[index] ) );
+		}
+	}
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Checked the bins of " << numberOfCandidates << " EG candidates" << std::endl;
+}
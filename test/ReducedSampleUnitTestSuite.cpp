@@ -0,0 +1,584 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include "l1menu/TriggerMenu.h"
+
+//
+// Forward definitions
+//
+namespace l1menu
+{
+	class ReducedSample;
+}
+
+/** @brief A cppunit TestFixture to test ReducedSample objects.
+ *
+ * Uses the sample and menu given on the command line (see unitTestsMain.cpp), which has to be a
+ * ReducedSample file made with a menu that includes the triggers in the test menu.
+ */
+class ReducedSampleUnitTestSuite : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ReducedSampleUnitTestSuite);
+	CPPUNIT_TEST(testColumnsMatchProtobufFile);
+	CPPUNIT_TEST(testQuantisedRatesUnchanged);
+	CPPUNIT_TEST(testAddNtupleFilesMatchesSerial);
+	CPPUNIT_TEST(testFileFormatRoundTrip);
+	CPPUNIT_TEST(testQuantisedRoundTrip);
+	CPPUNIT_TEST(testAppendToFile);
+	CPPUNIT_TEST(testSplitAndMerge);
+	CPPUNIT_TEST(testCollapsedRatesUnchanged);
+	CPPUNIT_TEST(testThresholdIndex);
+	CPPUNIT_TEST(testSkippingWithZoneMaps);
+	CPPUNIT_TEST_SUITE_END();
+
+protected:
+	std::ostream* pVerboseOutput_;
+	std::unique_ptr<l1menu::ReducedSample> pSample_;
+	std::unique_ptr<l1menu::TriggerMenu> pTriggerMenu_;
+	std::string inputSampleFilename_;
+	std::string inputMenuFilename_;
+	std::string inputNtupleFilename_;
+public:
+	ReducedSampleUnitTestSuite();
+	void setUp();
+
+protected:
+	/** @brief Checks that the columns hold exactly the events in a PROTOBUF file, read with the protobuf classes directly. */
+	void testColumnsMatchProtobufFile();
+	/** @brief Checks that rounding the thresholds onto the hardware steps doesn't change the rates at the thresholds in the menu. */
+	void testQuantisedRatesUnchanged();
+	/** @brief Checks that addNtupleFiles() on several threads saves exactly the same file as adding FullSamples one at a time. */
+	void testAddNtupleFilesMatchesSerial();
+	/** @brief Checks that saving in each format, with each codec and with and without sparse columns, reads back the same events and rates. */
+	void testFileFormatRoundTrip();
+	/** @brief Checks that a quantised sample saved in the CHUNKED format is still quantised when loaded and has the same events. */
+	void testQuantisedRoundTrip();
+	/** @brief Checks that appendToFile() adds the events onto the end of the file, leaving the ones already there. */
+	void testAppendToFile();
+	/** @brief Checks that splitting a file and putting it back together with mergeFiles() gives the same events. */
+	void testSplitAndMerge();
+	/** @brief Checks that collapseIdenticalEvents() doesn't change the rates or their errors. */
+	void testCollapsedRatesUnchanged();
+	/** @brief Checks weightPassingThreshold() against adding up the event weights, and rates with and without the threshold index. */
+	void testThresholdIndex();
+	/** @brief Checks that forEachBlockPassingAny() only leaves out events that fail every trigger, in memory and streaming. */
+	void testSkippingWithZoneMaps();
+};
+
+
+
+
+
+#include <cppunit/config/SourcePrefix.h>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/coded_stream.h>
+#include "l1menu/ReducedSample.h"
+#include "l1menu/ReducedEvent.h"
+#include "l1menu/FullSample.h"
+#include "l1menu/ITrigger.h"
+#include "l1menu/ICachedTrigger.h"
+#include "l1menu/IEventBlock.h"
+#include "l1menu/IMenuRate.h"
+#include "l1menu/ITriggerRate.h"
+#include "l1menu/tools/fileIO.h"
+#include "l1menu/tools/miscellaneous.h"
+#include "TestParameters.h"
+#include "TemporaryFile.h"
+#include "protobuf/l1menu.pb.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ReducedSampleUnitTestSuite);
+
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/** @brief The weight and thresholds of an event as stored in a PROTOBUF file. */
+	struct ProtobufEvent
+	{
+		float weight;
+		std::vector<float> thresholds;
+	};
+
+	/** @brief The version number of a ReducedSample file, which comes straight after the magic number. */
+	int fileFormatVersion( const std::string& filename )
+	{
+		const std::string contents=TemporaryFile::contents( filename );
+		const std::string magicNumber="l1menuReducedSample";
+		if( contents.size()<=magicNumber.size() || contents.compare( 0, magicNumber.size(), magicNumber )!=0 ) throw std::runtime_error( filename+" is not a ReducedSample file" );
+		return contents[magicNumber.size()]; // Only a single byte as a varint for the versions that exist
+	}
+
+	/** @brief Reads a PROTOBUF (version 1) file with the protobuf classes, without going through ReducedSample at all. */
+	std::vector<ProtobufEvent> readProtobufFile( const std::string& filename, l1menuprotobuf::SampleHeader& header )
+	{
+		const std::string contents=TemporaryFile::contents( filename );
+		const size_t headerStart=std::string("l1menuReducedSample").size()+1;
+		google::protobuf::io::ArrayInputStream fileInput( contents.data()+headerStart, contents.size()-headerStart );
+		google::protobuf::io::GzipInputStream gzipInput( &fileInput );
+		google::protobuf::io::CodedInputStream codedInput( &gzipInput );
+		codedInput.SetTotalBytesLimit( std::numeric_limits<int>::max(), -1 );
+
+		google::protobuf::uint64 messageSize;
+		if( !codedInput.ReadVarint64( &messageSize ) ) throw std::runtime_error( "Unable to read the header size from "+filename );
+		google::protobuf::io::CodedInputStream::Limit readLimit=codedInput.PushLimit( messageSize );
+		if( !header.ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "Unable to read the header from "+filename );
+		codedInput.PopLimit( readLimit );
+
+		std::vector<ProtobufEvent> events;
+		l1menuprotobuf::Run run;
+		while( codedInput.ReadVarint64( &messageSize ) )
+		{
+			readLimit=codedInput.PushLimit( messageSize );
+			if( !run.ParseFromCodedStream( &codedInput ) ) throw std::runtime_error( "Unable to read a Run from "+filename );
+			codedInput.PopLimit( readLimit );
+			for( const auto& event : run.event() )
+			{
+				ProtobufEvent newEvent;
+				newEvent.weight=( event.has_weight() ? event.weight() : 1 );
+				newEvent.thresholds.assign( event.threshold().begin(), event.threshold().end() );
+				events.push_back( newEvent );
+			}
+		}
+		return events;
+	}
+
+	/** @brief The weight, squared weight and every parameter of each event in turn, so that two samples can be compared.
+	 *
+	 * Goes through forEachBlock() so that it also works for samples streamed from file. */
+	std::vector<float> sampleContents( const l1menu::ReducedSample& sample )
+	{
+		std::vector<l1menu::ReducedEvent::ParameterID> parameterIdentifiers;
+		const l1menu::TriggerMenu& menu=sample.getTriggerMenu();
+		for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber )
+		{
+			for( const auto& nameIdentifierPair : sample.getTriggerParameterIdentifiers( menu.getTrigger(triggerNumber) ) ) parameterIdentifiers.push_back( nameIdentifierPair.second );
+		}
+
+		std::vector<float> contents;
+		sample.forEachBlock( 1000, [&]( const l1menu::IEventBlock& eventBlock )
+		{
+			for( size_t index=0; index<eventBlock.size(); ++index )
+			{
+				const l1menu::ReducedEvent& event=static_cast<const l1menu::ReducedEvent&>( eventBlock.getEvent(index) );
+				contents.push_back( event.weight() );
+				contents.push_back( event.weightSquared() );
+				for( const auto parameterIdentifier : parameterIdentifiers ) contents.push_back( event.parameterValue(parameterIdentifier) );
+			}
+		} );
+		return contents;
+	}
+
+	void checkRatesEqual( const l1menu::IMenuRate& expectedRate, const l1menu::IMenuRate& actualRate, double delta )
+	{
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedRate.totalFraction(), actualRate.totalFraction(), delta );
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedRate.totalFractionError(), actualRate.totalFractionError(), delta );
+		CPPUNIT_ASSERT_EQUAL( expectedRate.triggerRates().size(), actualRate.triggerRates().size() );
+		for( size_t triggerNumber=0; triggerNumber<expectedRate.triggerRates().size(); ++triggerNumber )
+		{
+			const l1menu::ITriggerRate& expectedTriggerRate=*expectedRate.triggerRates()[triggerNumber];
+			const l1menu::ITriggerRate& actualTriggerRate=*actualRate.triggerRates()[triggerNumber];
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedTriggerRate.fraction(), actualTriggerRate.fraction(), delta );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedTriggerRate.fractionError(), actualTriggerRate.fractionError(), delta );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedTriggerRate.pureFraction(), actualTriggerRate.pureFraction(), delta );
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedTriggerRate.pureFractionError(), actualTriggerRate.pureFractionError(), delta );
+		}
+	}
+
+	/** @brief The weight of the events that pass any of the triggers, found by applying every trigger to every event. */
+	double weightPassingAny( const l1menu::ReducedSample& sample, const std::vector<const l1menu::ITrigger*>& triggers )
+	{
+		std::vector< std::unique_ptr<l1menu::ICachedTrigger> > cachedTriggers;
+		for( const auto pTrigger : triggers ) cachedTriggers.push_back( sample.createCachedTrigger( *pTrigger ) );
+
+		double weight=0;
+		std::unique_ptr<bool[]> results( new bool[1000] );
+		sample.forEachBlock( 1000, [&]( const l1menu::IEventBlock& eventBlock )
+		{
+			std::vector<bool> passesAny( eventBlock.size(), false );
+			for( auto& pCachedTrigger : cachedTriggers )
+			{
+				pCachedTrigger->apply( eventBlock, results.get() );
+				for( size_t index=0; index<eventBlock.size(); ++index ) if( results[index] ) passesAny[index]=true;
+			}
+			for( size_t index=0; index<eventBlock.size(); ++index ) if( passesAny[index] ) weight+=eventBlock.weights()[index];
+		} );
+		return weight;
+	}
+}
+
+ReducedSampleUnitTestSuite::ReducedSampleUnitTestSuite() : pTriggerMenu_( new l1menu::TriggerMenu )
+{
+	pVerboseOutput_=nullptr;
+	//pVerboseOutput_=&std::cout;
+
+	inputSampleFilename_=TestParameters<std::string>::instance().getParameter( "TEST_SAMPLE_FILENAME" );
+	inputMenuFilename_=TestParameters<std::string>::instance().getParameter( "TEST_MENU_FILENAME" );
+	inputNtupleFilename_=TestParameters<std::string>::instance().getParameter( "TEST_NTUPLE_FILENAME" );
+}
+
+void ReducedSampleUnitTestSuite::setUp()
+{
+	// Add a newline, because cppunit starts this function with half a line already written
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "\n";
+
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Loading sample from file " << inputSampleFilename_ << std::endl;
+	CPPUNIT_ASSERT_NO_THROW( pSample_.reset( new l1menu::ReducedSample( inputSampleFilename_ ) ) );
+
+	if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Loading menu from file " << inputMenuFilename_ << std::endl;
+	CPPUNIT_ASSERT_NO_THROW( pTriggerMenu_=l1menu::tools::loadMenu( inputMenuFilename_ ) );
+	CPPUNIT_ASSERT_MESSAGE( "TriggerMenu supplied needs at least one trigger for the tests", pTriggerMenu_->numberOfTriggers()>=1 );
+}
+
+void ReducedSampleUnitTestSuite::testColumnsMatchProtobufFile()
+{
+	// Check the input file if it's in the PROTOBUF format, and the sample saved in it either way
+	TemporaryFile outputFile;
+	CPPUNIT_ASSERT_NO_THROW( pSample_->saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::PROTOBUF ) );
+	std::vector<std::string> filenames={ outputFile.filename() };
+	if( ::fileFormatVersion( inputSampleFilename_ )==1 ) filenames.push_back( inputSampleFilename_ );
+
+	for( const auto& filename : filenames )
+	{
+		l1menuprotobuf::SampleHeader header;
+		const std::vector<::ProtobufEvent> protobufEvents=::readProtobufFile( filename, header );
+		l1menu::ReducedSample sample( filename );
+		CPPUNIT_ASSERT_EQUAL( protobufEvents.size(), sample.numberOfEvents() );
+
+		// Each event's thresholds are in the order the header lists the triggers and their varying parameters
+		std::vector<l1menu::ReducedEvent::ParameterID> parameterIdentifiers;
+		const l1menu::TriggerMenu& menu=sample.getTriggerMenu();
+		CPPUNIT_ASSERT_EQUAL( static_cast<size_t>(header.trigger_size()), menu.numberOfTriggers() );
+		for( int triggerNumber=0; triggerNumber<header.trigger_size(); ++triggerNumber )
+		{
+			const l1menuprotobuf::Trigger& protobufTrigger=header.trigger(triggerNumber);
+			const l1menu::ITrigger& trigger=menu.getTrigger(triggerNumber);
+			CPPUNIT_ASSERT_EQUAL( protobufTrigger.name(), trigger.name() );
+			const auto& identifiers=sample.getTriggerParameterIdentifiers( trigger );
+			for( const auto& parameterName : protobufTrigger.varying_parameter() ) parameterIdentifiers.push_back( identifiers.at( parameterName ) );
+		}
+
+		for( size_t eventNumber=0; eventNumber<protobufEvents.size(); ++eventNumber )
+		{
+			const ::ProtobufEvent& protobufEvent=protobufEvents[eventNumber];
+			const l1menu::ReducedEvent& event=static_cast<const l1menu::ReducedEvent&>( sample.getEvent(eventNumber) );
+			CPPUNIT_ASSERT_EQUAL( parameterIdentifiers.size(), protobufEvent.thresholds.size() );
+			CPPUNIT_ASSERT_EQUAL( protobufEvent.weight, event.weight() );
+			for( size_t index=0; index<parameterIdentifiers.size(); ++index )
+			{
+				CPPUNIT_ASSERT_EQUAL( protobufEvent.thresholds[index], event.parameterValue( parameterIdentifiers[index] ) );
+			}
+		}
+	}
+}
+
+void ReducedSampleUnitTestSuite::testQuantisedRatesUnchanged()
+{
+	std::shared_ptr<const l1menu::IMenuRate> pRate=pSample_->rate( *pTriggerMenu_ );
+
+	l1menu::ReducedSample quantisedSample( inputSampleFilename_ );
+	CPPUNIT_ASSERT_NO_THROW( quantisedSample.setThresholdQuantisation( true ) );
+	CPPUNIT_ASSERT( quantisedSample.thresholdsAreQuantised() );
+	std::shared_ptr<const l1menu::IMenuRate> pQuantisedRate=quantisedSample.rate( *pTriggerMenu_ );
+
+	// The events are summed in the same order so there shouldn't be any rounding differences
+	::checkRatesEqual( *pRate, *pQuantisedRate, 0.0000001 );
+}
+
+void ReducedSampleUnitTestSuite::testAddNtupleFilesMatchesSerial()
+{
+	// Use the file twice so that there's more than one file to split into ranges
+	const std::vector<std::string> ntupleFilenames={ inputNtupleFilename_, inputNtupleFilename_ };
+
+	l1menu::ReducedSample serialSample( *pTriggerMenu_ );
+	for( const auto& filename : ntupleFilenames )
+	{
+		l1menu::FullSample fullSample;
+		CPPUNIT_ASSERT_NO_THROW( fullSample.loadFile( filename ) );
+		CPPUNIT_ASSERT_NO_THROW( serialSample.addSample( fullSample ) );
+	}
+
+	l1menu::ReducedSample threadedSample( *pTriggerMenu_ );
+	CPPUNIT_ASSERT_NO_THROW( threadedSample.addNtupleFiles( ntupleFilenames, 4 ) );
+	CPPUNIT_ASSERT_EQUAL( serialSample.numberOfEvents(), threadedSample.numberOfEvents() );
+
+	TemporaryFile serialFile, threadedFile;
+	for( const auto format : { l1menu::ReducedSample::FileFormat::CHUNKED, l1menu::ReducedSample::FileFormat::PROTOBUF } )
+	{
+		serialSample.saveToFile( serialFile.filename(), format );
+		threadedSample.saveToFile( threadedFile.filename(), format );
+		CPPUNIT_ASSERT_MESSAGE( "Samples made serially and on several threads saved differently", serialFile.contents()==threadedFile.contents() );
+	}
+}
+
+void ReducedSampleUnitTestSuite::testFileFormatRoundTrip()
+{
+	const std::vector<float> originalContents=::sampleContents( *pSample_ );
+	std::shared_ptr<const l1menu::IMenuRate> pRate=pSample_->rate( *pTriggerMenu_ );
+	TemporaryFile outputFile;
+
+	// Small chunks so that there's more than one
+	l1menu::ReducedSample sample( inputSampleFilename_ );
+	sample.setEventsPerRun( 1000 );
+	for( const auto codec : { l1menu::ReducedSample::Codec::NONE, l1menu::ReducedSample::Codec::GZIP, l1menu::ReducedSample::Codec::LZ4, l1menu::ReducedSample::Codec::ZSTD } )
+	{
+		for( const bool sparseEncoding : { false, true } )
+		{
+			if( pVerboseOutput_!=nullptr ) *pVerboseOutput_ << "Checking codec " << static_cast<int>(codec) << " with sparse encoding " << sparseEncoding << std::endl;
+			sample.setCodec( codec );
+			sample.setSparseEncoding( sparseEncoding );
+			CPPUNIT_ASSERT_NO_THROW( sample.saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+
+			for( const bool streamFromFile : { false, true } )
+			{
+				l1menu::ReducedSample loadedSample( outputFile.filename(), streamFromFile );
+				CPPUNIT_ASSERT( loadedSample.codec()==codec );
+				CPPUNIT_ASSERT_EQUAL( sparseEncoding, loadedSample.sparseEncoding() );
+				CPPUNIT_ASSERT_EQUAL( pSample_->numberOfEvents(), loadedSample.numberOfEvents() );
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( pSample_->sumOfWeights(), loadedSample.sumOfWeights(), pSample_->sumOfWeights()*0.0001 );
+				CPPUNIT_ASSERT_MESSAGE( "Events read back from a CHUNKED file are different", ::sampleContents( loadedSample )==originalContents );
+				::checkRatesEqual( *pRate, *loadedSample.rate( *pTriggerMenu_ ), 0.0000001 );
+			}
+		}
+	}
+
+	for( const auto format : { l1menu::ReducedSample::FileFormat::PROTOBUF, l1menu::ReducedSample::FileFormat::MEMORYMAPPED } )
+	{
+		CPPUNIT_ASSERT_NO_THROW( sample.saveToFile( outputFile.filename(), format ) );
+		l1menu::ReducedSample loadedSample( outputFile.filename() );
+		CPPUNIT_ASSERT_EQUAL( pSample_->numberOfEvents(), loadedSample.numberOfEvents() );
+		CPPUNIT_ASSERT_MESSAGE( "Events read back from file are different", ::sampleContents( loadedSample )==originalContents );
+		::checkRatesEqual( *pRate, *loadedSample.rate( *pTriggerMenu_ ), 0.0000001 );
+	}
+}
+
+void ReducedSampleUnitTestSuite::testQuantisedRoundTrip()
+{
+	std::shared_ptr<const l1menu::IMenuRate> pRate=pSample_->rate( *pTriggerMenu_ );
+
+	l1menu::ReducedSample quantisedSample( inputSampleFilename_ );
+	quantisedSample.setThresholdQuantisation( true );
+	const std::vector<float> quantisedContents=::sampleContents( quantisedSample );
+
+	TemporaryFile outputFile;
+	for( const bool sparseEncoding : { false, true } )
+	{
+		quantisedSample.setSparseEncoding( sparseEncoding );
+		CPPUNIT_ASSERT_NO_THROW( quantisedSample.saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+
+		for( const bool streamFromFile : { false, true } )
+		{
+			l1menu::ReducedSample loadedSample( outputFile.filename(), streamFromFile );
+			CPPUNIT_ASSERT( loadedSample.thresholdsAreQuantised() );
+			CPPUNIT_ASSERT_MESSAGE( "Quantised events read back from a CHUNKED file are different", ::sampleContents( loadedSample )==quantisedContents );
+			::checkRatesEqual( *pRate, *loadedSample.rate( *pTriggerMenu_ ), 0.0000001 );
+		}
+	}
+}
+
+void ReducedSampleUnitTestSuite::testAppendToFile()
+{
+	const std::vector<float> originalContents=::sampleContents( *pSample_ );
+	TemporaryFile appendedFile;
+	CPPUNIT_ASSERT_NO_THROW( pSample_->saveToFile( appendedFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+	CPPUNIT_ASSERT_NO_THROW( pSample_->appendToFile( appendedFile.filename() ) );
+	CPPUNIT_ASSERT_NO_THROW( pSample_->appendToFile( appendedFile.filename() ) );
+
+	std::vector<float> expectedContents;
+	for( size_t copy=0; copy<3; ++copy ) expectedContents.insert( expectedContents.end(), originalContents.begin(), originalContents.end() );
+	for( const bool streamFromFile : { false, true } )
+	{
+		l1menu::ReducedSample appendedSample( appendedFile.filename(), streamFromFile );
+		if( !streamFromFile ) CPPUNIT_ASSERT_EQUAL( 3*pSample_->numberOfEvents(), appendedSample.numberOfEvents() );
+		CPPUNIT_ASSERT_MESSAGE( "Events appended to a file are different", ::sampleContents( appendedSample )==expectedContents );
+	}
+}
+
+void ReducedSampleUnitTestSuite::testSplitAndMerge()
+{
+	const std::vector<float> originalContents=::sampleContents( *pSample_ );
+	TemporaryFile firstPart, secondPart, thirdPart;
+	const std::vector<std::string> partFilenames={ firstPart.filename(), secondPart.filename(), thirdPart.filename() };
+
+	CPPUNIT_ASSERT_NO_THROW( l1menu::ReducedSample::splitFile( inputSampleFilename_, partFilenames ) );
+	std::vector<float> splitContents;
+	size_t numberOfEvents=0;
+	for( const auto& filename : partFilenames )
+	{
+		l1menu::ReducedSample part( filename );
+		numberOfEvents+=part.numberOfEvents();
+		const std::vector<float> partContents=::sampleContents( part );
+		splitContents.insert( splitContents.end(), partContents.begin(), partContents.end() );
+	}
+	CPPUNIT_ASSERT_EQUAL( pSample_->numberOfEvents(), numberOfEvents );
+	CPPUNIT_ASSERT_MESSAGE( "Events split into several files are different", splitContents==originalContents );
+
+	TemporaryFile mergedFile;
+	CPPUNIT_ASSERT_NO_THROW( l1menu::ReducedSample::mergeFiles( partFilenames, mergedFile.filename() ) );
+	l1menu::ReducedSample mergedSample( mergedFile.filename() );
+	CPPUNIT_ASSERT_MESSAGE( "Events merged back together are different", ::sampleContents( mergedSample )==originalContents );
+	::checkRatesEqual( *pSample_->rate( *pTriggerMenu_ ), *mergedSample.rate( *pTriggerMenu_ ), 0.0000001 );
+
+	// Inputs that store their columns differently should still merge, as plain floats
+	l1menu::ReducedSample quantisedPart( firstPart.filename() );
+	quantisedPart.setThresholdQuantisation( true );
+	quantisedPart.setSparseEncoding( true );
+	TemporaryFile quantisedFile;
+	CPPUNIT_ASSERT_NO_THROW( quantisedPart.saveToFile( quantisedFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+	std::vector<float> expectedContents=::sampleContents( quantisedPart );
+	const std::vector<float> secondPartContents=::sampleContents( l1menu::ReducedSample( secondPart.filename() ) );
+	expectedContents.insert( expectedContents.end(), secondPartContents.begin(), secondPartContents.end() );
+	CPPUNIT_ASSERT_NO_THROW( l1menu::ReducedSample::mergeFiles( { quantisedFile.filename(), secondPart.filename() }, mergedFile.filename() ) );
+	CPPUNIT_ASSERT_MESSAGE( "Events merged from differently stored files are different", ::sampleContents( l1menu::ReducedSample( mergedFile.filename() ) )==expectedContents );
+}
+
+void ReducedSampleUnitTestSuite::testCollapsedRatesUnchanged()
+{
+	std::shared_ptr<const l1menu::IMenuRate> pRate=pSample_->rate( *pTriggerMenu_ );
+
+	l1menu::ReducedSample collapsedSample( inputSampleFilename_ );
+	CPPUNIT_ASSERT_NO_THROW( collapsedSample.collapseIdenticalEvents() );
+	CPPUNIT_ASSERT( collapsedSample.eventsAreCollapsed() );
+	CPPUNIT_ASSERT( collapsedSample.numberOfEvents()<=pSample_->numberOfEvents() );
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( pSample_->sumOfWeights(), collapsedSample.sumOfWeights(), pSample_->sumOfWeights()*0.0001 );
+	// The weights are added up in a different order, so allow for rounding
+	::checkRatesEqual( *pRate, *collapsedSample.rate( *pTriggerMenu_ ), 0.000001 );
+
+	// The sums of squared weights have to survive being saved, otherwise the errors would change
+	TemporaryFile outputFile;
+	for( const auto format : { l1menu::ReducedSample::FileFormat::CHUNKED, l1menu::ReducedSample::FileFormat::MEMORYMAPPED } )
+	{
+		CPPUNIT_ASSERT_NO_THROW( collapsedSample.saveToFile( outputFile.filename(), format ) );
+		l1menu::ReducedSample loadedSample( outputFile.filename() );
+		CPPUNIT_ASSERT( loadedSample.eventsAreCollapsed() );
+		::checkRatesEqual( *pRate, *loadedSample.rate( *pTriggerMenu_ ), 0.000001 );
+	}
+	CPPUNIT_ASSERT_THROW( collapsedSample.saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::PROTOBUF ), std::runtime_error );
+}
+
+void ReducedSampleUnitTestSuite::testThresholdIndex()
+{
+	l1menu::ReducedSample indexedSample( inputSampleFilename_ );
+	CPPUNIT_ASSERT( !indexedSample.hasThresholdIndex() );
+	CPPUNIT_ASSERT_THROW( indexedSample.weightPassingThreshold( 0, 0 ), std::runtime_error );
+	CPPUNIT_ASSERT_NO_THROW( indexedSample.buildThresholdIndex() );
+	CPPUNIT_ASSERT( indexedSample.hasThresholdIndex() );
+
+	TemporaryFile outputFile;
+	CPPUNIT_ASSERT_NO_THROW( indexedSample.saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+	l1menu::ReducedSample loadedSample( outputFile.filename(), true );
+	CPPUNIT_ASSERT( loadedSample.hasThresholdIndex() );
+
+	const double delta=pSample_->sumOfWeights()*0.000001;
+	for( size_t triggerNumber=0; triggerNumber<pTriggerMenu_->numberOfTriggers(); ++triggerNumber )
+	{
+		const l1menu::ITrigger& trigger=pTriggerMenu_->getTrigger( triggerNumber );
+		const std::vector<std::string> thresholdNames=l1menu::tools::getThresholdNames( trigger );
+		const auto& parameterIdentifiers=pSample_->getTriggerParameterIdentifiers( trigger );
+		for( const auto& thresholdName : thresholdNames )
+		{
+			const l1menu::ReducedEvent::ParameterID parameter=parameterIdentifiers.at( thresholdName );
+
+			// Thresholds at, between and either side of values in the sample as well as the one in the menu
+			std::vector<float> thresholds={ -2, -1, 0, trigger.parameter( thresholdName ), 1000000 };
+			for( size_t eventNumber=0; eventNumber<pSample_->numberOfEvents(); eventNumber+=pSample_->numberOfEvents()/10+1 )
+			{
+				const float value=static_cast<const l1menu::ReducedEvent&>( pSample_->getEvent(eventNumber) ).parameterValue( parameter );
+				thresholds.push_back( value );
+				thresholds.push_back( value+0.25 );
+				thresholds.push_back( std::nextafter( value, -1000000.f ) );
+			}
+
+			for( const float threshold : thresholds )
+			{
+				double weight=0, weightSquared=0;
+				for( size_t eventNumber=0; eventNumber<pSample_->numberOfEvents(); ++eventNumber )
+				{
+					const l1menu::ReducedEvent& event=static_cast<const l1menu::ReducedEvent&>( pSample_->getEvent(eventNumber) );
+					if( event.parameterValue( parameter )<threshold ) continue;
+					weight+=event.weight();
+					weightSquared+=event.weightSquared();
+				}
+
+				std::pair<double,double> indexedWeight=indexedSample.weightPassingThreshold( parameter, threshold );
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( weight, indexedWeight.first, delta );
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( weightSquared, indexedWeight.second, delta );
+				std::pair<double,double> loadedWeight=loadedSample.weightPassingThreshold( parameter, threshold );
+				CPPUNIT_ASSERT_EQUAL( indexedWeight.first, loadedWeight.first );
+				CPPUNIT_ASSERT_EQUAL( indexedWeight.second, loadedWeight.second );
+			}
+		}
+
+		// Menus of a single trigger with a single threshold use the index for the rate. The total weight
+		// isn't added up the same way, so allow for rounding.
+		l1menu::TriggerMenu singleTriggerMenu;
+		singleTriggerMenu.addTrigger( trigger );
+		::checkRatesEqual( *pSample_->rate( singleTriggerMenu ), *indexedSample.rate( singleTriggerMenu ), 0.00001 );
+		::checkRatesEqual( *pSample_->rate( singleTriggerMenu ), *loadedSample.rate( singleTriggerMenu ), 0.00001 );
+	}
+
+	// Anything that changes the thresholds has to remove the index
+	indexedSample.setThresholdQuantisation( true );
+	CPPUNIT_ASSERT( !indexedSample.hasThresholdIndex() );
+}
+
+void ReducedSampleUnitTestSuite::testSkippingWithZoneMaps()
+{
+	// Save with small chunks, so that the zone maps in the file have something to skip
+	l1menu::ReducedSample sample( inputSampleFilename_ );
+	sample.setEventsPerRun( 500 );
+	TemporaryFile outputFile;
+	CPPUNIT_ASSERT_NO_THROW( sample.saveToFile( outputFile.filename(), l1menu::ReducedSample::FileFormat::CHUNKED ) );
+	l1menu::ReducedSample streamedSample( outputFile.filename(), true );
+
+	// Raise the thresholds further each time, so that more and more of the sample can be left out
+	for( const float scale : { 1.f, 2.f, 4.f, 16.f } )
+	{
+		l1menu::TriggerMenu menu( *pTriggerMenu_ );
+		std::vector<const l1menu::ITrigger*> allTriggers;
+		for( size_t triggerNumber=0; triggerNumber<menu.numberOfTriggers(); ++triggerNumber )
+		{
+			l1menu::ITrigger& trigger=menu.getTrigger( triggerNumber );
+			for( const auto& thresholdName : l1menu::tools::getThresholdNames( trigger ) ) trigger.parameter( thresholdName )*=scale;
+			allTriggers.push_back( &trigger );
+		}
+
+		std::vector< std::vector<const l1menu::ITrigger*> > triggerCombinations={ allTriggers };
+		for( const auto pTrigger : allTriggers ) triggerCombinations.push_back( { pTrigger } );
+
+		for( const auto& triggers : triggerCombinations )
+		{
+			for( const l1menu::ReducedSample* pTestSample : { pSample_.get(), &streamedSample } )
+			{
+				const double expectedWeight=::weightPassingAny( *pTestSample, triggers );
+				double totalWeight=0;
+				pTestSample->forEachBlock( 1000, [&]( const l1menu::IEventBlock& eventBlock )
+				{
+					for( size_t index=0; index<eventBlock.size(); ++index ) totalWeight+=eventBlock.weights()[index];
+				} );
+
+				std::vector< std::unique_ptr<l1menu::ICachedTrigger> > cachedTriggers;
+				for( const auto pTrigger : triggers ) cachedTriggers.push_back( pTestSample->createCachedTrigger( *pTrigger ) );
+				std::unique_ptr<bool[]> results( new bool[1000] );
+				double passingWeight=0, givenWeight=0;
+				const double skippedWeight=pTestSample->forEachBlockPassingAny( triggers, 1000, [&]( const l1menu::IEventBlock& eventBlock )
+				{
+					std::vector<bool> passesAny( eventBlock.size(), false );
+					for( auto& pCachedTrigger : cachedTriggers )
+					{
+						pCachedTrigger->apply( eventBlock, results.get() );
+						for( size_t index=0; index<eventBlock.size(); ++index ) if( results[index] ) passesAny[index]=true;
+					}
+					for( size_t index=0; index<eventBlock.size(); ++index )
+					{
+						givenWeight+=eventBlock.weights()[index];
+						if( passesAny[index] ) passingWeight+=eventBlock.weights()[index];
+					}
+				} );
+
+				const double delta=pSample_->sumOfWeights()*0.000001;
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( expectedWeight, passingWeight, delta );
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( totalWeight, givenWeight+skippedWeight, delta );
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef TemporaryFile_h
+#define TemporaryFile_h
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+
+
+/** @brief Sentry for test suites that creates a uniquely named empty file, and deletes it when it goes out of scope. */
+class TemporaryFile
+{
+public:
+	TemporaryFile()
+	{
+		char filenameTemplate[]="/tmp/l1menuUnitTestXXXXXX";
+		int fileDescriptor=mkstemp( filenameTemplate );
+		if( fileDescriptor<0 ) throw std::runtime_error( "Unable to create a temporary file" );
+		close( fileDescriptor );
+		filename_=filenameTemplate;
+	}
+	~TemporaryFile() { unlink( filename_.c_str() ); }
+	TemporaryFile( const TemporaryFile& otherFile ) = delete;
+	TemporaryFile& operator=( const TemporaryFile& otherFile ) = delete;
+	const std::string& filename() const { return filename_; }
+
+	/** @brief Reads the whole of a file into a string. */
+	static std::string contents( const std::string& filename )
+	{
+		std::ifstream inputFile( filename.c_str(), std::ios::binary );
+		std::ostringstream contents;
+		contents << inputFile.rdbuf();
+		return contents.str();
+	}
+	std::string contents() const { return contents( filename_ ); }
+private:
+	std::string filename_;
+};
+
+#endif
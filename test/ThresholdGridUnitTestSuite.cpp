@@ -0,0 +1,74 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+
+/** @brief A cppunit TestFixture to test the grid quantised thresholds are rounded onto, and the column
+ * encodings chosen from it.
+ */
+class ThresholdGridUnitTestSuite : public CPPUNIT_NS::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ThresholdGridUnitTestSuite);
+	CPPUNIT_TEST(testSnap);
+	CPPUNIT_TEST(testValuesOffTheGrid);
+	CPPUNIT_TEST_SUITE_END();
+
+protected:
+	/** @brief Checks that values are rounded down onto the grid, and that -1 is left alone. */
+	void testSnap();
+	/** @brief Checks that NaN, infinity and huge values are never rounded, and make the column stay as floats. */
+	void testValuesOffTheGrid();
+};
+
+
+
+
+
+#include <cppunit/config/SourcePrefix.h>
+#include <stdexcept>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "implementation/ThresholdGrid.h"
+#include "implementation/ChunkedSampleFile.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ThresholdGridUnitTestSuite);
+
+void ThresholdGridUnitTestSuite::testSnap()
+{
+	const l1menu::implementation::ThresholdGrid grid( 0, 0.5 );
+	CPPUNIT_ASSERT_EQUAL( 20.f, grid.snap( 20.f ) );
+	CPPUNIT_ASSERT_EQUAL( 20.f, grid.snap( 20.49f ) );
+	CPPUNIT_ASSERT_EQUAL( 20.f, grid.snap( std::nextafter( 20.5f, 0.f ) ) );
+	CPPUNIT_ASSERT_EQUAL( 20.5f, grid.snap( 20.5f ) );
+	CPPUNIT_ASSERT_EQUAL( 0.f, grid.snap( -0.25f ) );
+	CPPUNIT_ASSERT_EQUAL( -1.f, grid.snap( -1.f ) );
+	CPPUNIT_ASSERT_EQUAL( static_cast<size_t>(41), grid.floorIndex( 20.5f ) );
+
+	// Every grid point has to snap to itself, otherwise a threshold on the grid would give a different result
+	for( size_t index=0; index<100000; index+=7 ) CPPUNIT_ASSERT_EQUAL( index, grid.floorIndex( grid.value(index) ) );
+}
+
+void ThresholdGridUnitTestSuite::testValuesOffTheGrid()
+{
+	const l1menu::implementation::ThresholdGrid grid( 0, 0.5 );
+	const float infinity=std::numeric_limits<float>::infinity();
+	const float notANumber=std::numeric_limits<float>::quiet_NaN();
+	const float hugeValue=1e10;
+
+	for( const float value : { infinity, -infinity, notANumber, hugeValue } )
+	{
+		CPPUNIT_ASSERT( !grid.contains(value) );
+		CPPUNIT_ASSERT_THROW( grid.floorIndex(value), std::runtime_error );
+	}
+	CPPUNIT_ASSERT_EQUAL( infinity, grid.snap( infinity ) );
+	CPPUNIT_ASSERT_EQUAL( hugeValue, grid.snap( hugeValue ) );
+	CPPUNIT_ASSERT( std::isnan( grid.snap( notANumber ) ) );
+
+	// A column the grid can hold all of can be stored quantised, but not if anything in it is off the grid
+	std::vector<float> column={ 20, -1, 35.5, 0 };
+	CPPUNIT_ASSERT_EQUAL( l1menu::implementation::ColumnEncoding::GRID8, l1menu::implementation::ColumnEncoding::narrowestFor( grid, column.data(), column.size() ).type );
+	for( const float value : { infinity, notANumber, hugeValue } )
+	{
+		column.back()=value;
+		CPPUNIT_ASSERT_EQUAL( l1menu::implementation::ColumnEncoding::FLOAT32, l1menu::implementation::ColumnEncoding::narrowestFor( grid, column.data(), column.size() ).type );
+	}
+}
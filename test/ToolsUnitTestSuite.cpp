@@ -11,6 +11,8 @@ class ToolsUnitTestSuite : public CPPUNIT_NS::TestFixture
 	CPPUNIT_TEST_SUITE(ToolsUnitTestSuite);
 	CPPUNIT_TEST(testLinearFitInputCheck);
 	CPPUNIT_TEST(testLinearFitResult);
+	CPPUNIT_TEST(testCalorimeterRegionEtaBounds);
+	CPPUNIT_TEST(testConvertEtaCutToRegionCut);
 	CPPUNIT_TEST_SUITE_END();
 
 protected:
@@ -21,6 +23,10 @@ public:
 protected:
 	void testLinearFitInputCheck();
 	void testLinearFitResult();
+	/** @brief Checks the region edges against the values they were originally hard coded as. */
+	void testCalorimeterRegionEtaBounds();
+	/** @brief Checks convertEtaCutToRegionCut against a search of each region in turn, especially at the edges. */
+	void testConvertEtaCutToRegionCut();
 };
 
 
@@ -30,10 +36,37 @@ protected:
 #include <cppunit/config/SourcePrefix.h>
 #include <iostream>
 #include <stdexcept>
+#include <cmath>
 #include "l1menu/tools/miscellaneous.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(ToolsUnitTestSuite);
 
+namespace // Use the unnamed namespace for things only used in this file
+{
+	/// @brief The calorimeter regions as calorimeterRegionEtaBounds originally gave them
+	const std::pair<float,float> REFERENCE_REGION_BOUNDS[]={
+			std::make_pair( -5.0, -4.5 ), std::make_pair( -4.5, -4.0 ), std::make_pair( -4.0, -3.5 ), std::make_pair( -3.5, -3.0 ),
+			std::make_pair( -3.0, -2.172 ), std::make_pair( -2.172, -1.74 ), std::make_pair( -1.74, -1.392 ), std::make_pair( -1.392, -1.044 ),
+			std::make_pair( -1.044, -0.696 ), std::make_pair( -0.696, -0.348 ), std::make_pair( -0.348, 0 ), std::make_pair( 0, 0.348 ),
+			std::make_pair( 0.348, 0.696 ), std::make_pair( 0.696, 1.044 ), std::make_pair( 1.044, 1.392 ), std::make_pair( 1.392, 1.74 ),
+			std::make_pair( 1.74, 2.172 ), std::make_pair( 2.172, 3.0 ), std::make_pair( 3.0, 3.5 ), std::make_pair( 3.5, 4.0 ),
+			std::make_pair( 4.0, 4.5 ), std::make_pair( 4.5, 5.0 ) };
+	const size_t NUMBER_OF_REGIONS=sizeof(REFERENCE_REGION_BOUNDS)/sizeof(REFERENCE_REGION_BOUNDS[0]);
+
+	/** @brief What convertEtaCutToRegionCut originally did, except that an eta of exactly 5 is put in
+	 * the last region instead of wrapping round to a huge number. */
+	float referenceEtaCutToRegionCut( float etaCut )
+	{
+		size_t caloRegion;
+		for( caloRegion=0; caloRegion<NUMBER_OF_REGIONS-1; ++caloRegion )
+		{
+			if( REFERENCE_REGION_BOUNDS[caloRegion].first<=etaCut && etaCut<REFERENCE_REGION_BOUNDS[caloRegion].second ) break;
+		}
+		if( caloRegion>10 ) caloRegion=21-caloRegion;
+		return caloRegion;
+	}
+}
+
 void ToolsUnitTestSuite::setUp()
 {
 
@@ -70,3 +103,41 @@ void ToolsUnitTestSuite::testLinearFitResult()
 	CPPUNIT_ASSERT_DOUBLES_EQUAL( slope, slopeInterceptPair.first, delta );
 	CPPUNIT_ASSERT_DOUBLES_EQUAL( intercept, slopeInterceptPair.second, delta );
 }
+
+void ToolsUnitTestSuite::testCalorimeterRegionEtaBounds()
+{
+	for( size_t region=0; region<NUMBER_OF_REGIONS; ++region )
+	{
+		std::pair<float,float> bounds;
+		CPPUNIT_ASSERT_NO_THROW( bounds=l1menu::tools::calorimeterRegionEtaBounds( region ) );
+		CPPUNIT_ASSERT_EQUAL( REFERENCE_REGION_BOUNDS[region].first, bounds.first );
+		CPPUNIT_ASSERT_EQUAL( REFERENCE_REGION_BOUNDS[region].second, bounds.second );
+	}
+	CPPUNIT_ASSERT_THROW( l1menu::tools::calorimeterRegionEtaBounds( NUMBER_OF_REGIONS ), std::runtime_error );
+}
+
+void ToolsUnitTestSuite::testConvertEtaCutToRegionCut()
+{
+	// Each edge and the floats either side of it, plus the middle of each region
+	std::vector<float> etaCuts;
+	for( size_t region=0; region<NUMBER_OF_REGIONS; ++region )
+	{
+		const float lowerEdge=REFERENCE_REGION_BOUNDS[region].first;
+		const float upperEdge=REFERENCE_REGION_BOUNDS[region].second;
+		etaCuts.push_back( lowerEdge );
+		etaCuts.push_back( std::nextafter( lowerEdge, 10.f ) );
+		etaCuts.push_back( std::nextafter( upperEdge, -10.f ) );
+		etaCuts.push_back( (lowerEdge+upperEdge)/2 );
+	}
+	etaCuts.push_back( REFERENCE_REGION_BOUNDS[NUMBER_OF_REGIONS-1].second );
+
+	for( const float etaCut : etaCuts )
+	{
+		float regionCut=-1;
+		CPPUNIT_ASSERT_NO_THROW( regionCut=l1menu::tools::convertEtaCutToRegionCut( etaCut ) );
+		CPPUNIT_ASSERT_EQUAL( ::referenceEtaCutToRegionCut( etaCut ), regionCut );
+	}
+
+	CPPUNIT_ASSERT_THROW( l1menu::tools::convertEtaCutToRegionCut( std::nextafter( -5.f, -10.f ) ), std::runtime_error );
+	CPPUNIT_ASSERT_THROW( l1menu::tools::convertEtaCutToRegionCut( std::nextafter( 5.f, 10.f ) ), std::runtime_error );
+}
@@ -45,8 +45,9 @@ void printUsage( const std::string& executableName, std::ostream& output=std::co
 			<< "\t" << executableName << "\n"
 			<< "\t" << "\t" << "runs the unit tests with the hard coded default input filenames." << "\n"
 			<< "\n"
-			<< "\t" << executableName << " [test input file] [test menu file]" << "\n"
-			<< "\t" << "\t" << "runs the unit tests with input files named" << "\n"
+			<< "\t" << executableName << " [test input file] [test menu file] [test ntuple file]" << "\n"
+			<< "\t" << "\t" << "runs the unit tests with input files named. The ntuple has to be an L1 DPG" << "\n"
+			<< "\t" << "\t" << "ntuple, and is used by the tests that read ntuples directly." << "\n"
 			<< "\n"
 			<< "\t" << executableName << " --help" << "\n"
 			<< "\t" << "\t" << "prints this help message"
@@ -80,7 +81,7 @@ bool handleCommandLine( int argc, char* argv[] )
 		return false;
 	}
 
-	if( commandLineParser.nonOptionArguments().size()>2 )
+	if( commandLineParser.nonOptionArguments().size()>3 )
 	{
 		printUsage( commandLineParser.executableName(), std::cerr );
 		throw std::runtime_error( "Too many command line arguments" );
@@ -113,6 +114,17 @@ bool handleCommandLine( int argc, char* argv[] )
 		MutableTestParameters<std::string>::setParameter( "TEST_MENU_FILENAME", filename );
 	}
 
+	if( commandLineParser.nonOptionArguments().size()>2 ) MutableTestParameters<std::string>::setParameter( "TEST_NTUPLE_FILENAME", commandLineParser.nonOptionArguments()[2] );
+	else
+	{
+		std::string filename="";
+		char* pEnvironmentVariable=std::getenv("HOME");
+		if( pEnvironmentVariable!=nullptr ) filename=pEnvironmentVariable+std::string("/");
+		filename+="MenuGenerationFiles/L1Tree_NeutrinoGun_PU100.root";
+		std::cerr << "Input ntuple filename not specified on the command line, so using the default of " << filename << std::endl;
+		MutableTestParameters<std::string>::setParameter( "TEST_NTUPLE_FILENAME", filename );
+	}
+
 	return true;
 }
 